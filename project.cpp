@@ -9,8 +9,297 @@
 #include <sstream>
 #include <fstream>
 #include <limits>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <system_error>
+#include <iterator>
+#include <variant>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define SIMD_X86 1
+#define SIMD_TARGET(features) __attribute__((target(features)))
+#endif
 using namespace std;
 
+enum class LogDurability { Buffered, Flushed, Synced };
+
+template<typename Item>
+class MpscQueue {
+    public:
+        struct Node {
+            std::atomic<Node*> next;
+            Item item;
+            Node() : next(nullptr), item() {}
+            Node(Item&& item) : next(nullptr), item(std::move(item)) {}
+        };
+
+    private:
+        std::atomic<Node*> head;
+        Node* tail;
+        Node stub;
+
+        void pushNode(Node* node) {
+            node->next.store(nullptr, std::memory_order_relaxed);
+            Node* prev = head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+    public:
+        MpscQueue() : head(&stub), tail(&stub) {}
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        ~MpscQueue() {
+            while (Node* node = pop()) {
+                delete node;
+            }
+        }
+
+        void push(Item item) { pushNode(new Node(std::move(item))); }
+
+        Node* pop() {
+            Node* first = tail;
+            Node* next = first->next.load(std::memory_order_acquire);
+            if (first == &stub) {
+                if (!next) return nullptr;
+                tail = next;
+                first = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next) {
+                tail = next;
+                return first;
+            }
+            if (first != head.load(std::memory_order_acquire)) return nullptr;
+            pushNode(&stub);
+            next = first->next.load(std::memory_order_acquire);
+            if (next) {
+                tail = next;
+                return first;
+            }
+            return nullptr;
+        }
+};
+
+// Work-stealing pool behind parallelFor and parallelReduce. Each thread owns a deque: it runs its newest task and
+// an idle worker steals the oldest task of another. A range larger than its grain is halved and the upper half
+// pushed back, so thieves always find large pieces. A thread waiting on a loop runs tasks instead of blocking,
+// which also makes nested loops safe. Queue 0 belongs to threads outside the pool.
+class TaskPool {
+    private:
+        struct Job {
+            void (*run)(const void* body, int64_t begin, int64_t end);
+            const void* body;
+            int64_t grain;
+            std::atomic<int64_t> pending;
+            std::mutex errorLock;
+            std::exception_ptr error;
+        };
+
+        struct Task {
+            Job* job;
+            int64_t begin;
+            int64_t end;
+        };
+
+        struct alignas(64) Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        static TaskPool* instance;
+        static thread_local int current;
+
+        int numThreads;
+        std::unique_ptr<Queue[]> queues;
+        std::vector<std::thread> workers;
+        std::atomic<int> queued;
+        std::atomic<bool> stopping;
+        std::mutex sleepLock;
+        std::condition_variable wake;
+
+        explicit TaskPool(int numThreads) : numThreads(0), queued(0), stopping(false) { start(numThreads); }
+
+        void start(int count) {
+            numThreads = count;
+            queues.reset(new Queue[count]);
+            stopping = false;
+            for (int i = 1; i < count; i++) workers.emplace_back(&TaskPool::workerLoop, this, i);
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> guard(sleepLock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& worker : workers) worker.join();
+            workers.clear();
+        }
+
+        void push(const Task& task) {
+            Queue& queue = queues[current];
+            {
+                std::lock_guard<std::mutex> guard(queue.lock);
+                queue.tasks.push_back(task);
+            }
+            queued.fetch_add(1);
+            { std::lock_guard<std::mutex> guard(sleepLock); }
+            wake.notify_one();
+        }
+
+        bool take(Task& task) {
+            for (int i = 0; i < numThreads; i++) {
+                Queue& queue = queues[(current + i) % numThreads];
+                std::lock_guard<std::mutex> guard(queue.lock);
+                if (queue.tasks.empty()) continue;
+                if (i == 0) {
+                    task = queue.tasks.back();
+                    queue.tasks.pop_back();
+                } else {
+                    task = queue.tasks.front();
+                    queue.tasks.pop_front();
+                }
+                queued.fetch_sub(1);
+                return true;
+            }
+            return false;
+        }
+
+        void execute(Task task) {
+            Job* job = task.job;
+            try {
+                while (task.end - task.begin > job->grain) {
+                    int64_t middle = task.begin + (task.end - task.begin) / 2;
+                    job->pending.fetch_add(1);
+                    push(Task{job, middle, task.end});
+                    task.end = middle;
+                }
+                job->run(job->body, task.begin, task.end);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(job->errorLock);
+                if (!job->error) job->error = std::current_exception();
+            }
+            job->pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        void workerLoop(int index) {
+            current = index;
+            Task task;
+            while (true) {
+                if (take(task)) {
+                    execute(task);
+                    continue;
+                }
+                std::unique_lock<std::mutex> guard(sleepLock);
+                wake.wait(guard, [this] { return stopping.load() || queued.load() > 0; });
+                if (stopping) return;
+            }
+        }
+
+    public:
+        static TaskPool* getInstance() {
+            if (instance == nullptr) { instance = new TaskPool(defaultThreads());}
+            return instance;
+        }
+
+        TaskPool(const TaskPool&) = delete;
+        TaskPool& operator=(const TaskPool&) = delete;
+
+        // COINQUEROR_THREADS overrides the number of hardware threads.
+        static int defaultThreads() {
+            if (const char* requested = getenv("COINQUEROR_THREADS")) {
+                int count = atoi(requested);
+                if (count > 0) return count;
+            }
+            return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        int getThreads() const { return numThreads; }
+
+        // Resizes the pool, counting the calling thread. No loop may be running.
+        void setThreads(int count) {
+            if (count < 1) throw invalid_argument("Thread count must be positive");
+            if (count == numThreads) return;
+            stop();
+            start(count);
+        }
+
+        // Calls body(first, last) on disjoint subranges covering [begin, end), none longer than grain.
+        template <typename Body>
+        void parallelFor(int64_t begin, int64_t end, int64_t grain, const Body& body) {
+            if (end <= begin) return;
+            grain = std::max<int64_t>(grain, 1);
+            if (numThreads == 1 || end - begin <= grain) {
+                body(begin, end);
+                return;
+            }
+            Job job;
+            job.run = [](const void* body, int64_t first, int64_t last) { (*static_cast<const Body*>(body))(first, last); };
+            job.body = &body;
+            job.grain = grain;
+            job.pending = 1;
+            execute(Task{&job, begin, end});
+            Task task;
+            while (job.pending.load(std::memory_order_acquire) > 0) {
+                if (take(task)) execute(task);
+                else std::this_thread::yield();
+            }
+            if (job.error) std::rethrow_exception(job.error);
+        }
+
+        // Maps fixed chunks of grain elements and combines the partials in order, so the result does not depend on
+        // the thread count.
+        template <typename T, typename Map, typename Combine>
+        T parallelReduce(int64_t begin, int64_t end, int64_t grain, T identity, const Map& map, const Combine& combine) {
+            if (end <= begin) return identity;
+            grain = std::max<int64_t>(grain, 1);
+            int64_t numChunks = (end - begin + grain - 1) / grain;
+            if (numChunks == 1) return combine(identity, map(begin, end));
+            std::vector<T> partials(numChunks, identity);
+            parallelFor(0, numChunks, 1, [&](int64_t first, int64_t last) {
+                for (int64_t chunk = first; chunk < last; chunk++) partials[chunk] = map(begin + chunk * grain, std::min(end, begin + (chunk + 1) * grain));
+            });
+            T result = identity;
+            for (const T& partial : partials) result = combine(result, partial);
+            return result;
+        }
+};
+
+TaskPool* TaskPool::instance = nullptr;
+thread_local int TaskPool::current = 0;
+
+template <typename Body>
+void parallelFor(int64_t begin, int64_t end, int64_t grain, const Body& body) {
+    TaskPool::getInstance()->parallelFor(begin, end, grain, body);
+}
+
+template <typename T, typename Map, typename Combine>
+T parallelReduce(int64_t begin, int64_t end, int64_t grain, T identity, const Map& map, const Combine& combine) {
+    return TaskPool::getInstance()->parallelReduce(begin, end, grain, identity, map, combine);
+}
+
 template<typename T>
 class AuditLog {
     private:
@@ -24,16 +313,88 @@ class AuditLog {
         T getDetails() const { return details; }
     };
 
+        struct PendingEntry {
+            std::time_t time = 0;
+            std::string action;
+            T details{};
+        };
+
+        static constexpr size_t BATCH_BYTES = 64 * 1024;
+
         std::vector<LogEntry> entries;
         std::ofstream logFile;
         std::string filename;
 
+        bool async;
+        std::chrono::milliseconds flushInterval;
+        LogDurability durability;
+
+        std::time_t cachedTime = -1;
+        std::string cachedTimestamp;
+
+        MpscQueue<PendingEntry> queue;
+        std::atomic<unsigned long long> enqueued{0};
+        std::atomic<unsigned long long> written{0};
+        std::mutex entriesMutex;
+        std::mutex wakeMutex;
+        std::condition_variable wakeCv;
+        std::condition_variable drainedCv;
+        unsigned long long flushedUpTo = 0;
+        bool flushRequested = false;
+        bool stopping = false;
+        std::thread writer;
+
+        const std::string& formatTime(std::time_t time) {
+            if (time != cachedTime) {
+                // localtime's shared static tm would race between the writer threads of several logs.
+                std::tm local = {};
+#ifdef _WIN32
+                localtime_s(&local, &time);
+#else
+                localtime_r(&time, &local);
+#endif
+                std::stringstream ss;
+                ss << std::put_time(&local, "%Y-%m-%d %X");
+                cachedTimestamp = ss.str();
+                cachedTime = time;
+            }
+            return cachedTimestamp;
+        }
+
         std::string getCurrentTime() {
-            auto now = std::chrono::system_clock::now();
-            auto in_time_t = std::chrono::system_clock::to_time_t(now);
-            std::stringstream ss;
-            ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
-            return ss.str();
+            return formatTime(std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()));
+        }
+
+        static void appendLine(std::string& buffer, const LogEntry& entry) {
+            buffer += '[';
+            buffer += entry.timestamp;
+            buffer += "] ";
+            buffer += entry.action;
+            buffer += " - ";
+            if constexpr (std::is_same<T, std::string>::value) {
+                buffer += entry.details;
+            } else if constexpr (std::is_integral<T>::value) {
+                buffer += std::to_string(entry.details);
+            } else {
+                std::ostringstream details;
+                details << entry.details;
+                buffer += details.str();
+            }
+            buffer += '\n';
+        }
+
+        void applyDurability() {
+            if (durability == LogDurability::Buffered) return;
+            logFile.flush();
+#ifndef _WIN32
+            if (durability == LogDurability::Synced) {
+                int fd = ::open(filename.c_str(), O_WRONLY);
+                if (fd >= 0) {
+                    ::fsync(fd);
+                    ::close(fd);
+                }
+            }
+#endif
         }
 
     void writeToFile(const LogEntry& entry) {
@@ -41,32 +402,146 @@ class AuditLog {
             logFile.open(filename, std::ios::app);
         }
         if (logFile.is_open()) {
-            logFile << "[" << entry.timestamp << "] "
-                    << entry.action << " - "
-                    << entry.details << std::endl;
+            std::string line;
+            appendLine(line, entry);
+            logFile << line;
+            applyDurability();
         }
     }
 
+        void writeBatch(std::string& buffer) {
+            if (buffer.empty()) return;
+            if (!logFile.is_open()) {
+                logFile.open(filename, std::ios::app);
+            }
+            if (logFile.is_open()) {
+                logFile.write(buffer.data(), buffer.size());
+            }
+            buffer.clear();
+        }
+
+        void drainQueue(std::string& buffer) {
+            std::vector<LogEntry> batch;
+            unsigned long long count = 0;
+            while (typename MpscQueue<PendingEntry>::Node* node = queue.pop()) {
+                PendingEntry& pending = node->item;
+                batch.push_back(LogEntry{formatTime(pending.time), std::move(pending.action), std::move(pending.details)});
+                delete node;
+                appendLine(buffer, batch.back());
+                if (buffer.size() >= BATCH_BYTES) writeBatch(buffer);
+                count++;
+            }
+            if (count == 0) return;
+            writeBatch(buffer);
+            applyDurability();
+            {
+                std::lock_guard<std::mutex> lock(entriesMutex);
+                for (auto& entry : batch) entries.emplace_back(std::move(entry));
+            }
+            written.fetch_add(count, std::memory_order_release);
+        }
+
+        void writerLoop() {
+            std::string buffer;
+            buffer.reserve(BATCH_BYTES + 256);
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            while (true) {
+                wakeCv.wait_for(lock, flushInterval, [this] { return stopping || flushRequested; });
+                bool stop = stopping;
+                bool forced = stopping || flushRequested;
+                flushRequested = false;
+                lock.unlock();
+                drainQueue(buffer);
+                while (written.load(std::memory_order_acquire) < enqueued.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                    drainQueue(buffer);
+                }
+                if (forced && logFile.is_open()) logFile.flush();
+                lock.lock();
+                if (forced || durability != LogDurability::Buffered) {
+                    flushedUpTo = written.load(std::memory_order_acquire);
+                }
+                drainedCv.notify_all();
+                if (stop) break;
+            }
+        }
+
     public:
-        AuditLog(const std::string& logFilename) : filename(logFilename) {
+        AuditLog(const std::string& logFilename, bool async = false,
+                 std::chrono::milliseconds flushInterval = std::chrono::milliseconds(200),
+                 LogDurability durability = LogDurability::Flushed)
+            : filename(logFilename), async(async), flushInterval(flushInterval), durability(durability) {
         logFile.open(filename, std::ios::app); 
+        if (async) {
+            writer = std::thread(&AuditLog::writerLoop, this);
+        }
     }
 
+        AuditLog(const AuditLog&) = delete;
+        AuditLog& operator=(const AuditLog&) = delete;
+
         ~AuditLog() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopping = true;
+            }
+            wakeCv.notify_one();
+            writer.join();
+        }
         if (logFile.is_open()) {
             logFile.close();
         }
     }
 
+        bool isAsync() const { return async; }
+
+        template<typename Visitor>
+        void forEachEntry(Visitor visit) {
+            flush();
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            for (const auto& entry : entries) {
+                visit(entry.timestamp, entry.action, entry.details);
+            }
+        }
+
+        void restoreEntry(const std::string& timestamp, const std::string& action, const T& details) {
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            entries.push_back(LogEntry{timestamp, action, details});
+        }
+
         template<typename U>
         void addEntry(const std::string& action, const U& details) {
+            if (async) {
+                PendingEntry pending;
+                pending.time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+                pending.action = action;
+                pending.details = static_cast<T>(details);
+                queue.push(std::move(pending));
+                enqueued.fetch_add(1, std::memory_order_release);
+                return;
+            }
             LogEntry entry{getCurrentTime(), action, static_cast<T>(details)};
             entries.emplace_back(entry);
              writeToFile(entry);
         }
 
+        void flush() {
+            if (!async) {
+                if (logFile.is_open()) logFile.flush();
+                return;
+            }
+            unsigned long long target = enqueued.load(std::memory_order_acquire);
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            flushRequested = true;
+            wakeCv.notify_one();
+            drainedCv.wait(lock, [this, target] { return flushedUpTo >= target; });
+        }
+
         template<typename Formatter>
-        void displayLog(Formatter format) const {
+        void displayLog(Formatter format) {
+            flush();
+            std::lock_guard<std::mutex> lock(entriesMutex);
             for(const auto& entry : entries) {
                 std::cout << format(
                 entry.getTimestamp(),
@@ -77,986 +552,6677 @@ class AuditLog {
     }
 };
 
-class DigitalAsset {
-    protected:
-        char* name;
-        float price;
-    
-    public:
-        DigitalAsset() : name(nullptr), price(0.0f) {}
-    
-        DigitalAsset(const char* name, float price) : price(price) {
-            if (!name) throw invalid_argument("Name cannot be null");
-             if (price < 0) throw invalid_argument("Price cannot be negative");
-            delete[] this->name;
-            this->name = new char[strlen(name) + 1];
-            strcpy(this->name, name);
-    }
-    
-        DigitalAsset(const DigitalAsset& other) : price(other.price) {
-            this->name = new char[strlen(other.name) + 1];
-            strcpy(this->name, other.name);
-    }
-    
-        virtual ~DigitalAsset() {
-            delete[] name;
+inline unsigned long long hashName(std::string_view key) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
     }
-    
-        const char* getName() const { return name; }
-        float getPrice() const { return price; }
-    
-        void setName(const char* name) {
-            delete[] this->name;
-            this->name = new char[strlen(name) + 1];
-            strcpy(this->name, name);
+    return hash;
+}
+
+inline unsigned long long mixHash(unsigned long long hash, unsigned long long value) {
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ (hash >> 29);
+}
+
+class StringPool {
+    private:
+        struct Entry {
+            const char* text;
+            uint32_t length;
+            unsigned long long hash;
+        };
+
+        static const uint32_t CHUNK_BITS = 12;
+        static const uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+        static const uint32_t MAX_CHUNKS = 1u << 16;
+        static const size_t BLOCK_BYTES = 64 * 1024;
+
+        static StringPool* instance;
+        std::atomic<Entry*> chunks[MAX_CHUNKS];
+        uint32_t numEntries;
+        uint32_t* table;
+        uint32_t tableCapacity;
+        char* block;
+        size_t blockUsed;
+        std::vector<char*> blocks;
+        std::mutex mutex;
+
+        StringPool() : numEntries(0), tableCapacity(1024), block(nullptr), blockUsed(BLOCK_BYTES) {
+            for (uint32_t i = 0; i < MAX_CHUNKS; i++) chunks[i].store(nullptr, std::memory_order_relaxed);
+            table = new uint32_t[tableCapacity]();
         }
-    
-        void setPrice(float price) { 
-            if (price < 0) { throw std::invalid_argument("Price cannot be negative.");}
-            this->price = price; 
+
+        const Entry& entry(uint32_t id) const {
+            return chunks[id >> CHUNK_BITS].load(std::memory_order_acquire)[id & (CHUNK_SIZE - 1)];
         }
-    
-        virtual void displayInfo() const = 0;
 
-        virtual float calculateMarketValue() const {return price;}
-    
-        DigitalAsset& operator=(const DigitalAsset& other) {
-            if (this != &other) {
-                delete[] name; 
-                if (other.name) {
-                    this->name = new char[strlen(other.name) + 1];
-                    strcpy(this->name, other.name);
-                } else {
-                    this->name = nullptr;
+        const char* store(std::string_view text) {
+            char* target;
+            if (text.size() + 1 > BLOCK_BYTES / 4) {
+                target = new char[text.size() + 1];
+                blocks.push_back(target);
+            } else {
+                if (blockUsed + text.size() + 1 > BLOCK_BYTES) {
+                    block = new char[BLOCK_BYTES];
+                    blocks.push_back(block);
+                    blockUsed = 0;
                 }
-                this->price = other.price;
+                target = block + blockUsed;
+                blockUsed += text.size() + 1;
             }
-             return *this;
+            memcpy(target, text.data(), text.size());
+            target[text.size()] = '\0';
+            return target;
         }
 
-};
+        void growTable() {
+            uint32_t newCapacity = tableCapacity * 2;
+            uint32_t* newTable = new uint32_t[newCapacity]();
+            for (uint32_t i = 0; i < tableCapacity; i++) {
+                if (table[i] == 0) continue;
+                uint32_t j = static_cast<uint32_t>(entry(table[i] - 1).hash) & (newCapacity - 1);
+                while (newTable[j] != 0) j = (j + 1) & (newCapacity - 1);
+                newTable[j] = table[i];
+            }
+            delete[] table;
+            table = newTable;
+            tableCapacity = newCapacity;
+        }
 
-class Token : virtual public DigitalAsset {
-    protected:
-        char* symbol;
-    
     public:
-        Token() : symbol(nullptr) {}
-    
-        Token(const char* name, const char* symbol, float price) {
-            this->symbol = new char[strlen(symbol) + 1];
-            strcpy(this->symbol, symbol);
+        static StringPool* getInstance() {
+            if (instance == nullptr) { instance = new StringPool();}
+            return instance;
         }
 
-        Token(const Token& other) : symbol(nullptr) {
-            this->symbol = new char[strlen(other.symbol) + 1];
-            strcpy(this->symbol, other.symbol);
+        StringPool(const StringPool&) = delete;
+        StringPool& operator=(const StringPool&) = delete;
+
+        ~StringPool() {
+            for (uint32_t i = 0; i < MAX_CHUNKS; i++) delete[] chunks[i].load(std::memory_order_relaxed);
+            for (char* allocated : blocks) delete[] allocated;
+            delete[] table;
         }
-    
-        ~Token() {
-            delete[] symbol;
-         }
-    
-        const char* getSymbol() const { return symbol; }
-    
-        void setSymbol(const char* symbol) {
-            if (symbol == nullptr) {
-                throw std::invalid_argument("Symbol cannot be null.");
+
+        uint32_t intern(std::string_view text) {
+            unsigned long long hash = hashName(text);
+            std::lock_guard<std::mutex> lock(mutex);
+            uint32_t mask = tableCapacity - 1;
+            uint32_t i = static_cast<uint32_t>(hash) & mask;
+            while (table[i] != 0) {
+                const Entry& existing = entry(table[i] - 1);
+                if (existing.hash == hash && std::string_view(existing.text, existing.length) == text) return table[i] - 1;
+                i = (i + 1) & mask;
             }
-            delete[] this->symbol;
-            this->symbol = new char[strlen(symbol) + 1];
-            strcpy(this->symbol, symbol);
-        }
-    
-        void displayInfo() const override { cout << "Token: " << name << " (" << symbol << "), Price: " << price << endl;}
-    
-        Token& operator=(const Token& other) {
-            if (this != &other) {
-                DigitalAsset::operator=(other);
-                delete[] symbol;
-                symbol = new char[strlen(other.symbol) + 1];
-                strcpy(symbol, other.symbol);
+            if (numEntries >= CHUNK_SIZE * MAX_CHUNKS) throw runtime_error("String pool exhausted");
+            uint32_t id = numEntries;
+            Entry* chunk = chunks[id >> CHUNK_BITS].load(std::memory_order_relaxed);
+            if (!chunk) {
+                chunk = new Entry[CHUNK_SIZE];
+                chunks[id >> CHUNK_BITS].store(chunk, std::memory_order_release);
             }
-            return *this;
+            chunk[id & (CHUNK_SIZE - 1)] = Entry{store(text), static_cast<uint32_t>(text.size()), hash};
+            numEntries++;
+            table[i] = id + 1;
+            if (numEntries * 10 >= tableCapacity * 7) growTable();
+            return id;
         }
-};
 
-class MarketEntity : virtual public DigitalAsset {
-    protected:
-        long long marketCap;
-        char currencyType;
-    
-    public:
-        MarketEntity() : DigitalAsset(), marketCap(0), currencyType('U') {}
-    
-        MarketEntity(long long marketCap, char currencyType = 'U'): marketCap(marketCap), currencyType(currencyType) {}
-    
-        MarketEntity(const MarketEntity& other) : DigitalAsset(other), marketCap(other.marketCap), currencyType(other.currencyType) {}
-        
-        virtual ~MarketEntity() {}
-    
-        long long getMarketCap() const { return marketCap; }
-        char getCurrencyType() const { return currencyType; }
-    
-        void setMarketCap(long long marketCap) { 
-            if (marketCap < 0) {
-                throw std::invalid_argument("Market cap cannot be negative.");
-            }
-            this->marketCap = marketCap; 
-        }
-        
-        void setCurrencyType(char type) { currencyType = type; }
+        const char* text(uint32_t id) const { return entry(id).text; }
 
-        virtual void displayMarketInfo() const { cout << "Market Cap: " << marketCap << ", Currency Type: " << currencyType << endl;}
-    
-        MarketEntity& operator=(const MarketEntity& other) {
-            if (this != &other) {
-                marketCap = other.marketCap;
-                currencyType = other.currencyType;
-            }
-            return *this;
-        }
+        uint32_t length(uint32_t id) const { return entry(id).length; }
+
+        uint32_t size() const { return numEntries; }
 };
 
-class CryptoCurrency : public Token, public MarketEntity {
+StringPool* StringPool::instance = nullptr;
+
+class InternedString {
     private:
-        static int totalCryptos;
-        const int MAX_NAME_LENGTH = 100;
-    
+        static const unsigned char POOLED = 0x80;
+        char bytes[4];
+
+        bool isPooled() const { return (static_cast<unsigned char>(bytes[3]) & POOLED) != 0; }
+
+        uint32_t poolId() const {
+            return static_cast<unsigned char>(bytes[0])
+                 | static_cast<uint32_t>(static_cast<unsigned char>(bytes[1])) << 8
+                 | static_cast<uint32_t>(static_cast<unsigned char>(bytes[2])) << 16
+                 | static_cast<uint32_t>(static_cast<unsigned char>(bytes[3]) & ~POOLED) << 24;
+        }
+
     public:
-        CryptoCurrency() : Token(), MarketEntity() {totalCryptos++;}
-        
-        CryptoCurrency(const char* name, const char* symbol, float price, long long marketCap, char currencyType = 'C'): DigitalAsset(name, price), Token(), MarketEntity() {
-            setSymbol(symbol);           
-            this->marketCap = marketCap;
-            this->currencyType = currencyType;
-            totalCryptos++;
+        InternedString() : bytes{0, 0, 0, 0} {}
+
+        explicit InternedString(std::string_view text) : bytes{0, 0, 0, 0} {
+            if (text.size() < sizeof(bytes) && text.find('\0') == std::string_view::npos) {
+                memcpy(bytes, text.data(), text.size());
+                return;
+            }
+            uint32_t id = StringPool::getInstance()->intern(text);
+            bytes[0] = static_cast<char>(id & 0xFF);
+            bytes[1] = static_cast<char>((id >> 8) & 0xFF);
+            bytes[2] = static_cast<char>((id >> 16) & 0xFF);
+            bytes[3] = static_cast<char>(((id >> 24) & 0x7F) | POOLED);
         }
 
-        CryptoCurrency(const CryptoCurrency& other) : DigitalAsset(other), Token(other), MarketEntity(other) {totalCryptos++;}
+        explicit InternedString(const char* text) : InternedString(text ? std::string_view(text) : std::string_view()) {}
 
-        ~CryptoCurrency() {totalCryptos--;}
+        bool empty() const { return bytes[0] == 0 && !isPooled(); }
 
-        virtual void displayInfo() const {displayInfo(std::cout);}
+        const char* c_str() const { return isPooled() ? StringPool::getInstance()->text(poolId()) : bytes; }
 
-        virtual void displayInfo(std::ostream& os) const { os << "Name: " << name << ", Symbol: " << symbol << ", Price: " << price << ", Market Cap: " << marketCap << ", Currency Type: " << currencyType;}
+        size_t length() const { return isPooled() ? StringPool::getInstance()->length(poolId()) : strnlen(bytes, sizeof(bytes) - 1); }
 
-        void displayMarketInfo() const override { cout << "Cryptocurrency Market Cap: " << marketCap << ", Type: " << currencyType << endl;}
-    
-        float calculateMarketValue() const override { return price * 100; }
+        std::string_view view() const { return std::string_view(c_str(), length()); }
 
-        CryptoCurrency& operator=(const CryptoCurrency& other) {
-            if (this != &other) {
-                DigitalAsset::operator=(other); 
-                Token::operator=(other);
-                MarketEntity::operator=(other);
-            }
-            return *this;
-        }
- 
-        bool operator==(const CryptoCurrency& other) const { return strcmp(name, other.name) == 0 && strcmp(symbol, other.symbol) == 0;}
+        bool operator==(const InternedString& other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
 
-        bool operator<(const CryptoCurrency& other) const { return marketCap < other.marketCap;}
+        bool operator!=(const InternedString& other) const { return !(*this == other); }
+};
 
-        CryptoCurrency operator+(const CryptoCurrency& other) const { return CryptoCurrency(name, symbol, price + other.price, marketCap + other.marketCap);}
+ostream& operator<<(ostream& os, const InternedString& text) {
+    return os << text.view();
+}
 
-        CryptoCurrency operator*(const CryptoCurrency& other) const {return CryptoCurrency(name, symbol, price * other.price, marketCap * other.marketCap);}
+// Signed fixed-point number stored as a 128-bit count of 10^-18 units. Assets carry their own
+// decimal scale on top of this (see DigitalAsset::getDecimals); every operator checks for overflow.
+class Amount {
+    public:
+        static const int DECIMALS = 18;
 
-        CryptoCurrency operator-(const CryptoCurrency& other) const { return CryptoCurrency(name, symbol, price - other.price, marketCap - other.marketCap);}
+    private:
+        static constexpr uint64_t ONE = 1000000000000000000ULL;
 
-        CryptoCurrency operator/(const CryptoCurrency& other) const {return CryptoCurrency(name, symbol, price / other.price, marketCap / other.marketCap);}
+        __int128 units;
 
-        CryptoCurrency& operator++() {
-            setPrice(getPrice() + 1.0f); 
-            return *this;
+        static __int128 pow10(int n) {
+            __int128 result = 1;
+            for (int i = 0; i < n; i++) result *= 10;
+            return result;
         }
-        
-        CryptoCurrency operator++(int) {
-            CryptoCurrency temp = *this;
-            price += 1.0f;
-            return temp;
+
+        static unsigned __int128 magnitude(__int128 value) {
+            return value < 0 ? -static_cast<unsigned __int128>(value) : static_cast<unsigned __int128>(value);
         }
 
-        char operator[](int index) const {
-            if (index < 0 || index >= strlen(name)) {throw out_of_range("Index out of range");}
-            return name[index];
+        static bool applySign(unsigned __int128 value, bool negative, __int128& result) {
+            if (value > static_cast<unsigned __int128>(std::numeric_limits<__int128>::max()) + negative) return false;
+            result = negative ? static_cast<__int128>(-value) : static_cast<__int128>(value);
+            return true;
         }
-    
-        static int getTotalCryptos() { return totalCryptos; }
-    
-        friend ostream& operator<<(ostream& os, const CryptoCurrency& crypto);
-        
-        friend istream& operator>>(istream& is, CryptoCurrency& crypto);
-};
 
-int CryptoCurrency::totalCryptos = 0;
+        // |a| * |b| as a 256-bit number in four 64-bit limbs, most significant first.
+        static void multiply(unsigned __int128 a, unsigned __int128 b, uint64_t limbs[4]) {
+            uint64_t a0 = static_cast<uint64_t>(a), a1 = static_cast<uint64_t>(a >> 64);
+            uint64_t b0 = static_cast<uint64_t>(b), b1 = static_cast<uint64_t>(b >> 64);
+            unsigned __int128 low = static_cast<unsigned __int128>(a0) * b0;
+            unsigned __int128 cross1 = static_cast<unsigned __int128>(a0) * b1;
+            unsigned __int128 cross2 = static_cast<unsigned __int128>(a1) * b0;
+            unsigned __int128 middle = (low >> 64) + static_cast<uint64_t>(cross1) + static_cast<uint64_t>(cross2);
+            unsigned __int128 high = static_cast<unsigned __int128>(a1) * b1 + (cross1 >> 64) + (cross2 >> 64) + (middle >> 64);
+            limbs[0] = static_cast<uint64_t>(high >> 64);
+            limbs[1] = static_cast<uint64_t>(high);
+            limbs[2] = static_cast<uint64_t>(middle);
+            limbs[3] = static_cast<uint64_t>(low);
+        }
 
-class UtilityCoin : virtual public CryptoCurrency {
-    private:
-        char* useCase;
-    
-    public:
-        UtilityCoin() : CryptoCurrency(),useCase(nullptr) {}
-    
-        UtilityCoin(const char* name, const char* symbol, float price, long long marketCap, const char* useCase, char currencyType = 'U'): CryptoCurrency(name, symbol, price, marketCap, currencyType) {
-            this->useCase = new char[strlen(useCase) + 1];
-            this->setName(name);
-            strcpy(this->useCase, useCase);
+        // a * b / 10^18 with a = ah + al and b = bh + bl split into whole and fractional units: only al * bl needs
+        // rounding, and it stays below 10^36, so no 256-bit intermediate is needed.
+        static bool mulScaled(__int128 a, __int128 b, __int128& result) {
+            unsigned __int128 ua = magnitude(a), ub = magnitude(b);
+            unsigned __int128 ah = ua / ONE, bh = ub / ONE;
+            unsigned __int128 al = ua - ah * ONE, bl = ub - bh * ONE;
+            unsigned __int128 low = al * bl;
+            unsigned __int128 lowWhole = low / ONE;
+            unsigned __int128 sum = lowWhole + ((low - lowWhole * ONE) * 2 >= ONE), term;
+            bool overflow = __builtin_mul_overflow(ah, bh, &term) || __builtin_mul_overflow(term, static_cast<unsigned __int128>(ONE), &term)
+                || __builtin_add_overflow(sum, term, &sum)
+                || __builtin_mul_overflow(ah, bl, &term) || __builtin_add_overflow(sum, term, &sum)
+                || __builtin_mul_overflow(al, bh, &term) || __builtin_add_overflow(sum, term, &sum);
+            return !overflow && applySign(sum, (a < 0) != (b < 0), result);
         }
-    
-        UtilityCoin(const UtilityCoin& other) : CryptoCurrency(other) {
-            this->useCase = new char[strlen(other.useCase) + 1];
-            strcpy(this->useCase, other.useCase);
+
+        // |a| * 10^18 / |b| by shift-and-subtract over the 256-bit numerator; only used by operator/.
+        static bool divScaled(__int128 a, __int128 b, __int128& result) {
+            uint64_t limbs[4];
+            multiply(magnitude(a), ONE, limbs);
+            unsigned __int128 divisor = magnitude(b), remainder = 0, quotient = 0;
+            for (int bit = 255; bit >= 0; bit--) {
+                bool carry = remainder >> 127;
+                remainder = (remainder << 1) | ((limbs[3 - bit / 64] >> (bit % 64)) & 1);
+                bool subtract = carry || remainder >= divisor;
+                if (subtract) remainder -= divisor;
+                if (quotient >> 127) return false;
+                quotient = (quotient << 1) | subtract;
+            }
+            quotient += remainder >= divisor - remainder;
+            return applySign(quotient, (a < 0) != (b < 0), result);
         }
+
+        // Takes units by reference so callers can pass the result their overflow builtin just wrote.
+        static Amount checked(bool ok, const __int128& units) {
+            if (!ok) throw overflow_error("Amount overflow");
+            return fromUnits(units);
+        }
+
+        friend class AmountSum;
+
+    public:
+        constexpr Amount() : units(0) {}
+
+        template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+        Amount(T whole) : units(static_cast<__int128>(whole) * ONE) {}
+
+        Amount(float) = delete;
+        Amount(double) = delete;
+
+        static Amount fromUnits(__int128 units) {
+            Amount amount;
+            amount.units = units;
+            return amount;
+        }
+
+        static Amount fromWords(uint64_t low, int64_t high) { return fromUnits(static_cast<__int128>(static_cast<unsigned __int128>(high) << 64 | low)); }
+
+        // value * 10^-decimals, exactly: fromScaled(250, 2) is 2.5.
+        static Amount fromScaled(long long value, int decimals) { return fromUnits(static_cast<__int128>(value) * pow10(DECIMALS - decimals)); }
+
+        // Nearest value with at most `decimals` fractional digits; binary floating point cannot hold most decimals exactly.
+        static Amount fromDouble(double value, int decimals = DECIMALS) {
+            double scaled = std::round(value * static_cast<double>(pow10(decimals)));
+            if (!std::isfinite(scaled) || std::fabs(scaled) >= 1.7e38 / static_cast<double>(pow10(DECIMALS - decimals))) throw overflow_error("Amount overflow");
+            return fromUnits(static_cast<__int128>(scaled) * pow10(DECIMALS - decimals));
+        }
+
+        // Parses "[-]digits[.digits]" with at most 18 fractional digits.
+        static bool parse(std::string_view text, Amount& amount) {
+            size_t i = 0;
+            bool negative = false;
+            if (!text.empty() && (text[0] == '-' || text[0] == '+')) {
+                negative = text[0] == '-';
+                i = 1;
+            }
+            unsigned __int128 value = 0;
+            int digits = 0, fraction = -1;
+            for (; i < text.size(); i++) {
+                char c = text[i];
+                if (c == '.' && fraction < 0) {
+                    fraction = 0;
+                    continue;
+                }
+                if (c < '0' || c > '9' || fraction >= DECIMALS) return false;
+                if (value > (std::numeric_limits<unsigned __int128>::max() - 9) / 10) return false;
+                value = value * 10 + (c - '0');
+                digits++;
+                if (fraction >= 0) fraction++;
+            }
+            if (digits == 0) return false;
+            unsigned __int128 scale = pow10(DECIMALS - std::max(fraction, 0));
+            if (value > std::numeric_limits<unsigned __int128>::max() / scale) return false;
+            __int128 units;
+            if (!applySign(value * scale, negative, units)) return false;
+            amount = fromUnits(units);
+            return true;
+        }
+
+        __int128 getUnits() const { return units; }
+        uint64_t lowWord() const { return static_cast<uint64_t>(units); }
+        int64_t highWord() const { return static_cast<int64_t>(units >> 64); }
+
+        double toDouble() const { return static_cast<double>(units / ONE) + static_cast<double>(units % ONE) / ONE; }
+
+        bool isNegative() const { return units < 0; }
+        bool isZero() const { return units == 0; }
+
+        bool fitsDecimals(int decimals) const { return units % pow10(DECIMALS - decimals) == 0; }
+
+        // Rounds half away from zero to `decimals` fractional digits.
+        Amount rounded(int decimals) const {
+            __int128 step = pow10(DECIMALS - decimals);
+            __int128 remainder = units % step;
+            __int128 result = units - remainder;
+            if (2 * magnitude(remainder) >= static_cast<unsigned __int128>(step)) return checked(!__builtin_add_overflow(result, units < 0 ? -step : step, &result), result);
+            return fromUnits(result);
+        }
+
+        string toString(int decimals = DECIMALS) const {
+            Amount value = rounded(decimals);
+            unsigned __int128 whole = magnitude(value.units) / ONE;
+            uint64_t fraction = static_cast<uint64_t>(magnitude(value.units) % ONE);
+            char digits[48];
+            int length = 0;
+            do {
+                digits[length++] = static_cast<char>('0' + static_cast<int>(whole % 10));
+                whole /= 10;
+            } while (whole > 0);
+            string text = value.units < 0 ? "-" : "";
+            while (length > 0) text.push_back(digits[--length]);
+            if (fraction > 0) {
+                char buffer[20];
+                snprintf(buffer, sizeof(buffer), "%018llu", static_cast<unsigned long long>(fraction));
+                string decimalsText(buffer);
+                decimalsText.erase(decimalsText.find_last_not_of('0') + 1);
+                text += "." + decimalsText;
+            }
+            return text;
+        }
+
+        Amount operator-() const {
+            __int128 result;
+            return checked(!__builtin_sub_overflow(static_cast<__int128>(0), units, &result), result);
+        }
+
+        Amount operator+(const Amount& other) const {
+            __int128 result;
+            return checked(!__builtin_add_overflow(units, other.units, &result), result);
+        }
+
+        Amount operator-(const Amount& other) const {
+            __int128 result;
+            return checked(!__builtin_sub_overflow(units, other.units, &result), result);
+        }
+
+        Amount operator*(const Amount& other) const {
+            __int128 result = 0;
+            return checked(mulScaled(units, other.units, result), result);
+        }
+
+        template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+        Amount operator*(T factor) const {
+            __int128 result;
+            return checked(!__builtin_mul_overflow(units, static_cast<__int128>(factor), &result), result);
+        }
+
+        Amount operator/(const Amount& other) const {
+            if (other.units == 0) throw invalid_argument("Division by zero amount");
+            __int128 result = 0;
+            return checked(divScaled(units, other.units, result), result);
+        }
+
+        Amount& operator+=(const Amount& other) { return *this = *this + other; }
+        Amount& operator-=(const Amount& other) { return *this = *this - other; }
+
+        bool operator==(const Amount& other) const { return units == other.units; }
+        bool operator!=(const Amount& other) const { return units != other.units; }
+        bool operator<(const Amount& other) const { return units < other.units; }
+        bool operator<=(const Amount& other) const { return units <= other.units; }
+        bool operator>(const Amount& other) const { return units > other.units; }
+        bool operator>=(const Amount& other) const { return units >= other.units; }
+};
+
+ostream& operator<<(ostream& os, const Amount& amount) {
+    return os << amount.toString();
+}
+
+istream& operator>>(istream& is, Amount& amount) {
+    string text;
+    if (is >> text && !Amount::parse(text, amount)) is.setstate(ios::failbit);
+    return is;
+}
+
+// Running total without a branch per term: overflow is remembered and reported once by total().
+class AmountSum {
+    private:
+        __int128 sum;
+        bool overflowed;
+
+    public:
+        AmountSum() : sum(0), overflowed(false) {}
+
+        void add(const Amount& value) {
+            __int128 result = static_cast<__int128>(static_cast<unsigned __int128>(sum) + static_cast<unsigned __int128>(value.units));
+            overflowed |= ((sum ^ result) & (value.units ^ result)) < 0;
+            sum = result;
+        }
+
+        // Folds in a partial sum, keeping its overflow.
+        void add(const AmountSum& other) {
+            overflowed |= other.overflowed;
+            add(Amount::fromUnits(other.sum));
+        }
+
+        Amount total() const { return Amount::checked(!overflowed, sum); }
+};
+
+typedef int AssetId;
+const AssetId INVALID_ASSET = -1;
+
+class DigitalAsset {
+    friend class AssetRegistry;
+
+    protected:
+        InternedString name;
+        Amount price;
+        AssetId assetId;
+        int decimals;
     
-        ~UtilityCoin() { delete[] useCase; }
-    
-        const char* getUseCase() const { return useCase; }
+    public:
+        static const int DEFAULT_DECIMALS = 8;
+
+        DigitalAsset() : assetId(INVALID_ASSET), decimals(DEFAULT_DECIMALS) {}
     
-        void setUseCase(const char* useCase) {
-            delete[] this->useCase;
-            this->useCase = new char[strlen(useCase) + 1];
-            strcpy(this->useCase, useCase);
+        DigitalAsset(const char* name, Amount price) : price(price), assetId(INVALID_ASSET), decimals(DEFAULT_DECIMALS) {
+            if (!name) throw invalid_argument("Name cannot be null");
+             if (price.isNegative()) throw invalid_argument("Price cannot be negative");
+            this->name = InternedString(name);
+    }
+
+        DigitalAsset(InternedString name, Amount price) : name(name), price(price), assetId(INVALID_ASSET), decimals(DEFAULT_DECIMALS) {
+            if (price.isNegative()) throw invalid_argument("Price cannot be negative");
         }
     
-        void displayInfo() const override {displayInfo(std::cout);}
+        DigitalAsset(const DigitalAsset& other) : name(other.name), price(other.price), assetId(other.assetId), decimals(other.decimals) {}
 
-        void displayInfo(std::ostream& os) const override {
-            CryptoCurrency::displayInfo(os);
-            if (useCase)
-                os << ", Use Case: " << useCase;
-            else
-                os << ", Use Case: N/A";
+        DigitalAsset(DigitalAsset&& other) noexcept : name(other.name), price(other.price), assetId(other.assetId), decimals(other.decimals) {}
+    
+        virtual ~DigitalAsset() {}
+    
+        const char* getName() const { return name.empty() ? nullptr : name.c_str(); }
+        InternedString getNameString() const { return name; }
+        Amount getPrice() const { return price; }
+        AssetId getAssetId() const { return assetId; }
+        int getDecimals() const { return decimals; }
+
+        // Quantities of this asset may not be finer than 10^-decimals.
+        void setDecimals(int decimals) {
+            if (decimals < 0 || decimals > Amount::DECIMALS) throw invalid_argument("Decimals must be between 0 and 18");
+            this->decimals = decimals;
+        }
+
+        void checkQuantity(const Amount& quantity) const {
+            if (!quantity.fitsDecimals(decimals)) throw invalid_argument("Quantity has more than " + to_string(decimals) + " decimals for " + name.c_str());
+        }
+    
+        void setName(const char* name) {
+            if (!name) throw invalid_argument("Name cannot be null");
+            this->name = InternedString(name);
         }
+
+        void setName(InternedString name) { this->name = name; }
     
-        float calculateMarketValue() const override {return price * 120; }
+        void setPrice(Amount price);
+
+        // The price as readers on other threads see it: from the registry's price book once registered, without a lock.
+        Amount getQuotedPrice() const;
     
-        UtilityCoin& operator=(const UtilityCoin& other) {
+        virtual void displayInfo() const = 0;
+
+        virtual int getValueMultiplier() const { return 1; }
+
+        virtual Amount calculateMarketValue() const { return getQuotedPrice() * getValueMultiplier(); }
+    
+        DigitalAsset& operator=(const DigitalAsset& other) {
             if (this != &other) {
-                CryptoCurrency::operator=(other);
-                delete[] useCase;
-                useCase = new char[strlen(other.useCase) + 1];
-                strcpy(useCase, other.useCase);
+                this->name = other.name;
+                this->price = other.price;
+                this->assetId = other.assetId;
+                this->decimals = other.decimals;
             }
+             return *this;
+        }
+
+        DigitalAsset& operator=(DigitalAsset&& other) noexcept {
+            name = other.name;
+            price = other.price;
+            assetId = other.assetId;
+            decimals = other.decimals;
             return *this;
         }
+
 };
 
-class StableCoin : virtual public CryptoCurrency {
-    private:
-        char* backedBy;
+class Token : virtual public DigitalAsset {
+    protected:
+        InternedString symbol;
     
     public:
-        StableCoin() : CryptoCurrency(), backedBy(nullptr) {}
+        Token() {}
     
-        StableCoin(const char* name, const char* symbol, float price, long long marketCap, const char* backedBy, char currencyType = 'S'): CryptoCurrency(name, symbol, price, marketCap, currencyType) {
-            this->backedBy = new char[strlen(backedBy) + 1];
-            this->setName(name);
-            strcpy(this->backedBy, backedBy);
+        Token(const char* name, const char* symbol, Amount price) {
+            setSymbol(symbol);
         }
+
+        Token(const Token& other) : DigitalAsset(other), symbol(other.symbol) {}
+
+        Token(Token&& other) noexcept : DigitalAsset(std::move(other)), symbol(other.symbol) {}
     
-        StableCoin(const StableCoin& other) : CryptoCurrency(other) {
-            this->backedBy = new char[strlen(other.backedBy) + 1];
-            strcpy(this->backedBy, other.backedBy);
-        }
+        ~Token() {}
+    
+        const char* getSymbol() const { return symbol.empty() ? nullptr : symbol.c_str(); }
+
+        InternedString getSymbolString() const { return symbol; }
     
-        ~StableCoin() { delete[] backedBy;}
+        void setSymbol(const char* symbol) {
+            if (symbol == nullptr) {
+                throw std::invalid_argument("Symbol cannot be null.");
+            }
+            this->symbol = InternedString(symbol);
+        }
+
+        void setSymbol(InternedString symbol) { this->symbol = symbol; }
     
-        const char* getBackedBy() const { return backedBy; }
+        void displayInfo() const override { cout << "Token: " << name << " (" << symbol << "), Price: " << price << endl;}
     
-        void setBackedBy(const char* backedBy) {
-            delete[] this->backedBy;
-            this->backedBy = new char[strlen(backedBy) + 1];
-            strcpy(this->backedBy, backedBy);
+        Token& operator=(const Token& other) {
+            if (this != &other) {
+                DigitalAsset::operator=(other);
+                symbol = other.symbol;
+            }
+            return *this;
+        }
+
+        Token& operator=(Token&& other) noexcept {
+            DigitalAsset::operator=(std::move(other));
+            symbol = other.symbol;
+            return *this;
         }
+};
+
+class MarketEntity : virtual public DigitalAsset {
+    protected:
+        long long marketCap;
+        char currencyType;
     
-        void displayInfo() const override { displayInfo(std::cout);}
+    public:
+        MarketEntity() : DigitalAsset(), marketCap(0), currencyType('U') {}
+    
+        MarketEntity(long long marketCap, char currencyType = 'U'): marketCap(marketCap), currencyType(currencyType) {}
+    
+        MarketEntity(const MarketEntity& other) : DigitalAsset(other), marketCap(other.marketCap), currencyType(other.currencyType) {}
 
-        void displayInfo(std::ostream& os) const override {
-            CryptoCurrency::displayInfo(os);
-            os << ", Backed By: " << backedBy;
+        MarketEntity(MarketEntity&& other) noexcept : DigitalAsset(std::move(other)), marketCap(other.marketCap), currencyType(other.currencyType) {}
+        
+        virtual ~MarketEntity() {}
+    
+        long long getMarketCap() const { return marketCap; }
+        char getCurrencyType() const { return currencyType; }
+    
+        void setMarketCap(long long marketCap);
+        
+        void setCurrencyType(char type) { currencyType = type; }
+
+        virtual void displayMarketInfo() const { cout << "Market Cap: " << marketCap << ", Currency Type: " << currencyType << endl;}
+    
+        MarketEntity& operator=(const MarketEntity& other) {
+            if (this != &other) {
+                marketCap = other.marketCap;
+                currencyType = other.currencyType;
+            }
+            return *this;
         }
+
+        MarketEntity& operator=(MarketEntity&& other) noexcept {
+            marketCap = other.marketCap;
+            currencyType = other.currencyType;
+            return *this;
+        }
+};
+
+class CryptoCurrency : public Token, public MarketEntity {
+    private:
+        static int totalCryptos;
+        const int MAX_NAME_LENGTH = 100;
+    
+    public:
+        CryptoCurrency() : Token(), MarketEntity() {totalCryptos++;}
         
-        float calculateMarketValue() const override { return price * 110; }
+        CryptoCurrency(const char* name, const char* symbol, Amount price, long long marketCap, char currencyType = 'C'): DigitalAsset(name, price), Token(), MarketEntity() {
+            setSymbol(symbol);           
+            this->marketCap = marketCap;
+            this->currencyType = currencyType;
+            totalCryptos++;
+        }
+
+        CryptoCurrency(InternedString name, InternedString symbol, Amount price, long long marketCap, char currencyType = 'C'): DigitalAsset(name, price), Token(), MarketEntity() {
+            setSymbol(symbol);
+            this->marketCap = marketCap;
+            this->currencyType = currencyType;
+            totalCryptos++;
+        }
+
+        CryptoCurrency(const CryptoCurrency& other) : DigitalAsset(other), Token(other), MarketEntity(other) {totalCryptos++;}
+
+        CryptoCurrency(CryptoCurrency&& other) noexcept : DigitalAsset(std::move(other)), Token(std::move(other)), MarketEntity(std::move(other)) {totalCryptos++;}
+
+        ~CryptoCurrency() {totalCryptos--;}
+
+        virtual void displayInfo() const {displayInfo(std::cout);}
+
+        virtual void displayInfo(std::ostream& os) const { writeInfo(os, name, symbol, price, marketCap, currencyType); }
+
+        // Shared with CryptoValue so both representations print the same line.
+        static void writeInfo(std::ostream& os, InternedString name, InternedString symbol, const Amount& price, long long marketCap, char currencyType) {
+            os << "Name: " << name << ", Symbol: " << symbol << ", Price: " << price << ", Market Cap: " << marketCap << ", Currency Type: " << currencyType;
+        }
+
+        void displayMarketInfo() const override { cout << "Cryptocurrency Market Cap: " << marketCap << ", Type: " << currencyType << endl;}
+
+        static const int VALUE_MULTIPLIER = 100;
     
-        StableCoin& operator=(const StableCoin& other) {
+        int getValueMultiplier() const override { return VALUE_MULTIPLIER; }
+
+        CryptoCurrency& operator=(const CryptoCurrency& other) {
             if (this != &other) {
-                CryptoCurrency::operator=(other);
-                delete[] backedBy;
-                backedBy = new char[strlen(other.backedBy) + 1];
-                strcpy(backedBy, other.backedBy);
+                DigitalAsset::operator=(other); 
+                Token::operator=(other);
+                MarketEntity::operator=(other);
             }
             return *this;
         }
+
+        CryptoCurrency& operator=(CryptoCurrency&& other) noexcept {
+            Token::operator=(std::move(other));
+            MarketEntity::operator=(std::move(other));
+            return *this;
+        }
+ 
+        bool operator==(const CryptoCurrency& other) const { return name == other.name && symbol == other.symbol;}
+
+        bool operator<(const CryptoCurrency& other) const { return marketCap < other.marketCap;}
+
+        CryptoCurrency operator+(const CryptoCurrency& other) const { return CryptoCurrency(name, symbol, price + other.price, marketCap + other.marketCap);}
+
+        CryptoCurrency operator*(const CryptoCurrency& other) const {return CryptoCurrency(name, symbol, price * other.price, marketCap * other.marketCap);}
+
+        CryptoCurrency operator-(const CryptoCurrency& other) const { return CryptoCurrency(name, symbol, price - other.price, marketCap - other.marketCap);}
+
+        CryptoCurrency operator/(const CryptoCurrency& other) const {return CryptoCurrency(name, symbol, price / other.price, marketCap / other.marketCap);}
+
+        CryptoCurrency& operator++() {
+            setPrice(getPrice() + 1); 
+            return *this;
+        }
+        
+        CryptoCurrency operator++(int) {
+            CryptoCurrency temp = *this;
+            setPrice(price + 1);
+            return temp;
+        }
+
+        char operator[](int index) const {
+            if (index < 0 || index >= static_cast<int>(name.length())) {throw out_of_range("Index out of range");}
+            return name.c_str()[index];
+        }
+    
+        static int getTotalCryptos() { return totalCryptos; }
+    
+        friend ostream& operator<<(ostream& os, const CryptoCurrency& crypto);
+        
+        friend istream& operator>>(istream& is, CryptoCurrency& crypto);
+};
+
+int CryptoCurrency::totalCryptos = 0;
+
+class UtilityCoin : virtual public CryptoCurrency {
+    private:
+        InternedString useCase;
+    
+    public:
+        UtilityCoin() : CryptoCurrency() {}
+    
+        UtilityCoin(const char* name, const char* symbol, Amount price, long long marketCap, const char* useCase, char currencyType = 'U'): DigitalAsset(name, price), CryptoCurrency(name, symbol, price, marketCap, currencyType) {
+            setUseCase(useCase);
+            setDecimals(Amount::DECIMALS);
+        }
+
+        UtilityCoin(InternedString name, InternedString symbol, Amount price, long long marketCap, InternedString useCase, char currencyType = 'U'): DigitalAsset(name, price), CryptoCurrency(name, symbol, price, marketCap, currencyType), useCase(useCase) {
+            setDecimals(Amount::DECIMALS);
+        }
+    
+        UtilityCoin(const UtilityCoin& other) : DigitalAsset(other), CryptoCurrency(other), useCase(other.useCase) {}
+
+        UtilityCoin(UtilityCoin&& other) noexcept : DigitalAsset(std::move(other)), CryptoCurrency(std::move(other)), useCase(other.useCase) {}
+    
+        ~UtilityCoin() {}
+    
+        const char* getUseCase() const { return useCase.empty() ? nullptr : useCase.c_str(); }
+
+        InternedString getUseCaseString() const { return useCase; }
+    
+        void setUseCase(const char* useCase) {
+            if (!useCase) throw invalid_argument("Use case cannot be null");
+            this->useCase = InternedString(useCase);
+        }
+    
+        void displayInfo() const override {displayInfo(std::cout);}
+
+        void displayInfo(std::ostream& os) const override {
+            CryptoCurrency::displayInfo(os);
+            writeUseCase(os, useCase);
+        }
+
+        static void writeUseCase(std::ostream& os, InternedString useCase) {
+            if (!useCase.empty())
+                os << ", Use Case: " << useCase;
+            else
+                os << ", Use Case: N/A";
+        }
+
+        static const int VALUE_MULTIPLIER = 120;
+    
+        int getValueMultiplier() const override { return VALUE_MULTIPLIER; }
+    
+        UtilityCoin& operator=(const UtilityCoin& other) {
+            if (this != &other) {
+                CryptoCurrency::operator=(other);
+                useCase = other.useCase;
+            }
+            return *this;
+        }
+
+        UtilityCoin& operator=(UtilityCoin&& other) noexcept {
+            CryptoCurrency::operator=(std::move(other));
+            useCase = other.useCase;
+            return *this;
+        }
+};
+
+class StableCoin : virtual public CryptoCurrency {
+    private:
+        InternedString backedBy;
+    
+    public:
+        // Fiat-backed tokens settle in micro-units.
+        static const int DEFAULT_DECIMALS = 6;
+
+        StableCoin() : CryptoCurrency() {}
+    
+        StableCoin(const char* name, const char* symbol, Amount price, long long marketCap, const char* backedBy, char currencyType = 'S'): DigitalAsset(name, price), CryptoCurrency(name, symbol, price, marketCap, currencyType) {
+            setBackedBy(backedBy);
+            setDecimals(DEFAULT_DECIMALS);
+        }
+
+        StableCoin(InternedString name, InternedString symbol, Amount price, long long marketCap, InternedString backedBy, char currencyType = 'S'): DigitalAsset(name, price), CryptoCurrency(name, symbol, price, marketCap, currencyType), backedBy(backedBy) {
+            setDecimals(DEFAULT_DECIMALS);
+        }
+    
+        StableCoin(const StableCoin& other) : DigitalAsset(other), CryptoCurrency(other), backedBy(other.backedBy) {}
+
+        StableCoin(StableCoin&& other) noexcept : DigitalAsset(std::move(other)), CryptoCurrency(std::move(other)), backedBy(other.backedBy) {}
+    
+        ~StableCoin() {}
+    
+        const char* getBackedBy() const { return backedBy.empty() ? nullptr : backedBy.c_str(); }
+
+        InternedString getBackedByString() const { return backedBy; }
+    
+        void setBackedBy(const char* backedBy) {
+            if (!backedBy) throw invalid_argument("Backing asset cannot be null");
+            this->backedBy = InternedString(backedBy);
+        }
+    
+        void displayInfo() const override { displayInfo(std::cout);}
+
+        void displayInfo(std::ostream& os) const override {
+            CryptoCurrency::displayInfo(os);
+            writeBackedBy(os, backedBy);
+        }
+
+        static void writeBackedBy(std::ostream& os, InternedString backedBy) { os << ", Backed By: " << backedBy; }
+
+        static const int VALUE_MULTIPLIER = 110;
+        
+        int getValueMultiplier() const override { return VALUE_MULTIPLIER; }
+    
+        StableCoin& operator=(const StableCoin& other) {
+            if (this != &other) {
+                CryptoCurrency::operator=(other);
+                backedBy = other.backedBy;
+            }
+            return *this;
+        }
+
+        StableCoin& operator=(StableCoin&& other) noexcept {
+            CryptoCurrency::operator=(std::move(other));
+            backedBy = other.backedBy;
+            return *this;
+        }
+};
+
+ostream& operator<<(ostream& os, const CryptoCurrency& crypto) {
+        crypto.displayInfo(os);
+        return os;
+    }
+
+istream& operator>>(istream& is, CryptoCurrency& crypto) {
+    char buffer[100];
+    Amount price;
+    long long marketCap;
+    char currencyType;
+
+    cout << "Enter name: ";
+    is >> buffer;
+    crypto.setName(buffer);
+
+    cout << "Enter symbol: ";
+    is >> buffer;
+    crypto.setSymbol(buffer);
+
+    cout << "Enter price: ";
+    is >> price;
+    crypto.setPrice(price); 
+
+    cout << "Enter market cap: ";
+    is >> marketCap;
+    crypto.setMarketCap(marketCap); 
+
+    cout << "Enter currency type (C for Crypto): ";
+    is >> currencyType;
+    crypto.setCurrencyType(currencyType);
+
+    return is;
+}
+
+template<typename T>
+void resizeArray(T**& array, int& capacity, int required) {
+    try {
+        if (required <= capacity) return;
+        int newCapacity = capacity * 2;
+        if (newCapacity < required) newCapacity = required + 10;
+        T** newArray = new T*[newCapacity];
+        for (int i = 0; i < capacity; i++) {
+            newArray[i] = array[i];
+        }
+        delete[] array;
+        array = newArray;
+        capacity = newCapacity;
+    } 
+    catch (const bad_alloc& e) {
+        throw runtime_error("Failed to resize array: memory allocation failed");
+    }
+}
+
+class NameIndex {
+    private:
+        static const int EMPTY = -1;
+        static const int DELETED = -2;
+
+        struct Slot {
+            InternedString key;
+            int value = EMPTY;
+            unsigned long long hash = 0;
+        };
+
+        Slot* slots;
+        int capacity;
+        int count;
+        int used;
+
+        int probe(std::string_view key, unsigned long long hash) const {
+            int mask = capacity - 1;
+            int i = static_cast<int>(hash & mask);
+            while (slots[i].value != EMPTY) {
+                if (slots[i].value != DELETED && slots[i].hash == hash && slots[i].key.view() == key) return i;
+                i = (i + 1) & mask;
+            }
+            return -1;
+        }
+
+        void rehash(int newCapacity) {
+            Slot* oldSlots = slots;
+            int oldCapacity = capacity;
+            slots = new Slot[newCapacity];
+            capacity = newCapacity;
+            used = count;
+            int mask = capacity - 1;
+            for (int i = 0; i < oldCapacity; i++) {
+                if (oldSlots[i].value < 0) continue;
+                int j = static_cast<int>(oldSlots[i].hash & mask);
+                while (slots[j].value != EMPTY) j = (j + 1) & mask;
+                slots[j] = oldSlots[i];
+            }
+            delete[] oldSlots;
+        }
+
+    public:
+        NameIndex(int initialCapacity = 16) : count(0), used(0) {
+            capacity = 16;
+            while (capacity < initialCapacity) capacity *= 2;
+            slots = new Slot[capacity];
+        }
+
+        NameIndex(const NameIndex&) = delete;
+        NameIndex& operator=(const NameIndex&) = delete;
+
+        ~NameIndex() { delete[] slots; }
+
+        int size() const { return count; }
+
+        int find(std::string_view key) const {
+            int i = probe(key, hashName(key));
+            return i < 0 ? EMPTY : slots[i].value;
+        }
+
+        int find(InternedString key) const { return find(key.view()); }
+
+        void insert(InternedString key, int value) {
+            if (value < 0) throw invalid_argument("Index values must be non-negative");
+            if ((used + 1) * 10 >= capacity * 7) {
+                rehash(count * 2 >= capacity / 2 ? capacity * 2 : capacity);
+            }
+            unsigned long long hash = hashName(key.view());
+            int mask = capacity - 1;
+            int i = static_cast<int>(hash & mask);
+            int firstDeleted = -1;
+            while (slots[i].value != EMPTY) {
+                if (slots[i].value == DELETED) {
+                    if (firstDeleted < 0) firstDeleted = i;
+                } else if (slots[i].key == key) {
+                    slots[i].value = value;
+                    return;
+                }
+                i = (i + 1) & mask;
+            }
+            if (firstDeleted >= 0) {
+                i = firstDeleted;
+            } else {
+                used++;
+            }
+            slots[i].key = key;
+            slots[i].hash = hash;
+            slots[i].value = value;
+            count++;
+        }
+
+        bool erase(InternedString key) {
+            int i = probe(key.view(), hashName(key.view()));
+            if (i < 0) return false;
+            slots[i].key = InternedString();
+            slots[i].value = DELETED;
+            count--;
+            return true;
+        }
+
+        void clear() {
+            delete[] slots;
+            slots = new Slot[capacity];
+            count = 0;
+            used = 0;
+        }
+};
+
+enum MarketType : uint8_t { MARKET_EMPTY = 0, MARKET_CRYPTO, MARKET_UTILITY, MARKET_STABLE, MARKET_TYPES };
+
+struct MarketSummary {
+    int count[MARKET_TYPES];
+    double value[MARKET_TYPES];
+    long long marketCap[MARKET_TYPES];
+};
+
+// Column-per-field copy of the asset table for analytics; prices are kept as doubles, the exact
+// Amounts stay on the assets. Rows are AssetIds; empty rows are all zero, and the columns are
+// padded to whole blocks so the scans below need no tail loop or branches.
+class MarketTable {
+    private:
+        static const int BLOCK = 8;
+        static const size_t ALIGNMENT = 64;
+        // Rows per task-pool chunk in the column scans; a multiple of BLOCK.
+        static const int SCAN_GRAIN = 1 << 16;
+
+        double* prices;
+        float* multipliers;
+        int64_t* marketCaps;
+        uint8_t* types;
+        int numRows;
+        int capacity;
+
+        template <typename T>
+        static void regrowColumn(T*& column, int used, int newCapacity) {
+            T* grown = static_cast<T*>(::operator new[](newCapacity * sizeof(T), std::align_val_t(ALIGNMENT)));
+            if (used > 0) memcpy(grown, column, used * sizeof(T));
+            memset(grown + used, 0, (newCapacity - used) * sizeof(T));
+            ::operator delete[](column, std::align_val_t(ALIGNMENT));
+            column = grown;
+        }
+
+        template <typename T>
+        static void freeColumn(T*& column) {
+            ::operator delete[](column, std::align_val_t(ALIGNMENT));
+            column = nullptr;
+        }
+
+        void grow(int required) {
+            if (required <= capacity) return;
+            int newCapacity = std::max(capacity * 2, (required + BLOCK - 1) / BLOCK * BLOCK);
+            regrowColumn(prices, numRows, newCapacity);
+            regrowColumn(multipliers, numRows, newCapacity);
+            regrowColumn(marketCaps, numRows, newCapacity);
+            regrowColumn(types, numRows, newCapacity);
+            capacity = newCapacity;
+        }
+
+        int paddedRows() const { return (numRows + BLOCK - 1) / BLOCK * BLOCK; }
+
+        static bool simd;
+
+        static bool detectSimd() {
+#ifdef SIMD_X86
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        int firstInvalidScalar(const int* rows, const Amount* newPrices, int count) const {
+            for (int i = 0; i < count; i++) {
+                if (rows[i] < 0 || rows[i] >= numRows || types[rows[i]] == MARKET_EMPTY || newPrices[i].isNegative()) return i;
+            }
+            return count;
+        }
+
+#ifdef SIMD_X86
+        // Live rows always have a non-zero multiplier, so one masked gather checks that every id is in use.
+        // A negative Amount has the sign bit of its high word set; OR-ing the eight amounts exposes it.
+        SIMD_TARGET("avx2") int firstInvalidAvx2(const int* rows, const Amount* newPrices, int count) const {
+            static_assert(sizeof(Amount) == 16, "Amount is one 128-bit word");
+            const __m256i limit = _mm256_set1_epi32(numRows);
+            const __m256i minusOne = _mm256_set1_epi32(-1);
+            const __m256 zero = _mm256_setzero_ps();
+            int i = 0;
+            for (; i + BLOCK <= count; i += BLOCK) {
+                __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + i));
+                __m256i inRange = _mm256_and_si256(_mm256_cmpgt_epi32(ids, minusOne), _mm256_cmpgt_epi32(limit, ids));
+                __m256 multiplier = _mm256_mask_i32gather_ps(zero, multipliers, ids, _mm256_castsi256_ps(inRange), 4);
+                const __m256i* amounts = reinterpret_cast<const __m256i*>(newPrices + i);
+                __m256i words = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256(amounts), _mm256_loadu_si256(amounts + 1)),
+                                                _mm256_or_si256(_mm256_loadu_si256(amounts + 2), _mm256_loadu_si256(amounts + 3)));
+                bool negative = _mm256_movemask_pd(_mm256_castsi256_pd(words)) & 0xA;
+                if (negative || _mm256_movemask_ps(_mm256_cmp_ps(multiplier, zero, _CMP_EQ_OQ))) break;
+            }
+            return i + firstInvalidScalar(rows + i, newPrices + i, count - i);
+        }
+
+        SIMD_TARGET("avx2") void positionValuesAvx2(const int* rows, const double* quantities, int count, double* out) const {
+            const __m256d zero = _mm256_setzero_pd();
+            const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+            int i = 0;
+            for (; i + BLOCK <= count; i += BLOCK) {
+                __m256d low = _mm256_mask_i32gather_pd(zero, prices, _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + i)), all, 8);
+                __m256d high = _mm256_mask_i32gather_pd(zero, prices, _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows + i + 4)), all, 8);
+                _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(quantities + i), low));
+                _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(_mm256_loadu_pd(quantities + i + 4), high));
+            }
+            for (; i < count; i++) out[i] = quantities[i] * prices[rows[i]];
+        }
+#endif
+
+    public:
+        MarketTable() : prices(nullptr), multipliers(nullptr), marketCaps(nullptr), types(nullptr), numRows(0), capacity(0) {}
+
+        MarketTable(const MarketTable&) = delete;
+        MarketTable& operator=(const MarketTable&) = delete;
+
+        ~MarketTable() {
+            freeColumn(prices);
+            freeColumn(multipliers);
+            freeColumn(marketCaps);
+            freeColumn(types);
+        }
+
+        static const char* typeName(MarketType type) {
+            switch (type) {
+                case MARKET_CRYPTO: return "Cryptocurrencies";
+                case MARKET_UTILITY: return "Utility coins";
+                case MARKET_STABLE: return "Stable coins";
+                default: return "Empty";
+            }
+        }
+
+        static MarketType typeOf(const CryptoCurrency& asset) {
+            if (dynamic_cast<const UtilityCoin*>(&asset)) return MARKET_UTILITY;
+            if (dynamic_cast<const StableCoin*>(&asset)) return MARKET_STABLE;
+            return MARKET_CRYPTO;
+        }
+
+        int getNumRows() const { return numRows; }
+
+        void reserve(int rows) { grow(rows); }
+
+        static bool isSimdAvailable() { return detectSimd(); }
+
+        static bool usesSimd() { return simd; }
+
+        static bool setSimd(bool enabled) {
+            simd = enabled && detectSimd();
+            return simd;
+        }
+
+        void set(int row, double price, long long marketCap, MarketType type, float multiplier) {
+            if (row < 0) throw out_of_range("Market row cannot be negative");
+            if (type != MARKET_EMPTY && !(multiplier > 0)) throw invalid_argument("Market multiplier must be positive");
+            grow(row + 1);
+            prices[row] = price;
+            multipliers[row] = multiplier;
+            marketCaps[row] = marketCap;
+            types[row] = type;
+            numRows = std::max(numRows, row + 1);
+        }
+
+        void set(int row, const CryptoCurrency& asset) {
+            set(row, asset.getPrice().toDouble(), asset.getMarketCap(), typeOf(asset), static_cast<float>(asset.getValueMultiplier()));
+        }
+
+        void erase(int row) { set(row, 0.0, 0, MARKET_EMPTY, 0.0f); }
+
+        void setPrice(int row, double price) {
+            if (row < 0 || row >= numRows || types[row] == MARKET_EMPTY) throw out_of_range("Unknown market row");
+            prices[row] = price;
+        }
+
+        // Returns the index of the first tick with an unknown row or a negative price, or count.
+        int firstInvalid(const int* rows, const Amount* newPrices, int count) const {
+#ifdef SIMD_X86
+            if (simd) return firstInvalidAvx2(rows, newPrices, count);
+#endif
+            return firstInvalidScalar(rows, newPrices, count);
+        }
+
+        // Applies a batch of price ticks in order; the whole batch is checked first so a bad tick changes nothing.
+        void setPrices(const int* rows, const Amount* newPrices, int count) {
+            int bad = firstInvalid(rows, newPrices, count);
+            if (bad < count) {
+                if (rows[bad] < 0 || rows[bad] >= numRows || types[rows[bad]] == MARKET_EMPTY) {
+                    throw out_of_range("Unknown asset id " + to_string(rows[bad]) + " in price tick " + to_string(bad));
+                }
+                throw invalid_argument("Price cannot be negative (price tick " + to_string(bad) + ")");
+            }
+            for (int i = 0; i < count; i++) prices[rows[i]] = newPrices[i].toDouble();
+        }
+
+        // out[i] = quantities[i] * price of rows[i]; every row must be below getNumRows().
+        void positionValues(const int* rows, const double* quantities, int count, double* out) const {
+#ifdef SIMD_X86
+            if (simd) {
+                positionValuesAvx2(rows, quantities, count, out);
+                return;
+            }
+#endif
+            for (int i = 0; i < count; i++) out[i] = quantities[i] * prices[rows[i]];
+        }
+
+        void clear() {
+            if (numRows > 0) {
+                memset(prices, 0, numRows * sizeof(double));
+                memset(multipliers, 0, numRows * sizeof(float));
+                memset(marketCaps, 0, numRows * sizeof(int64_t));
+                memset(types, 0, numRows);
+            }
+            numRows = 0;
+        }
+
+        double getPrice(int row) const { return prices[row]; }
+        double getMarketValue(int row) const { return prices[row] * multipliers[row]; }
+        long long getMarketCap(int row) const { return marketCaps[row]; }
+        MarketType getType(int row) const { return static_cast<MarketType>(types[row]); }
+
+        double totalMarketValue() const {
+            return parallelReduce(0, paddedRows(), SCAN_GRAIN, 0.0, [this](int64_t first, int64_t last) {
+                double lanes[BLOCK] = {};
+                for (int64_t base = first; base < last; base += BLOCK) {
+                    for (int j = 0; j < BLOCK; j++) lanes[j] += prices[base + j] * multipliers[base + j];
+                }
+                double total = 0;
+                for (int j = 0; j < BLOCK; j++) total += lanes[j];
+                return total;
+            }, std::plus<double>());
+        }
+
+        long long totalMarketCap() const {
+            return parallelReduce(0, paddedRows(), SCAN_GRAIN, 0LL, [this](int64_t first, int64_t last) {
+                int64_t lanes[BLOCK] = {};
+                for (int64_t base = first; base < last; base += BLOCK) {
+                    for (int j = 0; j < BLOCK; j++) lanes[j] += marketCaps[base + j];
+                }
+                long long total = 0;
+                for (int j = 0; j < BLOCK; j++) total += lanes[j];
+                return total;
+            }, std::plus<long long>());
+        }
+
+        MarketSummary summarize() const {
+            MarketSummary empty = {};
+            auto scan = [this](int64_t first, int64_t last) {
+                MarketSummary summary = {};
+                for (int type = MARKET_CRYPTO; type < MARKET_TYPES; type++) {
+                    int64_t counts[BLOCK] = {};
+                    double values[BLOCK] = {};
+                    int64_t caps[BLOCK] = {};
+                    for (int64_t base = first; base < last; base += BLOCK) {
+                        for (int j = 0; j < BLOCK; j++) {
+                            int64_t match = -static_cast<int64_t>(types[base + j] == type);
+                            counts[j] -= match;
+                            values[j] += prices[base + j] * multipliers[base + j] * static_cast<double>(-match);
+                            caps[j] += marketCaps[base + j] & match;
+                        }
+                    }
+                    for (int j = 0; j < BLOCK; j++) {
+                        summary.count[type] += counts[j];
+                        summary.value[type] += values[j];
+                        summary.marketCap[type] += caps[j];
+                    }
+                }
+                return summary;
+            };
+            auto combine = [](MarketSummary a, const MarketSummary& b) {
+                for (int type = 0; type < MARKET_TYPES; type++) {
+                    a.count[type] += b.count[type];
+                    a.value[type] += b.value[type];
+                    a.marketCap[type] += b.marketCap[type];
+                }
+                return a;
+            };
+            return parallelReduce(0, paddedRows(), SCAN_GRAIN, empty, scan, combine);
+        }
+
+        // Writes the rows of the n most valuable assets to rows, highest first; returns how many.
+        int topByValue(int n, int* rows) const {
+            if (n <= 0) return 0;
+            auto ranksAbove = [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            };
+            std::vector<std::pair<double, int>> best;
+            best.reserve(n + 1);
+            double threshold = -1.0;
+            for (int base = 0; base < paddedRows(); base += BLOCK) {
+                double values[BLOCK];
+                int candidates = 0;
+                for (int j = 0; j < BLOCK; j++) {
+                    values[j] = prices[base + j] * multipliers[base + j];
+                    candidates |= values[j] >= threshold;
+                }
+                if (!candidates) continue;
+                for (int j = 0; j < BLOCK; j++) {
+                    if (values[j] < threshold || types[base + j] == MARKET_EMPTY) continue;
+                    best.emplace_back(values[j], base + j);
+                    std::push_heap(best.begin(), best.end(), ranksAbove);
+                    if (static_cast<int>(best.size()) > n) {
+                        std::pop_heap(best.begin(), best.end(), ranksAbove);
+                        best.pop_back();
+                    }
+                    if (static_cast<int>(best.size()) == n) threshold = best.front().first;
+                }
+            }
+            std::sort(best.begin(), best.end(), ranksAbove);
+            for (size_t i = 0; i < best.size(); i++) rows[i] = best[i].second;
+            return static_cast<int>(best.size());
+        }
+};
+
+bool MarketTable::simd = MarketTable::detectSimd();
+
+// Prices of the registered assets for readers on other threads: one updater publishes ticks, in batches where it can,
+// while any number of readers value portfolios without a lock. Every price has its own sequence number, odd while a
+// write is in flight, so a reader never sees a torn Amount and retries only when it races a write of that same price.
+// Pages are allocated once and never move, so the book can grow under readers without epochs, and each slot records
+// the registered object it prices so readers never look at the registry's own arrays.
+class PriceBook {
+    private:
+        static const int PAGE_SHIFT = 12;
+        static const int PAGE_SIZE = 1 << PAGE_SHIFT;
+        static const int PAGE_MASK = PAGE_SIZE - 1;
+        static const int MAX_PAGES = 1 << 12;
+
+        struct alignas(32) Slot {
+            std::atomic<uint32_t> sequence{0};
+            std::atomic<uint64_t> low{0};
+            std::atomic<int64_t> high{0};
+            std::atomic<const DigitalAsset*> owner{nullptr};
+        };
+
+        std::atomic<Slot*> pages[MAX_PAGES];
+        // Odd while a batch is being published; see getGeneration.
+        std::atomic<uint64_t> generation;
+        std::mutex updater;
+
+        const Slot* find(AssetId id) const {
+            if (id < 0 || id >= MAX_PAGES * PAGE_SIZE) return nullptr;
+            const Slot* page = pages[id >> PAGE_SHIFT].load(std::memory_order_acquire);
+            return page ? page + (id & PAGE_MASK) : nullptr;
+        }
+
+        Slot& slotFor(AssetId id) {
+            if (id < 0 || id >= MAX_PAGES * PAGE_SIZE) throw out_of_range("Asset id " + to_string(id) + " is outside the price book");
+            Slot* page = pages[id >> PAGE_SHIFT].load(std::memory_order_relaxed);
+            if (!page) {
+                page = new Slot[PAGE_SIZE];
+                pages[id >> PAGE_SHIFT].store(page, std::memory_order_release);
+            }
+            return page[id & PAGE_MASK];
+        }
+
+        static void write(Slot& slot, const Amount& price, const DigitalAsset* owner) {
+            uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.low.store(price.lowWord(), std::memory_order_relaxed);
+            slot.high.store(price.highWord(), std::memory_order_relaxed);
+            slot.owner.store(owner, std::memory_order_relaxed);
+            slot.sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        static void write(Slot& slot, const Amount& price) { write(slot, price, slot.owner.load(std::memory_order_relaxed)); }
+
+        static Amount load(const Slot& slot, const DigitalAsset*& owner) {
+            while (true) {
+                uint32_t before = slot.sequence.load(std::memory_order_acquire);
+                uint64_t low = slot.low.load(std::memory_order_relaxed);
+                int64_t high = slot.high.load(std::memory_order_relaxed);
+                owner = slot.owner.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (!(before & 1) && slot.sequence.load(std::memory_order_relaxed) == before) return Amount::fromWords(low, high);
+                std::this_thread::yield();
+            }
+        }
+
+    public:
+        PriceBook() : generation(0) {
+            for (std::atomic<Slot*>& page : pages) page.store(nullptr, std::memory_order_relaxed);
+        }
+
+        PriceBook(const PriceBook&) = delete;
+        PriceBook& operator=(const PriceBook&) = delete;
+
+        ~PriceBook() {
+            for (std::atomic<Slot*>& page : pages) delete[] page.load(std::memory_order_relaxed);
+        }
+
+        // Ids never published or since withdrawn read as zero.
+        Amount read(AssetId id) const {
+            const Slot* slot = find(id);
+            const DigitalAsset* owner;
+            return slot ? load(*slot, owner) : Amount();
+        }
+
+        // Sets price to the price of id and returns true if asset is the object registered under id.
+        bool quote(AssetId id, const DigitalAsset* asset, Amount& price) const {
+            const Slot* slot = find(id);
+            if (!slot) return false;
+            const DigitalAsset* owner;
+            Amount quoted = load(*slot, owner);
+            if (owner != asset) return false;
+            price = quoted;
+            return true;
+        }
+
+        // Even between batches; a reader that sees the same even generation before and after a pass over several prices
+        // read them all from one state of the book.
+        uint64_t getGeneration() const { return generation.load(std::memory_order_acquire); }
+
+        void publish(AssetId id, const Amount& price) { publish(&id, &price, 1); }
+
+        // Starts pricing id for the registered object owner.
+        void enlist(AssetId id, const DigitalAsset* owner, const Amount& price) {
+            std::lock_guard<std::mutex> lock(updater);
+            write(slotFor(id), price, owner);
+            generation.fetch_add(2, std::memory_order_release);
+        }
+
+        // Forgets the object registered under id; its price reads as zero from now on.
+        void withdraw(AssetId id) { enlist(id, nullptr, Amount()); }
+
+        // Publishes a batch of ticks in order, taking the updater lock and bumping the generation once for all of them.
+        void publish(const AssetId* ids, const Amount* prices, int count) {
+            std::lock_guard<std::mutex> lock(updater);
+            generation.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (int i = 0; i < count; i++) write(slotFor(ids[i]), prices[i]);
+            generation.fetch_add(1, std::memory_order_release);
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(updater);
+            for (std::atomic<Slot*>& entry : pages) {
+                Slot* page = entry.load(std::memory_order_relaxed);
+                for (int i = 0; page && i < PAGE_SIZE; i++) write(page[i], Amount(), nullptr);
+            }
+            generation.fetch_add(2, std::memory_order_release);
+        }
+};
+
+class AssetRegistry {
+    private:
+        static AssetRegistry* instance;
+        CryptoCurrency** assets;
+        int numSlots;
+        int capacity;
+        int numLive;
+        NameIndex byName;
+        NameIndex bySymbol;
+        MarketTable market;
+        PriceBook book;
+        // The repriced set is written by the updater and drained by readers revaluing wallets, under repricedLock.
+        std::vector<AssetId> repriced;
+        std::vector<uint8_t> isRepriced;
+        bool repricedAll;
+        std::mutex repricedLock;
+
+        AssetRegistry() : assets(new CryptoCurrency*[16]), numSlots(0), capacity(16), numLive(0), repricedAll(false) {}
+
+        void noteRepricedLocked(AssetId id) {
+            if (id >= static_cast<int>(isRepriced.size())) isRepriced.resize(numSlots);
+            if (isRepriced[id]) return;
+            isRepriced[id] = 1;
+            repriced.push_back(id);
+        }
+
+        void noteRepriced(AssetId id) {
+            std::lock_guard<std::mutex> guard(repricedLock);
+            noteRepricedLocked(id);
+        }
+
+    public:
+        static AssetRegistry* getInstance() {
+            if (instance == nullptr) { instance = new AssetRegistry();}
+            return instance;
+        }
+
+        AssetRegistry(const AssetRegistry&) = delete;
+        AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+        ~AssetRegistry() {
+            clear();
+            delete[] assets;
+        }
+
+        int getNumAssets() const { return numLive; }
+
+        int getNumSlots() const { return numSlots; }
+
+        AssetId add(CryptoCurrency* asset) {
+            if (!asset || !asset->getName()) throw invalid_argument("Asset must have a name");
+            if (byName.find(asset->getName()) >= 0) {
+                throw invalid_argument(string("Asset name already registered: ") + asset->getName());
+            }
+            if (asset->getSymbol() && bySymbol.find(asset->getSymbol()) >= 0) {
+                throw invalid_argument(string("Asset symbol already registered: ") + asset->getSymbol());
+            }
+            resizeArray(assets, capacity, numSlots + 1);
+            AssetId id = numSlots++;
+            assets[id] = asset;
+            asset->assetId = id;
+            market.set(id, *asset);
+            book.enlist(id, asset, asset->getPrice());
+            byName.insert(asset->getNameString(), id);
+            if (asset->getSymbol()) bySymbol.insert(asset->getSymbolString(), id);
+            numLive++;
+            return id;
+        }
+
+        AssetId skipSlot() {
+            resizeArray(assets, capacity, numSlots + 1);
+            assets[numSlots] = nullptr;
+            market.erase(numSlots);
+            return numSlots++;
+        }
+
+        CryptoCurrency* get(AssetId id) const {
+            if (id < 0 || id >= numSlots) return nullptr;
+            return assets[id];
+        }
+
+        const MarketTable& getMarketTable() const { return market; }
+
+        const PriceBook& getPriceBook() const { return book; }
+
+        // Applies price ticks to the market table, the price book and the asset objects; nothing changes if any tick is
+        // invalid.
+        void reprice(const AssetId* ids, const Amount* prices, int count) {
+            market.setPrices(ids, prices, count);
+            book.publish(ids, prices, count);
+            for (int i = 0; i < count; i++) assets[ids[i]]->price = prices[i];
+            std::lock_guard<std::mutex> guard(repricedLock);
+            for (int i = 0; i < count; i++) noteRepricedLocked(ids[i]);
+        }
+
+        // Refreshes the market row of an asset whose price changed and remembers it for takeRepriced.
+        void priceChanged(const DigitalAsset* asset) {
+            refresh(asset);
+            AssetId id = asset->getAssetId();
+            if (id >= 0 && id < numSlots && static_cast<const DigitalAsset*>(assets[id]) == asset) {
+                book.publish(id, asset->getPrice());
+                noteRepriced(id);
+            }
+        }
+
+        // Moves the assets repriced or removed since the last call into ids, each once.
+        // Returns false instead when every asset may have changed (after clear()).
+        bool takeRepriced(std::vector<AssetId>& ids) {
+            std::lock_guard<std::mutex> guard(repricedLock);
+            ids.clear();
+            for (AssetId id : repriced) isRepriced[id] = 0;
+            bool all = repricedAll;
+            if (!all) ids.swap(repriced);
+            repriced.clear();
+            repricedAll = false;
+            return !all;
+        }
+
+        // Re-reads a registered asset into the market table after its price or market cap changed.
+        void refresh(const DigitalAsset* asset) {
+            AssetId id = asset->getAssetId();
+            if (id >= 0 && id < numSlots && assets[id] && static_cast<const DigitalAsset*>(assets[id]) == asset) market.set(id, *assets[id]);
+        }
+
+        AssetId findByName(std::string_view name) const { return byName.find(name); }
+
+        AssetId findBySymbol(std::string_view symbol) const { return bySymbol.find(symbol); }
+
+        AssetId resolve(std::string_view key) const {
+            AssetId id = byName.find(key);
+            return id >= 0 ? id : bySymbol.find(key);
+        }
+
+        void rename(AssetId id, const char* name) {
+            CryptoCurrency* asset = get(id);
+            if (!asset) throw out_of_range("Unknown asset id");
+            if (!name) throw invalid_argument("Name cannot be null");
+            AssetId existing = byName.find(name);
+            if (existing >= 0 && existing != id) throw invalid_argument(string("Asset name already registered: ") + name);
+            byName.erase(asset->getNameString());
+            asset->setName(name);
+            byName.insert(asset->getNameString(), id);
+        }
+
+        void changeSymbol(AssetId id, const char* symbol) {
+            CryptoCurrency* asset = get(id);
+            if (!asset) throw out_of_range("Unknown asset id");
+            if (!symbol) throw invalid_argument("Symbol cannot be null.");
+            AssetId existing = bySymbol.find(symbol);
+            if (existing >= 0 && existing != id) throw invalid_argument(string("Asset symbol already registered: ") + symbol);
+            if (asset->getSymbol()) bySymbol.erase(asset->getSymbolString());
+            asset->setSymbol(symbol);
+            bySymbol.insert(asset->getSymbolString(), id);
+        }
+
+        void remove(AssetId id) {
+            CryptoCurrency* asset = get(id);
+            if (!asset) return;
+            byName.erase(asset->getNameString());
+            if (asset->getSymbol()) bySymbol.erase(asset->getSymbolString());
+            noteRepriced(id);
+            assets[id] = nullptr;
+            market.erase(id);
+            book.withdraw(id);
+            numLive--;
+            delete asset;
+        }
+
+        void clear() {
+            for (int i = 0; i < numSlots; i++) {
+                delete assets[i];
+                assets[i] = nullptr;
+            }
+            numSlots = 0;
+            numLive = 0;
+            byName.clear();
+            bySymbol.clear();
+            market.clear();
+            book.clear();
+            std::lock_guard<std::mutex> guard(repricedLock);
+            for (AssetId id : repriced) isRepriced[id] = 0;
+            repriced.clear();
+            repricedAll = true;
+        }
+};
+
+AssetRegistry* AssetRegistry::instance = nullptr;
+
+void DigitalAsset::setPrice(Amount price) {
+    if (price.isNegative()) { throw std::invalid_argument("Price cannot be negative.");}
+    this->price = price;
+    if (assetId != INVALID_ASSET) AssetRegistry::getInstance()->priceChanged(this);
+}
+
+Amount DigitalAsset::getQuotedPrice() const {
+    Amount quoted;
+    if (assetId != INVALID_ASSET && AssetRegistry::getInstance()->getPriceBook().quote(assetId, this, quoted)) return quoted;
+    return price;
+}
+
+void MarketEntity::setMarketCap(long long marketCap) {
+    if (marketCap < 0) {
+        throw std::invalid_argument("Market cap cannot be negative.");
+    }
+    this->marketCap = marketCap;
+    if (assetId != INVALID_ASSET) AssetRegistry::getInstance()->refresh(this);
+}
+
+// Plain value copies of the three asset classes: no vptrs or virtual-base offsets, so an AssetStore can hold them
+// contiguously and std::visit dispatches on the variant index. The methods mirror the classes they copy.
+struct CryptoValue {
+    Amount price;
+    long long marketCap;
+    InternedString name;
+    InternedString symbol;
+    AssetId id;
+    int decimals;
+    char currencyType;
+
+    static const int VALUE_MULTIPLIER = CryptoCurrency::VALUE_MULTIPLIER;
+
+    explicit CryptoValue(const CryptoCurrency& asset)
+        : price(asset.getPrice()), marketCap(asset.getMarketCap()), name(asset.getNameString()), symbol(asset.getSymbolString()),
+          id(asset.getAssetId()), decimals(asset.getDecimals()), currencyType(asset.getCurrencyType()) {}
+
+    void displayInfo(std::ostream& os) const { CryptoCurrency::writeInfo(os, name, symbol, price, marketCap, currencyType); }
+    Amount calculateMarketValue() const { return price * VALUE_MULTIPLIER; }
+};
+
+struct UtilityValue : CryptoValue {
+    InternedString useCase;
+
+    static const int VALUE_MULTIPLIER = UtilityCoin::VALUE_MULTIPLIER;
+
+    explicit UtilityValue(const UtilityCoin& asset) : CryptoValue(asset), useCase(asset.getUseCaseString()) {}
+
+    void displayInfo(std::ostream& os) const {
+        CryptoValue::displayInfo(os);
+        UtilityCoin::writeUseCase(os, useCase);
+    }
+    Amount calculateMarketValue() const { return price * VALUE_MULTIPLIER; }
+};
+
+struct StableValue : CryptoValue {
+    InternedString backedBy;
+
+    static const int VALUE_MULTIPLIER = StableCoin::VALUE_MULTIPLIER;
+
+    explicit StableValue(const StableCoin& asset) : CryptoValue(asset), backedBy(asset.getBackedByString()) {}
+
+    void displayInfo(std::ostream& os) const {
+        CryptoValue::displayInfo(os);
+        StableCoin::writeBackedBy(os, backedBy);
+    }
+    Amount calculateMarketValue() const { return price * VALUE_MULTIPLIER; }
+};
+
+typedef std::variant<CryptoValue, UtilityValue, StableValue> AssetValue;
+
+// Contiguous, devirtualized copy of the registry for read-mostly scans; rebuild it after the registry changes.
+class AssetStore {
+    private:
+        static const int REDUCE_GRAIN = 4096;
+
+        std::vector<AssetValue> values;
+
+    public:
+        static AssetValue toValue(const CryptoCurrency& asset) {
+            if (const UtilityCoin* utility = dynamic_cast<const UtilityCoin*>(&asset)) return UtilityValue(*utility);
+            if (const StableCoin* stable = dynamic_cast<const StableCoin*>(&asset)) return StableValue(*stable);
+            return CryptoValue(asset);
+        }
+
+        void add(const CryptoCurrency& asset) { values.push_back(toValue(asset)); }
+
+        void build(const AssetRegistry& registry) {
+            values.clear();
+            values.reserve(registry.getNumAssets());
+            for (AssetId id = 0; id < registry.getNumSlots(); id++) {
+                if (const CryptoCurrency* asset = registry.get(id)) add(*asset);
+            }
+        }
+
+        void clear() { values.clear(); }
+        int size() const { return static_cast<int>(values.size()); }
+        const AssetValue& operator[](int index) const { return values[index]; }
+
+        template <typename Visitor>
+        void forEach(Visitor visitor) const {
+            for (const AssetValue& value : values) std::visit(visitor, value);
+        }
+
+        static void displayInfo(const AssetValue& value, std::ostream& os) {
+            std::visit([&os](const auto& asset) { asset.displayInfo(os); }, value);
+        }
+
+        static Amount calculateMarketValue(const AssetValue& value) {
+            return std::visit([](const auto& asset) { return asset.calculateMarketValue(); }, value);
+        }
+
+        Amount totalMarketValue() const {
+            auto partial = [this](int64_t first, int64_t last) {
+                AmountSum total;
+                for (int64_t i = first; i < last; i++) total.add(calculateMarketValue(values[i]));
+                return total;
+            };
+            auto combine = [](AmountSum a, const AmountSum& b) {
+                a.add(b);
+                return a;
+            };
+            return parallelReduce(0, static_cast<int64_t>(values.size()), REDUCE_GRAIN, AmountSum(), partial, combine).total();
+        }
+};
+
+struct WalletId {
+    int index;
+    unsigned int generation;
+
+    bool isValid() const { return index >= 0; }
+    bool operator==(const WalletId& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const WalletId& other) const { return !(*this == other); }
+};
+
+const WalletId INVALID_WALLET = {-1, 0};
+
+struct Holding {
+    AssetId asset;
+    Amount quantity;
+};
+
+class Holdings {
+    private:
+        static const int INLINE_CAPACITY = 4;
+
+        Holding inlineItems[INLINE_CAPACITY];
+        Holding* items;
+        int count;
+        int capacity;
+
+        int lowerBound(AssetId asset) const {
+            int lo = 0, hi = count;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (items[mid].asset < asset) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        }
+
+        static void checkQuantity(const Amount& quantity) {
+            if (quantity.isNegative()) throw invalid_argument("Quantity must be a non-negative number");
+        }
+
+        void grow(int required) {
+            if (required <= capacity) return;
+            int newCapacity = capacity * 2;
+            while (newCapacity < required) newCapacity *= 2;
+            Holding* newItems = new Holding[newCapacity];
+            std::copy(items, items + count, newItems);
+            if (items != inlineItems) delete[] items;
+            items = newItems;
+            capacity = newCapacity;
+        }
+
+    public:
+        Holdings() : items(inlineItems), count(0), capacity(INLINE_CAPACITY) {}
+
+        Holdings(const Holdings& other) : items(inlineItems), count(0), capacity(INLINE_CAPACITY) {
+            grow(other.count);
+            std::copy(other.items, other.items + other.count, items);
+            count = other.count;
+        }
+
+        Holdings(Holdings&& other) noexcept : items(inlineItems), count(0), capacity(INLINE_CAPACITY) {
+            *this = std::move(other);
+        }
+
+        Holdings& operator=(const Holdings& other) {
+            if (this != &other) {
+                count = 0;
+                grow(other.count);
+                std::copy(other.items, other.items + other.count, items);
+                count = other.count;
+            }
+            return *this;
+        }
+
+        Holdings& operator=(Holdings&& other) noexcept {
+            if (this == &other) return *this;
+            if (items != inlineItems) delete[] items;
+            if (other.items == other.inlineItems) {
+                std::copy(other.items, other.items + other.count, inlineItems);
+                items = inlineItems;
+                capacity = INLINE_CAPACITY;
+            } else {
+                items = other.items;
+                capacity = other.capacity;
+                other.items = other.inlineItems;
+                other.capacity = INLINE_CAPACITY;
+            }
+            count = other.count;
+            other.count = 0;
+            return *this;
+        }
+
+        ~Holdings() {
+            if (items != inlineItems) delete[] items;
+        }
+
+        int size() const { return count; }
+
+        const Holding* begin() const { return items; }
+
+        const Holding* end() const { return items + count; }
+
+        const Holding& operator[](int index) const {
+            if (index < 0 || index >= count) throw out_of_range("Index out of range");
+            return items[index];
+        }
+
+        int indexOf(AssetId asset) const {
+            int i = lowerBound(asset);
+            return (i < count && items[i].asset == asset) ? i : -1;
+        }
+
+        Amount balance(AssetId asset) const {
+            int i = indexOf(asset);
+            return i >= 0 ? items[i].quantity : Amount();
+        }
+
+        Amount credit(AssetId asset, const Amount& quantity) {
+            if (asset < 0) throw invalid_argument("Unknown asset");
+            checkQuantity(quantity);
+            int i = lowerBound(asset);
+            if (i < count && items[i].asset == asset) return items[i].quantity += quantity;
+            if (quantity.isZero()) return Amount();
+            grow(count + 1);
+            std::copy_backward(items + i, items + count, items + count + 1);
+            items[i] = Holding{asset, quantity};
+            count++;
+            return quantity;
+        }
+
+        Amount debit(AssetId asset, const Amount& quantity) {
+            checkQuantity(quantity);
+            int i = indexOf(asset);
+            Amount held = i >= 0 ? items[i].quantity : Amount();
+            if (held < quantity) throw runtime_error("Insufficient balance");
+            if (i < 0) return Amount();
+            items[i].quantity -= quantity;
+            if (!items[i].quantity.isZero()) return items[i].quantity;
+            std::copy(items + i + 1, items + count, items + i);
+            count--;
+            return Amount();
+        }
+
+        void clear() { count = 0; }
+};
+
+class Wallet {
+    friend class WalletDirectory;
+
+    private:
+        WalletId walletId = INVALID_WALLET;
+        InternedString owner;
+        Holdings holdings;
+        int capacity;
+        bool isActive; 
+
+        // Tells the wallet directory this wallet's cached value is stale.
+        void changed();
+
+    public:
+        Wallet() : capacity(10), isActive(true) {}
+
+        Wallet(const char* owner) : owner(owner), capacity(10), isActive(true) {}
+
+        Wallet(const char* owner, int capacity) : owner(owner), capacity(capacity), isActive(true) {}
+
+        Wallet(InternedString owner, int capacity) : owner(owner), capacity(capacity), isActive(true) {}
+
+        Wallet(const Wallet& other) : owner(other.owner), holdings(other.holdings), capacity(other.capacity), isActive(other.isActive) {}
+
+        Wallet(Wallet&& other) noexcept : owner(other.owner), holdings(std::move(other.holdings)), capacity(other.capacity), isActive(other.isActive) {}
+
+        const char* getOwner() const { return owner.empty() ? nullptr : owner.c_str(); }
+
+        InternedString getOwnerString() const { return owner; }
+
+        WalletId getWalletId() const { return walletId; }
+        
+        int getNumCryptos() const { return holdings.size(); }
+        
+        int getCapacity() const { return capacity; }
+        
+        bool getIsActive() const { return isActive; } 
+
+        const Holdings& getHoldings() const { return holdings; }
+
+        void setOwner(const char* owner) {
+            if (!owner) throw invalid_argument("Owner cannot be null");
+            this->owner = InternedString(owner);
+        }
+
+        void setIsActive(bool isActive) { this->isActive = isActive;}
+
+        Amount credit(AssetId asset, const Amount& quantity) {
+            if (const CryptoCurrency* crypto = AssetRegistry::getInstance()->get(asset)) crypto->checkQuantity(quantity);
+            Amount held = holdings.credit(asset, quantity);
+            changed();
+            return held;
+        }
+
+        Amount debit(AssetId asset, const Amount& quantity) {
+            Amount held = holdings.debit(asset, quantity);
+            changed();
+            return held;
+        }
+
+        Amount balance(AssetId asset) const { return holdings.balance(asset); }
+
+        Amount valuation(const AssetRegistry& registry) const {
+            AmountSum total;
+            for (const Holding& holding : holdings) total.add(holding.quantity * registry.getPriceBook().read(holding.asset));
+            return total.total();
+        }
+
+        // The directory's cached valuation for registered wallets, recomputing only what changed; valuation() otherwise.
+        Amount value() const;
+
+        Wallet& operator=(const Wallet& other) {
+            if (this != &other) {
+                owner = other.owner;
+                holdings = other.holdings;
+                capacity = other.capacity;
+                isActive = other.isActive;
+                changed();
+            }
+            return *this;
+        }
+
+        Wallet& operator=(Wallet&& other) noexcept {
+            owner = other.owner;
+            holdings = std::move(other.holdings);
+            capacity = other.capacity;
+            isActive = other.isActive;
+            changed();
+            return *this;
+        }
+
+        bool operator==(const Wallet& other) const {return owner == other.owner && holdings.size() == other.holdings.size();}
+
+        bool operator<(const Wallet& other) const {return holdings.size() < other.holdings.size();}
+
+        Wallet operator+(const Wallet& other) const {
+            Wallet newWallet(owner, capacity + other.capacity);
+            newWallet.holdings = holdings;
+            for (const Holding& holding : other.holdings) {
+                newWallet.credit(holding.asset, holding.quantity);
+            }
+            return newWallet;
+        }
+
+        Wallet operator*(const Wallet& other) const {
+            Wallet newWallet(owner, capacity * other.capacity);
+            newWallet.holdings = holdings;
+            for (const Holding& holding : other.holdings) {
+                newWallet.credit(holding.asset, holding.quantity);
+            }
+            return newWallet;
+        }
+
+        Wallet& operator++() {
+            capacity += 10;
+            return *this;
+        }
+
+        Wallet operator++(int) {
+            Wallet temp = *this;
+            ++(*this);
+            return temp;
+        }
+    
+        int indexOf(AssetId asset) const { return holdings.indexOf(asset); }
+
+        const Holding& operator[](int index) const { return holdings[index]; }
+
+        friend ostream& operator<<(ostream& os, const Wallet& wallet);
+        friend istream& operator>>(istream& is, Wallet& wallet);
+};
+
+ostream& operator<<(ostream& os, const Holding& holding) {
+    const CryptoCurrency* crypto = AssetRegistry::getInstance()->get(holding.asset);
+    if (!crypto) return os << "<deleted asset>: " << holding.quantity;
+    os << crypto->getNameString();
+    if (crypto->getSymbol()) os << " (" << crypto->getSymbolString() << ")";
+    return os << ": " << holding.quantity << " @ " << crypto->getPrice() << " = " << holding.quantity * crypto->getPrice();
+}
+
+ostream& operator<<(ostream& os, const Wallet& wallet) {
+    os << "Owner: " << wallet.owner << "\n";
+    os << "Active: " << (wallet.isActive ? "Yes" : "No") << "\n";
+    os << "Holdings:\n";
+    for (const Holding& holding : wallet.holdings) {
+        os << "  " << holding << "\n";
+    }
+    os << "Value: " << wallet.value() << "\n";
+    return os;
+}
+istream& operator>>(istream& is, Wallet& wallet) {
+    char buffer[100];
+    cout << "Enter wallet owner name: ";
+    is >> buffer;
+    wallet.setOwner(buffer);
+
+    char activeStatus;
+    cout << "Is the wallet active? (y/n): ";
+    is >> activeStatus;
+    wallet.setIsActive(activeStatus == 'y' || activeStatus == 'Y');
+
+    return is;
+}
+
+// Holdings of many wallets flattened into columns, so a round of price ticks can be
+// marked to market with one gather pass instead of a registry lookup per holding.
+class PositionBook {
+    private:
+        std::vector<int> assets;
+        std::vector<double> quantities;
+        std::vector<int> offsets;
+        mutable std::vector<double> values;
+        int maxAsset;
+
+    public:
+        static const int WALLET_GRAIN = 4096;
+
+        PositionBook() : offsets(1, 0), maxAsset(-1) {}
+
+        void build(Wallet** wallets, int numWallets) {
+            assets.clear();
+            quantities.clear();
+            offsets.assign(1, 0);
+            maxAsset = -1;
+            for (int i = 0; i < numWallets; i++) {
+                for (const Holding& holding : wallets[i]->getHoldings()) {
+                    assets.push_back(holding.asset);
+                    quantities.push_back(holding.quantity.toDouble());
+                    maxAsset = std::max(maxAsset, holding.asset);
+                }
+                offsets.push_back(static_cast<int>(assets.size()));
+            }
+            values.resize(assets.size());
+        }
+
+        int getNumWallets() const { return static_cast<int>(offsets.size()) - 1; }
+
+        int getNumPositions() const { return static_cast<int>(assets.size()); }
+
+        // walletValues[i] matches wallets[i]->valuation() for the wallets the book was built from.
+        void markToMarket(const MarketTable& market, double* walletValues) const {
+            if (maxAsset >= market.getNumRows()) throw out_of_range("Position book refers to an unknown asset");
+            parallelFor(0, getNumWallets(), WALLET_GRAIN, [&](int64_t first, int64_t last) {
+                int begin = offsets[first];
+                market.positionValues(assets.data() + begin, quantities.data() + begin, offsets[last] - begin, values.data() + begin);
+                for (int64_t i = first; i < last; i++) {
+                    double total = 0;
+                    for (int k = offsets[i]; k < offsets[i + 1]; k++) total += values[k];
+                    walletValues[i] = total;
+                }
+            });
+        }
+};
+
+class WalletDirectory {
+    private:
+        struct Entry {
+            Wallet* wallet;
+            unsigned int generation;
+        };
+
+        static WalletDirectory* instance;
+        Entry* entries;
+        int numEntries;
+        int capacity;
+        int numLive;
+        int* freeSlots;
+        int numFree;
+        // Set from restoreSlots until finishRestore: the free list is left empty while wallets are put back.
+        bool restoring;
+        NameIndex byOwner;
+        // Cached valuations: values[i] is the value of slot i when it was last revalued, and total their sum.
+        // holders[a] lists the slots that held asset a when revalued (plus some that since sold it);
+        // listed[i] is the sorted set of assets whose holder list contains slot i. stale[i] is claimed by whoever first
+        // marks slot i and released by revalueLocked before it reads the wallet.
+        std::vector<Amount> values;
+        std::unique_ptr<std::atomic<uint8_t>[]> stale;
+        std::vector<int> staleSlots;
+        std::vector<std::vector<int>> holders;
+        std::vector<std::vector<AssetId>> listed;
+        Amount total;
+        std::mutex valueLock;
+
+        WalletDirectory() : entries(new Entry[16]), numEntries(0), capacity(16), numLive(0), freeSlots(new int[16]), numFree(0), restoring(false),
+            values(16), stale(new std::atomic<uint8_t>[16]), listed(16) {
+            for (int i = 0; i < 16; i++) stale[i].store(0, std::memory_order_relaxed);
+        }
+
+        void grow(int required) {
+            if (required <= capacity) return;
+            int newCapacity = capacity * 2;
+            while (newCapacity < required) newCapacity *= 2;
+            Entry* newEntries = new Entry[newCapacity];
+            int* newFree = new int[newCapacity];
+            for (int i = 0; i < numEntries; i++) newEntries[i] = entries[i];
+            for (int i = 0; i < numFree; i++) newFree[i] = freeSlots[i];
+            delete[] entries;
+            delete[] freeSlots;
+            entries = newEntries;
+            freeSlots = newFree;
+            capacity = newCapacity;
+            values.resize(newCapacity);
+            std::unique_ptr<std::atomic<uint8_t>[]> newStale(new std::atomic<uint8_t>[newCapacity]);
+            for (int i = 0; i < newCapacity; i++) newStale[i].store(i < numEntries ? stale[i].load(std::memory_order_relaxed) : 0, std::memory_order_relaxed);
+            stale = std::move(newStale);
+            listed.resize(newCapacity);
+        }
+
+        void place(Wallet* wallet, int index) {
+            entries[index].wallet = wallet;
+            wallet->walletId = WalletId{index, entries[index].generation};
+            byOwner.insert(wallet->getOwnerString(), index);
+            numLive++;
+            markStale(index);
+        }
+
+        void markStaleLocked(int index) {
+            if (stale[index].exchange(1)) return;
+            staleSlots.push_back(index);
+        }
+
+        // Marks the live holders of a repriced asset stale, dropping slots that no longer hold it.
+        void markHolders(AssetId asset) {
+            if (asset >= static_cast<int>(holders.size())) return;
+            std::vector<int>& slots = holders[asset];
+            size_t kept = 0;
+            for (int slot : slots) {
+                Wallet* wallet = entries[slot].wallet;
+                if (wallet && wallet->holdings.indexOf(asset) >= 0) {
+                    slots[kept++] = slot;
+                    markStaleLocked(slot);
+                } else {
+                    std::vector<AssetId>& assets = listed[slot];
+                    assets.erase(std::lower_bound(assets.begin(), assets.end(), asset));
+                }
+            }
+            slots.resize(kept);
+        }
+
+        // Adds slot to the holder list of every asset its wallet holds that does not list it yet.
+        void listHoldings(int slot) {
+            Wallet* wallet = entries[slot].wallet;
+            if (!wallet) return;
+            std::vector<AssetId>& assets = listed[slot];
+            for (const Holding& holding : wallet->holdings) {
+                auto position = std::lower_bound(assets.begin(), assets.end(), holding.asset);
+                if (position != assets.end() && *position == holding.asset) continue;
+                assets.insert(position, holding.asset);
+                if (holding.asset >= static_cast<int>(holders.size())) holders.resize(holding.asset + 1);
+                holders[holding.asset].push_back(slot);
+            }
+        }
+
+        int revalueLocked() {
+            AssetRegistry& registry = *AssetRegistry::getInstance();
+            std::vector<AssetId> repriced;
+            if (registry.takeRepriced(repriced)) {
+                for (AssetId asset : repriced) markHolders(asset);
+            } else {
+                for (int i = 0; i < numEntries; i++) {
+                    if (entries[i].wallet) markStaleLocked(i);
+                }
+            }
+            int count = static_cast<int>(staleSlots.size());
+            for (int slot : staleSlots) stale[slot].store(0);
+            std::vector<Amount> fresh(count);
+            parallelFor(0, count, REVALUE_GRAIN, [&](int64_t first, int64_t last) {
+                for (int64_t i = first; i < last; i++) {
+                    Wallet* wallet = entries[staleSlots[i]].wallet;
+                    if (wallet) fresh[i] = wallet->valuation(registry);
+                }
+            });
+            for (int i = 0; i < count; i++) {
+                int slot = staleSlots[i];
+                total = total - values[slot] + fresh[i];
+                values[slot] = fresh[i];
+                listHoldings(slot);
+            }
+            staleSlots.clear();
+            return count;
+        }
+
+    public:
+        static WalletDirectory* getInstance() {
+            if (instance == nullptr) { instance = new WalletDirectory();}
+            return instance;
+        }
+
+        WalletDirectory(const WalletDirectory&) = delete;
+        WalletDirectory& operator=(const WalletDirectory&) = delete;
+
+        ~WalletDirectory() {
+            clear();
+            delete[] entries;
+            delete[] freeSlots;
+        }
+
+        int getNumWallets() const { return numLive; }
+
+        int getNumSlots() const { return numEntries; }
+
+        unsigned int getGeneration(int index) const { return entries[index].generation; }
+
+        static const int REVALUE_GRAIN = 1024;
+
+        // Called after the holdings of slot index change. Only the caller that claims the flag takes valueLock; since
+        // revalueLocked releases flags before reading the wallets, a change it may have missed is marked again.
+        void markStale(int index) {
+            if (stale[index].exchange(1)) return;
+            std::lock_guard<std::mutex> guard(valueLock);
+            staleSlots.push_back(index);
+        }
+
+        // Recomputes the wallets whose holdings changed or that hold a repriced asset; returns how many.
+        int revalue() {
+            std::lock_guard<std::mutex> guard(valueLock);
+            return revalueLocked();
+        }
+
+        // Sum of every registered wallet's valuation, in time proportional to what changed since the last call.
+        Amount totalValue() {
+            std::lock_guard<std::mutex> guard(valueLock);
+            revalueLocked();
+            return total;
+        }
+
+        Amount valueOf(WalletId id) {
+            if (!get(id)) throw out_of_range("Unknown wallet");
+            std::lock_guard<std::mutex> guard(valueLock);
+            revalueLocked();
+            return values[id.index];
+        }
+
+        WalletId add(Wallet* wallet) {
+            if (!wallet || !wallet->getOwner()) throw invalid_argument("Wallet must have an owner");
+            if (byOwner.find(wallet->getOwner()) >= 0) {
+                throw invalid_argument(string("Wallet owner already registered: ") + wallet->getOwner());
+            }
+            int index;
+            if (numFree > 0) {
+                index = freeSlots[--numFree];
+            } else {
+                grow(numEntries + 1);
+                index = numEntries++;
+                entries[index].generation = 0;
+            }
+            place(wallet, index);
+            return wallet->walletId;
+        }
+
+        // Starts a restore: the slots come back empty with their generations, restore puts each wallet back in its own
+        // slot, and finishRestore frees whatever is left, so restoring n wallets costs O(n).
+        void restoreSlots(const uint32_t* generations, int count) {
+            if (numEntries != 0) throw runtime_error("Wallet slots can only be restored into an empty directory");
+            grow(count);
+            for (int i = 0; i < count; i++) entries[i] = Entry{nullptr, generations[i]};
+            numEntries = count;
+            restoring = true;
+        }
+
+        WalletId restore(Wallet* wallet, WalletId id) {
+            if (!restoring) throw runtime_error("Wallets can only be restored between restoreSlots and finishRestore");
+            if (!wallet || !wallet->getOwner()) throw invalid_argument("Wallet must have an owner");
+            if (byOwner.find(wallet->getOwner()) >= 0) {
+                throw invalid_argument(string("Wallet owner already registered: ") + wallet->getOwner());
+            }
+            if (id.index < 0 || id.index >= numEntries || entries[id.index].wallet || entries[id.index].generation != id.generation) {
+                throw invalid_argument("Wallet slot is not free");
+            }
+            place(wallet, id.index);
+            return wallet->walletId;
+        }
+
+        // Rebuilds the free list from the slots no wallet was restored into, lowest slot reused first.
+        void finishRestore() {
+            if (!restoring) return;
+            numFree = 0;
+            for (int i = numEntries - 1; i >= 0; i--) {
+                if (!entries[i].wallet) freeSlots[numFree++] = i;
+            }
+            restoring = false;
+        }
+
+        Wallet* get(WalletId id) const {
+            if (id.index < 0 || id.index >= numEntries) return nullptr;
+            const Entry& entry = entries[id.index];
+            return entry.generation == id.generation ? entry.wallet : nullptr;
+        }
+
+        WalletId find(std::string_view owner) const {
+            int index = byOwner.find(owner);
+            if (index < 0) return INVALID_WALLET;
+            return WalletId{index, entries[index].generation};
+        }
+
+        void rename(WalletId id, const char* owner) {
+            Wallet* wallet = get(id);
+            if (!wallet) throw out_of_range("Unknown wallet");
+            if (!owner) throw invalid_argument("Owner cannot be null");
+            int existing = byOwner.find(owner);
+            if (existing >= 0 && existing != id.index) throw invalid_argument(string("Wallet owner already registered: ") + owner);
+            if (wallet->getOwner()) byOwner.erase(wallet->getOwnerString());
+            wallet->setOwner(owner);
+            byOwner.insert(wallet->getOwnerString(), id.index);
+        }
+
+        void remove(WalletId id) {
+            Wallet* wallet = get(id);
+            if (!wallet) return;
+            byOwner.erase(wallet->getOwnerString());
+            entries[id.index].wallet = nullptr;
+            entries[id.index].generation++;
+            freeSlots[numFree++] = id.index;
+            numLive--;
+            delete wallet;
+            std::lock_guard<std::mutex> guard(valueLock);
+            total = total - values[id.index];
+            values[id.index] = Amount();
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> guard(valueLock);
+            for (int i = 0; i < numEntries; i++) {
+                if (entries[i].wallet) {
+                    delete entries[i].wallet;
+                    entries[i].wallet = nullptr;
+                    entries[i].generation++;
+                    freeSlots[numFree++] = i;
+                }
+                values[i] = Amount();
+                stale[i].store(0, std::memory_order_relaxed);
+                listed[i].clear();
+            }
+            numLive = 0;
+            byOwner.clear();
+            staleSlots.clear();
+            holders.clear();
+            total = Amount();
+        }
+};
+
+WalletDirectory* WalletDirectory::instance = nullptr;
+
+void Wallet::changed() {
+    if (walletId.index >= 0) WalletDirectory::getInstance()->markStale(walletId.index);
+}
+
+Amount Wallet::value() const {
+    if (walletId.index >= 0) return WalletDirectory::getInstance()->valueOf(walletId);
+    return valuation(*AssetRegistry::getInstance());
+}
+
+struct Hash256 {
+    uint8_t bytes[32];
+
+    bool operator==(const Hash256& other) const { return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
+
+    bool operator!=(const Hash256& other) const { return !(*this == other); }
+
+    string toHex(int digits = 64) const {
+        static const char* HEX = "0123456789abcdef";
+        string text;
+        for (int i = 0; i < 32 && static_cast<int>(text.size()) < digits; i++) {
+            text.push_back(HEX[bytes[i] >> 4]);
+            text.push_back(HEX[bytes[i] & 0xF]);
+        }
+        return text.substr(0, digits);
+    }
+};
+
+class Sha256 {
+    private:
+        static constexpr uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+        };
+
+        static constexpr uint32_t INITIAL[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+        using BlockFunction = void (*)(uint32_t* state, const uint8_t* block);
+        static BlockFunction blockFunction;
+
+        uint32_t state[8];
+        uint8_t buffer[64];
+        uint64_t totalBytes;
+        size_t buffered;
+
+        friend class HashEngine;
+
+        static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    public:
+        static void compress(uint32_t* state, const uint8_t* block) {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+
+        Sha256() { reset(); }
+
+        void reset() {
+            memcpy(state, INITIAL, sizeof(state));
+            totalBytes = 0;
+            buffered = 0;
+        }
+
+        void update(const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            totalBytes += size;
+            if (buffered > 0) {
+                size_t take = std::min(size, sizeof(buffer) - buffered);
+                memcpy(buffer + buffered, bytes, take);
+                buffered += take;
+                bytes += take;
+                size -= take;
+                if (buffered < sizeof(buffer)) return;
+                blockFunction(state, buffer);
+                buffered = 0;
+            }
+            while (size >= sizeof(buffer)) {
+                blockFunction(state, bytes);
+                bytes += sizeof(buffer);
+                size -= sizeof(buffer);
+            }
+            memcpy(buffer, bytes, size);
+            buffered = size;
+        }
+
+        Hash256 finish() {
+            uint64_t bits = totalBytes * 8;
+            uint8_t padding[72] = {0x80};
+            size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+            for (int i = 0; i < 8; i++) padding[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+            update(padding, padLength + 8);
+            Hash256 digest;
+            for (int i = 0; i < 8; i++) {
+                digest.bytes[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+                digest.bytes[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+                digest.bytes[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+                digest.bytes[4 * i + 3] = static_cast<uint8_t>(state[i]);
+            }
+            reset();
+            return digest;
+        }
+
+        static Hash256 digest(const void* data, size_t size) {
+            Sha256 hasher;
+            hasher.update(data, size);
+            return hasher.finish();
+        }
+
+        static Hash256 digestPair(const Hash256& left, const Hash256& right) {
+            Sha256 hasher;
+            hasher.update(left.bytes, sizeof(left.bytes));
+            hasher.update(right.bytes, sizeof(right.bytes));
+            return hasher.finish();
+        }
+};
+
+Sha256::BlockFunction Sha256::blockFunction = &Sha256::compress;
+
+enum class HashPath {Scalar, Sse4, Avx2, ShaNi};
+
+class HashEngine {
+    private:
+        static HashPath active;
+
+        static uint32_t loadBigEndian(const uint8_t* bytes) {
+            return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+        }
+
+        static void storeDigest(const uint32_t* state, int stride, Hash256& digest) {
+            for (int i = 0; i < 8; i++) {
+                uint32_t word = state[i * stride];
+                digest.bytes[4 * i] = static_cast<uint8_t>(word >> 24);
+                digest.bytes[4 * i + 1] = static_cast<uint8_t>(word >> 16);
+                digest.bytes[4 * i + 2] = static_cast<uint8_t>(word >> 8);
+                digest.bytes[4 * i + 3] = static_cast<uint8_t>(word);
+            }
+        }
+
+        static size_t numBlocks(size_t size) { return (size + 72) / 64; }
+
+        // Block `index` of a padded message; blocks past the raw data are built in `tail`.
+        static const uint8_t* messageBlock(const uint8_t* message, size_t size, size_t index, uint8_t* tail) {
+            size_t offset = index * 64;
+            if (offset + 64 <= size) return message + offset;
+            memset(tail, 0, 64);
+            if (offset <= size) {
+                memcpy(tail, message + offset, size - offset);
+                tail[size - offset] = 0x80;
+            }
+            if (index == numBlocks(size) - 1) {
+                uint64_t bits = static_cast<uint64_t>(size) * 8;
+                for (int i = 0; i < 8; i++) tail[56 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+            }
+            return tail;
+        }
+
+        static void digestEach(const uint8_t* data, size_t size, int count, Hash256* out, Sha256::BlockFunction compress) {
+            uint8_t tail[64];
+            size_t blocks = numBlocks(size);
+            for (int i = 0; i < count; i++) {
+                uint32_t state[8];
+                memcpy(state, Sha256::INITIAL, sizeof(state));
+                for (size_t block = 0; block < blocks; block++) compress(state, messageBlock(data + i * size, size, block, tail));
+                storeDigest(state, 1, out[i]);
+            }
+        }
+
+        // Hashes LANES messages side by side; the kernel sees word t of every lane as one vector.
+        template <int LANES>
+        static void digestLanes(const uint8_t* data, size_t size, int count, Hash256* out, void (*kernel)(uint32_t*, const uint32_t*)) {
+            alignas(32) uint32_t state[8 * LANES];
+            alignas(32) uint32_t words[16 * LANES];
+            uint8_t tails[LANES][64];
+            size_t blocks = numBlocks(size);
+            for (int first = 0; first < count; first += LANES) {
+                for (int i = 0; i < 8; i++) {
+                    for (int lane = 0; lane < LANES; lane++) state[i * LANES + lane] = Sha256::INITIAL[i];
+                }
+                for (size_t block = 0; block < blocks; block++) {
+                    for (int lane = 0; lane < LANES; lane++) {
+                        int message = std::min(first + lane, count - 1);
+                        const uint8_t* bytes = messageBlock(data + message * size, size, block, tails[lane]);
+                        for (int t = 0; t < 16; t++) words[t * LANES + lane] = loadBigEndian(bytes + 4 * t);
+                    }
+                    kernel(state, words);
+                }
+                for (int lane = 0; lane < LANES && first + lane < count; lane++) storeDigest(state + lane, LANES, out[first + lane]);
+            }
+        }
+
+#ifdef SIMD_X86
+        SIMD_TARGET("sse4.1") static inline __m128i rotr4(__m128i x, int n) { return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n)); }
+
+        SIMD_TARGET("sse4.1") static void compressSse4(uint32_t* state, const uint32_t* words) {
+            __m128i w[64];
+            for (int i = 0; i < 16; i++) w[i] = _mm_load_si128(reinterpret_cast<const __m128i*>(words) + i);
+            for (int i = 16; i < 64; i++) {
+                __m128i s0 = _mm_xor_si128(_mm_xor_si128(rotr4(w[i - 15], 7), rotr4(w[i - 15], 18)), _mm_srli_epi32(w[i - 15], 3));
+                __m128i s1 = _mm_xor_si128(_mm_xor_si128(rotr4(w[i - 2], 17), rotr4(w[i - 2], 19)), _mm_srli_epi32(w[i - 2], 10));
+                w[i] = _mm_add_epi32(_mm_add_epi32(w[i - 16], s0), _mm_add_epi32(w[i - 7], s1));
+            }
+            __m128i* lanes = reinterpret_cast<__m128i*>(state);
+            __m128i a = lanes[0], b = lanes[1], c = lanes[2], d = lanes[3], e = lanes[4], f = lanes[5], g = lanes[6], h = lanes[7];
+            for (int i = 0; i < 64; i++) {
+                __m128i s1 = _mm_xor_si128(_mm_xor_si128(rotr4(e, 6), rotr4(e, 11)), rotr4(e, 25));
+                __m128i choose = _mm_xor_si128(_mm_and_si128(e, f), _mm_andnot_si128(e, g));
+                __m128i t1 = _mm_add_epi32(_mm_add_epi32(h, s1), _mm_add_epi32(choose, _mm_add_epi32(_mm_set1_epi32(static_cast<int>(Sha256::K[i])), w[i])));
+                __m128i s0 = _mm_xor_si128(_mm_xor_si128(rotr4(a, 2), rotr4(a, 13)), rotr4(a, 22));
+                __m128i majority = _mm_xor_si128(_mm_xor_si128(_mm_and_si128(a, b), _mm_and_si128(a, c)), _mm_and_si128(b, c));
+                h = g;
+                g = f;
+                f = e;
+                e = _mm_add_epi32(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm_add_epi32(t1, _mm_add_epi32(s0, majority));
+            }
+            lanes[0] = _mm_add_epi32(lanes[0], a); lanes[1] = _mm_add_epi32(lanes[1], b);
+            lanes[2] = _mm_add_epi32(lanes[2], c); lanes[3] = _mm_add_epi32(lanes[3], d);
+            lanes[4] = _mm_add_epi32(lanes[4], e); lanes[5] = _mm_add_epi32(lanes[5], f);
+            lanes[6] = _mm_add_epi32(lanes[6], g); lanes[7] = _mm_add_epi32(lanes[7], h);
+        }
+
+        SIMD_TARGET("avx2") static inline __m256i rotr8(__m256i x, int n) { return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n)); }
+
+        SIMD_TARGET("avx2") static void compressAvx2(uint32_t* state, const uint32_t* words) {
+            __m256i w[64];
+            for (int i = 0; i < 16; i++) w[i] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words) + i);
+            for (int i = 16; i < 64; i++) {
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[i - 15], 7), rotr8(w[i - 15], 18)), _mm256_srli_epi32(w[i - 15], 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w[i - 2], 17), rotr8(w[i - 2], 19)), _mm256_srli_epi32(w[i - 2], 10));
+                w[i] = _mm256_add_epi32(_mm256_add_epi32(w[i - 16], s0), _mm256_add_epi32(w[i - 7], s1));
+            }
+            __m256i* lanes = reinterpret_cast<__m256i*>(state);
+            __m256i a = lanes[0], b = lanes[1], c = lanes[2], d = lanes[3], e = lanes[4], f = lanes[5], g = lanes[6], h = lanes[7];
+            for (int i = 0; i < 64; i++) {
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+                __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(choose, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(Sha256::K[i])), w[i])));
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+                __m256i majority = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+                h = g;
+                g = f;
+                f = e;
+                e = _mm256_add_epi32(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, majority));
+            }
+            lanes[0] = _mm256_add_epi32(lanes[0], a); lanes[1] = _mm256_add_epi32(lanes[1], b);
+            lanes[2] = _mm256_add_epi32(lanes[2], c); lanes[3] = _mm256_add_epi32(lanes[3], d);
+            lanes[4] = _mm256_add_epi32(lanes[4], e); lanes[5] = _mm256_add_epi32(lanes[5], f);
+            lanes[6] = _mm256_add_epi32(lanes[6], g); lanes[7] = _mm256_add_epi32(lanes[7], h);
+        }
+
+        // The SHA extensions keep the state as ABEF/CDGH and run two rounds per instruction.
+        SIMD_TARGET("sha,sse4.1") static void compressShaNi(uint32_t* state, const uint8_t* block) {
+            const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+            __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+            __m128i abef = _mm_alignr_epi8(dcba, efgh, 8);
+            __m128i cdgh = _mm_blend_epi16(efgh, dcba, 0xF0);
+            __m128i savedAbef = abef, savedCdgh = cdgh;
+            __m128i m[4];
+#pragma GCC unroll 16
+            for (int g = 0; g < 16; g++) {
+                if (g < 4) m[g] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block) + g), byteSwap);
+                __m128i message = _mm_add_epi32(m[g & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(Sha256::K + 4 * g)));
+                cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+                if (g >= 3 && g < 15) {
+                    __m128i partial = _mm_add_epi32(_mm_sha256msg1_epu32(m[(g + 1) & 3], m[(g + 2) & 3]), _mm_alignr_epi8(m[g & 3], m[(g + 3) & 3], 4));
+                    m[(g + 1) & 3] = _mm_sha256msg2_epu32(partial, m[g & 3]);
+                }
+                abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(message, 0x0E));
+            }
+            abef = _mm_add_epi32(abef, savedAbef);
+            cdgh = _mm_add_epi32(cdgh, savedCdgh);
+            __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+            __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+        }
+#endif
+
+        static void digestRange(const uint8_t* data, size_t size, int count, Hash256* out) {
+            switch (active) {
+#ifdef SIMD_X86
+                case HashPath::Sse4: digestLanes<4>(data, size, count, out, compressSse4); break;
+                case HashPath::Avx2: digestLanes<8>(data, size, count, out, compressAvx2); break;
+                case HashPath::ShaNi: digestEach(data, size, count, out, compressShaNi); break;
+#endif
+                default: digestEach(data, size, count, out, Sha256::compress); break;
+            }
+        }
+
+        static HashPath detect() {
+            HashPath path = HashPath::Scalar;
+            for (HashPath candidate : {HashPath::Sse4, HashPath::Avx2, HashPath::ShaNi}) {
+                if (isSupported(candidate)) path = candidate;
+            }
+            if (const char* requested = getenv("COINQUEROR_HASH")) {
+                for (HashPath candidate : {HashPath::Scalar, HashPath::Sse4, HashPath::Avx2, HashPath::ShaNi}) {
+                    if (string(requested) == pathName(candidate) && isSupported(candidate)) path = candidate;
+                }
+            }
+            return path;
+        }
+
+    public:
+        static const int PARALLEL_MIN = 4096;
+
+        static bool isSupported(HashPath path) {
+#ifdef SIMD_X86
+            __builtin_cpu_init();
+            unsigned eax, ebx, ecx, edx;
+            switch (path) {
+                case HashPath::Scalar: return true;
+                case HashPath::Sse4: return __builtin_cpu_supports("sse4.1");
+                case HashPath::Avx2: return __builtin_cpu_supports("avx2");
+                case HashPath::ShaNi: return __builtin_cpu_supports("sse4.1") && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+            }
+            return false;
+#else
+            return path == HashPath::Scalar;
+#endif
+        }
+
+        static const char* pathName(HashPath path) {
+            switch (path) {
+                case HashPath::Sse4: return "sse4";
+                case HashPath::Avx2: return "avx2";
+                case HashPath::ShaNi: return "sha-ni";
+                default: return "scalar";
+            }
+        }
+
+        static HashPath getPath() { return active; }
+
+        static HashPath selectBest() {
+            setPath(detect());
+            return active;
+        }
+
+        static void setPath(HashPath path) {
+            if (!isSupported(path)) throw invalid_argument(string("Hash path not supported on this CPU: ") + pathName(path));
+            active = path;
+#ifdef SIMD_X86
+            Sha256::blockFunction = path == HashPath::ShaNi ? compressShaNi : Sha256::compress;
+#endif
+        }
+
+        // out[i] = sha256 of the i-th `size`-byte message in data. With one thread out may
+        // alias data as long as it does not run ahead of it (e.g. halving a Merkle level in place).
+        // Spreads inputs of more than PARALLEL_MIN across the task pool; only smaller batches may hash in place.
+        static void digestMany(const void* data, size_t size, int count, Hash256* out) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            parallelFor(0, count, PARALLEL_MIN, [=](int64_t first, int64_t last) {
+                digestRange(bytes + first * size, size, static_cast<int>(last - first), out + first);
+            });
+        }
+};
+
+HashPath HashEngine::active = HashEngine::selectBest();
+
+enum class TransactionKind : uint32_t {Transfer, Void};
+
+struct TransactionRecord {
+    int32_t fromIndex;
+    uint32_t fromGeneration;
+    int32_t toIndex;
+    uint32_t toGeneration;
+    int32_t asset;
+    uint32_t kind;
+    int32_t reference;
+    uint32_t padding;
+    uint64_t amountLow;
+    int64_t amountHigh;
+};
+
+struct BlockHeader {
+    uint64_t height;
+    int64_t timestamp;
+    uint32_t firstTransaction;
+    uint32_t numTransactions;
+    Hash256 prevHash;
+    Hash256 merkleRoot;
+};
+
+static_assert(sizeof(TransactionRecord) == 48 && sizeof(BlockHeader) == 88, "block records are written to disk as-is");
+
+Hash256 merkleRoot(const TransactionRecord* records, int count, std::vector<Hash256>& level) {
+    if (count == 0) return Hash256{};
+    level.resize(count);
+    HashEngine::digestMany(records, sizeof(TransactionRecord), count, level.data());
+    std::vector<Hash256> parents;
+    while (count > 1) {
+        int pairs = count / 2;
+        Hash256 odd = level[count - 1];
+        if (pairs > HashEngine::PARALLEL_MIN) {
+            parents.resize(pairs + count % 2);
+            HashEngine::digestMany(level.data(), 2 * sizeof(Hash256), pairs, parents.data());
+            level.swap(parents);
+        } else {
+            HashEngine::digestMany(level.data(), 2 * sizeof(Hash256), pairs, level.data());
+        }
+        if (count % 2) level[pairs] = Sha256::digestPair(odd, odd);
+        count = pairs + count % 2;
+    }
+    return level[0];
+}
+
+Hash256 merkleRoot(const TransactionRecord* records, int count) {
+    std::vector<Hash256> level;
+    return merkleRoot(records, count, level);
+}
+
+class BlockSink {
+    public:
+        virtual ~BlockSink() {}
+        virtual bool appendBlock(const BlockHeader& header, const TransactionRecord* records) = 0;
+};
+
+class Transaction {
+    private:
+        WalletId from;
+        WalletId to;
+        AssetId asset;
+        TransactionKind kind;
+        int reference;
+        Amount amount;
+
+    public:
+        Transaction() : from(INVALID_WALLET), to(INVALID_WALLET), asset(INVALID_ASSET), kind(TransactionKind::Transfer), reference(-1) {}
+
+        Transaction(WalletId from, WalletId to, AssetId asset, Amount amount): from(from), to(to), asset(asset), kind(TransactionKind::Transfer), reference(-1), amount(amount) {
+            const CryptoCurrency* crypto = AssetRegistry::getInstance()->get(asset);
+            if (!crypto) throw invalid_argument("Unknown asset for transaction");
+            crypto->checkQuantity(amount);
+        }
+
+        explicit Transaction(const TransactionRecord& record)
+            : from{record.fromIndex, record.fromGeneration}, to{record.toIndex, record.toGeneration}, asset(record.asset),
+              kind(static_cast<TransactionKind>(record.kind)), reference(record.reference), amount(Amount::fromWords(record.amountLow, record.amountHigh)) {}
+
+        static Transaction voiding(int index) {
+            Transaction transaction;
+            transaction.kind = TransactionKind::Void;
+            transaction.reference = index;
+            return transaction;
+        }
+
+        TransactionRecord toRecord() const {
+            return TransactionRecord{from.index, from.generation, to.index, to.generation, asset, static_cast<uint32_t>(kind), reference, 0, amount.lowWord(), amount.highWord()};
+        }
+
+        Wallet* getFrom() const { return WalletDirectory::getInstance()->get(from); }
+        
+        Wallet* getTo() const { return WalletDirectory::getInstance()->get(to); }
+
+        WalletId getFromId() const { return from; }
+
+        WalletId getToId() const { return to; }
+        
+        const CryptoCurrency* getCrypto() const { return AssetRegistry::getInstance()->get(asset); }
+
+        AssetId getAssetId() const { return asset; }
+        
+        Amount getAmount() const { return amount; }
+
+        TransactionKind getKind() const { return kind; }
+
+        bool isVoid() const { return kind == TransactionKind::Void; }
+
+        int getReference() const { return reference; }
+
+        void setFrom(WalletId from) { this->from = from; } 
+        
+        void setTo(WalletId to) { this->to = to; }
+        
+        void setAsset(AssetId asset) { this->asset = asset; }
+        
+        void setAmount(Amount amount) { this->amount = amount; }
+
+        bool sameAsset(const Transaction& other) const { return asset == other.asset; }
+
+        // Equal transactions hash alike.
+        unsigned long long hashValue() const {
+            unsigned long long hash = mixHash(static_cast<unsigned long long>(from.index) << 32 | from.generation, static_cast<unsigned long long>(to.index) << 32 | to.generation);
+            hash = mixHash(hash, static_cast<unsigned long long>(asset) << 32 | static_cast<uint32_t>(kind));
+            hash = mixHash(hash, static_cast<unsigned long long>(static_cast<unsigned int>(reference)));
+            hash = mixHash(hash, amount.lowWord());
+            hash = mixHash(hash, amount.highWord());
+            hash *= 0xC2B2AE3D27D4EB4FULL;
+            return hash ^ (hash >> 31);
+        }
+
+        bool operator==(const Transaction& other) const {return from == other.from && to == other.to && sameAsset(other) && amount == other.amount && kind == other.kind && reference == other.reference;}
+
+        bool operator<(const Transaction& other) const {return amount < other.amount;}
+
+        Transaction operator+(const Transaction& other) const {
+            if (from == other.from && to == other.to && sameAsset(other)) {
+                return Transaction(from, to, asset, amount + other.amount);
+            } else {
+                throw invalid_argument("Cannot add transactions with different participants or cryptos.");
+            }
+        }
+
+        Transaction operator-(const Transaction& other) const {
+            if (from == other.from && to == other.to && sameAsset(other)) {
+                return Transaction(from, to, asset, amount - other.amount);
+            } else {
+                throw invalid_argument("Cannot subtract transactions with different participants or cryptos.");
+            }
+        }
+
+        Transaction& operator++() {
+            amount += 1;
+            return *this;
+        }
+
+        Transaction operator++(int) {
+            Transaction temp = *this;
+            amount += 1;
+            return temp;
+        }
+
+        Amount operator[](int index) const {
+            if (index != 0) {
+                throw out_of_range("Index out of range");
+            }
+            return amount;
+        }
+
+        friend ostream& operator<<(ostream& os, const Transaction& transaction);
+};
+
+ostream& operator<<(ostream& os, const Transaction& transaction) {
+    if (transaction.isVoid()) return os << "Void of transaction #" << transaction.reference;
+    const Wallet* from = transaction.getFrom();
+    const Wallet* to = transaction.getTo();
+    const CryptoCurrency* crypto = transaction.getCrypto();
+    os << "Transaction: " << transaction.amount << " of ";
+    if (crypto) os << crypto->getSymbolString();
+    else os << "<deleted asset>";
+    os << " from " << (from ? from->getOwner() : "<deleted wallet>") << " to " << (to ? to->getOwner() : "<deleted wallet>");
+    return os;
+}
+
+// Increasing transaction ids stored as LEB128 varints of the gap to the previous id, so dense runs take a byte each.
+class PostingList {
+    private:
+        // Room for the longest gap is kept past the used bytes, so appending checks the capacity once, not per byte.
+        static const size_t MAX_GAP_BYTES = 5;
+        std::vector<uint8_t> bytes;
+        size_t used;
+        int last;
+        int count;
+
+    public:
+        PostingList() : used(0), last(-1), count(0) {}
+
+        int size() const { return count; }
+
+        size_t getBytes() const { return used; }
+
+        int back() const { return last; }
+
+        // Ids at or below the last one are already present and are ignored.
+        void append(int id) {
+            if (id <= last) return;
+            if (bytes.size() - used < MAX_GAP_BYTES) bytes.resize(std::max<size_t>(4 * MAX_GAP_BYTES, 2 * bytes.size()));
+            uint8_t* out = bytes.data() + used;
+            uint32_t gap = static_cast<uint32_t>(id - last);
+            while (gap >= 0x80) {
+                *out++ = static_cast<uint8_t>(gap | 0x80);
+                gap >>= 7;
+            }
+            *out++ = static_cast<uint8_t>(gap);
+            used = out - bytes.data();
+            last = id;
+            count++;
+        }
+
+        template<typename Visitor>
+        void forEach(Visitor visit) const {
+            int id = -1;
+            const uint8_t* p = bytes.data();
+            const uint8_t* end = p + used;
+            while (p < end) {
+                uint32_t gap = 0;
+                int shift = 0;
+                while (*p & 0x80) {
+                    gap |= static_cast<uint32_t>(*p++ & 0x7F) << shift;
+                    shift += 7;
+                }
+                gap |= static_cast<uint32_t>(*p++) << shift;
+                id += static_cast<int>(gap);
+                visit(id);
+            }
+        }
+};
+
+// Posting lists keyed by a wallet slot or asset id, allocated a page of keys at a time on first use: a chain touching
+// a few wallets with high slot numbers does not pay for an empty list per lower slot.
+class PostingIndex {
+    private:
+        static const int PAGE_SHIFT = 10;
+        static const int PAGE_KEYS = 1 << PAGE_SHIFT;
+        std::vector<std::unique_ptr<PostingList[]>> pages;
+
+    public:
+        PostingIndex() = default;
+        PostingIndex(const PostingIndex& other) { *this = other; }
+        PostingIndex(PostingIndex&&) = default;
+        PostingIndex& operator=(PostingIndex&&) = default;
+
+        PostingIndex& operator=(const PostingIndex& other) {
+            if (this == &other) return *this;
+            pages.clear();
+            pages.resize(other.pages.size());
+            for (size_t page = 0; page < pages.size(); page++) {
+                if (!other.pages[page]) continue;
+                pages[page].reset(new PostingList[PAGE_KEYS]);
+                std::copy(other.pages[page].get(), other.pages[page].get() + PAGE_KEYS, pages[page].get());
+            }
+            return *this;
+        }
+
+        // The list of key, or null when nothing was ever posted near it.
+        const PostingList* find(int key) const {
+            size_t page = static_cast<size_t>(key) >> PAGE_SHIFT;
+            if (key < 0 || page >= pages.size() || !pages[page]) return nullptr;
+            return &pages[page][key & (PAGE_KEYS - 1)];
+        }
+
+        // Negative keys, such as the invalid wallet, are not indexed.
+        void append(int key, int id) {
+            if (key < 0) return;
+            size_t page = static_cast<size_t>(key) >> PAGE_SHIFT;
+            if (page >= pages.size()) pages.resize(page + 1);
+            if (!pages[page]) pages[page].reset(new PostingList[PAGE_KEYS]);
+            pages[page][key & (PAGE_KEYS - 1)].append(id);
+        }
+
+        size_t getBytes() const {
+            size_t total = 0;
+            for (const std::unique_ptr<PostingList[]>& page : pages) {
+                for (int i = 0; page && i < PAGE_KEYS; i++) total += page[i].getBytes();
+            }
+            return total;
+        }
+
+        void clear() { pages.clear(); }
+};
+
+// Transaction slots in fixed chunks carved from a few large slabs. A slot never moves once written, so growing the
+// store never copies it and references into it stay valid.
+class TransactionArena {
+    public:
+        static const int CHUNK_SHIFT = 10;
+        static const int CHUNK_SIZE = 1 << CHUNK_SHIFT;
+        static const int CHUNK_MASK = CHUNK_SIZE - 1;
+        static const size_t CHUNK_BYTES = CHUNK_SIZE * sizeof(Transaction);
+        // Slabs this large are aligned to it and advised onto huge pages, so reserving a long chain faults a few
+        // 2 MiB pages instead of one page per 4 KiB.
+        static const size_t HUGE_PAGE = 2 << 20;
+
+    private:
+        // Memory the chunks are carved from. Transactions are trivially copyable and destructible, so a slot stays raw
+        // memory until a transaction is constructed in it.
+        struct Slab {
+            void* memory;
+            size_t bytes;
+        };
+
+        static_assert(std::is_trivially_copyable<Transaction>::value && std::is_trivially_destructible<Transaction>::value,
+            "TransactionArena chunks hold raw Transaction memory");
+
+        Transaction** chunks;
+        std::vector<Slab> slabs;
+        int numChunks;
+        int chunksCapacity;
+
+        void stealFrom(TransactionArena& other) {
+            chunks = other.chunks;
+            slabs = std::move(other.slabs);
+            numChunks = other.numChunks;
+            chunksCapacity = other.chunksCapacity;
+            other.chunks = nullptr;
+            other.slabs.clear();
+            other.numChunks = 0;
+            other.chunksCapacity = 0;
+        }
+
+    public:
+        TransactionArena() : chunks(nullptr), numChunks(0), chunksCapacity(0) {}
+
+        TransactionArena(const TransactionArena&) = delete;
+
+        TransactionArena(TransactionArena&& other) noexcept : chunks(nullptr), numChunks(0), chunksCapacity(0) { stealFrom(other); }
+
+        ~TransactionArena() { release(); }
+
+        TransactionArena& operator=(const TransactionArena&) = delete;
+
+        TransactionArena& operator=(TransactionArena&& other) noexcept {
+            if (this != &other) {
+                release();
+                stealFrom(other);
+            }
+            return *this;
+        }
+
+        Transaction& operator[](int index) { return chunks[index >> CHUNK_SHIFT][index & CHUNK_MASK]; }
+
+        const Transaction& operator[](int index) const { return chunks[index >> CHUNK_SHIFT][index & CHUNK_MASK]; }
+
+        const Transaction* getChunk(int chunk) const { return chunks[chunk]; }
+
+        int getCapacity() const { return numChunks * CHUNK_SIZE; }
+
+        void reserve(int required) {
+            int neededChunks = (required + CHUNK_MASK) >> CHUNK_SHIFT;
+            if (neededChunks <= numChunks) return;
+            size_t bytes = (neededChunks - numChunks) * CHUNK_BYTES;
+            void* memory;
+            if (bytes >= HUGE_PAGE) {
+                bytes = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+                memory = ::operator new(bytes, std::align_val_t(HUGE_PAGE));
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+                madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+            } else {
+                memory = ::operator new(bytes);
+            }
+            slabs.push_back(Slab{memory, bytes});
+            int carved = static_cast<int>(bytes / CHUNK_BYTES);
+            resizeArray(chunks, chunksCapacity, numChunks + carved);
+            for (int i = 0; i < carved; i++) chunks[numChunks++] = static_cast<Transaction*>(memory) + static_cast<size_t>(i) * CHUNK_SIZE;
+        }
+
+        // Copies the first count slots of other, which must all hold transactions.
+        void copyFrom(const TransactionArena& other, int count) {
+            reserve(count);
+            for (int i = 0; i < other.numChunks && i * CHUNK_SIZE < count; i++) {
+                std::uninitialized_copy(other.chunks[i], other.chunks[i] + std::min(CHUNK_SIZE, count - i * CHUNK_SIZE), chunks[i]);
+            }
+        }
+
+        void release() {
+            for (const Slab& slab : slabs) {
+                if (slab.bytes >= HUGE_PAGE) ::operator delete(slab.memory, std::align_val_t(HUGE_PAGE));
+                else ::operator delete(slab.memory);
+            }
+            slabs.clear();
+            delete[] chunks;
+            chunks = nullptr;
+            numChunks = 0;
+            chunksCapacity = 0;
+        }
+};
+
+// Live transfers found on only one side of a comparison, in chain order.
+struct ChainDiff {
+    std::vector<Transaction> added;
+    std::vector<Transaction> removed;
+};
+
+class Blockchain {
+    public:
+        static const int BLOCK_CAPACITY = 256;
+        // Below this many transfers on both sides together, matching runs on the calling thread.
+        static const int MATCH_PARALLEL_MIN = 1 << 14;
+        // Width of the block-time buckets in the time index.
+        static const int TIME_BUCKET_SECONDS = 3600;
+
+    private:
+        struct TimeBucket {
+            int64_t bucket;
+            PostingList ids;
+        };
+
+        TransactionArena arena;
+        int numTransactions;
+        int sealedTransactions;
+        std::vector<BlockHeader> blocks;
+        std::vector<Hash256> blockHashes;
+        std::vector<bool> voided;
+        // Secondary indexes from wallet slot, asset id and block-time bucket to transfer ids. Voided transfers stay
+        // posted and are skipped when a query reads the list.
+        mutable PostingIndex byWallet;
+        mutable PostingIndex byAsset;
+        std::vector<TimeBucket> byTime;
+        // Transfers from postedThrough on are not in byWallet and byAsset yet. A restore leaves them to the first query
+        // of those indexes, so loading a chain does not pay for postings nobody reads; postingLock lets concurrent
+        // readers post them once.
+        mutable std::atomic<int> postedThrough;
+        mutable std::mutex postingLock;
+        BlockSink* sink;
+
+        Transaction& at(int index) { return arena[index]; }
+
+        const Transaction& at(int index) const { return arena[index]; }
+
+        void collectRecords(int first, int count, std::vector<TransactionRecord>& records) const {
+            records.resize(count);
+            for (int i = 0; i < count; i++) records[i] = at(first + i).toRecord();
+        }
+
+        // Copies count stored records after the last transaction, checking voids as addTransaction does; on a bad record
+        // nothing is appended. The caller posts the indexes.
+        bool appendRecords(const TransactionRecord* records, int count) {
+            const uint32_t VOID = static_cast<uint32_t>(TransactionKind::Void);
+            int first = numTransactions;
+            reserve(first + count);
+            voided.resize(first + count, false);
+            for (int i = 0; i < count; i++) {
+                if (records[i].kind != VOID) continue;
+                int target = records[i].reference;
+                if (target < 0 || target >= first + i || (target >= first ? records[target - first].kind == VOID : at(target).isVoid()) || voided[target]) {
+                    for (int j = 0; j < i; j++) {
+                        if (records[j].kind == VOID) voided[records[j].reference] = false;
+                    }
+                    voided.resize(first);
+                    return false;
+                }
+                voided[target] = true;
+            }
+            for (int i = 0; i < count; i++) new (&at(first + i)) Transaction(records[i]);
+            numTransactions = first + count;
+            return true;
+        }
+
+        // Appends and seals stored blocks after the tip, linking each header to the chain (height, first transaction and
+        // prevHash are overwritten). Returns how many were appended, stopping at the first that does not fit.
+        int appendBlocks(BlockHeader* headers, int numBlocks, const TransactionRecord* records, bool verifyRoot) {
+            int appended = 0;
+            for (; appended < numBlocks && numTransactions == sealedTransactions; appended++) {
+                BlockHeader& header = headers[appended];
+                int count = static_cast<int>(header.numTransactions);
+                if (count == 0 || (verifyRoot && merkleRoot(records, count) != header.merkleRoot) || !appendRecords(records, count)) break;
+                header.height = blocks.size();
+                header.firstTransaction = static_cast<uint32_t>(sealedTransactions);
+                header.prevHash = blockHashes.empty() ? Hash256{} : blockHashes.back();
+                blocks.push_back(header);
+                blockHashes.push_back(Sha256::digest(&header, sizeof(header)));
+                indexBlock(header);
+                sealedTransactions = numTransactions;
+                records += count;
+            }
+            return appended;
+        }
+
+        // Posts the transfers among [first, last) to the wallet and asset indexes.
+        void postRange(int first, int last) const {
+            for (int id = first; id < last; id++) {
+                const Transaction& transaction = at(id);
+                if (transaction.isVoid()) continue;
+                byWallet.append(transaction.getFromId().index, id);
+                byWallet.append(transaction.getToId().index, id);
+                byAsset.append(transaction.getAssetId(), id);
+            }
+        }
+
+        // Brings byWallet and byAsset up to the last transfer before a query reads them.
+        void postPending() const {
+            if (postedThrough.load(std::memory_order_acquire) == numTransactions) return;
+            std::lock_guard<std::mutex> guard(postingLock);
+            postRange(postedThrough.load(std::memory_order_relaxed), numTransactions);
+            postedThrough.store(numTransactions, std::memory_order_release);
+        }
+
+        static int64_t bucketOf(int64_t timestamp) {
+            int64_t bucket = timestamp / TIME_BUCKET_SECONDS;
+            return bucket - (timestamp % TIME_BUCKET_SECONDS < 0);
+        }
+
+        void indexBlock(const BlockHeader& header) {
+            int64_t bucket = bucketOf(header.timestamp);
+            auto slot = std::lower_bound(byTime.begin(), byTime.end(), bucket, [](const TimeBucket& entry, int64_t value) { return entry.bucket < value; });
+            if (slot == byTime.end() || slot->bucket != bucket) slot = byTime.insert(slot, TimeBucket{bucket, PostingList()});
+            int first = static_cast<int>(header.firstTransaction);
+            for (int id = first; id < first + static_cast<int>(header.numTransactions); id++) {
+                if (!at(id).isVoid()) slot->ids.append(id);
+            }
+        }
+
+        enum MatchState : uint8_t {NOT_LIVE, UNMATCHED, MATCHED};
+
+        bool isLive(int index) const { return !at(index).isVoid() && !voided[index]; }
+
+        // Pairs the live transfers of both chains as multisets: the k-th copy of a transfer here matches the k-th
+        // copy there. Both sides are split into partitions by hash, and each partition is matched on its own with
+        // an open-addressing table, so the pairing does not depend on the thread count.
+        void matchTransfers(const Blockchain& other, std::vector<uint8_t>& here, std::vector<uint8_t>& there) const {
+            std::vector<unsigned long long> hereHashes(numTransactions), thereHashes(other.numTransactions);
+            auto hashLive = [](const Blockchain& chain, std::vector<unsigned long long>& hashes, std::vector<uint8_t>& states) {
+                states.assign(chain.numTransactions, NOT_LIVE);
+                parallelFor(0, chain.numTransactions, 4096, [&](int64_t first, int64_t last) {
+                    for (int64_t i = first; i < last; i++) {
+                        if (!chain.isLive(static_cast<int>(i))) continue;
+                        states[i] = UNMATCHED;
+                        hashes[i] = chain.at(static_cast<int>(i)).hashValue();
+                    }
+                });
+            };
+            hashLive(*this, hereHashes, here);
+            hashLive(other, thereHashes, there);
+
+            int bits = 0;
+            if (numTransactions + other.numTransactions >= MATCH_PARALLEL_MIN) {
+                while (bits < 8 && (1 << bits) < 4 * TaskPool::getInstance()->getThreads()) bits++;
+            }
+            int numPartitions = 1 << bits;
+            auto partitionOf = [bits](unsigned long long hash) { return bits == 0 ? 0 : static_cast<int>(hash >> (64 - bits)); };
+            auto group = [&](const std::vector<uint8_t>& states, const std::vector<unsigned long long>& hashes, std::vector<int>& start, std::vector<int>& indexes) {
+                start.assign(numPartitions + 1, 0);
+                for (size_t i = 0; i < states.size(); i++) {
+                    if (states[i] != NOT_LIVE) start[partitionOf(hashes[i]) + 1]++;
+                }
+                for (int p = 0; p < numPartitions; p++) start[p + 1] += start[p];
+                indexes.resize(start[numPartitions]);
+                std::vector<int> fill(start.begin(), start.end() - 1);
+                for (size_t i = 0; i < states.size(); i++) {
+                    if (states[i] != NOT_LIVE) indexes[fill[partitionOf(hashes[i])]++] = static_cast<int>(i);
+                }
+            };
+            std::vector<int> hereStart, hereIndexes, thereStart, thereIndexes;
+            group(here, hereHashes, hereStart, hereIndexes);
+            group(there, thereHashes, thereStart, thereIndexes);
+
+            parallelFor(0, numPartitions, 1, [&](int64_t first, int64_t last) {
+                struct Slot {
+                    int key;
+                    int head;
+                };
+                std::vector<Slot> slots;
+                std::vector<int> next;
+                for (int64_t p = first; p < last; p++) {
+                    const int* candidates = thereIndexes.data() + thereStart[p];
+                    int count = thereStart[p + 1] - thereStart[p];
+                    int capacity = 16;
+                    while (capacity < 2 * count) capacity *= 2;
+                    int mask = capacity - 1;
+                    slots.assign(capacity, Slot{-1, -1});
+                    next.assign(count, -1);
+                    auto probe = [&](unsigned long long hash, const Transaction& transaction) {
+                        int i = static_cast<int>(hash & mask);
+                        while (slots[i].key >= 0) {
+                            int key = candidates[slots[i].key];
+                            if (thereHashes[key] == hash && other.at(key) == transaction) break;
+                            i = (i + 1) & mask;
+                        }
+                        return i;
+                    };
+                    // Threads the copies of each transfer there into a list in chain order.
+                    for (int k = count - 1; k >= 0; k--) {
+                        int index = candidates[k];
+                        Slot& slot = slots[probe(thereHashes[index], other.at(index))];
+                        slot.key = k;
+                        next[k] = slot.head;
+                        slot.head = k;
+                    }
+                    for (int k = hereStart[p]; k < hereStart[p + 1]; k++) {
+                        int index = hereIndexes[k];
+                        Slot& slot = slots[probe(hereHashes[index], at(index))];
+                        if (slot.head < 0) continue;
+                        here[index] = MATCHED;
+                        there[candidates[slot.head]] = MATCHED;
+                        slot.head = next[slot.head];
+                    }
+                }
+            });
+        }
+
+        void release() {
+            arena.release();
+            numTransactions = 0;
+            sealedTransactions = 0;
+            blocks.clear();
+            blockHashes.clear();
+            voided.clear();
+            byWallet.clear();
+            byAsset.clear();
+            byTime.clear();
+            postedThrough.store(0, std::memory_order_relaxed);
+        }
+
+        void copyFrom(const Blockchain& other) {
+            other.postPending();
+            arena.copyFrom(other.arena, other.numTransactions);
+            numTransactions = other.numTransactions;
+            sealedTransactions = other.sealedTransactions;
+            blocks = other.blocks;
+            blockHashes = other.blockHashes;
+            voided = other.voided;
+            byWallet = other.byWallet;
+            byAsset = other.byAsset;
+            byTime = other.byTime;
+            postedThrough.store(numTransactions, std::memory_order_relaxed);
+        }
+
+        void stealFrom(Blockchain& other) {
+            arena = std::move(other.arena);
+            numTransactions = other.numTransactions;
+            sealedTransactions = other.sealedTransactions;
+            blocks = std::move(other.blocks);
+            blockHashes = std::move(other.blockHashes);
+            voided = std::move(other.voided);
+            byWallet = std::move(other.byWallet);
+            byAsset = std::move(other.byAsset);
+            byTime = std::move(other.byTime);
+            postedThrough.store(other.postedThrough.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            other.release();
+        }
+
+    public:
+        Blockchain() : numTransactions(0), sealedTransactions(0), postedThrough(0), sink(nullptr) {}
+
+        Blockchain(int capacity) : numTransactions(0), sealedTransactions(0), postedThrough(0), sink(nullptr) { reserve(capacity); }
+    
+        Blockchain(const Blockchain& other) : numTransactions(0), sealedTransactions(0), postedThrough(0), sink(nullptr) { copyFrom(other); }
+
+        Blockchain(Blockchain&& other) noexcept : postedThrough(0), sink(nullptr) { stealFrom(other); }
+
+        ~Blockchain() { release(); }
+
+        int getNumTransactions() const { return numTransactions; }
+        
+        int getCapacity() const { return arena.getCapacity(); }
+
+        int getNumBlocks() const { return static_cast<int>(blocks.size()); }
+
+        int getPendingTransactions() const { return numTransactions - sealedTransactions; }
+
+        const BlockHeader& getBlock(int height) const { return blocks.at(height); }
+
+        const Hash256& getBlockHash(int height) const { return blockHashes.at(height); }
+
+        void getBlockRecords(int height, std::vector<TransactionRecord>& records) const {
+            const BlockHeader& header = blocks.at(height);
+            collectRecords(static_cast<int>(header.firstTransaction), static_cast<int>(header.numTransactions), records);
+        }
+
+        bool isVoided(int index) const { return index >= 0 && index < numTransactions && voided[index]; }
+
+        void attachSink(BlockSink* sink) { this->sink = sink; }
+
+        void reserve(int required) { arena.reserve(required); }
+   
+        const Transaction& addTransaction(const Transaction& transaction) {
+            if (transaction.isVoid()) {
+                int target = transaction.getReference();
+                if (target < 0 || target >= numTransactions) throw out_of_range("Voided transaction index out of range");
+                if (at(target).isVoid()) throw invalid_argument("A void record cannot be voided");
+                if (voided[target]) throw invalid_argument("Transaction is already void");
+            }
+            if (numTransactions - sealedTransactions >= BLOCK_CAPACITY) sealBlock();
+            reserve(numTransactions + 1);
+            Transaction& slot = *new (&at(numTransactions++)) Transaction(transaction);
+            voided.push_back(false);
+            if (transaction.isVoid()) voided[transaction.getReference()] = true;
+            // Posts any restored transfers still waiting for a query along with this one.
+            postRange(postedThrough.load(std::memory_order_relaxed), numTransactions);
+            postedThrough.store(numTransactions, std::memory_order_relaxed);
+            return slot;
+        }
+
+        const Transaction& voidTransaction(int index) { return addTransaction(Transaction::voiding(index)); }
+
+        bool sealBlock() {
+            int count = numTransactions - sealedTransactions;
+            if (count == 0) return false;
+            std::vector<TransactionRecord> records;
+            collectRecords(sealedTransactions, count, records);
+            BlockHeader header = {};
+            header.height = blocks.size();
+            header.timestamp = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            header.firstTransaction = static_cast<uint32_t>(sealedTransactions);
+            header.numTransactions = static_cast<uint32_t>(count);
+            header.prevHash = blockHashes.empty() ? Hash256{} : blockHashes.back();
+            header.merkleRoot = merkleRoot(records.data(), count);
+            blocks.push_back(header);
+            blockHashes.push_back(Sha256::digest(&header, sizeof(header)));
+            indexBlock(header);
+            sealedTransactions = numTransactions;
+            if (sink && !sink->appendBlock(header, records.data())) {
+                cerr << "Failed to append block " << header.height << " to the chain log" << endl;
+            }
+            return true;
+        }
+
+        // Seals pending transactions under a stored header; verifyRoot = false trusts its Merkle root, for sources with
+        // their own checksums.
+        bool restoreBlock(const BlockHeader& header, bool verifyRoot = true) {
+            if (header.height != blocks.size() || header.firstTransaction != static_cast<uint32_t>(sealedTransactions)) return false;
+            if (header.numTransactions == 0 || header.numTransactions > static_cast<uint32_t>(numTransactions - sealedTransactions)) return false;
+            if (header.prevHash != (blockHashes.empty() ? Hash256{} : blockHashes.back())) return false;
+            if (verifyRoot) {
+                std::vector<TransactionRecord> records;
+                collectRecords(sealedTransactions, static_cast<int>(header.numTransactions), records);
+                if (merkleRoot(records.data(), static_cast<int>(header.numTransactions)) != header.merkleRoot) return false;
+            }
+            blocks.push_back(header);
+            blockHashes.push_back(Sha256::digest(&header, sizeof(header)));
+            indexBlock(header);
+            sealedTransactions += static_cast<int>(header.numTransactions);
+            return true;
+        }
+
+        // Appends runs of stored blocks after the tip, taking each from next(headers, numBlocks, records) until it
+        // returns false. Each header is linked to the chain here (height, first transaction and prevHash are
+        // overwritten) and its records are checked as addTransaction checks them. The wallet and asset indexes are left to
+        // the first query that reads them (see postPending), which posts the whole restore in one pass. Returns how many
+        // blocks were appended, stopping at the first that does not fit and leaving no trace of it.
+        template<typename Source>
+        int restoreBlocks(Source next, bool verifyRoot = true) {
+            int restored = 0;
+            BlockHeader* headers;
+            int numBlocks;
+            const TransactionRecord* records;
+            while (next(headers, numBlocks, records)) {
+                int appended = appendBlocks(headers, numBlocks, records, verifyRoot);
+                restored += appended;
+                if (appended < numBlocks) break;
+            }
+            return restored;
+        }
+
+        void clear() { release(); }
+
+        // Live transfers sent or received by wallet, oldest first, read from the wallet index.
+        std::vector<int> findByWallet(WalletId wallet) const {
+            std::vector<int> ids;
+            postPending();
+            const PostingList* list = byWallet.find(wallet.index);
+            if (!list) return ids;
+            list->forEach([&](int id) {
+                const Transaction& transaction = at(id);
+                if (!voided[id] && (transaction.getFromId() == wallet || transaction.getToId() == wallet)) ids.push_back(id);
+            });
+            return ids;
+        }
+
+        // Live transfers of every wallet that has held directory slot index, oldest first.
+        std::vector<int> findByWalletSlot(int index) const {
+            std::vector<int> ids;
+            postPending();
+            const PostingList* list = byWallet.find(index);
+            if (!list) return ids;
+            list->forEach([&](int id) {
+                if (!voided[id]) ids.push_back(id);
+            });
+            return ids;
+        }
+
+        // Live transfers of asset, oldest first, read from the asset index.
+        std::vector<int> findByAsset(AssetId asset) const {
+            std::vector<int> ids;
+            postPending();
+            const PostingList* list = byAsset.find(asset);
+            if (!list) return ids;
+            list->forEach([&](int id) {
+                if (!voided[id]) ids.push_back(id);
+            });
+            return ids;
+        }
+
+        // Live transfers sealed into blocks stamped within [from, to) (seconds since the epoch), oldest first; pending
+        // transfers have no block time yet.
+        std::vector<int> findByTime(int64_t from, int64_t to) const {
+            std::vector<int> ids;
+            if (from >= to) return ids;
+            auto slot = std::lower_bound(byTime.begin(), byTime.end(), bucketOf(from), [](const TimeBucket& entry, int64_t value) { return entry.bucket < value; });
+            for (; slot != byTime.end() && slot->bucket <= bucketOf(to - 1); ++slot) {
+                bool whole = slot->bucket > bucketOf(from) && slot->bucket < bucketOf(to - 1);
+                size_t height = 0;
+                slot->ids.forEach([&](int id) {
+                    if (voided[id]) return;
+                    if (!whole) {
+                        if (height == 0 || id >= static_cast<int>(blocks[height - 1].firstTransaction + blocks[height - 1].numTransactions)) {
+                            height = std::upper_bound(blocks.begin(), blocks.end(), static_cast<uint32_t>(id),
+                                [](uint32_t value, const BlockHeader& block) { return value < block.firstTransaction; }) - blocks.begin();
+                        }
+                        int64_t timestamp = blocks[height - 1].timestamp;
+                        if (timestamp < from || timestamp >= to) return;
+                    }
+                    ids.push_back(id);
+                });
+            }
+            if (!std::is_sorted(ids.begin(), ids.end())) std::sort(ids.begin(), ids.end());
+            return ids;
+        }
+
+        // Bytes held by the posting lists of the three indexes.
+        size_t getIndexBytes() const {
+            postPending();
+            size_t total = byWallet.getBytes() + byAsset.getBytes();
+            for (const TimeBucket& entry : byTime) total += entry.ids.getBytes();
+            return total;
+        }
+
+        template<typename Visitor>
+        void forEach(Visitor visit) const {
+            for (int c = 0; c * TransactionArena::CHUNK_SIZE < numTransactions; c++) {
+                const Transaction* chunk = arena.getChunk(c);
+                int count = std::min(TransactionArena::CHUNK_SIZE, numTransactions - c * TransactionArena::CHUNK_SIZE);
+                for (int i = 0; i < count; i++) {
+                    visit(chunk[i]);
+                }
+            }
+        }
+
+        Blockchain& operator=(const Blockchain& other) {
+            if (this != &other) {
+                blocks.clear();
+                blockHashes.clear();
+                voided.clear();
+                byWallet.clear();
+                byAsset.clear();
+                byTime.clear();
+                postedThrough.store(0, std::memory_order_relaxed);
+                numTransactions = 0;
+                sealedTransactions = 0;
+                copyFrom(other);
+            }
+            return *this;
+        }
+
+        Blockchain& operator=(Blockchain&& other) noexcept {
+            if (this != &other) {
+                release();
+                stealFrom(other);
+            }
+            return *this;
+        }
+
+        bool operator==(const Blockchain& other) const {return numTransactions == other.numTransactions;}
+
+        bool operator<(const Blockchain& other) const {return numTransactions < other.numTransactions;}
+
+        Blockchain operator+(const Blockchain& other) const {
+            Blockchain newBlockchain(numTransactions + other.numTransactions);
+            forEach([&](const Transaction& transaction) { newBlockchain.addTransaction(transaction); });
+            other.forEach([&](const Transaction& transaction) {
+                if (transaction.isVoid()) newBlockchain.voidTransaction(transaction.getReference() + numTransactions);
+                else newBlockchain.addTransaction(transaction);
+            });
+            return newBlockchain;
+        }
+
+        // Live transfers that only other has (added) and that only this chain has (removed), counting copies.
+        ChainDiff diff(const Blockchain& other) const {
+            std::vector<uint8_t> here, there;
+            matchTransfers(other, here, there);
+            ChainDiff result;
+            for (int i = 0; i < numTransactions; i++) {
+                if (here[i] == UNMATCHED) result.removed.push_back(at(i));
+            }
+            for (int i = 0; i < other.numTransactions; i++) {
+                if (there[i] == UNMATCHED) result.added.push_back(other.at(i));
+            }
+            return result;
+        }
+
+        // Live transfers of this chain that other also has, as many copies as both have.
+        Blockchain intersection(const Blockchain& other) const {
+            std::vector<uint8_t> here, there;
+            matchTransfers(other, here, there);
+            Blockchain newBlockchain;
+            for (int i = 0; i < numTransactions; i++) {
+                if (here[i] == MATCHED) newBlockchain.addTransaction(at(i));
+            }
+            return newBlockchain;
+        }
+
+        // Appends the live transfers of other that this chain lacks, in their order; returns how many.
+        int merge(const Blockchain& other) {
+            std::vector<uint8_t> here, there;
+            matchTransfers(other, here, there);
+            int count = other.numTransactions;
+            int added = 0;
+            for (int i = 0; i < count; i++) {
+                if (there[i] != UNMATCHED) continue;
+                addTransaction(Transaction(other.at(i)));
+                added++;
+            }
+            return added;
+        }
+
+        // Live transfers of this chain that other lacks, counting copies.
+        Blockchain operator-(const Blockchain& other) const {
+            std::vector<uint8_t> here, there;
+            matchTransfers(other, here, there);
+            Blockchain newBlockchain;
+            for (int i = 0; i < numTransactions; i++) {
+                if (here[i] == UNMATCHED) newBlockchain.addTransaction(at(i));
+            }
+            return newBlockchain;
+        }
+
+        Blockchain& operator++() {
+            reserve(getCapacity() + 10);
+            return *this;
+        }
+
+        Blockchain operator++(int) {
+            Blockchain temp = *this;
+            ++(*this);
+            return temp;
+        }
+
+        const Transaction& operator[](int index) const {
+            if (index < 0 || index >= numTransactions) {
+                throw out_of_range("Index out of range");
+            }
+            return at(index);
+        }
+
+        friend ostream& operator<<(ostream& os, const Blockchain& blockchain);
+};
+
+ostream& operator<<(ostream& os, const Blockchain& blockchain) {
+    os << "Blockchain Transactions (" << blockchain.getNumBlocks() << " blocks, " << blockchain.getPendingTransactions() << " pending):\n";
+    for (int i = 0; i < blockchain.numTransactions; i++) {
+        os << i << ". " << blockchain.at(i);
+        if (blockchain.voided[i]) os << " [void]";
+        os << "\n";
+    }
+    return os;
+}
+
+enum class SettlementStatus : uint8_t {Settled, NotTransfer, UnknownWallet, InactiveWallet, UnknownAsset, InvalidAmount, InsufficientFunds};
+
+struct SettlementReport {
+    int settled;
+    int rejected;
+    int waves;
+    double ms;
+
+    double settledPerSecond() const { return ms > 0 ? settled / (ms / 1000) : 0; }
+};
+
+// Moves transfers between wallets: the sender must be active, hold the asset and cover the amount, and the debit
+// and credit happen together or not at all. A batch is split into waves of transfers that touch disjoint wallets;
+// every wallet still sees its transfers in batch order, so the outcome equals settling one by one.
+class SettlementEngine {
+    private:
+        const WalletDirectory& directory;
+        const AssetRegistry& registry;
+        std::vector<int> lastWave;
+        std::vector<int> waveStart;
+        std::vector<int> order;
+
+        void applyRange(const Transaction* transactions, const int* indexes, int count, SettlementStatus* statuses) const {
+            for (int i = 0; i < count; i++) statuses[indexes[i]] = apply(transactions[indexes[i]]);
+        }
+
+        // Wave of each transfer is one past the last wave that touched either of its wallets.
+        int planWaves(const Transaction* transactions, int count) {
+            lastWave.assign(directory.getNumSlots(), -1);
+            order.resize(count);
+            int numWaves = 0;
+            for (int i = 0; i < count; i++) {
+                int from = transactions[i].getFromId().index, to = transactions[i].getToId().index;
+                bool tracked = transactions[i].getKind() == TransactionKind::Transfer && from >= 0 && from < directory.getNumSlots() && to >= 0 && to < directory.getNumSlots();
+                int wave = tracked ? std::max(lastWave[from], lastWave[to]) + 1 : 0;
+                if (tracked) lastWave[from] = lastWave[to] = wave;
+                order[i] = wave;
+                numWaves = std::max(numWaves, wave + 1);
+            }
+            waveStart.assign(numWaves + 1, 0);
+            for (int i = 0; i < count; i++) waveStart[order[i] + 1]++;
+            for (int wave = 0; wave < numWaves; wave++) waveStart[wave + 1] += waveStart[wave];
+            std::vector<int> next(waveStart.begin(), waveStart.end() - 1);
+            std::vector<int> byWave(count);
+            for (int i = 0; i < count; i++) byWave[next[order[i]]++] = i;
+            order.swap(byWave);
+            return numWaves;
+        }
+
+    public:
+        static const int PARALLEL_MIN = 1024;
+
+        SettlementEngine(const WalletDirectory& directory, const AssetRegistry& registry) : directory(directory), registry(registry) {}
+
+        // Settles one transfer without recording it. Callers must keep other threads off both wallets.
+        SettlementStatus apply(const Transaction& transaction) const {
+            if (transaction.getKind() != TransactionKind::Transfer) return SettlementStatus::NotTransfer;
+            Wallet* from = directory.get(transaction.getFromId());
+            Wallet* to = directory.get(transaction.getToId());
+            if (!from || !to) return SettlementStatus::UnknownWallet;
+            if (!from->getIsActive() || !to->getIsActive()) return SettlementStatus::InactiveWallet;
+            const CryptoCurrency* crypto = registry.get(transaction.getAssetId());
+            if (!crypto) return SettlementStatus::UnknownAsset;
+            AssetId asset = transaction.getAssetId();
+            Amount amount = transaction.getAmount();
+            if (amount.isNegative() || !amount.fitsDecimals(crypto->getDecimals())) return SettlementStatus::InvalidAmount;
+            if (from->balance(asset) < amount) return SettlementStatus::InsufficientFunds;
+            from->debit(asset, amount);
+            try {
+                to->credit(asset, amount);
+            } catch (...) {
+                from->credit(asset, amount);
+                throw;
+            }
+            return SettlementStatus::Settled;
+        }
+
+        static const char* statusName(SettlementStatus status) {
+            switch (status) {
+                case SettlementStatus::Settled: return "settled";
+                case SettlementStatus::NotTransfer: return "not a transfer";
+                case SettlementStatus::UnknownWallet: return "unknown wallet";
+                case SettlementStatus::InactiveWallet: return "inactive wallet";
+                case SettlementStatus::UnknownAsset: return "unknown asset";
+                case SettlementStatus::InvalidAmount: return "invalid amount";
+                case SettlementStatus::InsufficientFunds: return "insufficient funds";
+            }
+            return "unknown";
+        }
+
+        // Settles one transfer and records it on the chain if it went through.
+        SettlementStatus settle(const Transaction& transaction, Blockchain& blockchain) const {
+            SettlementStatus status = apply(transaction);
+            if (status == SettlementStatus::Settled) blockchain.addTransaction(transaction);
+            return status;
+        }
+
+        // Settles a batch wave by wave, splitting large waves across the task pool, then records the settled
+        // transfers on the chain in batch order. statuses receives one entry per transaction.
+        SettlementReport settleBatch(const Transaction* transactions, int count, Blockchain& blockchain, SettlementStatus* statuses) {
+            auto start = chrono::steady_clock::now();
+            int numWaves = planWaves(transactions, count);
+            for (int wave = 0; wave < numWaves; wave++) {
+                const int* indexes = order.data() + waveStart[wave];
+                parallelFor(0, waveStart[wave + 1] - waveStart[wave], PARALLEL_MIN, [&](int64_t first, int64_t last) {
+                    applyRange(transactions, indexes + first, static_cast<int>(last - first), statuses);
+                });
+            }
+            SettlementReport report = {0, 0, numWaves, 0};
+            for (int i = 0; i < count; i++) {
+                if (statuses[i] == SettlementStatus::Settled) {
+                    blockchain.addTransaction(transactions[i]);
+                    report.settled++;
+                } else {
+                    report.rejected++;
+                }
+            }
+            report.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            return report;
+        }
+};
+
+// Concurrent ingestion path for the chain. Producer threads settle transfers under the lock stripes of both wallets
+// and append them to private segments, tagged with a sequence number taken while those locks are held, so transfers
+// that share a wallet are numbered in the order they were applied. commit() merges the segments into the chain by
+// sequence number: whichever thread commits, the chain is the serial history the balances came from.
+class ChainIngest {
+    private:
+        struct SequencedTransfer {
+            uint64_t sequence;
+            Transaction transaction;
+        };
+
+        struct alignas(64) Stripe {
+            std::mutex lock;
+        };
+
+        struct alignas(64) Segment {
+            std::vector<SequencedTransfer> entries;
+            int rejected = 0;
+        };
+
+        Blockchain& blockchain;
+        const WalletDirectory& directory;
+        SettlementEngine engine;
+        std::unique_ptr<Stripe[]> stripes;
+        std::vector<Segment> segments;
+        std::atomic<uint64_t> sequence;
+
+        static int stripeOf(const WalletId& id) { return static_cast<int>(static_cast<unsigned int>(id.index) * 2654435761u >> 26) & (STRIPES - 1); }
+
+    public:
+        static const int STRIPES = 64;
+
+        ChainIngest(Blockchain& blockchain, const WalletDirectory& directory, const AssetRegistry& registry, int numProducers)
+            : blockchain(blockchain), directory(directory), engine(directory, registry), stripes(new Stripe[STRIPES]), segments(numProducers), sequence(0) {
+            if (numProducers < 1) throw invalid_argument("Ingestion needs at least one producer");
+        }
+
+        int getNumProducers() const { return static_cast<int>(segments.size()); }
+
+        // Safe to call from many threads at once as long as each producer index is used by one thread at a time.
+        SettlementStatus submit(int producer, const Transaction& transaction) {
+            Segment& segment = segments.at(producer);
+            int first = stripeOf(transaction.getFromId()), second = stripeOf(transaction.getToId());
+            if (first > second) std::swap(first, second);
+            std::unique_lock<std::mutex> firstLock(stripes[first].lock);
+            std::unique_lock<std::mutex> secondLock;
+            if (second != first) secondLock = std::unique_lock<std::mutex>(stripes[second].lock);
+            SettlementStatus status = engine.apply(transaction);
+            if (status != SettlementStatus::Settled) {
+                segment.rejected++;
+                return status;
+            }
+            uint64_t number = sequence.fetch_add(1, std::memory_order_relaxed);
+            firstLock.unlock();
+            if (secondLock.owns_lock()) secondLock.unlock();
+            segment.entries.push_back(SequencedTransfer{number, transaction});
+            return status;
+        }
+
+        int getPending() const {
+            int pending = 0;
+            for (const Segment& segment : segments) pending += static_cast<int>(segment.entries.size());
+            return pending;
+        }
+
+        int getRejected() const {
+            int rejected = 0;
+            for (const Segment& segment : segments) rejected += segment.rejected;
+            return rejected;
+        }
+
+        // Appends every pending transfer in sequence order. Producers must be idle.
+        int commit() {
+            typedef std::pair<uint64_t, int> Head;
+            std::vector<Head> heads;
+            std::vector<size_t> positions(segments.size(), 0);
+            for (size_t i = 0; i < segments.size(); i++) {
+                if (!segments[i].entries.empty()) heads.push_back(Head(segments[i].entries[0].sequence, static_cast<int>(i)));
+            }
+            std::make_heap(heads.begin(), heads.end(), std::greater<Head>());
+            blockchain.reserve(blockchain.getNumTransactions() + getPending());
+            int committed = 0;
+            while (!heads.empty()) {
+                std::pop_heap(heads.begin(), heads.end(), std::greater<Head>());
+                int producer = heads.back().second;
+                std::vector<SequencedTransfer>& entries = segments[producer].entries;
+                blockchain.addTransaction(entries[positions[producer]++].transaction);
+                committed++;
+                if (positions[producer] < entries.size()) {
+                    heads.back().first = entries[positions[producer]].sequence;
+                    std::push_heap(heads.begin(), heads.end(), std::greater<Head>());
+                } else {
+                    heads.pop_back();
+                }
+            }
+            for (Segment& segment : segments) {
+                segment.entries.clear();
+                segment.rejected = 0;
+            }
+            return committed;
+        }
+};
+
+enum class QueryType : uint8_t {Int, Amount};
+
+struct QueryColumn {
+    string name;
+    QueryType type;
+};
+
+// Up to CAPACITY rows stored column by column; each column uses the vector matching its type.
+struct RowBatch {
+    static const int CAPACITY = 1024;
+
+    int size = 0;
+    std::vector<std::vector<int64_t>> ints;
+    std::vector<std::vector<Amount>> amounts;
+
+    void shape(const std::vector<QueryColumn>& schema) {
+        ints.resize(schema.size());
+        amounts.resize(schema.size());
+        for (size_t c = 0; c < schema.size(); c++) {
+            if (schema[c].type == QueryType::Int) ints[c].resize(CAPACITY);
+            else amounts[c].resize(CAPACITY);
+        }
+        size = 0;
+    }
+};
+
+// A pull-based operator: each call to next() hands over the next batch of rows.
+class QueryOperator {
+    protected:
+        std::vector<QueryColumn> schema;
+
+    public:
+        virtual ~QueryOperator() {}
+
+        const std::vector<QueryColumn>& getSchema() const { return schema; }
+
+        int columnIndex(const string& name) const {
+            for (size_t c = 0; c < schema.size(); c++) {
+                if (schema[c].name == name) return static_cast<int>(c);
+            }
+            throw invalid_argument("Unknown query column: " + name);
+        }
+
+        // Fills batch with the next non-empty batch of rows; returns false once the input is exhausted.
+        virtual bool next(RowBatch& batch) = 0;
+};
+
+typedef std::unique_ptr<QueryOperator> QueryPlan;
+
+// Live transfers of a chain, oldest first, either as one row per transfer (id, from, to, asset, amount, time) or
+// as two signed legs per transfer (id, wallet, counterparty, asset, amount, time). Wallet columns hold directory
+// slots and time is the block timestamp, or -1 while the transfer is pending.
+class LedgerScan : public QueryOperator {
+    public:
+        enum Mode {TRANSFERS, LEGS};
+
+    private:
+        const Blockchain& chain;
+        Mode mode;
+        std::vector<int> ids;
+        bool useIds;
+        int position;
+        int end;
+        int height;
+
+        // Ids arrive in increasing order, so the block cursor only moves forward.
+        int64_t timeOf(int id) {
+            int numBlocks = chain.getNumBlocks();
+            auto endOf = [&](int block) { return static_cast<int>(chain.getBlock(block).firstTransaction + chain.getBlock(block).numTransactions); };
+            if (height < numBlocks && id >= endOf(height)) {
+                int low = height + 1, high = numBlocks;
+                while (low < high) {
+                    int middle = (low + high) / 2;
+                    if (id >= endOf(middle)) low = middle + 1;
+                    else high = middle;
+                }
+                height = low;
+            }
+            return height < numBlocks ? chain.getBlock(height).timestamp : -1;
+        }
+
+    public:
+        LedgerScan(const Blockchain& chain, Mode mode) : chain(chain), mode(mode), useIds(false), position(0), end(chain.getNumTransactions()), height(0) {
+            if (mode == TRANSFERS) {
+                schema = {{"id", QueryType::Int}, {"from", QueryType::Int}, {"to", QueryType::Int}, {"asset", QueryType::Int},
+                          {"amount", QueryType::Amount}, {"time", QueryType::Int}};
+            } else {
+                schema = {{"id", QueryType::Int}, {"wallet", QueryType::Int}, {"counterparty", QueryType::Int}, {"asset", QueryType::Int},
+                          {"amount", QueryType::Amount}, {"time", QueryType::Int}};
+            }
+        }
+
+        // Reads only these increasing ids, as returned by one of the chain's indexes.
+        LedgerScan(const Blockchain& chain, Mode mode, std::vector<int> ids) : LedgerScan(chain, mode) {
+            this->ids = std::move(ids);
+            useIds = true;
+            end = static_cast<int>(this->ids.size());
+        }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            int n = 0;
+            int rowsPerTransfer = mode == TRANSFERS ? 1 : 2;
+            while (n + rowsPerTransfer <= RowBatch::CAPACITY && position < end) {
+                int id = useIds ? ids[position] : position;
+                position++;
+                const Transaction& transaction = chain[id];
+                if (transaction.isVoid() || chain.isVoided(id)) continue;
+                int64_t time = timeOf(id);
+                int from = transaction.getFromId().index, to = transaction.getToId().index;
+                for (int leg = 0; leg < rowsPerTransfer; leg++) {
+                    batch.ints[0][n] = id;
+                    batch.ints[1][n] = leg == 0 ? from : to;
+                    batch.ints[2][n] = leg == 0 ? to : from;
+                    batch.ints[3][n] = transaction.getAssetId();
+                    batch.amounts[4][n] = mode == LEGS && leg == 0 ? -transaction.getAmount() : transaction.getAmount();
+                    batch.ints[5][n] = time;
+                    n++;
+                }
+            }
+            batch.size = n;
+            return n > 0;
+        }
+};
+
+// Registered assets as (asset, type, price, marketCap) rows, read from the market table and the asset objects.
+class AssetScan : public QueryOperator {
+    private:
+        const AssetRegistry& registry;
+        int position;
+
+    public:
+        explicit AssetScan(const AssetRegistry& registry) : registry(registry), position(0) {
+            schema = {{"asset", QueryType::Int}, {"type", QueryType::Int}, {"price", QueryType::Amount}, {"marketCap", QueryType::Int}};
+        }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            const MarketTable& market = registry.getMarketTable();
+            int n = 0;
+            for (; n < RowBatch::CAPACITY && position < registry.getNumSlots(); position++) {
+                const CryptoCurrency* asset = registry.get(position);
+                if (!asset) continue;
+                batch.ints[0][n] = position;
+                batch.ints[1][n] = market.getType(position);
+                batch.amounts[2][n] = asset->getPrice();
+                batch.ints[3][n] = market.getMarketCap(position);
+                n++;
+            }
+            batch.size = n;
+            return n > 0;
+        }
+};
+
+enum class CompareOp : uint8_t {Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual};
+
+// column <op> value; an integer value compared against an Amount column counts whole units.
+struct QueryPredicate {
+    string column;
+    CompareOp op;
+    int64_t value;
+    Amount amount;
+    bool isAmount;
+
+    QueryPredicate(const string& column, CompareOp op, int64_t value) : column(column), op(op), value(value), amount(value), isAmount(false) {}
+    QueryPredicate(const string& column, CompareOp op, Amount amount) : column(column), op(op), value(0), amount(amount), isAmount(true) {}
+};
+
+// Keeps the rows matching every predicate. Each predicate narrows a selection vector over the whole batch before
+// the surviving rows are gathered column by column.
+class QueryFilter : public QueryOperator {
+    private:
+        QueryPlan input;
+        std::vector<QueryPredicate> predicates;
+        std::vector<int> columns;
+        RowBatch inner;
+        std::vector<int> selection;
+
+        template <typename T>
+        static int select(const T* values, int* rows, int count, CompareOp op, const T& value) {
+            int kept = 0;
+            switch (op) {
+                case CompareOp::Equal: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] == value; } break;
+                case CompareOp::NotEqual: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] != value; } break;
+                case CompareOp::Less: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] < value; } break;
+                case CompareOp::LessEqual: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] <= value; } break;
+                case CompareOp::Greater: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] > value; } break;
+                case CompareOp::GreaterEqual: for (int i = 0; i < count; i++) { rows[kept] = rows[i]; kept += values[rows[i]] >= value; } break;
+            }
+            return kept;
+        }
+
+    public:
+        QueryFilter(QueryPlan input, std::vector<QueryPredicate> predicates) : input(std::move(input)), predicates(std::move(predicates)), selection(RowBatch::CAPACITY) {
+            schema = this->input->getSchema();
+            for (const QueryPredicate& predicate : this->predicates) {
+                int column = columnIndex(predicate.column);
+                if (predicate.isAmount && schema[column].type != QueryType::Amount) throw invalid_argument("Column " + predicate.column + " is not an amount");
+                columns.push_back(column);
+            }
+        }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            while (input->next(inner)) {
+                int count = inner.size;
+                for (int i = 0; i < count; i++) selection[i] = i;
+                for (size_t p = 0; p < predicates.size() && count > 0; p++) {
+                    int column = columns[p];
+                    if (schema[column].type == QueryType::Int) count = select(inner.ints[column].data(), selection.data(), count, predicates[p].op, predicates[p].value);
+                    else count = select(inner.amounts[column].data(), selection.data(), count, predicates[p].op, predicates[p].amount);
+                }
+                if (count == 0) continue;
+                for (size_t c = 0; c < schema.size(); c++) {
+                    if (schema[c].type == QueryType::Int) {
+                        for (int i = 0; i < count; i++) batch.ints[c][i] = inner.ints[c][selection[i]];
+                    } else {
+                        for (int i = 0; i < count; i++) batch.amounts[c][i] = inner.amounts[c][selection[i]];
+                    }
+                }
+                batch.size = count;
+                return true;
+            }
+            return false;
+        }
+};
+
+// An output column copied from source; a positive bucket rounds integer values down to a multiple of it.
+struct ProjectColumn {
+    string name;
+    string source;
+    int64_t bucket;
+
+    ProjectColumn(const string& name, const string& source, int64_t bucket = 0) : name(name), source(source), bucket(bucket) {}
+};
+
+class QueryProject : public QueryOperator {
+    private:
+        QueryPlan input;
+        std::vector<ProjectColumn> columns;
+        std::vector<int> sources;
+        RowBatch inner;
+
+    public:
+        QueryProject(QueryPlan input, std::vector<ProjectColumn> columns) : input(std::move(input)), columns(std::move(columns)) {
+            for (const ProjectColumn& column : this->columns) {
+                int source = this->input->columnIndex(column.source);
+                QueryType type = this->input->getSchema()[source].type;
+                if (column.bucket > 0 && type != QueryType::Int) throw invalid_argument("Only integer columns can be bucketed: " + column.source);
+                sources.push_back(source);
+                schema.push_back(QueryColumn{column.name, type});
+            }
+        }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            if (!input->next(inner)) return false;
+            int count = inner.size;
+            for (size_t c = 0; c < schema.size(); c++) {
+                int source = sources[c];
+                int64_t bucket = columns[c].bucket;
+                if (schema[c].type == QueryType::Amount) {
+                    std::copy(inner.amounts[source].begin(), inner.amounts[source].begin() + count, batch.amounts[c].begin());
+                } else if (bucket <= 0) {
+                    std::copy(inner.ints[source].begin(), inner.ints[source].begin() + count, batch.ints[c].begin());
+                } else {
+                    const int64_t* values = inner.ints[source].data();
+                    int64_t* out = batch.ints[c].data();
+                    for (int i = 0; i < count; i++) out[i] = (values[i] / bucket - (values[i] % bucket < 0)) * bucket;
+                }
+            }
+            batch.size = count;
+            return true;
+        }
+};
+
+enum class AggregateKind : uint8_t {Count, Sum, Min, Max};
+
+// An aggregate over source (unused for Count), output as name.
+struct QueryAggregate {
+    AggregateKind kind;
+    string source;
+    string name;
+};
+
+// Hash aggregation on integer key columns. At most maxGroups groups stay in memory: when the table fills up, the
+// partial groups are written to temporary files partitioned by hash, and each partition is merged on its own
+// once the input is exhausted, splitting further if it still does not fit. Groups come out in no particular order.
+class QueryGroupBy : public QueryOperator {
+    private:
+        static const int SPILL_BITS = 4;
+        static const int SPILL_FANOUT = 1 << SPILL_BITS;
+
+        QueryPlan input;
+        std::vector<int> keyColumns;
+        std::vector<QueryAggregate> aggregates;
+        std::vector<int> sourceColumns;
+        int maxGroups;
+        int numKeys;
+        int numAggregates;
+
+        std::vector<int64_t> keys;
+        std::vector<unsigned long long> hashes;
+        std::vector<int64_t> counts;
+        std::vector<AmountSum> sums;
+        std::vector<Amount> extremes;
+        std::vector<int> slots;
+
+        std::vector<FILE*> partitions;
+        std::deque<std::pair<FILE*, int>> pending;
+        int depth;
+        int emitted;
+        bool consumed;
+        int spillFiles;
+
+        int numGroups() const { return static_cast<int>(counts.size()); }
+
+        void resetTable() {
+            keys.clear();
+            hashes.clear();
+            counts.clear();
+            sums.clear();
+            extremes.clear();
+            slots.assign(16, -1);
+            emitted = 0;
+        }
+
+        int findOrAdd(const int64_t* key, unsigned long long hash, bool& added) {
+            int mask = static_cast<int>(slots.size()) - 1;
+            int i = static_cast<int>(hash & mask);
+            while (slots[i] >= 0) {
+                int group = slots[i];
+                if (hashes[group] == hash && std::equal(key, key + numKeys, keys.begin() + static_cast<size_t>(group) * numKeys)) {
+                    added = false;
+                    return group;
+                }
+                i = (i + 1) & mask;
+            }
+            added = true;
+            if (numGroups() == maxGroups) {
+                spill();
+                return findOrAdd(key, hash, added);
+            }
+            int group = numGroups();
+            slots[i] = group;
+            keys.insert(keys.end(), key, key + numKeys);
+            hashes.push_back(hash);
+            counts.push_back(0);
+            sums.resize(sums.size() + numAggregates);
+            extremes.resize(extremes.size() + numAggregates);
+            if (2 * numGroups() > static_cast<int>(slots.size())) {
+                slots.assign(2 * slots.size(), -1);
+                int newMask = static_cast<int>(slots.size()) - 1;
+                for (int g = 0; g < numGroups(); g++) {
+                    int j = static_cast<int>(hashes[g] & newMask);
+                    while (slots[j] >= 0) j = (j + 1) & newMask;
+                    slots[j] = g;
+                }
+            }
+            return group;
+        }
+
+        // Moves every group to the partition files of the current depth, leaving the table empty.
+        void spill() {
+            if (depth * SPILL_BITS >= 64) throw runtime_error("Too many groups share one hash to spill");
+            if (partitions.empty()) {
+                partitions.assign(SPILL_FANOUT, nullptr);
+                for (FILE*& file : partitions) {
+                    file = std::tmpfile();
+                    if (!file) throw runtime_error("Cannot create a spill file for grouping");
+                    spillFiles++;
+                }
+            }
+            int shift = 64 - SPILL_BITS * (depth + 1);
+            for (int g = 0; g < numGroups(); g++) {
+                FILE* file = partitions[(hashes[g] >> shift) & (SPILL_FANOUT - 1)];
+                fwrite(&keys[static_cast<size_t>(g) * numKeys], sizeof(int64_t), numKeys, file);
+                fwrite(&counts[g], sizeof(int64_t), 1, file);
+                for (int a = 0; a < numAggregates; a++) {
+                    Amount sum = sums[static_cast<size_t>(g) * numAggregates + a].total();
+                    const Amount& extreme = extremes[static_cast<size_t>(g) * numAggregates + a];
+                    uint64_t words[4] = {sum.lowWord(), static_cast<uint64_t>(sum.highWord()), extreme.lowWord(), static_cast<uint64_t>(extreme.highWord())};
+                    fwrite(words, sizeof(words), 1, file);
+                }
+            }
+            resetTable();
+        }
+
+        // After a source is consumed, queues the partitions it spilled so they are merged one at a time.
+        void finishSource() {
+            if (partitions.empty()) return;
+            spill();
+            for (FILE* file : partitions) {
+                if (fflush(file) != 0 || ferror(file)) throw runtime_error("Failed to write a grouping spill file");
+                rewind(file);
+                pending.push_back(std::make_pair(file, depth + 1));
+            }
+            partitions.clear();
+        }
+
+        void accumulate(int group, int a, const Amount& value, bool added) {
+            size_t cell = static_cast<size_t>(group) * numAggregates + a;
+            sums[cell].add(value);
+            Amount& extreme = extremes[cell];
+            if (added || (aggregates[a].kind == AggregateKind::Min ? value < extreme : value > extreme)) extreme = value;
+        }
+
+        void consume() {
+            RowBatch batch;
+            std::vector<unsigned long long> batchHashes(RowBatch::CAPACITY);
+            std::vector<int64_t> key(numKeys);
+            while (input->next(batch)) {
+                int count = batch.size;
+                std::fill(batchHashes.begin(), batchHashes.begin() + count, 0x9E3779B97F4A7C15ULL);
+                for (int k = 0; k < numKeys; k++) {
+                    const int64_t* values = batch.ints[keyColumns[k]].data();
+                    for (int i = 0; i < count; i++) batchHashes[i] = mixHash(batchHashes[i], static_cast<unsigned long long>(values[i]));
+                }
+                for (int i = 0; i < count; i++) {
+                    for (int k = 0; k < numKeys; k++) key[k] = batch.ints[keyColumns[k]][i];
+                    bool added;
+                    int group = findOrAdd(key.data(), batchHashes[i], added);
+                    counts[group]++;
+                    for (int a = 0; a < numAggregates; a++) {
+                        int source = sourceColumns[a];
+                        if (source < 0) continue;
+                        if (input->getSchema()[source].type == QueryType::Amount) accumulate(group, a, batch.amounts[source][i], added);
+                        else accumulate(group, a, Amount::fromUnits(batch.ints[source][i]), added);
+                    }
+                }
+            }
+            finishSource();
+        }
+
+        // Merges the partial groups of one spilled partition back into the table.
+        void load(FILE* file) {
+            std::vector<int64_t> key(numKeys);
+            int64_t count;
+            std::vector<uint64_t> words(4 * static_cast<size_t>(numAggregates));
+            while (fread(key.data(), sizeof(int64_t), numKeys, file) == static_cast<size_t>(numKeys)) {
+                if (fread(&count, sizeof(count), 1, file) != 1 || fread(words.data(), sizeof(uint64_t), words.size(), file) != words.size()) {
+                    throw runtime_error("Truncated grouping spill file");
+                }
+                unsigned long long hash = 0x9E3779B97F4A7C15ULL;
+                for (int k = 0; k < numKeys; k++) hash = mixHash(hash, static_cast<unsigned long long>(key[k]));
+                bool added;
+                int group = findOrAdd(key.data(), hash, added);
+                counts[group] += count;
+                for (int a = 0; a < numAggregates; a++) {
+                    size_t cell = static_cast<size_t>(group) * numAggregates + a;
+                    sums[cell].add(Amount::fromWords(words[4 * a], static_cast<int64_t>(words[4 * a + 1])));
+                    Amount extreme = Amount::fromWords(words[4 * a + 2], static_cast<int64_t>(words[4 * a + 3]));
+                    if (added || (aggregates[a].kind == AggregateKind::Min ? extreme < extremes[cell] : extreme > extremes[cell])) extremes[cell] = extreme;
+                }
+            }
+            fclose(file);
+            finishSource();
+        }
+
+        static int64_t wholeUnits(const Amount& value) {
+            if (value.highWord() != (static_cast<int64_t>(value.lowWord()) < 0 ? -1 : 0)) throw overflow_error("Aggregate overflows an integer column");
+            return static_cast<int64_t>(value.lowWord());
+        }
+
+    public:
+        QueryGroupBy(QueryPlan input, const std::vector<string>& keyNames, std::vector<QueryAggregate> aggregates, int maxGroups = 1 << 20)
+            : input(std::move(input)), aggregates(std::move(aggregates)), maxGroups(std::max(maxGroups, 1)), depth(0), emitted(0), consumed(false), spillFiles(0) {
+            for (const string& name : keyNames) {
+                int column = this->input->columnIndex(name);
+                if (this->input->getSchema()[column].type != QueryType::Int) throw invalid_argument("Group keys must be integer columns: " + name);
+                keyColumns.push_back(column);
+                schema.push_back(QueryColumn{name, QueryType::Int});
+            }
+            for (const QueryAggregate& aggregate : this->aggregates) {
+                int source = aggregate.kind == AggregateKind::Count ? -1 : this->input->columnIndex(aggregate.source);
+                sourceColumns.push_back(source);
+                schema.push_back(QueryColumn{aggregate.name, source < 0 ? QueryType::Int : this->input->getSchema()[source].type});
+            }
+            numKeys = static_cast<int>(keyColumns.size());
+            numAggregates = static_cast<int>(this->aggregates.size());
+            resetTable();
+        }
+
+        ~QueryGroupBy() {
+            for (FILE* file : partitions) fclose(file);
+            for (const std::pair<FILE*, int>& partition : pending) fclose(partition.first);
+        }
+
+        int getSpillFiles() const { return spillFiles; }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            if (!consumed) {
+                consume();
+                consumed = true;
+            }
+            while (emitted == numGroups()) {
+                if (pending.empty()) return false;
+                resetTable();
+                std::pair<FILE*, int> partition = pending.front();
+                pending.pop_front();
+                depth = partition.second;
+                load(partition.first);
+            }
+            int n = 0;
+            for (; n < RowBatch::CAPACITY && emitted < numGroups(); n++, emitted++) {
+                for (int k = 0; k < numKeys; k++) batch.ints[k][n] = keys[static_cast<size_t>(emitted) * numKeys + k];
+                for (int a = 0; a < numAggregates; a++) {
+                    int column = numKeys + a;
+                    size_t cell = static_cast<size_t>(emitted) * numAggregates + a;
+                    Amount value = aggregates[a].kind == AggregateKind::Sum ? sums[cell].total() : extremes[cell];
+                    if (aggregates[a].kind == AggregateKind::Count) batch.ints[column][n] = counts[emitted];
+                    else if (schema[column].type == QueryType::Amount) batch.amounts[column][n] = value;
+                    else batch.ints[column][n] = wholeUnits(value);
+                }
+            }
+            batch.size = n;
+            return true;
+        }
+};
+
+// The k rows with the largest (or smallest) values in one column, best first; ties keep input order. Only about
+// 2k rows are held at a time, and rows that cannot beat the current k-th value are skipped a batch at a time.
+class QueryTopK : public QueryOperator {
+    private:
+        QueryPlan input;
+        int column;
+        int k;
+        bool descending;
+        int width;
+        std::vector<__int128> ranks;
+        std::vector<int64_t> order;
+        std::vector<int64_t> intCells;
+        std::vector<Amount> amountCells;
+        std::vector<int> rows;
+        int emitted;
+        bool consumed;
+
+        static __int128 rankOf(const Amount& value) { return static_cast<__int128>(static_cast<unsigned __int128>(value.highWord()) << 64 | value.lowWord()); }
+
+        bool better(int a, int b) const {
+            if (ranks[a] != ranks[b]) return descending ? ranks[a] > ranks[b] : ranks[a] < ranks[b];
+            return order[a] < order[b];
+        }
+
+        // Keeps the best k stored rows, best first.
+        void prune() {
+            rows.resize(ranks.size());
+            for (size_t i = 0; i < rows.size(); i++) rows[i] = static_cast<int>(i);
+            auto compare = [this](int a, int b) { return better(a, b); };
+            if (static_cast<int>(rows.size()) > k) {
+                std::nth_element(rows.begin(), rows.begin() + k, rows.end(), compare);
+                rows.resize(k);
+            }
+            std::sort(rows.begin(), rows.end(), compare);
+            std::vector<__int128> keptRanks;
+            std::vector<int64_t> keptOrder, keptInts;
+            std::vector<Amount> keptAmounts;
+            for (int row : rows) {
+                keptRanks.push_back(ranks[row]);
+                keptOrder.push_back(order[row]);
+                keptInts.insert(keptInts.end(), intCells.begin() + static_cast<size_t>(row) * width, intCells.begin() + static_cast<size_t>(row + 1) * width);
+                keptAmounts.insert(keptAmounts.end(), amountCells.begin() + static_cast<size_t>(row) * width, amountCells.begin() + static_cast<size_t>(row + 1) * width);
+            }
+            ranks.swap(keptRanks);
+            order.swap(keptOrder);
+            intCells.swap(keptInts);
+            amountCells.swap(keptAmounts);
+        }
+
+        void consume() {
+            RowBatch batch;
+            std::vector<__int128> batchRanks(RowBatch::CAPACITY);
+            std::vector<int> candidates(RowBatch::CAPACITY);
+            int64_t seen = 0;
+            while (input->next(batch)) {
+                int count = batch.size;
+                if (schema[column].type == QueryType::Int) {
+                    for (int i = 0; i < count; i++) batchRanks[i] = batch.ints[column][i];
+                } else {
+                    for (int i = 0; i < count; i++) batchRanks[i] = rankOf(batch.amounts[column][i]);
+                }
+                int numCandidates = 0;
+                bool full = static_cast<int>(ranks.size()) >= k;
+                __int128 threshold = full ? ranks[k - 1] : 0;
+                for (int i = 0; i < count; i++) {
+                    candidates[numCandidates] = i;
+                    numCandidates += !full || (descending ? batchRanks[i] > threshold : batchRanks[i] < threshold);
+                }
+                for (int c = 0; c < numCandidates; c++) {
+                    int i = candidates[c];
+                    ranks.push_back(batchRanks[i]);
+                    order.push_back(seen + i);
+                    for (int col = 0; col < width; col++) {
+                        intCells.push_back(schema[col].type == QueryType::Int ? batch.ints[col][i] : 0);
+                        amountCells.push_back(schema[col].type == QueryType::Amount ? batch.amounts[col][i] : Amount());
+                    }
+                }
+                seen += count;
+                if (static_cast<int>(ranks.size()) >= 2 * k || (!full && static_cast<int>(ranks.size()) >= k)) prune();
+            }
+            prune();
+        }
+
+    public:
+        QueryTopK(QueryPlan input, const string& columnName, int k, bool descending = true)
+            : input(std::move(input)), k(k), descending(descending), emitted(0), consumed(false) {
+            if (k < 1) throw invalid_argument("Top-k needs k of at least 1");
+            schema = this->input->getSchema();
+            column = columnIndex(columnName);
+            width = static_cast<int>(schema.size());
+        }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            if (!consumed) {
+                consume();
+                consumed = true;
+            }
+            int n = 0;
+            for (; n < RowBatch::CAPACITY && emitted < static_cast<int>(ranks.size()); n++, emitted++) {
+                for (int col = 0; col < width; col++) {
+                    size_t cell = static_cast<size_t>(emitted) * width + col;
+                    if (schema[col].type == QueryType::Int) batch.ints[col][n] = intCells[cell];
+                    else batch.amounts[col][n] = amountCells[cell];
+                }
+            }
+            batch.size = n;
+            return n > 0;
+        }
+};
+
+// Scans the ledger, answering the most selective indexed predicate from the chain's indexes: a wallet equality,
+// then an asset equality, then a time range. Every predicate is still checked by a filter on top of the scan.
+QueryPlan planLedgerScan(const Blockchain& chain, LedgerScan::Mode mode, const std::vector<QueryPredicate>& predicates) {
+    const char* walletColumns[] = {mode == LedgerScan::TRANSFERS ? "from" : "wallet", mode == LedgerScan::TRANSFERS ? "to" : "counterparty"};
+    const QueryPredicate* wallet = nullptr;
+    const QueryPredicate* asset = nullptr;
+    int64_t from = std::numeric_limits<int64_t>::min(), to = std::numeric_limits<int64_t>::max();
+    bool timed = false;
+    for (const QueryPredicate& predicate : predicates) {
+        if (predicate.isAmount) continue;
+        if (predicate.op == CompareOp::Equal && (predicate.column == walletColumns[0] || predicate.column == walletColumns[1])) wallet = &predicate;
+        if (predicate.op == CompareOp::Equal && predicate.column == "asset") asset = &predicate;
+        if (predicate.column != "time" || predicate.op == CompareOp::NotEqual) continue;
+        int64_t value = predicate.value;
+        timed = true;
+        if (predicate.op == CompareOp::Equal || predicate.op == CompareOp::GreaterEqual) from = std::max(from, value);
+        if (predicate.op == CompareOp::Greater && value < std::numeric_limits<int64_t>::max()) from = std::max(from, value + 1);
+        if (predicate.op == CompareOp::Equal || predicate.op == CompareOp::LessEqual) {
+            if (value < std::numeric_limits<int64_t>::max()) to = std::min(to, value + 1);
+        }
+        if (predicate.op == CompareOp::Less) to = std::min(to, value);
+    }
+    auto fitsInt = [](const QueryPredicate* predicate) {
+        return predicate && predicate->value >= std::numeric_limits<int>::min() && predicate->value <= std::numeric_limits<int>::max();
+    };
+    QueryPlan scan;
+    if (fitsInt(wallet)) {
+        scan.reset(new LedgerScan(chain, mode, chain.findByWalletSlot(static_cast<int>(wallet->value))));
+    } else if (fitsInt(asset)) {
+        scan.reset(new LedgerScan(chain, mode, chain.findByAsset(static_cast<AssetId>(asset->value))));
+    } else if (timed && from >= 0) {
+        // Pending transfers carry time -1, so a range starting at or after zero only covers sealed blocks.
+        scan.reset(new LedgerScan(chain, mode, chain.findByTime(from, to)));
+    } else {
+        scan.reset(new LedgerScan(chain, mode));
+    }
+    if (predicates.empty()) return scan;
+    return QueryPlan(new QueryFilter(std::move(scan), predicates));
+}
+
+// Pulls every batch of plan, calling visit(batch, row) for each row.
+template <typename Visitor>
+void forEachRow(QueryOperator& plan, Visitor visit) {
+    RowBatch batch;
+    while (plan.next(batch)) {
+        for (int i = 0; i < batch.size; i++) visit(batch, i);
+    }
+}
+
+void demonstratePolymorphism(DigitalAsset** assets, int count) {
+    cout << "\n=== Polymorphism Demonstration ===\n";
+    for (int i = 0; i <count; i++) {
+        cout << "Asset " << i + 1 << ":\n";
+        assets[i]->displayInfo();
+        cout << "Market value calculation: " << assets[i]->calculateMarketValue() << endl;
+        cout << endl;
+    }
+} 
+
+void demonstrateValueDispatch(const AssetStore& store) {
+    cout << "=== Value-Type Dispatch (std::visit) ===\n";
+    for (int i = 0; i < store.size(); i++) {
+        cout << "Asset " << i + 1 << ":\n";
+        AssetStore::displayInfo(store[i], cout);
+        cout << "Market value calculation: " << AssetStore::calculateMarketValue(store[i]) << endl;
+        cout << endl;
+    }
+    cout << "Total market value: " << store.totalMarketValue() << endl;
+}
+
+class MappedFile {
+    private:
+        const char* data;
+        size_t length;
+#ifndef _WIN32
+        bool mapped;
+#else
+        std::vector<char> buffer;
+#endif
+        bool open;
+
+    public:
+        explicit MappedFile(const string& filename) : data(nullptr), length(0), open(false) {
+#ifndef _WIN32
+            mapped = false;
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) return;
+            struct stat info;
+            if (::fstat(fd, &info) == 0) {
+                open = true;
+                length = static_cast<size_t>(info.st_size);
+                if (length > 0) {
+                    void* address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (address == MAP_FAILED) {
+                        open = false;
+                        length = 0;
+                    } else {
+                        ::madvise(address, length, MADV_SEQUENTIAL);
+                        data = static_cast<const char*>(address);
+                        mapped = true;
+                    }
+                }
+            }
+            ::close(fd);
+#else
+            ifstream file(filename, ios::binary);
+            if (!file.is_open()) return;
+            buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+            data = buffer.data();
+            length = buffer.size();
+            open = true;
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() {
+#ifndef _WIN32
+            if (mapped) ::munmap(const_cast<char*>(data), length);
+#endif
+        }
+
+        bool isOpen() const { return open; }
+
+        std::string_view view() const { return std::string_view(data, length); }
+};
+
+struct ChainVerification {
+    bool ok = true;
+    uint64_t totalBlocks = 0;
+    uint64_t verifiedBlocks = 0;
+    uint64_t checkedBlocks = 0;
+    uint64_t checkedTransactions = 0;
+    uint64_t failedBlock = 0;
+    string error;
+};
+
+class BlockLog : public BlockSink {
+    private:
+        struct IndexEntry {
+            uint32_t segment;
+            uint32_t padding;
+            uint64_t offset;
+            uint64_t bytes;
+            Hash256 hash;
+        };
+
+        struct Checkpoint {
+            char magic[8];
+            uint64_t verifiedBlocks;
+            Hash256 lastHash;
+        };
+
+        static constexpr const char* CHECKPOINT_MAGIC = "CQCHAIN";
+        static const uint64_t SEGMENT_BYTES = 64ull << 20;
+        static const uint64_t VERIFY_BATCH = 4096;
+
+        string baseName;
+        std::vector<IndexEntry> index;
+        ofstream segmentOut;
+        ofstream indexOut;
+        uint32_t currentSegment;
+        uint64_t segmentBytes;
+        bool opened;
+
+        string segmentName(uint32_t segment) const {
+            char suffix[16];
+            snprintf(suffix, sizeof(suffix), ".%06u", segment);
+            return baseName + suffix;
+        }
+
+        string indexName() const { return baseName + ".idx"; }
+
+        string checkpointName() const { return baseName + ".chk"; }
+
+        bool openSegment(uint32_t segment) {
+            segmentOut.close();
+            segmentOut.clear();
+            segmentOut.open(segmentName(segment), ios::binary | ios::app);
+            currentSegment = segment;
+            std::error_code error;
+            uint64_t size = std::filesystem::file_size(segmentName(segment), error);
+            segmentBytes = error ? 0 : size;
+            return segmentOut.is_open();
+        }
+
+        bool readCheckpoint(uint64_t& verifiedBlocks, Hash256& lastHash) const {
+            ifstream in(checkpointName(), ios::binary);
+            Checkpoint checkpoint;
+            if (!in.read(reinterpret_cast<char*>(&checkpoint), sizeof(checkpoint))) return false;
+            if (memcmp(checkpoint.magic, CHECKPOINT_MAGIC, sizeof(checkpoint.magic)) != 0) return false;
+            verifiedBlocks = checkpoint.verifiedBlocks;
+            lastHash = checkpoint.lastHash;
+            return true;
+        }
+
+        bool writeCheckpoint(uint64_t verifiedBlocks, const Hash256& lastHash) const {
+            Checkpoint checkpoint = {};
+            memcpy(checkpoint.magic, CHECKPOINT_MAGIC, sizeof(checkpoint.magic));
+            checkpoint.verifiedBlocks = verifiedBlocks;
+            checkpoint.lastHash = lastHash;
+            string temporary = checkpointName() + ".tmp";
+            {
+                ofstream out(temporary, ios::binary | ios::trunc);
+                if (!out.write(reinterpret_cast<const char*>(&checkpoint), sizeof(checkpoint))) return false;
+            }
+            return std::rename(temporary.c_str(), checkpointName().c_str()) == 0;
+        }
+
+        static string checkBlock(std::string_view segment, const IndexEntry& entry, uint64_t height, Hash256& prevHash, std::vector<Hash256>& scratch, uint64_t& transactions) {
+            if (entry.bytes < sizeof(BlockHeader) || entry.offset > segment.size() || entry.bytes > segment.size() - entry.offset) return "block extends past the end of its segment";
+            BlockHeader header;
+            memcpy(&header, segment.data() + entry.offset, sizeof(header));
+            if (header.height != height) return "unexpected block height " + to_string(header.height);
+            if (sizeof(BlockHeader) + uint64_t(header.numTransactions) * sizeof(TransactionRecord) != entry.bytes) return "block size does not match its transaction count";
+            if (Sha256::digest(&header, sizeof(header)) != entry.hash) return "block header hash mismatch";
+            const TransactionRecord* records = reinterpret_cast<const TransactionRecord*>(segment.data() + entry.offset + sizeof(BlockHeader));
+            if (merkleRoot(records, static_cast<int>(header.numTransactions), scratch) != header.merkleRoot) return "Merkle root mismatch";
+            prevHash = header.prevHash;
+            transactions += header.numTransactions;
+            return string();
+        }
+
+    public:
+        explicit BlockLog(const string& baseName) : baseName(baseName), currentSegment(0), segmentBytes(0), opened(false) {}
+
+        BlockLog(const BlockLog&) = delete;
+        BlockLog& operator=(const BlockLog&) = delete;
+
+        ~BlockLog() { close(); }
+
+        bool isOpen() const { return opened; }
+
+        uint64_t getNumBlocks() const { return index.size(); }
+
+        const Hash256& getBlockHash(uint64_t height) const { return index.at(height).hash; }
+
+        bool open() {
+            close();
+            index.clear();
+            std::error_code error;
+            uint64_t indexBytes = std::filesystem::file_size(indexName(), error);
+            if (error) indexBytes = 0;
+            index.resize(indexBytes / sizeof(IndexEntry));
+            if (!index.empty()) {
+                ifstream in(indexName(), ios::binary);
+                if (!in.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(IndexEntry))) index.clear();
+            }
+
+            size_t valid = 0;
+            uint64_t segmentSize = 0;
+            for (; valid < index.size(); valid++) {
+                const IndexEntry& entry = index[valid];
+                bool contiguous = valid == 0 ? entry.segment == 0 && entry.offset == 0
+                    : (entry.segment == index[valid - 1].segment && entry.offset == index[valid - 1].offset + index[valid - 1].bytes)
+                      || (entry.segment == index[valid - 1].segment + 1 && entry.offset == 0);
+                if (!contiguous) break;
+                if (valid == 0 || entry.segment != index[valid - 1].segment) {
+                    segmentSize = std::filesystem::file_size(segmentName(entry.segment), error);
+                    if (error) segmentSize = 0;
+                }
+                if (entry.offset + entry.bytes > segmentSize) break;
+            }
+            if (valid < index.size()) {
+                cerr << "Chain log " << baseName << ": discarding " << index.size() - valid << " incomplete block(s)" << endl;
+                index.resize(valid);
+            }
+
+            currentSegment = index.empty() ? 0 : index.back().segment;
+            segmentBytes = index.empty() ? 0 : index.back().offset + index.back().bytes;
+            if (std::filesystem::exists(indexName(), error)) std::filesystem::resize_file(indexName(), index.size() * sizeof(IndexEntry), error);
+            if (std::filesystem::exists(segmentName(currentSegment), error)) std::filesystem::resize_file(segmentName(currentSegment), segmentBytes, error);
+            for (uint32_t segment = currentSegment + 1; std::filesystem::remove(segmentName(segment), error); segment++) {}
+
+            indexOut.open(indexName(), ios::binary | ios::app);
+            opened = indexOut.is_open() && openSegment(currentSegment);
+            return opened;
+        }
+
+        void close() {
+            segmentOut.close();
+            indexOut.close();
+            segmentOut.clear();
+            indexOut.clear();
+            opened = false;
+        }
+
+        void removeFiles() {
+            close();
+            index.clear();
+            std::error_code error;
+            std::filesystem::remove(indexName(), error);
+            clearCheckpoint();
+            for (uint32_t segment = 0; std::filesystem::remove(segmentName(segment), error); segment++) {}
+        }
+
+        bool reset() {
+            removeFiles();
+            return open();
+        }
+
+        void clearCheckpoint() {
+            std::error_code error;
+            std::filesystem::remove(checkpointName(), error);
+        }
+
+        bool appendBlock(const BlockHeader& header, const TransactionRecord* records) override {
+            if (!opened || header.height != index.size()) return false;
+            if (header.prevHash != (index.empty() ? Hash256{} : index.back().hash)) return false;
+            uint64_t bytes = sizeof(BlockHeader) + uint64_t(header.numTransactions) * sizeof(TransactionRecord);
+            if (segmentBytes > 0 && segmentBytes + bytes > SEGMENT_BYTES && !openSegment(currentSegment + 1)) return false;
+
+            IndexEntry entry = {currentSegment, 0, segmentBytes, bytes, Sha256::digest(&header, sizeof(header))};
+            segmentOut.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            segmentOut.write(reinterpret_cast<const char*>(records), header.numTransactions * sizeof(TransactionRecord));
+            segmentOut.flush();
+            if (!segmentOut) return false;
+            indexOut.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            indexOut.flush();
+            if (!indexOut) return false;
+            segmentBytes += bytes;
+            index.push_back(entry);
+            return true;
+        }
+
+        ChainVerification verify() {
+            ChainVerification result;
+            result.totalBlocks = index.size();
+            uint64_t start = 0;
+            Hash256 lastHash = {};
+            if (!readCheckpoint(start, lastHash) || start > index.size() || (start > 0 && index[start - 1].hash != lastHash)) {
+                start = 0;
+                lastHash = Hash256{};
+            }
+            result.verifiedBlocks = start;
+            if (start == index.size()) return result;
+
+            std::vector<std::unique_ptr<MappedFile>> segments(index.back().segment + 1);
+            for (uint32_t segment = index[start].segment; segment <= index.back().segment; segment++) {
+                segments[segment].reset(new MappedFile(segmentName(segment)));
+            }
+
+            for (uint64_t batchStart = start; batchStart < index.size() && result.ok; batchStart += VERIFY_BATCH) {
+                uint64_t batchEnd = std::min<uint64_t>(batchStart + VERIFY_BATCH, index.size());
+                std::vector<Hash256> prevHashes(batchEnd - batchStart);
+                std::vector<string> errors(batchEnd - batchStart);
+                std::atomic<uint64_t> transactions(0);
+                parallelFor(batchStart, batchEnd, 1, [&](int64_t first, int64_t last) {
+                    std::vector<Hash256> scratch;
+                    uint64_t checked = 0;
+                    for (int64_t height = first; height < last; height++) {
+                        const IndexEntry& entry = index[height];
+                        std::string_view segment = segments[entry.segment]->view();
+                        errors[height - batchStart] = checkBlock(segment, entry, height, prevHashes[height - batchStart], scratch, checked);
+                    }
+                    transactions += checked;
+                });
+
+                for (uint64_t height = batchStart; height < batchEnd; height++) {
+                    string& error = errors[height - batchStart];
+                    if (error.empty() && prevHashes[height - batchStart] != lastHash) error = "previous-block hash does not match block " + to_string(height - 1);
+                    if (!error.empty()) {
+                        result.ok = false;
+                        result.failedBlock = height;
+                        result.error = error;
+                        break;
+                    }
+                    lastHash = index[height].hash;
+                    result.verifiedBlocks = height + 1;
+                    result.checkedBlocks++;
+                }
+                result.checkedTransactions += transactions;
+                writeCheckpoint(result.verifiedBlocks, lastHash);
+            }
+            return result;
+        }
+};
+
+inline bool isFieldSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool nextLine(std::string_view& text, std::string_view& line) {
+    if (text.empty()) return false;
+    size_t end = text.find('\n');
+    if (end == std::string_view::npos) {
+        line = text;
+        text = std::string_view();
+    } else {
+        line = text.substr(0, end);
+        text.remove_prefix(end + 1);
+    }
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return true;
+}
+
+inline bool nextToken(std::string_view& text, std::string_view& token) {
+    size_t i = 0;
+    while (i < text.size() && isFieldSpace(text[i])) i++;
+    size_t j = i;
+    while (j < text.size() && !isFieldSpace(text[j])) j++;
+    token = text.substr(i, j - i);
+    text.remove_prefix(j);
+    return !token.empty();
+}
+
+template<typename N>
+bool parseNumber(std::string_view token, N& value) {
+    const char* first = token.data();
+    const char* last = token.data() + token.size();
+    if (first != last && *first == '+') first++;
+    auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last && !token.empty();
+}
+
+inline bool parseNumber(std::string_view token, Amount& value) { return Amount::parse(token, value); }
+
+bool loadCryptosFromFile(const string& filename, CryptoCurrency**& cryptos, int& numCryptos, int& cryptosCapacity,UtilityCoin**& utilityCoins, int& numUtilityCoins, int& utilityCoinsCapacity,StableCoin**& stableCoins, int& numStableCoins, int& stableCoinsCapacity, DigitalAsset**& assets, int& numAssets, int& assetsCapacity, AssetRegistry& registry, AuditLog<std::string>& generalLog, AuditLog<int>& statsLog) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        cout << "Failed to open file: " << filename << endl;
+        return false;
+    }
+
+    std::string_view text = file.view();
+    std::string_view line;
+    while (nextLine(text, line)) {
+        std::string_view fields = line;
+        std::string_view type;
+        if (!nextToken(fields, type)) continue;
+
+        std::string_view name, symbol, priceField, marketCapField, extra, currencyField;
+        Amount price;
+        long long marketCap;
+
+        if (type == "CRYPTO") {
+            if (nextToken(fields, name) && nextToken(fields, symbol) && nextToken(fields, priceField) && parseNumber(priceField, price)
+                && nextToken(fields, marketCapField) && parseNumber(marketCapField, marketCap) && nextToken(fields, currencyField)) {
+                resizeArray(cryptos, cryptosCapacity, numCryptos + 1);
+                resizeArray(assets, assetsCapacity, numAssets + 1);
+                
+                CryptoCurrency* crypto = new CryptoCurrency(
+                    InternedString(name), InternedString(symbol), price, marketCap, currencyField[0]
+                );
+                try {
+                    registry.add(crypto);
+                } catch (const invalid_argument& e) {
+                    cerr << "Skipping duplicate asset: " << e.what() << endl;
+                    delete crypto;
+                    continue;
+                }
+                cryptos[numCryptos++] = crypto;
+                assets[numAssets++] = crypto;
+                
+                generalLog.addEntry("Crypto loaded", name);
+                statsLog.addEntry("Total cryptos", numCryptos);
+            } else {
+                cerr << "Skipping invalid CRYPTO line: " << line << endl;
+            }
+        } else if (type == "UTILITY") {
+            if (nextToken(fields, name) && nextToken(fields, symbol) && nextToken(fields, priceField) && parseNumber(priceField, price)
+                && nextToken(fields, marketCapField) && parseNumber(marketCapField, marketCap) && nextToken(fields, extra) && nextToken(fields, currencyField)) {
+                resizeArray(utilityCoins, utilityCoinsCapacity, numUtilityCoins + 1);
+                resizeArray(assets, assetsCapacity, numAssets + 1);
+                
+                UtilityCoin* utility = new UtilityCoin(
+                    InternedString(name), InternedString(symbol), price, marketCap, InternedString(extra), currencyField[0]
+                );
+                try {
+                    registry.add(utility);
+                } catch (const invalid_argument& e) {
+                    cerr << "Skipping duplicate asset: " << e.what() << endl;
+                    delete utility;
+                    continue;
+                }
+                utilityCoins[numUtilityCoins++] = utility;
+                assets[numAssets++] = utility;
+                
+                generalLog.addEntry("Utility loaded", name);
+                statsLog.addEntry("Total utilities", numUtilityCoins);
+            } else {
+                cerr << "Skipping invalid UTILITY line: " << line << endl;
+            }
+        } else if (type == "STABLE") {
+            if (nextToken(fields, name) && nextToken(fields, symbol) && nextToken(fields, priceField) && parseNumber(priceField, price)
+                && nextToken(fields, marketCapField) && parseNumber(marketCapField, marketCap) && nextToken(fields, extra) && nextToken(fields, currencyField)) {
+                resizeArray(stableCoins, stableCoinsCapacity, numStableCoins + 1);
+                resizeArray(assets, assetsCapacity, numAssets + 1);
+                
+                StableCoin* stable = new StableCoin(
+                    InternedString(name), InternedString(symbol), price, marketCap, InternedString(extra), currencyField[0]
+                );
+                try {
+                    registry.add(stable);
+                } catch (const invalid_argument& e) {
+                    cerr << "Skipping duplicate asset: " << e.what() << endl;
+                    delete stable;
+                    continue;
+                }
+                stableCoins[numStableCoins++] = stable;
+                assets[numAssets++] = stable;
+                
+                generalLog.addEntry("Stable loaded", name);
+                statsLog.addEntry("Total stables", numStableCoins);
+            } else {
+                cerr << "Skipping invalid STABLE line: " << line << endl;
+            }
+        } else {
+            cerr << "Unknown type: " << type << endl;
+        }
+    }
+    
+    return true;
+}
+
+bool loadWalletsFromFile(const string& filename, Wallet**& wallets, int& numWallets, int& walletsCapacity, const AssetRegistry& registry, WalletDirectory& directory){
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        cout << "Failed to open file: " << filename << endl;
+        return false;
+    }
+
+    std::string_view text = file.view();
+    std::string_view owner, capacityField, activeField, countField;
+    int capacity, numCrypto;
+
+    while (nextToken(text, owner)) {
+        if (!nextToken(text, capacityField) || !parseNumber(capacityField, capacity) || !nextToken(text, activeField)
+            || !nextToken(text, countField) || !parseNumber(countField, numCrypto)) {
+            cerr << "Skipping invalid wallet record for owner: " << owner << endl;
+            break;
+        }
+        resizeArray(wallets, walletsCapacity, numWallets + 1);
+        
+        bool isActive = (activeField[0] == 'Y' || activeField[0] == 'y');
+        
+        Wallet* wallet = new Wallet(InternedString(owner), capacity);
+        wallet->setIsActive(isActive);
+        
+        std::string_view cryptoName;
+        for (int i = 0; i < numCrypto && nextToken(text, cryptoName); i++) {
+            AssetId asset = registry.findByName(cryptoName);
+            if (registry.get(asset)) {
+                wallet->credit(asset, 1);
+            }
+        }
+
+        try {
+            directory.add(wallet);
+        } catch (const invalid_argument& e) {
+            cerr << "Skipping duplicate wallet: " << e.what() << endl;
+            delete wallet;
+            continue;
+        }
+        wallets[numWallets++] = wallet;
+    }
+    
+    return true;
+}
+
+struct ParsedTransfer {
+    enum Status { VALID, INVALID_LINE, UNKNOWN_WALLET, UNKNOWN_ASSET };
+
+    Status status;
+    size_t lineOffset;
+    WalletId from;
+    WalletId to;
+    AssetId asset;
+    Amount amount;
+};
+
+void parseTransactionChunk(std::string_view file, size_t begin, size_t end, const WalletDirectory& directory, const AssetRegistry& registry, std::vector<ParsedTransfer>& out) {
+    std::string_view text = file.substr(begin, end - begin);
+    std::string_view line;
+    while (nextLine(text, line)) {
+        std::string_view fields = line;
+        std::string_view fromOwner, toOwner, cryptoName, amountField;
+        if (!nextToken(fields, fromOwner)) continue;
+
+        ParsedTransfer record;
+        record.lineOffset = static_cast<size_t>(line.data() - file.data());
+        record.from = INVALID_WALLET;
+        record.to = INVALID_WALLET;
+        record.asset = INVALID_ASSET;
+        record.amount = Amount();
+        if (!nextToken(fields, toOwner) || !nextToken(fields, cryptoName) || !nextToken(fields, amountField) || !parseNumber(amountField, record.amount)) {
+            record.status = ParsedTransfer::INVALID_LINE;
+        } else {
+            record.from = directory.find(fromOwner);
+            record.to = directory.find(toOwner);
+            record.asset = registry.findByName(cryptoName);
+            if (!directory.get(record.from) || !directory.get(record.to)) {
+                record.status = ParsedTransfer::UNKNOWN_WALLET;
+            } else if (!registry.get(record.asset)) {
+                record.status = ParsedTransfer::UNKNOWN_ASSET;
+            } else if (!record.amount.fitsDecimals(registry.get(record.asset)->getDecimals())) {
+                record.status = ParsedTransfer::INVALID_LINE;
+            } else {
+                record.status = ParsedTransfer::VALID;
+            }
+        }
+        out.push_back(record);
+    }
+}
+
+void reportParsedTransfer(std::string_view file, const ParsedTransfer& record) {
+    std::string_view text = file.substr(record.lineOffset);
+    std::string_view line, fromOwner, toOwner, cryptoName;
+    nextLine(text, line);
+    std::string_view fields = line;
+    nextToken(fields, fromOwner);
+    nextToken(fields, toOwner);
+    nextToken(fields, cryptoName);
+    if (record.status == ParsedTransfer::INVALID_LINE) {
+        cerr << "Skipping invalid transaction line: " << line << endl;
+    } else if (record.status == ParsedTransfer::UNKNOWN_WALLET) {
+        cout << "Warning: Couldn't find wallets for transaction between " 
+            << fromOwner << " and " << toOwner << endl;
+    } else {
+        cout << "Warning: Couldn't find cryptocurrency " << cryptoName << " for transaction" << endl;
+    }
+}
+
+bool loadTransactionsFromFile(const string& filename, Blockchain& blockchain, const WalletDirectory& directory, const AssetRegistry& registry) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        cout << "Failed to open file: " << filename << endl;
+        return false;
+    }
+
+    const size_t CHUNK_BYTES = 4 * 1024 * 1024;
+    std::string_view text = file.view();
+
+    std::vector<size_t> bounds;
+    bounds.push_back(0);
+    while (bounds.back() < text.size()) {
+        size_t next = bounds.back() + CHUNK_BYTES;
+        if (next >= text.size()) {
+            next = text.size();
+        } else {
+            size_t newline = text.find('\n', next);
+            next = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        bounds.push_back(next);
+    }
+    int numChunks = static_cast<int>(bounds.size()) - 1;
+    blockchain.reserve(blockchain.getNumTransactions() + static_cast<int>(std::count(text.begin(), text.end(), '\n')) + 1);
+
+    SettlementEngine engine(directory, registry);
+    SettlementReport total = {0, 0, 0, 0};
+    std::vector<Transaction> transfers;
+    std::vector<SettlementStatus> statuses;
+    auto settleChunk = [&](const std::vector<ParsedTransfer>& records) {
+        transfers.clear();
+        for (const ParsedTransfer& record : records) {
+            if (record.status == ParsedTransfer::VALID) transfers.push_back(Transaction(record.from, record.to, record.asset, record.amount));
+            else reportParsedTransfer(text, record);
+        }
+        statuses.resize(transfers.size());
+        SettlementReport report = engine.settleBatch(transfers.data(), static_cast<int>(transfers.size()), blockchain, statuses.data());
+        total.settled += report.settled;
+        total.rejected += report.rejected;
+        total.ms += report.ms;
+        for (size_t i = 0; i < transfers.size(); i++) {
+            if (statuses[i] == SettlementStatus::Settled) continue;
+            const Transaction& transfer = transfers[i];
+            cout << "Warning: Rejected transfer of " << transfer.getAmount() << " " << registry.get(transfer.getAssetId())->getSymbol()
+                 << " from " << directory.get(transfer.getFromId())->getOwner() << " to " << directory.get(transfer.getToId())->getOwner()
+                 << ": " << SettlementEngine::statusName(statuses[i]) << endl;
+        }
+    };
+    auto printTotal = [&]() {
+        cout << "Settled " << total.settled << " of " << total.settled + total.rejected << " transfers in " << total.ms
+             << " ms (" << static_cast<long long>(total.settledPerSecond()) << " tx/s).\n";
+    };
+
+    // Parses one window of chunks at a time on the task pool, then settles them in file order.
+    int window = TaskPool::getInstance()->getThreads();
+    std::vector<std::vector<ParsedTransfer>> results(std::min(window, numChunks));
+    for (int windowStart = 0; windowStart < numChunks; windowStart += window) {
+        int windowEnd = std::min(windowStart + window, numChunks);
+        parallelFor(windowStart, windowEnd, 1, [&](int64_t first, int64_t last) {
+            for (int64_t chunk = first; chunk < last; chunk++) {
+                std::vector<ParsedTransfer>& records = results[chunk - windowStart];
+                records.clear();
+                parseTransactionChunk(text, bounds[chunk], bounds[chunk + 1], directory, registry, records);
+            }
+        });
+        for (int chunk = windowStart; chunk < windowEnd; chunk++) settleChunk(results[chunk - windowStart]);
+    }
+    printTotal();
+    return true;
+} 
+
+inline uint64_t checksumBytes(const char* data, size_t length) {
+    const uint64_t PRIME1 = 0x9E3779B97F4A7C15ULL;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t hash = length * PRIME1;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash ^= word * PRIME2;
+        hash = ((hash << 31) | (hash >> 33)) * PRIME1;
+    }
+    for (; i < length; i++) {
+        hash ^= static_cast<unsigned char>(data[i]) * PRIME1;
+        hash = ((hash << 11) | (hash >> 53)) * PRIME2;
+    }
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+const char SNAPSHOT_MAGIC[8] = {'C', 'Q', 'S', 'N', 'A', 'P', '\0', '\0'};
+const uint32_t SNAPSHOT_VERSION = 4;
+const uint32_t SNAPSHOT_NONE = 0xFFFFFFFFu;
+
+enum SnapshotSectionType : uint32_t {
+    SECTION_STRINGS = 1,
+    SECTION_ASSETS,
+    SECTION_WALLETS,
+    SECTION_HOLDINGS,
+    SECTION_TRANSACTIONS,
+    SECTION_GENERAL_LOG,
+    SECTION_STATS_LOG,
+    SECTION_WALLET_SLOTS,
+    SECTION_BLOCKS
 };
 
-ostream& operator<<(ostream& os, const CryptoCurrency& crypto) {
-        crypto.displayInfo(os);
-        return os;
-    }
+const int SNAPSHOT_SECTIONS = 9;
 
-istream& operator>>(istream& is, CryptoCurrency& crypto) {
-    char buffer[100];
-    float price;
-    long long marketCap;
-    char currencyType;
+enum SnapshotAssetKind : uint32_t { KIND_CRYPTO = 0, KIND_UTILITY, KIND_STABLE, KIND_REMOVED };
 
-    cout << "Enter name: ";
-    is >> buffer;
-    crypto.setName(buffer);
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t payloadSize;
+    uint64_t checksum;
+};
 
-    cout << "Enter symbol: ";
-    is >> buffer;
-    crypto.setSymbol(buffer);
+struct SnapshotSection {
+    uint32_t type;
+    uint32_t recordSize;
+    uint64_t count;
+    uint64_t offset;
+    uint64_t bytes;
+};
 
-    cout << "Enter price: ";
-    is >> price;
-    crypto.setPrice(price); 
+struct AssetRecord {
+    uint32_t kind;
+    uint32_t name;
+    uint32_t symbol;
+    uint32_t extra;
+    int64_t marketCap;
+    uint64_t priceLow;
+    int64_t priceHigh;
+    uint32_t decimals;
+    char currencyType;
+    char padding[3];
+};
 
-    cout << "Enter market cap: ";
-    is >> marketCap;
-    crypto.setMarketCap(marketCap); 
+struct WalletRecord {
+    uint32_t owner;
+    uint32_t capacity;
+    uint32_t firstHolding;
+    uint32_t numHoldings;
+    uint32_t isActive;
+    int32_t index;
+    uint32_t generation;
+    uint32_t padding;
+};
 
-    cout << "Enter currency type (C for Crypto): ";
-    is >> currencyType;
-    crypto.setCurrencyType(currencyType);
+struct HoldingRecord {
+    uint32_t asset;
+    uint32_t padding;
+    uint64_t quantityLow;
+    int64_t quantityHigh;
+};
 
-    return is;
+struct LogRecord {
+    uint32_t timestamp;
+    uint32_t action;
+    int64_t details;
+};
+
+// The fixed record size of each section; the string table is variable-length and has none.
+inline uint32_t snapshotRecordSize(int type) {
+    switch (type) {
+        case SECTION_ASSETS: return sizeof(AssetRecord);
+        case SECTION_WALLETS: return sizeof(WalletRecord);
+        case SECTION_HOLDINGS: return sizeof(HoldingRecord);
+        case SECTION_TRANSACTIONS: return sizeof(TransactionRecord);
+        case SECTION_GENERAL_LOG:
+        case SECTION_STATS_LOG: return sizeof(LogRecord);
+        case SECTION_WALLET_SLOTS: return sizeof(uint32_t);
+        case SECTION_BLOCKS: return sizeof(BlockHeader);
+        default: return 0;
+    }
 }
 
-class Wallet {
+class SnapshotWriter {
     private:
-        char* owner;
-        CryptoCurrency* cryptos;
-        int numCryptos;
-        int capacity;
-        bool isActive; 
+        std::unordered_map<std::string, uint32_t> stringIds;
+        std::vector<uint64_t> stringOffsets;
+        std::string stringBytes;
+        std::string sections[SNAPSHOT_SECTIONS];
+        uint64_t counts[SNAPSHOT_SECTIONS] = {};
 
     public:
-        Wallet() : owner(nullptr), cryptos(nullptr), numCryptos(0), capacity(10), isActive(true) {cryptos = new CryptoCurrency[capacity];}
-
-        Wallet(const char* owner) : numCryptos(0), capacity(10), isActive(true) {
-            this->owner = new char[strlen(owner) + 1];
-            strcpy(this->owner, owner);
-            cryptos = new CryptoCurrency[capacity];
-        }
-
-        Wallet(const char* owner, int capacity) : numCryptos(0), capacity(capacity), isActive(true) {
-            this->owner = new char[strlen(owner) + 1];
-            strcpy(this->owner, owner);
-            cryptos = new CryptoCurrency[capacity];
-        }
-
-        Wallet(const Wallet& other) {
-            owner = new char[strlen(other.owner) + 1];
-            strcpy(owner, other.owner);
-            capacity = other.capacity;
-            numCryptos = other.numCryptos;
-            cryptos = new CryptoCurrency[capacity];
-            for (int i = 0; i < numCryptos; i++) {
-                cryptos[i] = other.cryptos[i];
-            }
-            isActive = other.isActive; 
-        }
-    
-         ~Wallet() {
-            delete[] owner;
-            delete[] cryptos;
+        SnapshotWriter() { stringOffsets.push_back(0); }
+
+        uint32_t addString(const char* text) {
+            if (!text) return SNAPSHOT_NONE;
+            auto inserted = stringIds.emplace(text, static_cast<uint32_t>(stringOffsets.size() - 1));
+            if (!inserted.second) return inserted.first->second;
+            stringBytes.append(text);
+            stringBytes.push_back('\0');
+            stringOffsets.push_back(stringBytes.size());
+            return inserted.first->second;
         }
 
-        const char* getOwner() const { return owner; }
-        
-        int getNumCryptos() const { return numCryptos; }
-        
-        int getCapacity() const { return capacity; }
-        
-        bool getIsActive() const { return isActive; } 
-
-        void setOwner(const char* owner) {
-            delete[] this->owner;
-            this->owner = new char[strlen(owner) + 1];
-            strcpy(this->owner, owner);
+        template<typename Record>
+        void addRecord(SnapshotSectionType type, const Record& record) {
+            if (sizeof(Record) != snapshotRecordSize(type)) throw invalid_argument("snapshot record does not fit its section");
+            sections[type - 1].append(reinterpret_cast<const char*>(&record), sizeof(Record));
+            counts[type - 1]++;
         }
 
-        void setIsActive(bool isActive) { this->isActive = isActive;}
-   
-        void setNumCryptos(int numCryptos) {this->numCryptos = numCryptos;}
-   
-        void addCrypto(const CryptoCurrency& crypto) {
-            if (numCryptos >= capacity) {
-                capacity *= 2;
-                CryptoCurrency* newCryptos = new CryptoCurrency[capacity];
-                for (int i = 0; i < numCryptos; i++) {
-                    newCryptos[i] = cryptos[i];
+        bool writeTo(const string& filename) {
+            std::string& strings = sections[SECTION_STRINGS - 1];
+            strings.assign(reinterpret_cast<const char*>(stringOffsets.data()), stringOffsets.size() * sizeof(uint64_t));
+            strings += stringBytes;
+            counts[SECTION_STRINGS - 1] = stringOffsets.size() - 1;
+
+            std::string payload;
+            SnapshotSection directory[SNAPSHOT_SECTIONS];
+            uint64_t offset = sizeof(SnapshotHeader) + sizeof(directory);
+            for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+                while (offset % 8 != 0) {
+                    payload.push_back('\0');
+                    offset++;
                 }
-                delete[] cryptos;
-                cryptos = newCryptos;
+                directory[i] = SnapshotSection{static_cast<uint32_t>(i + 1), snapshotRecordSize(i + 1), counts[i], offset, sections[i].size()};
+                payload += sections[i];
+                offset += sections[i].size();
             }
-            cryptos[numCryptos++] = crypto;
-        }
-
-        Wallet& operator=(const Wallet& other) {
-            if (this != &other) {
-                delete[] owner;
-                delete[] cryptos;
-
-                owner = new char[strlen(other.owner) + 1];
-                strcpy(owner, other.owner);
-
-                capacity = other.capacity;
-                numCryptos = other.numCryptos;
-                cryptos = new CryptoCurrency[capacity];
-                for (int i = 0; i < numCryptos; i++) {
-                    cryptos[i] = other.cryptos[i];
+            payload.insert(0, reinterpret_cast<const char*>(directory), sizeof(directory));
+
+            SnapshotHeader header;
+            memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+            header.version = SNAPSHOT_VERSION;
+            header.sectionCount = SNAPSHOT_SECTIONS;
+            header.payloadSize = payload.size();
+            header.checksum = checksumBytes(payload.data(), payload.size());
+
+            string temporary = filename + ".tmp";
+            {
+                ofstream out(temporary, ios::binary | ios::trunc);
+                if (!out.is_open()) return false;
+                out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                out.write(payload.data(), payload.size());
+                out.flush();
+                if (!out) {
+                    out.close();
+                    std::remove(temporary.c_str());
+                    return false;
                 }
-                isActive = other.isActive;
             }
-            return *this;
-        }
-
-        bool operator==(const Wallet& other) const {return strcmp(owner, other.owner) == 0 && numCryptos == other.numCryptos;}
-
-        bool operator<(const Wallet& other) const {return numCryptos < other.numCryptos;}
-
-        Wallet operator+(const Wallet& other) const {
-            Wallet newWallet(owner, capacity + other.capacity);
-            for (int i = 0; i < numCryptos; i++) {
-                newWallet.addCrypto(cryptos[i]);
+#ifndef _WIN32
+            int fd = ::open(temporary.c_str(), O_WRONLY);
+            if (fd >= 0) {
+                ::fsync(fd);
+                ::close(fd);
             }
-            for (int i = 0; i < other.numCryptos; i++) {
-                newWallet.addCrypto(other.cryptos[i]);
+#else
+            std::remove(filename.c_str());
+#endif
+            if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+                std::remove(temporary.c_str());
+                return false;
             }
-            return newWallet;
+            return true;
         }
+};
 
-        Wallet operator*(const Wallet& other) const {
-            Wallet newWallet(owner, capacity * other.capacity);
-            for (int i = 0; i < numCryptos; i++) {
-                newWallet.addCrypto(cryptos[i]);
+class SnapshotReader {
+    private:
+        MappedFile file;
+        std::string_view data;
+        const SnapshotSection* directory;
+        const uint64_t* stringOffsets;
+        const char* stringBytes;
+        uint64_t numStrings;
+        uint64_t stringBytesSize;
+        string error;
+
+        bool fail(const string& message) {
+            error = message;
+            return false;
+        }
+
+    public:
+        explicit SnapshotReader(const string& filename) : file(filename), directory(nullptr), stringOffsets(nullptr), stringBytes(nullptr), numStrings(0), stringBytesSize(0) {}
+
+        const string& getError() const { return error; }
+
+        bool exists() const { return file.isOpen(); }
+
+        bool validate() {
+            if (!file.isOpen()) return fail("cannot open file");
+            data = file.view();
+            if (data.size() < sizeof(SnapshotHeader)) return fail("file too small");
+            SnapshotHeader header;
+            memcpy(&header, data.data(), sizeof(header));
+            if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) return fail("bad magic");
+            if (header.version != SNAPSHOT_VERSION) return fail("unsupported version " + to_string(header.version));
+            if (header.sectionCount != SNAPSHOT_SECTIONS) return fail("unexpected section count");
+            if (header.payloadSize != data.size() - sizeof(SnapshotHeader)) return fail("truncated file");
+            if (checksumBytes(data.data() + sizeof(SnapshotHeader), header.payloadSize) != header.checksum) return fail("checksum mismatch");
+            directory = reinterpret_cast<const SnapshotSection*>(data.data() + sizeof(SnapshotHeader));
+            for (int i = 0; i < SNAPSHOT_SECTIONS; i++) {
+                const SnapshotSection& section = directory[i];
+                if (section.type != static_cast<uint32_t>(i + 1)) return fail("section directory out of order");
+                if (section.offset % 8 != 0 || section.offset > data.size() || section.bytes > data.size() - section.offset) return fail("section out of bounds");
+                // Snapshots before record sizes were fixed per section wrote 0 for empty sections.
+                uint32_t recordSize = snapshotRecordSize(section.type);
+                if (recordSize == 0 || (section.count == 0 && section.bytes == 0)) continue;
+                if (section.recordSize != recordSize || section.bytes % recordSize != 0 || section.count != section.bytes / recordSize) return fail("section size mismatch");
             }
-            for (int i = 0; i < other.numCryptos; i++) {
-                newWallet.addCrypto(other.cryptos[i]);
+            const SnapshotSection& strings = directory[SECTION_STRINGS - 1];
+            numStrings = strings.count;
+            if ((numStrings + 1) * sizeof(uint64_t) > strings.bytes) return fail("string table out of bounds");
+            stringOffsets = reinterpret_cast<const uint64_t*>(data.data() + strings.offset);
+            stringBytes = data.data() + strings.offset + (numStrings + 1) * sizeof(uint64_t);
+            stringBytesSize = strings.bytes - (numStrings + 1) * sizeof(uint64_t);
+            for (uint64_t i = 0; i < numStrings; i++) {
+                uint64_t end = stringOffsets[i + 1];
+                if (stringOffsets[i] >= end || end > stringBytesSize || stringBytes[end - 1] != '\0') return fail("corrupt string table");
             }
-            return newWallet;
+            return true;
         }
 
-        Wallet& operator++() {
-            capacity += 10;
-            CryptoCurrency* newCryptos = new CryptoCurrency[capacity];
-            for (int i = 0; i < numCryptos; i++) {
-                newCryptos[i] = cryptos[i];
-            }
-            delete[] cryptos;
-            cryptos = newCryptos;
-            return *this;
+        const char* getString(uint32_t id) const {
+            if (id == SNAPSHOT_NONE || id >= numStrings) return nullptr;
+            return stringBytes + stringOffsets[id];
         }
 
-        Wallet operator++(int) {
-            Wallet temp = *this;
-            ++(*this);
-            return temp;
+        // The records of a validated section, or none when Record is not the size the section was written with.
+        template<typename Record>
+        const Record* records(SnapshotSectionType type, uint64_t& count) const {
+            const SnapshotSection& section = directory[type - 1];
+            count = section.recordSize == sizeof(Record) ? section.count : 0;
+            return reinterpret_cast<const Record*>(data.data() + section.offset);
         }
-    
-        CryptoCurrency& operator[](int index) {
-            if (index < 0 || index >= numCryptos) {
-                throw out_of_range("Index out of range");
+};
+
+bool saveSnapshot(const string& filename, const AssetRegistry& registry, Wallet** wallets, int numWallets, Blockchain& blockchain, AuditLog<std::string>& generalLog, AuditLog<int>& statsLog) {
+    blockchain.sealBlock();
+    SnapshotWriter writer;
+    for (AssetId id = 0; id < registry.getNumSlots(); id++) {
+        const CryptoCurrency* asset = registry.get(id);
+        AssetRecord record = {};
+        record.kind = KIND_REMOVED;
+        record.name = record.symbol = record.extra = SNAPSHOT_NONE;
+        if (asset) {
+            record.kind = KIND_CRYPTO;
+            if (const UtilityCoin* utility = dynamic_cast<const UtilityCoin*>(asset)) {
+                record.kind = KIND_UTILITY;
+                record.extra = writer.addString(utility->getUseCase());
+            } else if (const StableCoin* stable = dynamic_cast<const StableCoin*>(asset)) {
+                record.kind = KIND_STABLE;
+                record.extra = writer.addString(stable->getBackedBy());
             }
-            return cryptos[index];
+            record.name = writer.addString(asset->getName());
+            record.symbol = writer.addString(asset->getSymbol());
+            record.marketCap = asset->getMarketCap();
+            record.priceLow = asset->getPrice().lowWord();
+            record.priceHigh = asset->getPrice().highWord();
+            record.decimals = static_cast<uint32_t>(asset->getDecimals());
+            record.currencyType = asset->getCurrencyType();
         }
+        writer.addRecord(SECTION_ASSETS, record);
+    }
 
-        friend ostream& operator<<(ostream& os, const Wallet& wallet);
-        friend istream& operator>>(istream& is, Wallet& wallet);
-};
+    const WalletDirectory& directory = *WalletDirectory::getInstance();
+    for (int i = 0; i < directory.getNumSlots(); i++) {
+        writer.addRecord(SECTION_WALLET_SLOTS, static_cast<uint32_t>(directory.getGeneration(i)));
+    }
 
-ostream& operator<<(ostream& os, const Wallet& wallet) {
-    os << "Owner: " << wallet.owner << "\n";
-    os << "Active: " << (wallet.isActive ? "Yes" : "No") << "\n";
-    os << "Cryptos:\n";
-    for (int i = 0; i < wallet.numCryptos; i++) {
-        os << wallet.cryptos[i] << "\n";
+    uint32_t numHoldings = 0;
+    for (int i = 0; i < numWallets; i++) {
+        Wallet& wallet = *wallets[i];
+        WalletRecord record = {};
+        record.owner = writer.addString(wallet.getOwner());
+        record.capacity = static_cast<uint32_t>(wallet.getCapacity());
+        record.firstHolding = numHoldings;
+        record.isActive = wallet.getIsActive() ? 1 : 0;
+        record.index = wallet.getWalletId().index;
+        record.generation = wallet.getWalletId().generation;
+        for (const Holding& holding : wallet.getHoldings()) {
+            if (!registry.get(holding.asset)) continue;
+            writer.addRecord(SECTION_HOLDINGS, HoldingRecord{static_cast<uint32_t>(holding.asset), 0, holding.quantity.lowWord(), holding.quantity.highWord()});
+            record.numHoldings++;
+            numHoldings++;
+        }
+        writer.addRecord(SECTION_WALLETS, record);
     }
-    return os;
-}
 
-istream& operator>>(istream& is, Wallet& wallet) {
-    char buffer[100];
-    cout << "Enter wallet owner name: ";
-    is >> buffer;
-    wallet.setOwner(buffer);
+    blockchain.forEach([&](const Transaction& transaction) {
+        writer.addRecord(SECTION_TRANSACTIONS, transaction.toRecord());
+    });
+    for (int height = 0; height < blockchain.getNumBlocks(); height++) {
+        writer.addRecord(SECTION_BLOCKS, blockchain.getBlock(height));
+    }
 
-    char activeStatus;
-    cout << "Is the wallet active? (y/n): ";
-    is >> activeStatus;
-    wallet.setIsActive(activeStatus == 'y' || activeStatus == 'Y');
+    generalLog.forEachEntry([&](const std::string& timestamp, const std::string& action, const std::string& details) {
+        LogRecord record = {writer.addString(timestamp.c_str()), writer.addString(action.c_str()), writer.addString(details.c_str())};
+        writer.addRecord(SECTION_GENERAL_LOG, record);
+    });
+    statsLog.forEachEntry([&](const std::string& timestamp, const std::string& action, int details) {
+        LogRecord record = {writer.addString(timestamp.c_str()), writer.addString(action.c_str()), details};
+        writer.addRecord(SECTION_STATS_LOG, record);
+    });
 
-    return is;
+    return writer.writeTo(filename);
 }
 
-class Transaction {
-    private:
-        Wallet* from;
-        Wallet* to;
-        CryptoCurrency crypto;
-        float amount;
-
-    public:
-        Transaction() : from(nullptr), to(nullptr), amount(0.0f) {}
+bool loadSnapshot(const string& filename, CryptoCurrency**& cryptos, int& numCryptos, int& cryptosCapacity, UtilityCoin**& utilityCoins, int& numUtilityCoins, int& utilityCoinsCapacity, StableCoin**& stableCoins, int& numStableCoins, int& stableCoinsCapacity, DigitalAsset**& assets, int& numAssets, int& assetsCapacity, Wallet**& wallets, int& numWallets, int& walletsCapacity, Blockchain& blockchain, AssetRegistry& registry, WalletDirectory& directory, AuditLog<std::string>& generalLog, AuditLog<int>& statsLog) {
+    SnapshotReader reader(filename);
+    if (!reader.exists()) return false;
+    if (!reader.validate()) {
+        cout << "Ignoring snapshot " << filename << ": " << reader.getError() << endl;
+        return false;
+    }
 
-        Transaction(Wallet* from, Wallet* to, const CryptoCurrency& crypto, float amount): from(from), to(to), crypto(crypto), amount(amount) {}
+    uint64_t numAssetRecords, numWalletRecords, numHoldingRecords, numTransactionRecords, numGeneral, numStats;
+    const AssetRecord* assetRecords = reader.records<AssetRecord>(SECTION_ASSETS, numAssetRecords);
+    const WalletRecord* walletRecords = reader.records<WalletRecord>(SECTION_WALLETS, numWalletRecords);
+    const HoldingRecord* holdingRecords = reader.records<HoldingRecord>(SECTION_HOLDINGS, numHoldingRecords);
+    const TransactionRecord* transactionRecords = reader.records<TransactionRecord>(SECTION_TRANSACTIONS, numTransactionRecords);
+    const LogRecord* generalRecords = reader.records<LogRecord>(SECTION_GENERAL_LOG, numGeneral);
+    const LogRecord* statsRecords = reader.records<LogRecord>(SECTION_STATS_LOG, numStats);
 
-        Transaction(const Transaction& other) : from(other.from), to(other.to), crypto(other.crypto), amount(other.amount) {}
+    uint64_t numSlotRecords, numBlockRecords;
+    const uint32_t* slotGenerations = reader.records<uint32_t>(SECTION_WALLET_SLOTS, numSlotRecords);
+    const BlockHeader* blockRecords = reader.records<BlockHeader>(SECTION_BLOCKS, numBlockRecords);
 
-        ~Transaction() {}
+    if (registry.getNumSlots() != 0 || directory.getNumSlots() != 0) {
+        cout << "Ignoring snapshot " << filename << ": session already holds assets or wallets" << endl;
+        return false;
+    }
 
-        Wallet* getFrom() const { return from; }
-        
-        Wallet* getTo() const { return to; }
-        
-        CryptoCurrency getCrypto() const { return crypto; }
-        
-        float getAmount() const { return amount; }
+    for (uint64_t i = 0; i < numAssetRecords; i++) {
+        const AssetRecord& record = assetRecords[i];
+        if (record.kind == KIND_REMOVED) {
+            registry.skipSlot();
+            continue;
+        }
+        const char* name = reader.getString(record.name);
+        const char* symbol = reader.getString(record.symbol);
+        const char* extra = reader.getString(record.extra);
+        CryptoCurrency* crypto = nullptr;
+        Amount price = Amount::fromWords(record.priceLow, record.priceHigh);
+        if (name && symbol && record.kind <= KIND_STABLE && (record.kind == KIND_CRYPTO || extra) && record.decimals <= static_cast<uint32_t>(Amount::DECIMALS)) {
+            if (record.kind == KIND_UTILITY) {
+                crypto = new UtilityCoin(name, symbol, price, record.marketCap, extra, record.currencyType);
+            } else if (record.kind == KIND_STABLE) {
+                crypto = new StableCoin(name, symbol, price, record.marketCap, extra, record.currencyType);
+            } else {
+                crypto = new CryptoCurrency(name, symbol, price, record.marketCap, record.currencyType);
+            }
+            crypto->setDecimals(static_cast<int>(record.decimals));
+            try {
+                registry.add(crypto);
+            } catch (const invalid_argument& e) {
+                delete crypto;
+                crypto = nullptr;
+            }
+        }
+        if (!crypto) {
+            cout << "Ignoring snapshot " << filename << ": corrupt asset record " << i << endl;
+            registry.clear();
+            numCryptos = numUtilityCoins = numStableCoins = numAssets = 0;
+            return false;
+        }
+        resizeArray(assets, assetsCapacity, numAssets + 1);
+        assets[numAssets++] = crypto;
+        if (record.kind == KIND_UTILITY) {
+            resizeArray(utilityCoins, utilityCoinsCapacity, numUtilityCoins + 1);
+            utilityCoins[numUtilityCoins++] = dynamic_cast<UtilityCoin*>(crypto);
+        } else if (record.kind == KIND_STABLE) {
+            resizeArray(stableCoins, stableCoinsCapacity, numStableCoins + 1);
+            stableCoins[numStableCoins++] = dynamic_cast<StableCoin*>(crypto);
+        } else {
+            resizeArray(cryptos, cryptosCapacity, numCryptos + 1);
+            cryptos[numCryptos++] = crypto;
+        }
+    }
 
-        void setFrom(Wallet* from) { this->from = from; } 
-        
-        void setTo(Wallet* to) { this->to = to; }
-        
-        void setCrypto(const CryptoCurrency& crypto) { this->crypto = crypto; }
-        
-        void setAmount(float amount) { this->amount = amount; }
+    directory.restoreSlots(slotGenerations, static_cast<int>(numSlotRecords));
+    resizeArray(wallets, walletsCapacity, numWallets + static_cast<int>(numWalletRecords));
+    for (uint64_t i = 0; i < numWalletRecords; i++) {
+        const WalletRecord& record = walletRecords[i];
+        const char* owner = reader.getString(record.owner);
+        if (!owner) continue;
+        Wallet* wallet = new Wallet(owner, record.capacity > 0 ? static_cast<int>(record.capacity) : 10);
+        wallet->setIsActive(record.isActive != 0);
+        for (uint64_t j = record.firstHolding; j < static_cast<uint64_t>(record.firstHolding) + record.numHoldings && j < numHoldingRecords; j++) {
+            AssetId asset = static_cast<AssetId>(holdingRecords[j].asset);
+            if (registry.get(asset)) wallet->credit(asset, Amount::fromWords(holdingRecords[j].quantityLow, holdingRecords[j].quantityHigh));
+        }
+        try {
+            directory.restore(wallet, WalletId{record.index, record.generation});
+        } catch (const invalid_argument& e) {
+            cerr << "Skipping wallet " << owner << ": " << e.what() << endl;
+            delete wallet;
+            continue;
+        }
+        wallets[numWallets++] = wallet;
+    }
+    directory.finishRestore();
 
-        Transaction& operator=(const Transaction& other) {
-            if (this != &other) {
-                from = other.from;
-                to = other.to;
-                crypto = other.crypto;
-                amount = other.amount;
+    blockchain.reserve(blockchain.getNumTransactions() + static_cast<int>(numTransactionRecords));
+    uint64_t nextRecord = 0;
+    auto addRecords = [&](uint64_t end) {
+        for (; nextRecord < end && nextRecord < numTransactionRecords; nextRecord++) {
+            blockchain.addTransaction(Transaction(transactionRecords[nextRecord]));
+        }
+    };
+    try {
+        for (uint64_t i = 0; i < numBlockRecords; i++) {
+            addRecords(uint64_t(blockRecords[i].firstTransaction) + blockRecords[i].numTransactions);
+            if (!blockchain.restoreBlock(blockRecords[i])) {
+                cout << "Snapshot block " << i << " failed verification; its transactions will be sealed again.\n";
+                break;
             }
-            return *this;
         }
+        addRecords(numTransactionRecords);
+    } catch (const exception& e) {
+        cout << "Skipping corrupt transaction records in " << filename << ": " << e.what() << endl;
+    }
 
-        bool operator==(const Transaction& other) const {return from == other.from && to == other.to && crypto == other.crypto && amount == other.amount;}
-
-        bool operator<(const Transaction& other) const {return amount < other.amount;}
+    for (uint64_t i = 0; i < numGeneral; i++) {
+        const char* timestamp = reader.getString(generalRecords[i].timestamp);
+        const char* action = reader.getString(generalRecords[i].action);
+        const char* details = reader.getString(static_cast<uint32_t>(generalRecords[i].details));
+        if (timestamp && action && details) generalLog.restoreEntry(timestamp, action, details);
+    }
+    for (uint64_t i = 0; i < numStats; i++) {
+        const char* timestamp = reader.getString(statsRecords[i].timestamp);
+        const char* action = reader.getString(statsRecords[i].action);
+        if (timestamp && action) statsLog.restoreEntry(timestamp, action, static_cast<int>(statsRecords[i].details));
+    }
+    return true;
+}
 
-        Transaction operator+(const Transaction& other) const {
-            if (from == other.from && to == other.to && crypto == other.crypto) {
-                return Transaction(from, to, crypto, amount + other.amount);
-            } else {
-                throw invalid_argument("Cannot add transactions with different participants or cryptos.");
-            }
+// LZ4 block format (no frame header): runs of literals and back-references of at least four bytes within 64 KB,
+// found with a hash table of the last position seen for each four-byte sequence.
+class Lz4 {
+    private:
+        static const int HASH_BITS = 14;
+        static const int MIN_MATCH = 4;
+        // The format ends every block with at least five literals and starts no match in the last twelve bytes.
+        static const int LAST_LITERALS = 5;
+        static const int MATCH_LIMIT = 12;
+        static const int MAX_OFFSET = 65535;
+
+        static uint32_t read32(const uint8_t* p) {
+            uint32_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
         }
 
-        Transaction operator-(const Transaction& other) const {
-            if (from == other.from && to == other.to && crypto == other.crypto) {
-                return Transaction(from, to, crypto, amount - other.amount);
-            } else {
-                throw invalid_argument("Cannot subtract transactions with different participants or cryptos.");
-            }
+        static void putLength(uint8_t*& out, size_t length) {
+            for (; length >= 255; length -= 255) *out++ = 255;
+            *out++ = static_cast<uint8_t>(length);
         }
 
-        Transaction& operator++() {
-            amount += 1.0f;
-            return *this;
+        static bool getLength(const uint8_t*& in, const uint8_t* end, size_t& length) {
+            uint8_t byte;
+            do {
+                if (in >= end) return false;
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+            return true;
         }
 
-        Transaction operator++(int) {
-            Transaction temp = *this;
-            amount += 1.0f;
-            return temp;
+        static void putSequence(uint8_t*& out, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength) {
+            uint8_t* token = out++;
+            *token = static_cast<uint8_t>(std::min<size_t>(numLiterals, 15) << 4);
+            if (numLiterals >= 15) putLength(out, numLiterals - 15);
+            memcpy(out, literals, numLiterals);
+            out += numLiterals;
+            if (matchLength == 0) return;
+            *out++ = static_cast<uint8_t>(offset);
+            *out++ = static_cast<uint8_t>(offset >> 8);
+            matchLength -= MIN_MATCH;
+            *token |= static_cast<uint8_t>(std::min<size_t>(matchLength, 15));
+            if (matchLength >= 15) putLength(out, matchLength - 15);
         }
 
-        float operator[](int index) const {
-            if (index != 0) {
-                throw out_of_range("Index out of range");
+    public:
+        static size_t maxCompressedSize(size_t size) { return size + size / 255 + 16; }
+
+        // Writes at most maxCompressedSize(size) bytes to out and returns how many.
+        static size_t compress(const uint8_t* in, size_t size, uint8_t* out) {
+            thread_local std::vector<int32_t> table;
+            table.assign(size_t(1) << HASH_BITS, -1);
+            uint8_t* start = out;
+            size_t anchor = 0, position = 0;
+            if (size > static_cast<size_t>(MATCH_LIMIT)) {
+                size_t matchEnd = size - LAST_LITERALS;
+                while (position + MATCH_LIMIT <= size) {
+                    uint32_t sequence = read32(in + position);
+                    uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+                    int32_t candidate = table[hash];
+                    table[hash] = static_cast<int32_t>(position);
+                    if (candidate < 0 || position - candidate > static_cast<size_t>(MAX_OFFSET) || read32(in + candidate) != sequence) {
+                        // Skip ahead faster through data that does not compress.
+                        position += 1 + ((position - anchor) >> 6);
+                        continue;
+                    }
+                    size_t length = MIN_MATCH;
+                    while (position + length < matchEnd && in[candidate + length] == in[position + length]) length++;
+                    putSequence(out, in + anchor, position - anchor, position - candidate, length);
+                    position += length;
+                    anchor = position;
+                }
             }
-            return amount;
+            putSequence(out, in + anchor, size - anchor, 0, 0);
+            return static_cast<size_t>(out - start);
         }
 
-        friend ostream& operator<<(ostream& os, const Transaction& transaction);
+        // Expands a block that must decode to exactly size bytes; returns false if it is malformed.
+        static bool decompress(const uint8_t* in, size_t inSize, uint8_t* out, size_t size) {
+            const uint8_t* end = in + inSize;
+            uint8_t* position = out;
+            uint8_t* outEnd = out + size;
+            while (in < end) {
+                uint8_t token = *in++;
+                size_t numLiterals = token >> 4;
+                if (numLiterals == 15 && !getLength(in, end, numLiterals)) return false;
+                if (numLiterals > static_cast<size_t>(end - in) || numLiterals > static_cast<size_t>(outEnd - position)) return false;
+                memcpy(position, in, numLiterals);
+                position += numLiterals;
+                in += numLiterals;
+                if (in == end) break;
+                if (end - in < 2) return false;
+                size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+                in += 2;
+                size_t length = token & 15;
+                if (length == 15 && !getLength(in, end, length)) return false;
+                length += MIN_MATCH;
+                if (offset == 0 || offset > static_cast<size_t>(position - out) || length > static_cast<size_t>(outEnd - position)) return false;
+                const uint8_t* match = position - offset;
+                if (offset >= length) {
+                    memcpy(position, match, length);
+                } else {
+                    for (size_t i = 0; i < length; i++) position[i] = match[i];
+                }
+                position += length;
+            }
+            return position == outEnd;
+        }
 };
 
-ostream& operator<<(ostream& os, const Transaction& transaction) {
-    os << "Transaction: " << transaction.amount << " of " << transaction.crypto.getSymbol() << " from " << transaction.from->getOwner() << " to " << transaction.to->getOwner();
-    return os;
+inline void putVarint(std::string& out, unsigned __int128 value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(static_cast<uint8_t>(value) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
 }
 
-class Blockchain {
-    private:
-        Transaction** transactions;
-        int numTransactions;
-        int capacity;
+// The first nine bytes hold 63 bits and are gathered in a machine word; only longer values pay for 128-bit shifts.
+inline bool getVarint(const uint8_t*& in, const uint8_t* end, unsigned __int128& value) {
+    uint64_t low = 0;
+    int shift = 0;
+    for (; in < end && shift < 63; shift += 7) {
+        uint8_t byte = *in++;
+        low |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = low;
+            return true;
+        }
+    }
+    value = low;
+    for (; in < end && shift < 128; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<unsigned __int128>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Values wider than N are rejected; an integer of at most 64 bits never leaves a machine word.
+template<typename N>
+bool getVarint(const uint8_t*& in, const uint8_t* end, N& value) {
+    typedef typename std::make_unsigned<N>::type Unsigned;
+    static_assert(sizeof(Unsigned) <= sizeof(uint64_t), "use the 128-bit getVarint");
+    uint64_t wide = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        uint64_t bits = byte & 0x7F;
+        if (shift == 63 && bits > 1) return false;
+        wide |= bits << shift;
+        if (!(byte & 0x80)) {
+            if (wide > std::numeric_limits<Unsigned>::max()) return false;
+            value = static_cast<N>(wide);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline unsigned __int128 zigzag(__int128 value) { return (static_cast<unsigned __int128>(value) << 1) ^ static_cast<unsigned __int128>(value >> 127); }
+
+inline __int128 unzigzag(unsigned __int128 value) { return static_cast<__int128>(value >> 1) ^ -static_cast<__int128>(value & 1); }
+
+const char ARCHIVE_MAGIC[8] = {'C', 'Q', 'A', 'R', 'C', 'H', '\0', '\0'};
+const uint32_t ARCHIVE_VERSION = 1;
+
+// Column chunks of a row group, in file order. Block columns hold one value per block (row count, timestamp as a
+// delta from the previous block, Merkle root); the rest hold one value per row (kind) or per transfer (wallet and
+// asset dictionary codes, amounts), except references, which hold one value per void record.
+enum ArchiveColumn : uint32_t {
+    COLUMN_BLOCK_ROWS = 0,
+    COLUMN_BLOCK_TIMES,
+    COLUMN_BLOCK_ROOTS,
+    COLUMN_KINDS,
+    COLUMN_FROM,
+    COLUMN_TO,
+    COLUMN_ASSETS,
+    COLUMN_AMOUNTS,
+    COLUMN_REFERENCES
+};
+
+const int ARCHIVE_COLUMNS = 9;
 
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+};
+
+// Footer entry for one row group. Statistics cover its transfers; a group of void records only has minAsset > maxAsset.
+// A column chunk is LZ4-compressed when its stored size is below its raw size.
+struct ArchiveGroup {
+    uint64_t offset;
+    uint64_t checksum;
+    uint64_t firstRow;
+    uint32_t firstBlock;
+    uint32_t numRows;
+    uint32_t numBlocks;
+    int32_t minAsset;
+    int32_t maxAsset;
+    uint32_t padding;
+    int64_t minTime;
+    int64_t maxTime;
+    uint64_t minAmountLow;
+    int64_t minAmountHigh;
+    uint64_t maxAmountLow;
+    int64_t maxAmountHigh;
+    uint32_t storedBytes[ARCHIVE_COLUMNS];
+    uint32_t rawBytes[ARCHIVE_COLUMNS];
+};
+
+// Last bytes of the file; the footer holds the group entries followed by the wallet and asset dictionaries and the
+// rows voided by later void records, all as varints.
+struct ArchiveTrailer {
+    uint64_t footerOffset;
+    uint64_t footerBytes;
+    uint64_t footerChecksum;
+    uint64_t numRows;
+    uint32_t numBlocks;
+    uint32_t numGroups;
+    uint32_t numWallets;
+    uint32_t numAssets;
+    uint64_t numVoided;
+    char magic[8];
+};
+
+static_assert(sizeof(ArchiveGroup) % 8 == 0 && sizeof(ArchiveTrailer) == 64, "archive records are written to disk as-is");
+
+// Streams sealed blocks into a columnar archive, one row group of GROUP_BLOCKS blocks at a time. Wallet and asset ids
+// are replaced by dictionary codes in order of first use; the dictionaries keep each id with its current owner or
+// asset name so the archive can be loaded into another directory. finish() writes the footer and renames the file
+// into place.
+class ArchiveWriter : public BlockSink {
     public:
-        Blockchain() : numTransactions(0), capacity(10) {transactions = new Transaction*[capacity];}
+        static const int GROUP_BLOCKS = 256;
 
-        Blockchain(int capacity) : numTransactions(0), capacity(capacity) { transactions = new Transaction*[capacity];}
-    
-        Blockchain(const Blockchain& other) {
-            capacity = other.capacity;
-            numTransactions = other.numTransactions;
-            transactions = new Transaction*[capacity];
-            for (int i = 0; i < numTransactions; i++) {
-                transactions[i] = new Transaction(*other.transactions[i]);
-            }
+    private:
+        const WalletDirectory& directory;
+        const AssetRegistry& registry;
+        string filename;
+        string temporary;
+        ofstream out;
+        uint64_t written;
+        bool failed;
+        std::string columns[ARCHIVE_COLUMNS];
+        std::vector<Amount> amounts;
+        ArchiveGroup group;
+        int64_t lastTime;
+        std::vector<ArchiveGroup> groups;
+        std::vector<WalletId> wallets;
+        std::unordered_map<uint64_t, uint32_t> walletCodes;
+        std::vector<AssetId> assets;
+        std::unordered_map<AssetId, uint32_t> assetCodes;
+        std::vector<uint64_t> voided;
+        uint64_t numRows;
+        uint32_t numBlocks;
+        std::vector<uint8_t> packed;
+
+        uint32_t walletCode(WalletId id) {
+            auto inserted = walletCodes.emplace(static_cast<uint64_t>(static_cast<uint32_t>(id.index)) << 32 | id.generation, static_cast<uint32_t>(wallets.size()));
+            if (inserted.second) wallets.push_back(id);
+            return inserted.first->second;
         }
 
-        ~Blockchain() {
-            for (int i = 0; i < numTransactions; i++) {
-                delete transactions[i];
-            }
-            delete[] transactions;
+        uint32_t assetCode(AssetId id) {
+            auto inserted = assetCodes.emplace(id, static_cast<uint32_t>(assets.size()));
+            if (inserted.second) assets.push_back(id);
+            return inserted.first->second;
         }
 
-        int getNumTransactions() const { return numTransactions; }
-        
-        int getCapacity() const { return capacity; }
-        
-        Transaction** getTransactions() {return transactions;}
-   
-        void addTransaction(Transaction* transaction) {
-            if (numTransactions >= capacity) {
-                capacity *= 2;
-                Transaction** newTransactions = new Transaction*[capacity];
-                for (int i = 0; i < numTransactions; i++) {
-                    newTransactions[i] = transactions[i];
-                }
-                delete[] transactions;
-                transactions = newTransactions;
-            }
-            transactions[numTransactions++] = transaction;
+        void startGroup() {
+            for (std::string& column : columns) column.clear();
+            amounts.clear();
+            group = ArchiveGroup{};
+            group.firstRow = numRows;
+            group.firstBlock = numBlocks;
+            group.minAsset = std::numeric_limits<int32_t>::max();
+            group.maxAsset = -1;
+            lastTime = 0;
         }
-    
-        void setNumTransactions(int numTransactions) {this->numTransactions = numTransactions; }
-
-        Blockchain& operator=(const Blockchain& other) {
-            if (this != &other) {
-                for (int i = 0; i < numTransactions; i++) {
-                    delete transactions[i];
-                }
-                delete[] transactions;
 
-                capacity = other.capacity;
-                numTransactions = other.numTransactions;
-                transactions = new Transaction*[capacity];
-                for (int i = 0; i < numTransactions; i++) {
-                    transactions[i] = new Transaction(*other.transactions[i]);
+        // Amounts are stored as varints of units / 10^scale, with scale the most trailing decimal zeros all share.
+        void packAmounts() {
+            std::string& column = columns[COLUMN_AMOUNTS];
+            int scale = Amount::DECIMALS;
+            __int128 divisor = 1;
+            for (int i = 0; i < scale; i++) divisor *= 10;
+            for (const Amount& amount : amounts) {
+                while (scale > 0 && amount.getUnits() % divisor != 0) {
+                    scale--;
+                    divisor /= 10;
                 }
             }
-            return *this;
+            column.push_back(static_cast<char>(scale));
+            for (const Amount& amount : amounts) putVarint(column, zigzag(amount.getUnits() / divisor));
         }
 
-        bool operator==(const Blockchain& other) const {return numTransactions == other.numTransactions;}
-
-        bool operator<(const Blockchain& other) const {return numTransactions < other.numTransactions;}
-
-        Blockchain operator+(const Blockchain& other) const {
-            Blockchain newBlockchain(capacity + other.capacity);
-            for (int i = 0; i < numTransactions; i++) {
-                newBlockchain.addTransaction(new Transaction(*transactions[i]));
-            }
-            for (int i = 0; i < other.numTransactions; i++) {
-                newBlockchain.addTransaction(new Transaction(*other.transactions[i]));
+        void flushGroup() {
+            if (group.numBlocks == 0) return;
+            packAmounts();
+            std::string stored;
+            for (int c = 0; c < ARCHIVE_COLUMNS; c++) {
+                const std::string& column = columns[c];
+                packed.resize(Lz4::maxCompressedSize(column.size()));
+                size_t size = Lz4::compress(reinterpret_cast<const uint8_t*>(column.data()), column.size(), packed.data());
+                if (size < column.size()) stored.append(reinterpret_cast<const char*>(packed.data()), size);
+                else stored += column;
+                group.storedBytes[c] = static_cast<uint32_t>(std::min(size, column.size()));
+                group.rawBytes[c] = static_cast<uint32_t>(column.size());
             }
-            return newBlockchain;
+            group.offset = written;
+            group.checksum = checksumBytes(stored.data(), stored.size());
+            out.write(stored.data(), stored.size());
+            written += stored.size();
+            failed |= !out;
+            groups.push_back(group);
+            startGroup();
         }
 
-        Blockchain operator-(const Blockchain& other) const {
-            Blockchain newBlockchain(capacity);
-            for (int i = 0; i < numTransactions; i++) {
-                bool found = false;
-                for (int j = 0; j < other.numTransactions; j++) {
-                    if (*transactions[i] == *other.transactions[j]) {
-                        found = true;
-                        break;
-                    }
-                }
-                if (!found) {
-                    newBlockchain.addTransaction(new Transaction(*transactions[i]));
-                }
-            }
-            return newBlockchain;
+        void putName(std::string& footer, const char* name) {
+            size_t length = name ? strlen(name) : 0;
+            putVarint(footer, length);
+            footer.append(name ? name : "", length);
+        }
+
+    public:
+        ArchiveWriter(const string& filename, const WalletDirectory& directory, const AssetRegistry& registry)
+            : directory(directory), registry(registry), filename(filename), temporary(filename + ".tmp"), written(0), failed(false), lastTime(0), numRows(0), numBlocks(0) {
+            out.open(temporary, ios::binary | ios::trunc);
+            ArchiveHeader header = {};
+            memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+            header.version = ARCHIVE_VERSION;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            written = sizeof(header);
+            failed = !out;
+            startGroup();
         }
 
-        Blockchain& operator++() {
-            capacity += 10;
-            Transaction** newTransactions = new Transaction*[capacity];
-            for (int i = 0; i < numTransactions; i++) {
-                newTransactions[i] = transactions[i];
+        ~ArchiveWriter() {
+            if (out.is_open()) {
+                out.close();
+                std::remove(temporary.c_str());
             }
-            delete[] transactions;
-            transactions = newTransactions;
-            return *this;
         }
 
-        Blockchain operator++(int) {
-            Blockchain temp = *this;
-            ++(*this);
-            return temp;
+        bool isOpen() const { return out.is_open() && !failed; }
+
+        uint64_t getNumRows() const { return numRows; }
+
+        int getNumGroups() const { return static_cast<int>(groups.size()); }
+
+        uint64_t getBytes() const { return written; }
+
+        // Blocks must arrive in chain order, starting at height 0.
+        bool appendBlock(const BlockHeader& header, const TransactionRecord* records) override {
+            if (failed || header.height != numBlocks || header.firstTransaction != numRows) return false;
+            putVarint(columns[COLUMN_BLOCK_ROWS], header.numTransactions);
+            putVarint(columns[COLUMN_BLOCK_TIMES], zigzag(static_cast<__int128>(header.timestamp) - lastTime));
+            columns[COLUMN_BLOCK_ROOTS].append(reinterpret_cast<const char*>(header.merkleRoot.bytes), sizeof(header.merkleRoot.bytes));
+            lastTime = header.timestamp;
+            if (group.numBlocks == 0) group.minTime = group.maxTime = header.timestamp;
+            group.minTime = std::min(group.minTime, header.timestamp);
+            group.maxTime = std::max(group.maxTime, header.timestamp);
+            for (uint32_t i = 0; i < header.numTransactions; i++, numRows++) {
+                const TransactionRecord& record = records[i];
+                columns[COLUMN_KINDS].push_back(static_cast<char>(record.kind));
+                if (static_cast<TransactionKind>(record.kind) == TransactionKind::Void) {
+                    putVarint(columns[COLUMN_REFERENCES], numRows - static_cast<uint64_t>(record.reference));
+                    voided.push_back(static_cast<uint64_t>(record.reference));
+                    continue;
+                }
+                putVarint(columns[COLUMN_FROM], walletCode(WalletId{record.fromIndex, record.fromGeneration}));
+                putVarint(columns[COLUMN_TO], walletCode(WalletId{record.toIndex, record.toGeneration}));
+                putVarint(columns[COLUMN_ASSETS], assetCode(record.asset));
+                Amount amount = Amount::fromWords(record.amountLow, record.amountHigh);
+                if (group.minAsset > group.maxAsset) {
+                    group.minAmountLow = group.maxAmountLow = record.amountLow;
+                    group.minAmountHigh = group.maxAmountHigh = record.amountHigh;
+                } else if (amount < Amount::fromWords(group.minAmountLow, group.minAmountHigh)) {
+                    group.minAmountLow = record.amountLow;
+                    group.minAmountHigh = record.amountHigh;
+                } else if (amount > Amount::fromWords(group.maxAmountLow, group.maxAmountHigh)) {
+                    group.maxAmountLow = record.amountLow;
+                    group.maxAmountHigh = record.amountHigh;
+                }
+                group.minAsset = std::min(group.minAsset, record.asset);
+                group.maxAsset = std::max(group.maxAsset, record.asset);
+                amounts.push_back(amount);
+            }
+            group.numRows += header.numTransactions;
+            numBlocks++;
+            if (++group.numBlocks == GROUP_BLOCKS) flushGroup();
+            return !failed;
         }
 
-        Transaction* operator[](int index) {
-            if (index < 0 || index >= numTransactions) {
-                throw out_of_range("Index out of range");
+        bool finish() {
+            if (!out.is_open()) return false;
+            flushGroup();
+            while (written % 8 != 0) {
+                out.put('\0');
+                written++;
+            }
+            std::string footer(reinterpret_cast<const char*>(groups.data()), groups.size() * sizeof(ArchiveGroup));
+            for (WalletId id : wallets) {
+                putVarint(footer, zigzag(id.index));
+                putVarint(footer, id.generation);
+                const Wallet* wallet = directory.get(id);
+                putName(footer, wallet ? wallet->getOwner() : nullptr);
             }
-            return transactions[index];
+            for (AssetId id : assets) {
+                putVarint(footer, zigzag(id));
+                const CryptoCurrency* asset = registry.get(id);
+                putName(footer, asset ? asset->getName() : nullptr);
+            }
+            std::sort(voided.begin(), voided.end());
+            for (size_t i = 0; i < voided.size(); i++) putVarint(footer, voided[i] - (i > 0 ? voided[i - 1] : 0));
+
+            ArchiveTrailer trailer = {};
+            trailer.footerOffset = written;
+            trailer.footerBytes = footer.size();
+            trailer.footerChecksum = checksumBytes(footer.data(), footer.size());
+            trailer.numRows = numRows;
+            trailer.numBlocks = numBlocks;
+            trailer.numGroups = static_cast<uint32_t>(groups.size());
+            trailer.numWallets = static_cast<uint32_t>(wallets.size());
+            trailer.numAssets = static_cast<uint32_t>(assets.size());
+            trailer.numVoided = voided.size();
+            memcpy(trailer.magic, ARCHIVE_MAGIC, sizeof(trailer.magic));
+            out.write(footer.data(), footer.size());
+            out.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+            written += footer.size() + sizeof(trailer);
+            out.flush();
+            failed |= !out;
+            out.close();
+            if (failed) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+#ifndef _WIN32
+            int fd = ::open(temporary.c_str(), O_WRONLY);
+            if (fd >= 0) {
+                ::fsync(fd);
+                ::close(fd);
+            }
+#else
+            std::remove(filename.c_str());
+#endif
+            if (std::rename(temporary.c_str(), filename.c_str()) != 0) {
+                std::remove(temporary.c_str());
+                return false;
+            }
+            return true;
         }
-
-        friend ostream& operator<<(ostream& os, const Blockchain& blockchain);
 };
 
-ostream& operator<<(ostream& os, const Blockchain& blockchain) {
-    os << "Blockchain Transactions:\n";
-    for (int i = 0; i < blockchain.numTransactions; i++) {
-        os << *blockchain.transactions[i] << "\n";
+// Seals the pending transfers and archives the whole chain.
+bool writeArchive(const string& filename, Blockchain& blockchain, const WalletDirectory& directory, const AssetRegistry& registry) {
+    blockchain.sealBlock();
+    ArchiveWriter writer(filename, directory, registry);
+    std::vector<TransactionRecord> records;
+    for (int height = 0; height < blockchain.getNumBlocks() && writer.isOpen(); height++) {
+        blockchain.getBlockRecords(height, records);
+        writer.appendBlock(blockchain.getBlock(height), records.data());
     }
-    return os;
+    return writer.finish();
 }
 
-void demonstratePolymorphism(DigitalAsset** assets, int count) {
-    cout << "\n=== Polymorphism Demonstration ===\n";
-    for (int i = 0; i <count; i++) {
-        cout << "Asset " << i + 1 << ":\n";
-        assets[i]->displayInfo();
-        cout << "Market value calculation: " << assets[i]->calculateMarketValue() << endl;
-        cout << endl;
-    }
-} 
+// Maps an archive and decodes one row group at a time; readGroup() is safe to call from several threads.
+class ArchiveReader {
+    private:
+        MappedFile file;
+        std::string_view data;
+        ArchiveTrailer trailer;
+        const ArchiveGroup* groups;
+        std::vector<WalletId> wallets;
+        std::vector<string> walletNames;
+        std::vector<AssetId> assets;
+        std::vector<string> assetNames;
+        std::vector<uint64_t> voided;
+        string error;
+
+        bool fail(const string& message) {
+            error = message;
+            return false;
+        }
 
-template<typename T>
-void resizeArray(T**& array, int& capacity, int required) {
-    try {
-        if (required <= capacity) return;
-        int newCapacity = capacity * 2;
-        if (newCapacity < required) newCapacity = required + 10;
-        T** newArray = new T*[newCapacity];
-        for (int i = 0; i < capacity; i++) {
-            newArray[i] = array[i];
+        static bool getName(const uint8_t*& in, const uint8_t* end, string& name) {
+            size_t length;
+            if (!getVarint(in, end, length) || length > static_cast<size_t>(end - in)) return false;
+            name.assign(reinterpret_cast<const char*>(in), length);
+            in += length;
+            return true;
         }
-        delete[] array;
-        array = newArray;
-        capacity = newCapacity;
-    } 
-    catch (const bad_alloc& e) {
-        throw runtime_error("Failed to resize array: memory allocation failed");
-    }
-}
 
-bool loadCryptosFromFile(const string& filename, CryptoCurrency**& cryptos, int& numCryptos, int& cryptosCapacity,UtilityCoin**& utilityCoins, int& numUtilityCoins, int& utilityCoinsCapacity,StableCoin**& stableCoins, int& numStableCoins, int& stableCoinsCapacity, DigitalAsset**& assets, int& numAssets, int& assetsCapacity, AuditLog<std::string>& generalLog, AuditLog<int>& statsLog) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cout << "Failed to open file: " << filename << endl;
-        return false;
-    }
+    public:
+        explicit ArchiveReader(const string& filename) : file(filename), trailer{}, groups(nullptr) {}
+
+        bool exists() const { return file.isOpen(); }
+
+        const string& getError() const { return error; }
+
+        bool validate() {
+            if (!file.isOpen()) return fail("cannot open file");
+            data = file.view();
+            if (data.size() < sizeof(ArchiveHeader) + sizeof(ArchiveTrailer)) return fail("file too small");
+            ArchiveHeader header;
+            memcpy(&header, data.data(), sizeof(header));
+            memcpy(&trailer, data.data() + data.size() - sizeof(trailer), sizeof(trailer));
+            if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0 || memcmp(trailer.magic, ARCHIVE_MAGIC, sizeof(trailer.magic)) != 0) return fail("bad magic");
+            if (header.version != ARCHIVE_VERSION) return fail("unsupported version " + to_string(header.version));
+            uint64_t footerEnd = data.size() - sizeof(trailer);
+            if (trailer.footerOffset % 8 != 0 || trailer.footerOffset > footerEnd || trailer.footerBytes != footerEnd - trailer.footerOffset) return fail("truncated file");
+            if (static_cast<uint64_t>(trailer.numGroups) * sizeof(ArchiveGroup) > trailer.footerBytes) return fail("footer out of bounds");
+            if (checksumBytes(data.data() + trailer.footerOffset, trailer.footerBytes) != trailer.footerChecksum) return fail("footer checksum mismatch");
+            groups = reinterpret_cast<const ArchiveGroup*>(data.data() + trailer.footerOffset);
+            uint64_t rows = 0, blocks = 0;
+            for (uint32_t g = 0; g < trailer.numGroups; g++) {
+                const ArchiveGroup& group = groups[g];
+                uint64_t stored = 0;
+                for (int c = 0; c < ARCHIVE_COLUMNS; c++) stored += group.storedBytes[c];
+                if (group.firstRow != rows || group.firstBlock != blocks || group.offset > trailer.footerOffset || stored > trailer.footerOffset - group.offset) {
+                    return fail("row group " + to_string(g) + " out of bounds");
+                }
+                rows += group.numRows;
+                blocks += group.numBlocks;
+            }
+            if (rows != trailer.numRows || blocks != trailer.numBlocks) return fail("row groups do not add up");
+
+            const uint8_t* in = reinterpret_cast<const uint8_t*>(data.data() + trailer.footerOffset) + trailer.numGroups * sizeof(ArchiveGroup);
+            const uint8_t* end = reinterpret_cast<const uint8_t*>(data.data() + footerEnd);
+            wallets.resize(trailer.numWallets);
+            walletNames.resize(trailer.numWallets);
+            for (uint32_t i = 0; i < trailer.numWallets; i++) {
+                unsigned __int128 index;
+                if (!getVarint(in, end, index) || !getVarint(in, end, wallets[i].generation) || !getName(in, end, walletNames[i])) return fail("corrupt wallet dictionary");
+                wallets[i].index = static_cast<int>(unzigzag(index));
+            }
+            assets.resize(trailer.numAssets);
+            assetNames.resize(trailer.numAssets);
+            for (uint32_t i = 0; i < trailer.numAssets; i++) {
+                unsigned __int128 id;
+                if (!getVarint(in, end, id) || !getName(in, end, assetNames[i])) return fail("corrupt asset dictionary");
+                assets[i] = static_cast<AssetId>(unzigzag(id));
+            }
+            voided.resize(trailer.numVoided);
+            for (uint64_t i = 0; i < trailer.numVoided; i++) {
+                if (!getVarint(in, end, voided[i])) return fail("corrupt void list");
+                if (i > 0) voided[i] += voided[i - 1];
+            }
+            return true;
+        }
 
-    string line;
-    while (getline(file, line)) {
-        stringstream ss(line);
-        string type;
-        ss >> type;
+        uint64_t getNumRows() const { return trailer.numRows; }
 
-        if (type == "CRYPTO") {
-            string name, symbol;
-            float price;
-            long long marketCap;
-            char currencyType;
+        int getNumBlocks() const { return static_cast<int>(trailer.numBlocks); }
 
-            if (ss >> name >> symbol >> price >> marketCap >> currencyType) {
-                resizeArray(cryptos, cryptosCapacity, numCryptos + 1);
-                resizeArray(assets, assetsCapacity, numAssets + 1);
-                
-                CryptoCurrency* crypto = new CryptoCurrency(
-                    name.c_str(), symbol.c_str(), price, marketCap, currencyType
-                );
-                cryptos[numCryptos++] = crypto;
-                assets[numAssets++] = crypto;
-                
-                generalLog.addEntry("Crypto loaded", name);
-                statsLog.addEntry("Total cryptos", numCryptos);
-            } else {
-                cerr << "Skipping invalid CRYPTO line: " << line << endl;
-            }
-        } else if (type == "UTILITY") {
-            string name, symbol, useCase;
-            float price;
-            long long marketCap;
-            char currencyType;
+        int getNumGroups() const { return static_cast<int>(trailer.numGroups); }
 
-            if (ss >> name >> symbol >> price >> marketCap >> useCase >> currencyType) {
-                resizeArray(utilityCoins, utilityCoinsCapacity, numUtilityCoins + 1);
-                resizeArray(assets, assetsCapacity, numAssets + 1);
-                
-                UtilityCoin* utility = new UtilityCoin(
-                    name.c_str(), symbol.c_str(), price, marketCap, useCase.c_str(), currencyType
-                );
-                utilityCoins[numUtilityCoins++] = utility;
-                assets[numAssets++] = utility;
-                
-                generalLog.addEntry("Utility loaded", name);
-                statsLog.addEntry("Total utilities", numUtilityCoins);
-            } else {
-                cerr << "Skipping invalid UTILITY line: " << line << endl;
-            }
-        } else if (type == "STABLE") {
-            string name, symbol, backedBy;
-            float price;
-            long long marketCap;
-            char currencyType;
+        const ArchiveGroup& getGroup(int index) const { return groups[index]; }
 
-            if (ss >> name >> symbol >> price >> marketCap >> backedBy >> currencyType) {
-                resizeArray(stableCoins, stableCoinsCapacity, numStableCoins + 1);
-                resizeArray(assets, assetsCapacity, numAssets + 1);
-                
-                StableCoin* stable = new StableCoin(
-                    name.c_str(), symbol.c_str(), price, marketCap, backedBy.c_str(), currencyType
-                );
-                stableCoins[numStableCoins++] = stable;
-                assets[numAssets++] = stable;
-                
-                generalLog.addEntry("Stable loaded", name);
-                statsLog.addEntry("Total stables", numStableCoins);
-            } else {
-                cerr << "Skipping invalid STABLE line: " << line << endl;
-            }
-        } else {
-            cerr << "Unknown type: " << type << endl;
-        }
-    }
-    
-    file.close();
-    return true;
-}
+        size_t getBytes() const { return data.size(); }
 
-bool loadWalletsFromFile(const string& filename, Wallet**& wallets, int& numWallets, int& walletsCapacity, CryptoCurrency** cryptos, int numCryptos, UtilityCoin** utilityCoins, int numUtilityCoins, StableCoin** stableCoins, int numStableCoins){
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cout << "Failed to open file: " << filename << endl;
-        return false;
-    }
+        const std::vector<WalletId>& getWallets() const { return wallets; }
 
-    string line, owner;
-    int capacity, numCrypto;
-    char isActiveChar;
-    bool isActive;
+        const string& getWalletName(int code) const { return walletNames[code]; }
 
-    while (file >> owner >> capacity >> isActiveChar) {
-        resizeArray(wallets, walletsCapacity, numWallets + 1);
-        
-        isActive = (isActiveChar == 'Y' || isActiveChar == 'y');
-        
-        Wallet* wallet = new Wallet(owner.c_str(), capacity);
-        wallet->setIsActive(isActive);
-        
-        file >> numCrypto;
-        for (int i = 0; i < numCrypto; i++) {
-            string cryptoName;
-            file >> cryptoName;
+        const std::vector<AssetId>& getAssets() const { return assets; }
+
+        const string& getAssetName(int code) const { return assetNames[code]; }
 
-            bool found = false;
-            for (int j = 0; j < numCryptos && !found; j++) {
-                if (cryptoName == cryptos[j]->getName()) {
-                    wallet->addCrypto(*cryptos[j]);
-                    found = true;
+        // Archive rows voided by a void record anywhere in the archive, in increasing order.
+        const std::vector<uint64_t>& getVoided() const { return voided; }
+
+        // Decodes row group index after checking its checksum. Blocks come back with their archive height and first row
+        // and a zero prevHash; dictionary codes are translated through walletIds and assetIds. False if the group is corrupt.
+        bool readGroup(int index, const WalletId* walletIds, const AssetId* assetIds, std::vector<BlockHeader>& blocks, std::vector<TransactionRecord>& records) const {
+            const ArchiveGroup& group = groups[index];
+            thread_local std::vector<uint8_t> raw[ARCHIVE_COLUMNS];
+            const char* stored = data.data() + group.offset;
+            uint64_t storedSize = 0;
+            for (int c = 0; c < ARCHIVE_COLUMNS; c++) storedSize += group.storedBytes[c];
+            if (checksumBytes(stored, storedSize) != group.checksum) return false;
+            const uint8_t* in[ARCHIVE_COLUMNS];
+            const uint8_t* end[ARCHIVE_COLUMNS];
+            for (int c = 0; c < ARCHIVE_COLUMNS; c++) {
+                const uint8_t* chunk = reinterpret_cast<const uint8_t*>(stored);
+                stored += group.storedBytes[c];
+                if (group.storedBytes[c] < group.rawBytes[c]) {
+                    raw[c].resize(group.rawBytes[c]);
+                    if (!Lz4::decompress(chunk, group.storedBytes[c], raw[c].data(), raw[c].size())) return false;
+                    chunk = raw[c].data();
+                } else if (group.storedBytes[c] != group.rawBytes[c]) {
+                    return false;
                 }
+                in[c] = chunk;
+                end[c] = chunk + group.rawBytes[c];
             }
-            
-            for (int j = 0; j < numUtilityCoins && !found; j++) {
-                if (cryptoName == utilityCoins[j]->getName()) {
-                    wallet->addCrypto(*utilityCoins[j]);
-                    found = true;
-                }
+
+            blocks.resize(group.numBlocks);
+            uint64_t row = group.firstRow;
+            int64_t time = 0;
+            if (static_cast<uint64_t>(end[COLUMN_BLOCK_ROOTS] - in[COLUMN_BLOCK_ROOTS]) != group.numBlocks * sizeof(Hash256)) return false;
+            for (uint32_t b = 0; b < group.numBlocks; b++) {
+                BlockHeader& header = blocks[b];
+                unsigned __int128 delta;
+                if (!getVarint(in[COLUMN_BLOCK_ROWS], end[COLUMN_BLOCK_ROWS], header.numTransactions) || !getVarint(in[COLUMN_BLOCK_TIMES], end[COLUMN_BLOCK_TIMES], delta)) return false;
+                time += static_cast<int64_t>(unzigzag(delta));
+                header.height = group.firstBlock + b;
+                header.timestamp = time;
+                header.firstTransaction = static_cast<uint32_t>(row);
+                header.prevHash = Hash256{};
+                memcpy(header.merkleRoot.bytes, in[COLUMN_BLOCK_ROOTS] + b * sizeof(Hash256), sizeof(Hash256));
+                row += header.numTransactions;
             }
-            
-            for (int j = 0; j < numStableCoins && !found; j++) {
-                if (cryptoName == stableCoins[j]->getName()) {
-                    wallet->addCrypto(*stableCoins[j]);
-                    found = true;
+            in[COLUMN_BLOCK_ROOTS] = end[COLUMN_BLOCK_ROOTS];
+            if (row != group.firstRow + group.numRows || static_cast<uint64_t>(end[COLUMN_KINDS] - in[COLUMN_KINDS]) != group.numRows) return false;
+            if (in[COLUMN_AMOUNTS] == end[COLUMN_AMOUNTS] || *in[COLUMN_AMOUNTS] > Amount::DECIMALS) return false;
+            __int128 scale = 1;
+            for (int i = *in[COLUMN_AMOUNTS]++; i > 0; i--) scale *= 10;
+
+            records.resize(group.numRows);
+            for (uint32_t i = 0; i < group.numRows; i++) {
+                TransactionRecord& record = records[i];
+                record = TransactionRecord{};
+                record.kind = in[COLUMN_KINDS][i];
+                if (static_cast<TransactionKind>(record.kind) == TransactionKind::Void) {
+                    uint64_t back;
+                    if (!getVarint(in[COLUMN_REFERENCES], end[COLUMN_REFERENCES], back) || back == 0 || back > group.firstRow + i) return false;
+                    record.fromIndex = record.toIndex = INVALID_WALLET.index;
+                    record.fromGeneration = record.toGeneration = INVALID_WALLET.generation;
+                    record.asset = INVALID_ASSET;
+                    record.reference = static_cast<int32_t>(group.firstRow + i - back);
+                    continue;
                 }
+                uint32_t from, to, asset;
+                unsigned __int128 amount;
+                if (!getVarint(in[COLUMN_FROM], end[COLUMN_FROM], from) || !getVarint(in[COLUMN_TO], end[COLUMN_TO], to) || !getVarint(in[COLUMN_ASSETS], end[COLUMN_ASSETS], asset)
+                    || !getVarint(in[COLUMN_AMOUNTS], end[COLUMN_AMOUNTS], amount)) return false;
+                if (from >= trailer.numWallets || to >= trailer.numWallets || asset >= trailer.numAssets) return false;
+                Amount value = Amount::fromUnits(unzigzag(amount) * scale);
+                record.fromIndex = walletIds[from].index;
+                record.fromGeneration = walletIds[from].generation;
+                record.toIndex = walletIds[to].index;
+                record.toGeneration = walletIds[to].generation;
+                record.asset = assetIds[asset];
+                record.reference = -1;
+                record.amountLow = value.lowWord();
+                record.amountHigh = value.highWord();
             }
+            in[COLUMN_KINDS] = end[COLUMN_KINDS];
+            for (int c = 0; c < ARCHIVE_COLUMNS; c++) {
+                if (in[c] != end[c]) return false;
+            }
+            return true;
         }
-        
-        wallets[numWallets++] = wallet;
-    }
-    
-    file.close();
-    return true;
-}
+};
 
-bool loadTransactionsFromFile(const string& filename, Blockchain& blockchain, Wallet** wallets, int numWallets, CryptoCurrency** cryptos, int numCryptos, UtilityCoin** utilityCoins, int numUtilityCoins, StableCoin** stableCoins, int numStableCoins) {
-    ifstream file(filename);
-    if (!file.is_open()) {
-        cout << "Failed to open file: " << filename << endl;
+// Appends an archived chain to blockchain, block by block, without settling: the archive holds history whose effect
+// is already in the wallets. Wallets and assets are matched by name, so the archive loads into another directory;
+// when that renumbers an id, or the chain already holds transactions, every block's Merkle root is recomputed;
+// otherwise the stored roots are kept as they are, protected by each row group's checksum.
+bool loadArchive(const string& filename, Blockchain& blockchain, const WalletDirectory& directory, const AssetRegistry& registry) {
+    ArchiveReader reader(filename);
+    if (!reader.exists()) return false;
+    if (!reader.validate()) {
+        cout << "Ignoring archive " << filename << ": " << reader.getError() << endl;
         return false;
     }
 
-    string fromOwner, toOwner, cryptoName;
-    float amount;
-
-    while (file >> fromOwner >> toOwner >> cryptoName >> amount) {
-        Wallet* fromWallet = nullptr;
-        Wallet* toWallet = nullptr;
-        
-        for (int i = 0; i < numWallets; i++) {
-            if (fromOwner == wallets[i]->getOwner()) {
-                fromWallet = wallets[i];
-            }
-            if (toOwner == wallets[i]->getOwner()) {
-                toWallet = wallets[i];
+    bool renumbered = false;
+    int unknown = 0;
+    std::vector<WalletId> walletIds(reader.getWallets());
+    for (size_t i = 0; i < walletIds.size(); i++) {
+        // A wallet deleted before archiving has no name, and its old slot may belong to someone else here.
+        WalletId id = reader.getWalletName(static_cast<int>(i)).empty() ? INVALID_WALLET : directory.find(reader.getWalletName(static_cast<int>(i)));
+        unknown += id == INVALID_WALLET && !(walletIds[i] == INVALID_WALLET);
+        renumbered |= !(id == walletIds[i]);
+        walletIds[i] = id;
+    }
+    std::vector<AssetId> assetIds(reader.getAssets());
+    for (size_t i = 0; i < assetIds.size(); i++) {
+        AssetId id = reader.getAssetName(static_cast<int>(i)).empty() ? INVALID_ASSET : registry.findByName(reader.getAssetName(static_cast<int>(i)));
+        unknown += id == INVALID_ASSET && assetIds[i] != INVALID_ASSET;
+        renumbered |= id != assetIds[i];
+        assetIds[i] = id;
+    }
+    if (unknown > 0) cout << "Warning: " << unknown << " archived wallets or assets are not registered; their transfers refer to no one.\n";
+
+    blockchain.sealBlock();
+    int base = blockchain.getNumTransactions();
+    bool rewritten = renumbered || base > 0;
+    blockchain.reserve(base + static_cast<int>(reader.getNumRows()));
+    int numGroups = reader.getNumGroups();
+    int window = TaskPool::getInstance()->getThreads();
+    std::vector<std::vector<BlockHeader>> blocks(std::min(window, numGroups));
+    std::vector<std::vector<TransactionRecord>> records(blocks.size());
+    std::vector<char> decoded(blocks.size());
+    int windowStart = 0, windowEnd = 0, nextGroup = 0, corrupt = -1;
+    // Row groups are decoded a window at a time, in parallel, and handed to the chain one by one.
+    auto decodeNext = [&](BlockHeader*& headers, int& numBlocks, const TransactionRecord*& rows) {
+        if (nextGroup == windowEnd) {
+            if (windowEnd == numGroups) return false;
+            windowStart = windowEnd;
+            windowEnd = std::min(windowStart + window, numGroups);
+            parallelFor(windowStart, windowEnd, 1, [&](int64_t first, int64_t last) {
+                for (int64_t g = first; g < last; g++) {
+                    decoded[g - windowStart] = reader.readGroup(static_cast<int>(g), walletIds.data(), assetIds.data(), blocks[g - windowStart], records[g - windowStart]);
+                }
+            });
+        }
+        int slot = nextGroup - windowStart;
+        if (!decoded[slot]) {
+            corrupt = nextGroup;
+            return false;
+        }
+        nextGroup++;
+        if (base > 0) {
+            for (TransactionRecord& record : records[slot]) {
+                if (record.kind == static_cast<uint32_t>(TransactionKind::Void)) record.reference += base;
             }
         }
-        
-        if (!fromWallet || !toWallet) {
-            cout << "Warning: Couldn't find wallets for transaction between " 
-                << fromOwner << " and " << toOwner << endl;
-            continue;
+        if (rewritten) {
+            const TransactionRecord* record = records[slot].data();
+            for (BlockHeader& header : blocks[slot]) {
+                header.merkleRoot = merkleRoot(record, static_cast<int>(header.numTransactions));
+                record += header.numTransactions;
+            }
         }
+        headers = blocks[slot].data();
+        numBlocks = static_cast<int>(blocks[slot].size());
+        rows = records[slot].data();
+        return true;
+    };
+    int restored = blockchain.restoreBlocks(decodeNext, false);
+    if (corrupt >= 0) {
+        cout << "Archive row group " << corrupt << " in " << filename << " is corrupt; loaded the " << blockchain.getNumTransactions() - base
+             << " transactions before it.\n";
+        return false;
+    }
+    if (restored < reader.getNumBlocks()) {
+        cout << "Archive block " << restored << " in " << filename << " does not fit the chain.\n";
+        return false;
+    }
+    return true;
+}
 
-        CryptoCurrency* crypto = nullptr;
-        
-        for (int i = 0; i < numCryptos; i++) {
-            if (cryptoName == cryptos[i]->getName()) {
-                crypto = cryptos[i];
-                break;
+// The transfers of an archive in LedgerScan's TRANSFERS schema, skipping every row group whose statistics rule out
+// one of the predicates on time, asset or amount. Rows from the groups it reads are not filtered; wallet and asset
+// columns hold the archived ids.
+class ArchiveScan : public QueryOperator {
+    private:
+        const ArchiveReader& reader;
+        std::vector<QueryPredicate> predicates;
+        std::vector<BlockHeader> blocks;
+        std::vector<TransactionRecord> records;
+        int nextGroup;
+        int groupsRead;
+        size_t position;
+        size_t block;
+        size_t voidedCursor;
+
+        template<typename T>
+        static bool overlaps(const T& low, const T& high, CompareOp op, const T& value) {
+            switch (op) {
+                case CompareOp::Equal: return low <= value && value <= high;
+                case CompareOp::NotEqual: return !(low == value && high == value);
+                case CompareOp::Less: return low < value;
+                case CompareOp::LessEqual: return low <= value;
+                case CompareOp::Greater: return high > value;
+                case CompareOp::GreaterEqual: return high >= value;
             }
+            return true;
         }
-        
-        if (!crypto) {
-            for (int i = 0; i < numUtilityCoins; i++) {
-                if (cryptoName == utilityCoins[i]->getName()) {
-                    crypto = utilityCoins[i];
-                    break;
+
+        bool mayMatch(const ArchiveGroup& group) const {
+            bool hasTransfers = group.minAsset <= group.maxAsset;
+            for (const QueryPredicate& predicate : predicates) {
+                if (predicate.column == "time") {
+                    if (!overlaps<int64_t>(group.minTime, group.maxTime, predicate.op, predicate.value)) return false;
+                } else if (predicate.column == "asset") {
+                    if (!hasTransfers || !overlaps<int64_t>(group.minAsset, group.maxAsset, predicate.op, predicate.value)) return false;
+                } else if (predicate.column == "amount") {
+                    Amount low = Amount::fromWords(group.minAmountLow, group.minAmountHigh), high = Amount::fromWords(group.maxAmountLow, group.maxAmountHigh);
+                    if (!hasTransfers || !overlaps(low, high, predicate.op, predicate.amount)) return false;
                 }
             }
+            return true;
         }
-        
-        if (!crypto) {
-            for (int i = 0; i < numStableCoins; i++) {
-                if (cryptoName == stableCoins[i]->getName()) {
-                    crypto = stableCoins[i];
-                    break;
+
+    public:
+        ArchiveScan(const ArchiveReader& reader, std::vector<QueryPredicate> predicates)
+            : reader(reader), predicates(std::move(predicates)), nextGroup(0), groupsRead(0), position(0), block(0), voidedCursor(0) {
+            schema = {{"id", QueryType::Int}, {"from", QueryType::Int}, {"to", QueryType::Int}, {"asset", QueryType::Int},
+                      {"amount", QueryType::Amount}, {"time", QueryType::Int}};
+        }
+
+        int getGroupsRead() const { return groupsRead; }
+
+        bool next(RowBatch& batch) override {
+            batch.shape(schema);
+            const std::vector<uint64_t>& voided = reader.getVoided();
+            int n = 0;
+            while (n < RowBatch::CAPACITY) {
+                if (position == records.size()) {
+                    while (nextGroup < reader.getNumGroups() && !mayMatch(reader.getGroup(nextGroup))) nextGroup++;
+                    if (nextGroup == reader.getNumGroups()) break;
+                    if (!reader.readGroup(nextGroup, reader.getWallets().data(), reader.getAssets().data(), blocks, records)) {
+                        throw runtime_error("Archive row group " + to_string(nextGroup) + " is corrupt");
+                    }
+                    nextGroup++;
+                    groupsRead++;
+                    position = 0;
+                    block = 0;
+                    continue;
                 }
+                const TransactionRecord& record = records[position];
+                uint64_t id = blocks[0].firstTransaction + position;
+                position++;
+                while (block + 1 < blocks.size() && id >= blocks[block + 1].firstTransaction) block++;
+                while (voidedCursor < voided.size() && voided[voidedCursor] < id) voidedCursor++;
+                if (static_cast<TransactionKind>(record.kind) == TransactionKind::Void || (voidedCursor < voided.size() && voided[voidedCursor] == id)) continue;
+                batch.ints[0][n] = static_cast<int64_t>(id);
+                batch.ints[1][n] = record.fromIndex;
+                batch.ints[2][n] = record.toIndex;
+                batch.ints[3][n] = record.asset;
+                batch.amounts[4][n] = Amount::fromWords(record.amountLow, record.amountHigh);
+                batch.ints[5][n] = blocks[block].timestamp;
+                n++;
             }
+            batch.size = n;
+            return n > 0;
         }
-        
-        if (!crypto) {
-            cout << "Warning: Couldn't find cryptocurrency " << cryptoName << " for transaction" << endl;
-            continue;
-        }
-        Transaction* transaction = new Transaction(fromWallet, toWallet, *crypto, amount);
-        blockchain.addTransaction(transaction);
-        
-        toWallet->addCrypto(*crypto);
-    }
-    
-    file.close();
-    return true;
-} 
+};
+
+// Reads the archive's transfers matching every predicate, skipping the row groups that cannot hold any.
+QueryPlan planArchiveScan(const ArchiveReader& reader, const std::vector<QueryPredicate>& predicates) {
+    return QueryPlan(new QueryFilter(QueryPlan(new ArchiveScan(reader, predicates)), predicates));
+}
 
 class Meniu {
     private:
         static Meniu* instance;
         AuditLog<std::string> generalLog; 
         AuditLog<int> statsLog; 
-        Meniu() : generalLog("audit_general.log"), statsLog("audit_stats.log") {} 
+        const string SNAPSHOT_FILE = "coinqueror.snap";
+        const string CHAIN_FILE = "coinqueror.chain";
+        const string ARCHIVE_FILE = "coinqueror.archive";
+        Meniu() : generalLog("audit_general.log", true), statsLog("audit_stats.log", true) {} 
+
+        void verifyChainLog(BlockLog& chainLog) {
+            auto start = std::chrono::steady_clock::now();
+            ChainVerification result = chainLog.verify();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            if (!result.ok) {
+                cout << "Chain verification failed at block " << result.failedBlock << ": " << result.error << endl;
+                return;
+            }
+            cout << "Chain log verified: " << result.verifiedBlocks << "/" << result.totalBlocks << " blocks (" << result.checkedBlocks << " new, "
+                 << result.checkedTransactions << " transactions) in " << elapsed.count() / 1000.0 << " ms.\n";
+        }
+
+        void syncChainLog(Blockchain& blockchain, BlockLog& chainLog) {
+            if (!chainLog.open()) {
+                cout << "Warning: cannot open chain log " << CHAIN_FILE << endl;
+                return;
+            }
+            uint64_t onDisk = chainLog.getNumBlocks();
+            uint64_t inMemory = static_cast<uint64_t>(blockchain.getNumBlocks());
+            if (onDisk > inMemory || (onDisk > 0 && chainLog.getBlockHash(onDisk - 1) != blockchain.getBlockHash(static_cast<int>(onDisk - 1)))) {
+                cout << "Chain log " << CHAIN_FILE << " belongs to a different chain; starting a new log.\n";
+                chainLog.reset();
+                onDisk = 0;
+            }
+            std::vector<TransactionRecord> records;
+            for (uint64_t height = onDisk; height < inMemory; height++) {
+                blockchain.getBlockRecords(static_cast<int>(height), records);
+                if (!chainLog.appendBlock(blockchain.getBlock(static_cast<int>(height)), records.data())) {
+                    cout << "Warning: failed to append block " << height << " to " << CHAIN_FILE << endl;
+                    break;
+                }
+            }
+            blockchain.attachSink(&chainLog);
+            verifyChainLog(chainLog);
+        }
+
+        CryptoCurrency* readCrypto(const string& prompt, CryptoCurrency** cryptos, int numCryptos) {
+            cout << prompt;
+            string key;
+            cin >> key;
+            char* end = nullptr;
+            long index = strtol(key.c_str(), &end, 10);
+            if (!key.empty() && *end == '\0') {
+                return (index >= 0 && index < numCryptos) ? cryptos[index] : nullptr;
+            }
+            AssetRegistry* registry = AssetRegistry::getInstance();
+            return registry->get(registry->resolve(key));
+        }
     public:
         static Meniu* getInstance() {
             if (instance == nullptr) { instance = new Meniu();}
@@ -1080,7 +7246,7 @@ class Meniu {
             cout << "12. Delete Wallet\n";
             cout << "13. View Wallet Details\n";
             cout << "14. View Transaction Details\n";
-            cout << "15. Delete Transaction\n";
+            cout << "15. Void Transaction\n";
             cout << "16. Compare Two Cryptos\n"; 
             cout << "17. Increment Crypto Price\n";
             cout << "18. Subtract Two Cryptos\n";
@@ -1090,6 +7256,12 @@ class Meniu {
             cout << "22. Demonstrate Diamond Inheritance\n";
             cout << "23.Show audit log\n";
             cout << "24. Exit\n";
+            cout << "25. Save Snapshot\n";
+            cout << "26. Verify Blockchain\n";
+            cout << "27. Apply Price Ticks\n";
+            cout << "28. Ledger Analytics\n";
+            cout << "29. Archive Blockchain\n";
+            cout << "30. Load Archive\n";
             cout << "Enter your choice: ";
         }
 
@@ -1111,6 +7283,9 @@ class Meniu {
             int numAssets = 0;
             int assetsCapacity = INITIAL_CAPACITY;
             
+            AssetRegistry& registry = *AssetRegistry::getInstance();
+            WalletDirectory& directory = *WalletDirectory::getInstance();
+            BlockLog chainLog(CHAIN_FILE);
             Blockchain blockchain;
             
             Wallet** wallets = new Wallet*[INITIAL_CAPACITY];
@@ -1119,73 +7294,95 @@ class Meniu {
             int choice;
             cout << "Loading data from files...\n";
         
-            if (loadCryptosFromFile("cryptos.txt", cryptos, numCryptos, cryptosCapacity,  utilityCoins, numUtilityCoins, utilityCoinsCapacity, stableCoins, numStableCoins, stableCoinsCapacity, assets, numAssets, assetsCapacity, generalLog, statsLog)) {
-                cout << "Successfully loaded cryptocurrencies from file.\n";
+            auto loadStart = std::chrono::steady_clock::now();
+            if (loadSnapshot(SNAPSHOT_FILE, cryptos, numCryptos, cryptosCapacity, utilityCoins, numUtilityCoins, utilityCoinsCapacity, stableCoins, numStableCoins, stableCoinsCapacity, assets, numAssets, assetsCapacity, wallets, numWallets, walletsCapacity, blockchain, registry, directory, generalLog, statsLog)) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - loadStart);
+                cout << "Restored " << numAssets << " assets, " << numWallets << " wallets and " << blockchain.getNumTransactions()
+                     << " transactions from " << SNAPSHOT_FILE << " in " << elapsed.count() / 1000.0 << " ms.\n";
             } else {
-                cout << "Using default cryptocurrency data.\n";
+                if (loadCryptosFromFile("cryptos.txt", cryptos, numCryptos, cryptosCapacity,  utilityCoins, numUtilityCoins, utilityCoinsCapacity, stableCoins, numStableCoins, stableCoinsCapacity, assets, numAssets, assetsCapacity, registry, generalLog, statsLog)) {
+                    cout << "Successfully loaded cryptocurrencies from file.\n";
+                } else {
+                    cout << "Using default cryptocurrency data.\n";
             
-                CryptoCurrency* bitcoin = new CryptoCurrency("Bitcoin", "BTC", 45000.0f, 850000000000LL, 'C');
-                cryptos[numCryptos++] = bitcoin;
-                assets[numAssets++] = bitcoin;
-                generalLog.addEntry("Crypto added", bitcoin->getName());
-                statsLog.addEntry("Total cryptos", numCryptos);
+                    CryptoCurrency* bitcoin = new CryptoCurrency("Bitcoin", "BTC", 45000, 850000000000LL, 'C');
+                    registry.add(bitcoin);
+                    cryptos[numCryptos++] = bitcoin;
+                    assets[numAssets++] = bitcoin;
+                    generalLog.addEntry("Crypto added", bitcoin->getName());
+                    statsLog.addEntry("Total cryptos", numCryptos);
     
-                CryptoCurrency* ethereum = new CryptoCurrency("Ethereum", "ETH", 3000.0f, 350000000000LL, 'C');
-                cryptos[numCryptos++] = ethereum;
-                assets[numAssets++] = ethereum;
-                generalLog.addEntry("Crypto added", ethereum->getName());
-                statsLog.addEntry("Total cryptos", numCryptos);
+                    CryptoCurrency* ethereum = new CryptoCurrency("Ethereum", "ETH", 3000, 350000000000LL, 'C');
+                    registry.add(ethereum);
+                    cryptos[numCryptos++] = ethereum;
+                    assets[numAssets++] = ethereum;
+                    generalLog.addEntry("Crypto added", ethereum->getName());
+                    statsLog.addEntry("Total cryptos", numCryptos);
     
-                UtilityCoin* filecoin = new UtilityCoin("Filecoin", "FIL", 40.0f, 7000000000LL, "Decentralized Storage", 'U');
-                utilityCoins[numUtilityCoins++] = filecoin;
-                assets[numAssets++] = filecoin;
-                generalLog.addEntry("Utility added", filecoin->getName());
-                statsLog.addEntry("Total Utility", numUtilityCoins);
+                    UtilityCoin* filecoin = new UtilityCoin("Filecoin", "FIL", 40, 7000000000LL, "Decentralized Storage", 'U');
+                    registry.add(filecoin);
+                    utilityCoins[numUtilityCoins++] = filecoin;
+                    assets[numAssets++] = filecoin;
+                    generalLog.addEntry("Utility added", filecoin->getName());
+                    statsLog.addEntry("Total Utility", numUtilityCoins);
     
-                StableCoin* tether = new StableCoin("Tether", "USDT", 1.0f, 70000000000LL, "USD", 'S');
-                stableCoins[numStableCoins++] = tether;
-                assets[numAssets++] = tether;
-                generalLog.addEntry("Stable added", tether->getName());
-                statsLog.addEntry("Total stables", numStableCoins);
-            }
+                    StableCoin* tether = new StableCoin("Tether", "USDT", 1, 70000000000LL, "USD", 'S');
+                    registry.add(tether);
+                    stableCoins[numStableCoins++] = tether;
+                    assets[numAssets++] = tether;
+                    generalLog.addEntry("Stable added", tether->getName());
+                    statsLog.addEntry("Total stables", numStableCoins);
+                }
         
-            if (loadWalletsFromFile("wallets.txt", wallets, numWallets, walletsCapacity, cryptos, numCryptos, utilityCoins, numUtilityCoins, stableCoins, numStableCoins)) {
-                cout << "Successfully loaded wallets from file.\n";
-            } else {
-                cout << "Using default wallet data.\n";
+                if (loadWalletsFromFile("wallets.txt", wallets, numWallets, walletsCapacity, registry, directory)) {
+                    cout << "Successfully loaded wallets from file.\n";
+                } else {
+                    cout << "Using default wallet data.\n";
 
-                Wallet* aliceWallet = new Wallet("Alice");
-                if (numCryptos > 0) aliceWallet->addCrypto(*cryptos[0]);
-                if (numCryptos > 1) aliceWallet->addCrypto(*cryptos[1]);
-                wallets[numWallets++] = aliceWallet;
+                    Wallet* aliceWallet = new Wallet("Alice");
+                    if (numCryptos > 0) aliceWallet->credit(cryptos[0]->getAssetId(), 1);
+                    if (numCryptos > 1) aliceWallet->credit(cryptos[1]->getAssetId(), 1);
+                    directory.add(aliceWallet);
+                    wallets[numWallets++] = aliceWallet;
     
-                Wallet* bobWallet = new Wallet("Bob");
-                if (numStableCoins > 0) bobWallet->addCrypto(*stableCoins[0]);
-                wallets[numWallets++] = bobWallet;
-            }
+                    Wallet* bobWallet = new Wallet("Bob");
+                    if (numStableCoins > 0) bobWallet->credit(stableCoins[0]->getAssetId(), 1);
+                    directory.add(bobWallet);
+                    wallets[numWallets++] = bobWallet;
+                }
         
-            if (loadTransactionsFromFile("transactions.txt", blockchain,wallets, numWallets, cryptos, numCryptos, utilityCoins, numUtilityCoins, stableCoins, numStableCoins)) {
-                cout << "Successfully loaded transactions from file.\n";
-            } else {
-                 cout << "Using default transaction data.\n";
+                if (loadTransactionsFromFile("transactions.txt", blockchain, directory, registry)) {
+                    cout << "Successfully loaded transactions from file.\n";
+                } else {
+                     cout << "Using default transaction data.\n";
 
-                if (numWallets >= 2 && numCryptos >= 1) {
-                    Transaction* transaction = new Transaction(wallets[0], wallets[1], *cryptos[0], 0.5);
-                     blockchain.addTransaction(transaction);
+                    if (numWallets >= 2 && numCryptos >= 1) {
+                        SettlementEngine(directory, registry).settle(Transaction(wallets[0]->getWalletId(), wallets[1]->getWalletId(), cryptos[0]->getAssetId(), Amount::fromScaled(5, 1)), blockchain);
+                    }
                 }
             }
+            syncChainLog(blockchain, chainLog);
             do {
                 afiseazaMeniu();
                 if (!(cin >> choice)) {
                     cin.clear();
                     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-                    cout << "Invalid input. Please enter a number between 1-24.\n";
+                    cout << "Invalid input. Please enter a number between 1-30.\n";
                     continue;
                 }
                 switch (choice) {
                    case 1: {
                         CryptoCurrency* crypto = new CryptoCurrency();
                         cin >> *crypto;
+                        try {
+                            registry.add(crypto);
+                        } catch (const invalid_argument& e) {
+                            cout << "Input Error: " << e.what() << endl;
+                            delete crypto;
+                            break;
+                        }
+                        resizeArray(cryptos, cryptosCapacity, numCryptos + 1);
+                        resizeArray(assets, assetsCapacity, numAssets + 1);
                         cryptos[numCryptos++] = crypto;
                         assets[numAssets++] = crypto;
                         generalLog.addEntry("Crypto added", crypto->getName());
@@ -1196,7 +7393,7 @@ class Meniu {
                    case 2: {
                         try {
                             char name[100], symbol[100], useCase[100];
-                            float price;
+                            Amount price;
                             long long marketCap;
                             char currencyType;
                             
@@ -1247,6 +7444,12 @@ class Meniu {
                             } catch (const bad_alloc& e) {
                                 throw runtime_error("Memory allocation failed for new UtilityCoin");
                             }
+                            try {
+                                registry.add(utilityCoin);
+                            } catch (const invalid_argument& e) {
+                                delete utilityCoin;
+                                throw;
+                            }
                             
                             if (numUtilityCoins >= utilityCoinsCapacity) {
                                 resizeArray(utilityCoins, utilityCoinsCapacity, numUtilityCoins + 1);
@@ -1276,7 +7479,7 @@ class Meniu {
                    case 3: { // Add Stable Coin
                         try {
                             char name[100], symbol[100], backedBy[100];
-                            float price;
+                            Amount price;
                             long long marketCap;
                             char currencyType;
 
@@ -1335,6 +7538,12 @@ class Meniu {
                             } catch (const exception& e) {
                                 throw runtime_error(string("Object creation failed: ") + e.what());
                             }
+                            try {
+                                registry.add(stableCoin);
+                            } catch (const invalid_argument& e) {
+                                delete stableCoin;
+                                throw;
+                            }
 
                             try {
                                 if (numStableCoins >= stableCoinsCapacity) {
@@ -1344,7 +7553,7 @@ class Meniu {
                                     resizeArray(assets, assetsCapacity, numAssets + 1);
                                 }
                             } catch (const exception& e) {
-                                delete stableCoin;
+                                registry.remove(stableCoin->getAssetId());
                                 throw runtime_error(string("Array resize failed: ") + e.what());
                             }
                     
@@ -1375,14 +7584,22 @@ class Meniu {
                    case 4: {
                         Wallet* wallet = new Wallet();
                         cin >> *wallet;
+                        try {
+                            directory.add(wallet);
+                        } catch (const invalid_argument& e) {
+                            cout << "Input Error: " << e.what() << endl;
+                            delete wallet;
+                            break;
+                        }
+                        resizeArray(wallets, walletsCapacity, numWallets + 1);
                         wallets[numWallets++] = wallet;
                         cout << "Wallet added successfully!\n";
                         break;
                     }
                    case 5: {
                     try {
-                        int fromIndex, toIndex, cryptoIndex;
-                        float amount;
+                        int fromIndex, toIndex;
+                        Amount amount;
                 
                         // Input validation for indices
                         auto read_index = [](const string& prompt, int max) -> int {
@@ -1398,7 +7615,8 @@ class Meniu {
                 
                         fromIndex = read_index("Enter sender wallet index (0-" + to_string(numWallets-1) + "): ", numWallets);
                         toIndex = read_index("Enter receiver wallet index (0-" + to_string(numWallets-1) + "): ", numWallets);
-                        cryptoIndex = read_index("Enter cryptocurrency index (0-" + to_string(numCryptos-1) + "): ", numCryptos);
+                        CryptoCurrency* crypto = readCrypto("Enter cryptocurrency index, name or symbol (0-" + to_string(numCryptos-1) + "): ", cryptos, numCryptos);
+                        if (!crypto) throw out_of_range("Unknown cryptocurrency");
                 
                         cout << "Enter amount: ";
                         if (!(cin >> amount) || amount < 0) {
@@ -1410,15 +7628,14 @@ class Meniu {
                             throw invalid_argument("Amount cannot be negative");
                         }
                 
-                        Transaction* t = nullptr;
+                        SettlementStatus status;
                         try {
-                            t = new Transaction(wallets[fromIndex], wallets[toIndex], *cryptos[cryptoIndex], amount);
+                            status = SettlementEngine(directory, registry).settle(Transaction(wallets[fromIndex]->getWalletId(), wallets[toIndex]->getWalletId(), crypto->getAssetId(), amount), blockchain);
                         } catch (const bad_alloc& e) {
                             throw runtime_error("Failed to allocate memory for transaction");
                         }
-                        
-                        blockchain.addTransaction(t);
-                        wallets[toIndex]->addCrypto(*cryptos[cryptoIndex]);
+
+                        if (status != SettlementStatus::Settled) throw runtime_error(string("Transfer rejected: ") + SettlementEngine::statusName(status));
                         cout << "Transaction added!\n";
                     }
                     catch (const exception& e) {
@@ -1444,13 +7661,39 @@ class Meniu {
                             stableCoins[i]->displayInfo();
                             cout << endl;
                         }
+
+                        AssetRegistry* registry = AssetRegistry::getInstance();
+                        const MarketTable& market = registry->getMarketTable();
+                        MarketSummary summary = market.summarize();
+                        cout << "\nMarket Summary:\n";
+                        for (int type = MARKET_CRYPTO; type < MARKET_TYPES; type++) {
+                            cout << MarketTable::typeName(static_cast<MarketType>(type)) << ": " << summary.count[type] << " assets, market value "
+                                 << summary.value[type] << ", market cap " << summary.marketCap[type] << endl;
+                        }
+                        cout << "Total market value: " << market.totalMarketValue() << ", total market cap: " << market.totalMarketCap() << endl;
+                        int top[3];
+                        int numTop = market.topByValue(3, top);
+                        for (int i = 0; i < numTop; i++) {
+                            cout << "Top " << i + 1 << ": " << registry->get(top[i])->getName() << " (" << market.getMarketValue(top[i]) << ")\n";
+                        }
                         break;
                     }
                    case 7: {
                         cout << "\n=== All Wallets ===\n";
+                        // Revalues only the wallets touched since the last listing, then formats them on the task pool.
+                        Amount total = WalletDirectory::getInstance()->totalValue();
+                        std::vector<string> listings(numWallets);
+                        parallelFor(0, numWallets, 64, [&](int64_t first, int64_t last) {
+                            for (int64_t i = first; i < last; i++) {
+                                ostringstream listing;
+                                listing << *wallets[i];
+                                listings[i] = listing.str();
+                            }
+                        });
                         for (int i = 0; i < numWallets; i++) {
-                            cout << "Wallet " << i << ":\n" << *wallets[i] << endl;
+                            cout << "Wallet " << i << ":\n" << listings[i] << endl;
                         }
+                        cout << "Total value: " << total << endl;
                         break;
                     }
                    case 8: { // View Blockchain Transactions
@@ -1458,33 +7701,36 @@ class Meniu {
                         break;
                     }
                    case 9: {
-                        int index;
                         char name[100], symbol[100];
-                        float price;
+                        Amount price;
                         long long marketCap;
                         char currencyType;
                     
-                        cout << "Enter cryptocurrency index to update (0-" << numCryptos - 1 << "): ";
-                        cin >> index;
+                        CryptoCurrency* crypto = readCrypto("Enter cryptocurrency index, name or symbol to update (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
                     
-                        if (index >= 0 && index < numCryptos) {
-                            cout << "Enter new name (current: " << cryptos[index]->getName() << "): ";
+                        if (crypto) {
+                            cout << "Enter new name (current: " << crypto->getName() << "): ";
                             cin >> name;
-                            cout << "Enter new symbol (current: " << cryptos[index]->getSymbol() << "): ";
+                            cout << "Enter new symbol (current: " << crypto->getSymbol() << "): ";
                             cin >> symbol;
-                            cout << "Enter new price (current: " << cryptos[index]->getPrice() << "): ";
+                            cout << "Enter new price (current: " << crypto->getPrice() << "): ";
                             cin >> price;
                             cout << "Enter new market cap: ";
                             cin >> marketCap;
                             cout << "Enter new currency type: ";
                             cin >> currencyType;
                     
-                            cryptos[index]->setName(name);
-                            cryptos[index]->setSymbol(symbol);
-                            cryptos[index]->setPrice(price);
-                            cryptos[index]->setMarketCap(marketCap);
-                            cryptos[index]->setCurrencyType(currencyType);
-                            generalLog.addEntry("Crypto Updated",cryptos[index]->getName());
+                            try {
+                                registry.rename(crypto->getAssetId(), name);
+                                registry.changeSymbol(crypto->getAssetId(), symbol);
+                                crypto->setPrice(price);
+                                crypto->setMarketCap(marketCap);
+                                crypto->setCurrencyType(currencyType);
+                            } catch (const exception& e) {
+                                cout << "Update Error: " << e.what() << endl;
+                                break;
+                            }
+                            generalLog.addEntry("Crypto Updated",crypto->getName());
                             cout << "Cryptocurrency updated successfully!\n";
                         } else {
                             cout << "Invalid index!\n";
@@ -1498,7 +7744,16 @@ class Meniu {
                     
                         if (index >= 0 && index < numCryptos) {
                            // generalLog.addEntry("Crypto Deleted",cryptos[index]->getName());
-                            delete cryptos[index]; 
+                            for (int i = 0; i < numAssets; i++) {
+                                if (assets[i] == cryptos[index]) {
+                                    for (int j = i; j < numAssets - 1; j++) {
+                                        assets[j] = assets[j + 1];
+                                    }
+                                    numAssets--;
+                                    break;
+                                }
+                            }
+                            registry.remove(cryptos[index]->getAssetId());
                             for (int i = index; i < numCryptos - 1; i++) {
                                 cryptos[i] = cryptos[i + 1];
                             }
@@ -1523,7 +7778,12 @@ class Meniu {
                             cout << "Is the wallet active? (y/n): ";
                             cin >> activeStatus;
                     
-                            wallets[index]->setOwner(owner);
+                            try {
+                                directory.rename(wallets[index]->getWalletId(), owner);
+                            } catch (const exception& e) {
+                                cout << "Update Error: " << e.what() << endl;
+                                break;
+                            }
                             wallets[index]->setIsActive(activeStatus == 'y' || activeStatus == 'Y');
                             cout << "Wallet updated successfully!\n";
                         } else {
@@ -1537,7 +7797,7 @@ class Meniu {
                         cin >> index;
                     
                         if (index >= 0 && index < numWallets) {
-                            delete wallets[index]; 
+                            directory.remove(wallets[index]->getWalletId());
                             for (int i = index; i < numWallets - 1; i++) {
                                 wallets[i] = wallets[i + 1];
                             }
@@ -1555,60 +7815,72 @@ class Meniu {
                         
                         if (index >= 0 && index < numWallets) {
                             cout << "\n=== Wallet Details ===\n";
-                            cout << wallets[index];
+                            cout << *wallets[index];
                         } else {
                             cout << "Invalid index!\n";
                         }
                         break;
                     }
                    case 14: { // View Transaction Details
-                        int index;
-                        cout << "Enter transaction index to view (0-" << blockchain.getNumTransactions() - 1 << "): ";
-                        cin >> index;
-                        
-                        if (index >= 0 && index < blockchain.getNumTransactions()) {
-                            cout << "\n=== Transaction Details ===\n";
-                            cout << *blockchain[index] << endl;
+                        string key;
+                        cout << "Enter transaction index, wallet owner or asset name/symbol (0-" << blockchain.getNumTransactions() - 1 << "): ";
+                        cin >> key;
+                        char* end = nullptr;
+                        long index = strtol(key.c_str(), &end, 10);
+                        if (!key.empty() && *end == '\0') {
+                            if (index >= 0 && index < blockchain.getNumTransactions()) {
+                                cout << "\n=== Transaction Details ===\n";
+                                cout << blockchain[index] << endl;
+                            } else {
+                                cout << "Invalid index!\n";
+                            }
+                            break;
+                        }
+                        // Owners are looked up before assets; both come straight from the chain's secondary indexes.
+                        std::vector<int> ids;
+                        WalletId owner = directory.find(key);
+                        AssetId asset = registry.resolve(key);
+                        if (directory.get(owner)) {
+                            ids = blockchain.findByWallet(owner);
+                            cout << "\n=== Transfers of " << key << " ===\n";
+                        } else if (registry.get(asset)) {
+                            ids = blockchain.findByAsset(asset);
+                            cout << "\n=== " << registry.get(asset)->getName() << " Transfers ===\n";
                         } else {
-                            cout << "Invalid index!\n";
+                            cout << "No wallet or asset named " << key << "!\n";
+                            break;
                         }
+                        for (int id : ids) cout << id << ". " << blockchain[id] << "\n";
+                        cout << ids.size() << " live transfer(s)\n";
                         break;
                     }
-                   case 15: { // Delete Transaction
+                   case 15: { // Void Transaction
                         int index;
-                        cout << "Enter transaction index to delete (0-" << blockchain.getNumTransactions() - 1 << "): ";
+                        cout << "Enter transaction index to void (0-" << blockchain.getNumTransactions() - 1 << "): ";
                         cin >> index;
                         
-                        if (index >= 0 && index < blockchain.getNumTransactions()) {
-                            Transaction** transactions = blockchain.getTransactions();
-                            delete transactions[index];
-                            
-                            for (int i = index; i < blockchain.getNumTransactions() - 1; i++) {
-                                transactions[i] = transactions[i + 1];
-                            }
-                            
-                            blockchain.setNumTransactions(blockchain.getNumTransactions() - 1);
-                            cout << "Transaction deleted successfully!\n";
-                        } else {
+                        try {
+                            blockchain.voidTransaction(index);
+                            cout << "Transaction voided successfully!\n";
+                        } catch (const out_of_range& e) {
                             cout << "Invalid index!\n";
+                        } catch (const invalid_argument& e) {
+                            cout << "Cannot void transaction: " << e.what() << endl;
                         }
                         break;
                     }
                    case 16: { // Compare Two Cryptos
-                        int index1, index2;
                         cout << "\nAvailable cryptocurrencies:\n";
                         for (int i = 0; i < numCryptos; i++) {
                             cout << i << ". " << cryptos[i]->getName() << " (" << cryptos[i]->getSymbol() << ")\n";
                         }
                         
-                        cout << "Enter first cryptocurrency index (0-" << numCryptos - 1 << "): ";
-                        cin >> index1;
-                        cout << "Enter second cryptocurrency index (0-" << numCryptos - 1 << "): ";
-                        cin >> index2;
+                        CryptoCurrency* first = readCrypto("Enter first cryptocurrency index, name or symbol (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
+                        CryptoCurrency* second = readCrypto("Enter second cryptocurrency index, name or symbol (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
                         
-                        if (index1 >= 0 && index1 < numCryptos && index2 >= 0 && index2 < numCryptos) {
-                    bool isEqual = *cryptos[index1] == *cryptos[index2];
-                    bool isLess = *cryptos[index1] < *cryptos[index2];
+                        if (first && second) {
+                    bool isEqual = *first == *second;
+                    bool isLess = *first < *second;
                             
                             cout << "\nComparison Results:\n";
                             if (isEqual) {
@@ -1616,11 +7888,11 @@ class Meniu {
                             } else {
                                 cout << "The cryptocurrencies are not equal.\n";
                                 if (isLess) {
-                                    cout << cryptos[index1]->getName() << " has a smaller market cap than " 
-                                         << cryptos[index2]->getName() << endl;
+                                    cout << first->getName() << " has a smaller market cap than " 
+                                         << second->getName() << endl;
                                 } else {
-                                    cout << cryptos[index1]->getName() << " has a larger market cap than " 
-                                         << cryptos[index2]->getName() << endl;
+                                    cout << first->getName() << " has a larger market cap than " 
+                                         << second->getName() << endl;
                                 }
                             }
                         } else {
@@ -1634,18 +7906,16 @@ class Meniu {
                             cout << i << ". " << cryptos[i]->getName() << " (" << cryptos[i]->getSymbol() << ")\n";
                         }
                         
-                        int index;
-                        cout << "Enter cryptocurrency index to increment price (0-" << numCryptos - 1 << "): ";
-                        cin >> index;
+                        CryptoCurrency* crypto = readCrypto("Enter cryptocurrency index, name or symbol to increment price (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
                         
-                        if (index >= 0 && index < numCryptos) {
-                            cout << "Current price: " << cryptos[index]->getPrice() << endl;
-                            ++(*cryptos[index]); 
-                            cout << "New price after pre-increment: " << cryptos[index]->getPrice() << endl;
+                        if (crypto) {
+                            cout << "Current price: " << crypto->getPrice() << endl;
+                            ++(*crypto); 
+                            cout << "New price after pre-increment: " << crypto->getPrice() << endl;
                             
-                            (*cryptos[index])++; 
-                            cout << "New price after post-increment: " << cryptos[index]->getPrice() << endl;
-                            generalLog.addEntry("Crypto price updated", cryptos[index]->getName());
+                            (*crypto)++; 
+                            cout << "New price after post-increment: " << crypto->getPrice() << endl;
+                            generalLog.addEntry("Crypto price updated", crypto->getName());
                         } else {
                             cout << "Invalid index!\n";
                         }
@@ -1657,14 +7927,11 @@ class Meniu {
                             cout << i << ". " << cryptos[i]->getName() << " (" << cryptos[i]->getSymbol() << ")\n";
                         }
                     
-                        int index1, index2;
-                        cout << "Enter first cryptocurrency index (0-" << numCryptos - 1 << "): ";
-                        cin >> index1;
-                        cout << "Enter second cryptocurrency index (0-" << numCryptos - 1 << "): ";
-                        cin >> index2;
+                        CryptoCurrency* first = readCrypto("Enter first cryptocurrency index, name or symbol (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
+                        CryptoCurrency* second = readCrypto("Enter second cryptocurrency index, name or symbol (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
                     
-                        if (index1 >= 0 && index1 < numCryptos && index2 >= 0 && index2 < numCryptos) {
-                            CryptoCurrency result = *cryptos[index1] - *cryptos[index2];
+                        if (first && second) {
+                            CryptoCurrency result = *first - *second;
                             cout << "\nSubtraction Result:\n";
                             cout << result << endl;
                             cout << "Price of result: " << result.getPrice() << endl;
@@ -1675,17 +7942,23 @@ class Meniu {
                         break;
                     }
                    case 19: {
-                        int walletIndex, cryptoIndex;
+                        int walletIndex;
                         cout << "Enter wallet index: ";
                         cin >> walletIndex;
                         try {
                             if (walletIndex < 0 || walletIndex >= numWallets) throw std::out_of_range("Invalid wallet index.");
                             Wallet* wallet = wallets[walletIndex];
-                            cout << "Enter crypto index: ";
-                            cin >> cryptoIndex;
+                            cout << "Enter crypto index, name or symbol: ";
+                            string key;
+                            cin >> key;
                             try {
-                                CryptoCurrency& crypto = (*wallet)[cryptoIndex];
-                                cout << "Crypto: " << crypto << endl;
+                                char* end = nullptr;
+                                long cryptoIndex = strtol(key.c_str(), &end, 10);
+                                if (key.empty() || *end != '\0') {
+                                    cryptoIndex = wallet->indexOf(registry.resolve(key));
+                                }
+                                const Holding& holding = (*wallet)[static_cast<int>(cryptoIndex)];
+                                cout << "Holding: " << holding << endl;
                             } catch (const std::out_of_range& e) {
                                 cout << "Crypto error: " << e.what() << endl;
                             }
@@ -1695,16 +7968,26 @@ class Meniu {
                         break;
                     }
                    case 20: { // Add Crypto to Wallet
-                        int walletIndex, cryptoIndex;
+                        int walletIndex;
                         cout << "Enter wallet index (0-" << numWallets - 1 << "): ";
                         cin >> walletIndex;
-                        cout << "Enter cryptocurrency index (0-" << numCryptos - 1 << "): ";
-                        cin >> cryptoIndex;
+                        CryptoCurrency* crypto = readCrypto("Enter cryptocurrency index, name or symbol (0-" + to_string(numCryptos - 1) + "): ", cryptos, numCryptos);
                         
-                        if (walletIndex >= 0 && walletIndex < numWallets && cryptoIndex >= 0 && cryptoIndex < numCryptos) {
-                            wallets[walletIndex]->addCrypto(*cryptos[cryptoIndex]);
-                            cout << "Cryptocurrency added to wallet successfully!\n";
-                            
+                        if (walletIndex >= 0 && walletIndex < numWallets && crypto) {
+                            Amount quantity;
+                            cout << "Enter quantity: ";
+                            if (!(cin >> quantity)) {
+                                cin.clear();
+                                cin.ignore(numeric_limits<streamsize>::max(), '\n');
+                                cout << "Quantity must be a number\n";
+                                break;
+                            }
+                            try {
+                                Amount held = wallets[walletIndex]->credit(crypto->getAssetId(), quantity);
+                                cout << "Cryptocurrency added to wallet successfully! Balance: " << held << "\n";
+                            } catch (const invalid_argument& e) {
+                                cout << "Input Error: " << e.what() << endl;
+                            }
                         } else {
                             cout << "Invalid indices!\n";
                         }
@@ -1713,6 +7996,9 @@ class Meniu {
                    case 21: { // Show Polymorphism Demo
                         if (numAssets > 0) {
                             demonstratePolymorphism(assets, numAssets);
+                            AssetStore store;
+                            store.build(registry);
+                            demonstrateValueDispatch(store);
                         } else {
                             cout << "No assets available for demonstration. Please add some cryptocurrencies first.\n";
                         }
@@ -1720,7 +8006,7 @@ class Meniu {
                     }
                    case 22: { // Demonstrate Diamond Inheritance
                         char name[100], symbol[100];
-                        float price;
+                        Amount price;
                         long long marketCap;
                         char currencyType;
                         
@@ -1781,8 +8067,150 @@ class Meniu {
                         break;
                     }
                    case 24: { 
+                    if (!saveSnapshot(SNAPSHOT_FILE, registry, wallets, numWallets, blockchain, generalLog, statsLog)) {
+                        cout << "Warning: failed to save snapshot to " << SNAPSHOT_FILE << endl;
+                    }
                     cout << "Thank you for using Coinqueror! Goodbye!\n";
                     break;
+                }
+                   case 25: {
+                    if (saveSnapshot(SNAPSHOT_FILE, registry, wallets, numWallets, blockchain, generalLog, statsLog)) {
+                        cout << "Snapshot saved to " << SNAPSHOT_FILE << endl;
+                    } else {
+                        cout << "Failed to save snapshot to " << SNAPSHOT_FILE << endl;
+                    }
+                    break;
+                }
+                   case 26: {
+                    int pending = blockchain.getPendingTransactions();
+                    if (blockchain.sealBlock()) cout << "Sealed " << pending << " pending transaction(s) into block " << blockchain.getNumBlocks() - 1 << ".\n";
+                    verifyChainLog(chainLog);
+                    break;
+                }
+                   case 27: {
+                    string filename;
+                    cout << "Enter tick file name (lines of '<name or symbol> <price>'): ";
+                    cin >> filename;
+                    ifstream file(filename);
+                    if (!file) {
+                        cout << "Cannot open " << filename << endl;
+                        break;
+                    }
+                    std::vector<AssetId> ids;
+                    std::vector<Amount> prices;
+                    string key;
+                    Amount price;
+                    bool known = true;
+                    while (known && file >> key >> price) {
+                        AssetId id = registry.resolve(key);
+                        if (id < 0) {
+                            cout << "Unknown asset in tick file: " << key << endl;
+                            known = false;
+                        }
+                        ids.push_back(id);
+                        prices.push_back(price);
+                    }
+                    if (!known) break;
+                    try {
+                        auto start = std::chrono::steady_clock::now();
+                        registry.reprice(ids.data(), prices.data(), static_cast<int>(ids.size()));
+                        PositionBook book;
+                        book.build(wallets, numWallets);
+                        std::vector<double> values(numWallets);
+                        book.markToMarket(registry.getMarketTable(), values.data());
+                        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                        cout << "Applied " << ids.size() << " price tick(s) and revalued " << numWallets << " wallet(s) in " << elapsed.count() / 1000.0 << " ms.\n";
+                        for (int i = 0; i < numWallets; i++) {
+                            cout << i << ". " << wallets[i]->getOwner() << ": " << values[i] << endl;
+                        }
+                        generalLog.addEntry("Price ticks applied", filename);
+                    } catch (const exception& e) {
+                        cout << "Error: " << e.what() << endl;
+                    }
+                    break;
+                }
+                   case 28: {
+                    try {
+                        QueryPlan volume = planLedgerScan(blockchain, LedgerScan::TRANSFERS, {QueryPredicate("time", CompareOp::GreaterEqual, 0)});
+                        volume = QueryPlan(new QueryProject(std::move(volume), {ProjectColumn("asset", "asset"), ProjectColumn("hour", "time", 3600), ProjectColumn("amount", "amount")}));
+                        volume = QueryPlan(new QueryGroupBy(std::move(volume), {"asset", "hour"}, {{AggregateKind::Sum, "amount", "volume"}, {AggregateKind::Count, "", "transfers"}}));
+                        volume = QueryPlan(new QueryTopK(std::move(volume), "volume", 10));
+                        cout << "\n=== Volume per Asset per Hour (sealed blocks, top 10) ===\n";
+                        forEachRow(*volume, [&](const RowBatch& batch, int row) {
+                            const CryptoCurrency* asset = registry.get(static_cast<AssetId>(batch.ints[0][row]));
+                            time_t hour = static_cast<time_t>(batch.ints[1][row]);
+                            cout << (asset ? asset->getName() : "<deleted asset>") << " " << put_time(gmtime(&hour), "%Y-%m-%d %H:00 UTC") << ": "
+                                 << batch.amounts[2][row] << " in " << batch.ints[3][row] << " transfer(s)\n";
+                        });
+
+                        QueryPlan flows(new LedgerScan(blockchain, LedgerScan::LEGS));
+                        flows = QueryPlan(new QueryGroupBy(std::move(flows), {"wallet", "asset"}, {{AggregateKind::Sum, "amount", "net"}}));
+                        flows = QueryPlan(new QueryTopK(std::move(flows), "net", 5));
+                        cout << "\n=== Largest Net Inflows per Wallet and Asset ===\n";
+                        forEachRow(*flows, [&](const RowBatch& batch, int row) {
+                            int slot = static_cast<int>(batch.ints[0][row]);
+                            const Wallet* wallet = directory.get(WalletId{slot, directory.getGeneration(slot)});
+                            const CryptoCurrency* asset = registry.get(static_cast<AssetId>(batch.ints[1][row]));
+                            cout << (wallet ? wallet->getOwner() : "<deleted wallet>") << ", " << (asset ? asset->getName() : "<deleted asset>") << ": "
+                                 << batch.amounts[2][row] << "\n";
+                        });
+
+                        QueryPlan largest(new QueryTopK(QueryPlan(new AssetScan(registry)), "marketCap", 3));
+                        cout << "\n=== Largest Assets by Market Cap ===\n";
+                        forEachRow(*largest, [&](const RowBatch& batch, int row) {
+                            cout << registry.get(static_cast<AssetId>(batch.ints[0][row]))->getName() << ": " << batch.ints[3][row] << " at " << batch.amounts[2][row] << "\n";
+                        });
+                    } catch (const exception& e) {
+                        cout << "Query Error: " << e.what() << endl;
+                    }
+                    break;
+                }
+                   case 29: {
+                    if (!writeArchive(ARCHIVE_FILE, blockchain, directory, registry)) {
+                        cout << "Failed to write archive " << ARCHIVE_FILE << endl;
+                        break;
+                    }
+                    ArchiveReader archive(ARCHIVE_FILE);
+                    if (!archive.validate()) {
+                        cout << "Archive " << ARCHIVE_FILE << " does not read back: " << archive.getError() << endl;
+                        break;
+                    }
+                    cout << "Archived " << archive.getNumRows() << " transactions in " << archive.getNumBlocks() << " blocks and " << archive.getNumGroups()
+                         << " row group(s) to " << ARCHIVE_FILE << ": " << archive.getBytes() << " bytes for " << archive.getWallets().size() << " wallets and "
+                         << archive.getAssets().size() << " assets.\n";
+                    break;
+                }
+                   case 30: {
+                    // The archive is history already settled into the wallets, so it loads beside the live chain, not into it.
+                    Blockchain archived;
+                    auto start = std::chrono::steady_clock::now();
+                    if (!loadArchive(ARCHIVE_FILE, archived, directory, registry)) {
+                        cout << "Could not load archive " << ARCHIVE_FILE << endl;
+                        break;
+                    }
+                    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                    cout << "Loaded " << archived.getNumTransactions() << " transactions in " << archived.getNumBlocks() << " blocks from " << ARCHIVE_FILE
+                         << " in " << elapsed.count() / 1000.0 << " ms.\n";
+                    if (archived.getNumBlocks() == 0) break;
+                    try {
+                        const int SHOWN = 20;
+                        int64_t last = archived.getBlock(archived.getNumBlocks() - 1).timestamp;
+                        ArchiveReader reader(ARCHIVE_FILE);
+                        if (!reader.validate()) throw runtime_error(reader.getError());
+                        QueryPlan recent = planArchiveScan(reader, {QueryPredicate("time", CompareOp::GreaterEqual, last - 3600)});
+                        int found = 0;
+                        cout << "\n=== Archived Transfers in the Last Archived Hour ===\n";
+                        forEachRow(*recent, [&](const RowBatch& batch, int row) {
+                            if (found++ >= SHOWN) return;
+                            int id = static_cast<int>(batch.ints[0][row]);
+                            time_t time = static_cast<time_t>(batch.ints[5][row]);
+                            cout << "#" << id << " " << archived[id] << " at " << put_time(gmtime(&time), "%Y-%m-%d %H:%M UTC") << "\n";
+                        });
+                        if (found > SHOWN) cout << "... and " << found - SHOWN << " more\n";
+                    } catch (const exception& e) {
+                        cout << "Query Error: " << e.what() << endl;
+                    }
+                    break;
                 }
                    default: {
     cout << "Invalid choice! Please try again.\n";
@@ -1790,11 +8218,10 @@ class Meniu {
 }    
                 }
             }while(choice!=24);
-            for (int i = 0; i < numCryptos; i++) delete cryptos[i];
-            for (int i = 0; i < numUtilityCoins; i++) delete utilityCoins[i];
-            for (int i = 0; i < numStableCoins; i++) delete stableCoins[i];
-            for (int i = 0; i < numWallets; i++) delete wallets[i];
-            for (int i = 0; i < numAssets; i++) delete assets[i];
+            generalLog.flush();
+            statsLog.flush();
+            directory.clear();
+            registry.clear();
             delete[] cryptos;
             delete[] utilityCoins;
             delete[] stableCoins;
@@ -1805,6 +8232,1634 @@ class Meniu {
 
 Meniu* Meniu::instance = nullptr;
 
-int main() {
+// Counting allocations replaces the global operator new, so only bench builds (-DCOINQUEROR_BENCH) pay for it.
+#ifdef COINQUEROR_BENCH
+std::atomic<unsigned long long> allocationCount(0);
+
+#ifdef __GNUC__
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* memory) noexcept { std::free(memory); }
+
+BENCH_NOINLINE void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+#endif
+
+bool benchFailed = false;
+
+void benchCheck(bool condition, const char* what) {
+    if (condition) return;
+    cerr << "Benchmark check failed: " << what << endl;
+    benchFailed = true;
+}
+
+// Milliseconds body takes to run once.
+template<typename Body>
+double benchElapsed(Body body) {
+    auto start = chrono::steady_clock::now();
+    body();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// One result row: label, count items in ms as a rate per second, and ms.
+void benchReport(const string& label, double count, const char* unit, double ms) {
+    cout << "  " << left << setw(34) << label << right << fixed << setprecision(0) << setw(14) << count / (ms / 1000) << " " << left << setw(9) << unit
+         << right << setw(10) << setprecision(2) << ms << " ms\n";
+    cout.unsetf(ios::floatfield);
+}
+
+// Runs body once and reports it as count items of unit; returns the milliseconds for comparing rows.
+template<typename Body>
+double benchTime(const string& label, double count, const char* unit, Body body) {
+    double ms = benchElapsed(body);
+    benchReport(label, count, unit, ms);
+    return ms;
+}
+
+template<typename Body>
+void benchAllocations(const char* label, Body body) {
+#ifdef COINQUEROR_BENCH
+    unsigned long long before = allocationCount.load(std::memory_order_relaxed);
+#endif
+    double ms = benchElapsed(body);
+#ifdef COINQUEROR_BENCH
+    string allocations = to_string(allocationCount.load(std::memory_order_relaxed) - before);
+#else
+    string allocations = "n/a";
+#endif
+    cout << "  " << left << setw(40) << label << right << setw(10) << allocations << " allocs "
+         << setw(10) << fixed << setprecision(2) << ms << " ms\n";
+    cout.unsetf(ios::floatfield);
+}
+
+AssetId benchAsset() {
+    AssetRegistry* registry = AssetRegistry::getInstance();
+    AssetId id = registry->findByName("BenchCoin");
+    return id >= 0 ? id : registry->add(new CryptoCurrency("BenchCoin", "BNC", 1, 1000));
+}
+
+// Advances a bench's LCG state and returns it, so every run generates the same data.
+uint64_t benchRandom(uint64_t& state) {
+    return state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+}
+
+// Adds n wallets named prefix0, prefix1, ... with room for capacity assets, each holding balance of benchAsset().
+std::vector<WalletId> benchWallets(const string& prefix, int n, const Amount& balance, int capacity = 4) {
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<WalletId> ids(n);
+    for (int i = 0; i < n; i++) {
+        ids[i] = directory.add(new Wallet((prefix + to_string(i)).c_str(), capacity));
+        directory.get(ids[i])->credit(coin, balance);
+    }
+    return ids;
+}
+
+// Puts every wallet back at balance of benchAsset(), so each round of a bench starts from the same books.
+void benchResetBalances(const std::vector<WalletId>& ids, const Amount& balance) {
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetId coin = benchAsset();
+    for (WalletId id : ids) {
+        Wallet* wallet = directory.get(id);
+        wallet->debit(coin, wallet->balance(coin));
+        wallet->credit(coin, balance);
+    }
+}
+
+void benchRemoveWallets(const std::vector<WalletId>& ids) {
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    for (WalletId id : ids) directory.remove(id);
+}
+
+struct CopyOnlyWallet {
+    Wallet wallet;
+
+    explicit CopyOnlyWallet(const Wallet& wallet) : wallet(wallet) {}
+    CopyOnlyWallet(const CopyOnlyWallet& other) = default;
+    CopyOnlyWallet& operator=(const CopyOnlyWallet& other) = default;
+};
+
+void benchMoveSemantics() {
+    const int NUM_WALLETS = 20000;
+    const int HOLDINGS_PER_WALLET = 8;
+    const int NUM_TRANSACTIONS = 20000;
+
+    cout << "\n[move semantics] " << NUM_WALLETS << " wallets x " << HOLDINGS_PER_WALLET << " holdings, "
+         << NUM_TRANSACTIONS << " transactions per chain\n";
+
+    Wallet prototype("BenchOwner", 10);
+    for (int i = 0; i < HOLDINGS_PER_WALLET; i++) prototype.credit(i, i + 1);
+
+    benchAllocations("vector<Wallet> growth, copy only", [&]() {
+        std::vector<CopyOnlyWallet> wallets;
+        for (int i = 0; i < NUM_WALLETS; i++) wallets.push_back(CopyOnlyWallet(prototype));
+        benchCheck(wallets.back().wallet.balance(HOLDINGS_PER_WALLET - 1) == HOLDINGS_PER_WALLET, "copied wallet keeps holdings");
+    });
+    benchAllocations("vector<Wallet> growth, noexcept move", [&]() {
+        std::vector<Wallet> wallets;
+        for (int i = 0; i < NUM_WALLETS; i++) wallets.push_back(prototype);
+        benchCheck(wallets.front().balance(HOLDINGS_PER_WALLET - 1) == HOLDINGS_PER_WALLET, "moved wallet keeps holdings");
+    });
+
+    std::vector<CopyOnlyWallet> copyOnly;
+    std::vector<Wallet> movable;
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        Wallet wallet("BenchOwner", 10);
+        for (int j = 0; j < HOLDINGS_PER_WALLET; j++) wallet.credit(j, (i * 7919 + j) % NUM_WALLETS);
+        copyOnly.push_back(CopyOnlyWallet(wallet));
+        movable.push_back(wallet);
+    }
+    benchAllocations("sort wallets by value, copy only", [&]() {
+        std::sort(copyOnly.begin(), copyOnly.end(), [](const CopyOnlyWallet& a, const CopyOnlyWallet& b) { return a.wallet.balance(0) < b.wallet.balance(0); });
+    });
+    benchAllocations("sort wallets by value, noexcept move", [&]() {
+        std::sort(movable.begin(), movable.end(), [](const Wallet& a, const Wallet& b) { return a.balance(0) < b.balance(0); });
+    });
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        benchCheck(copyOnly[i].wallet.balance(0) == movable[i].balance(0), "copy and move sorts agree");
+    }
+
+    AssetId coin = benchAsset();
+    Blockchain first, second;
+    for (int i = 0; i < NUM_TRANSACTIONS; i++) {
+        first.addTransaction(Transaction(INVALID_WALLET, INVALID_WALLET, coin, i));
+        second.addTransaction(Transaction(INVALID_WALLET, INVALID_WALLET, coin, -i));
+    }
+    benchAllocations("Blockchain = a + b, copy assign", [&]() {
+        Blockchain merged;
+        Blockchain sum = first + second;
+        merged = sum;
+        benchCheck(merged.getNumTransactions() == 2 * NUM_TRANSACTIONS, "copy-assigned chain is complete");
+    });
+    benchAllocations("Blockchain = a + b, move assign", [&]() {
+        Blockchain merged;
+        merged = first + second;
+        benchCheck(merged.getNumTransactions() == 2 * NUM_TRANSACTIONS, "move-assigned chain is complete");
+    });
+
+    UtilityCoin utility("BenchUtility", "BUT", Amount::fromScaled(25, 1), 1000, "Bench");
+    UtilityCoin moved(std::move(utility));
+    benchCheck(moved.getPrice() == Amount::fromScaled(25, 1) && moved.getNameString() == InternedString("BenchUtility"), "utility coin keeps its virtual base when moved");
+}
+
+void benchTransactionArena() {
+    const int NUM_TRANSACTIONS = 200000;
+
+    cout << "\n[transaction storage] " << NUM_TRANSACTIONS << " transactions\n";
+
+    AssetId coin = benchAsset();
+    Amount pointerSum, arenaSum;
+    benchAllocations("one new Transaction per record", [&]() {
+        std::vector<Transaction*> transactions;
+        for (int i = 0; i < NUM_TRANSACTIONS; i++) {
+            transactions.push_back(new Transaction(INVALID_WALLET, INVALID_WALLET, coin, i % 1000));
+        }
+        for (const Transaction* transaction : transactions) pointerSum += transaction->getAmount();
+        for (Transaction* transaction : transactions) delete transaction;
+    });
+    // The arena on its own, filled the way addTransaction fills it; sealing and indexing are timed by the other benches.
+    benchAllocations("chunked TransactionArena", [&]() {
+        TransactionArena arena;
+        for (int i = 0; i < NUM_TRANSACTIONS; i++) {
+            arena.reserve(i + 1);
+            new (&arena[i]) Transaction(INVALID_WALLET, INVALID_WALLET, coin, i % 1000);
+        }
+        for (int i = 0; i < NUM_TRANSACTIONS; i++) arenaSum += arena[i].getAmount();
+    });
+    benchCheck(pointerSum == arenaSum, "arena scan matches pointer scan");
+
+    Blockchain blockchain;
+    for (int i = 0; i < 3000; i++) {
+        blockchain.addTransaction(Transaction(INVALID_WALLET, INVALID_WALLET, coin, i));
+    }
+    blockchain.voidTransaction(1023);
+    benchCheck(blockchain.getNumTransactions() == 3001 && blockchain.isVoided(1023) && blockchain[3000].isVoid() && blockchain[1024].getAmount() == 1024,
+        "voiding appends a record instead of shifting");
+    Blockchain copy = blockchain;
+    benchCheck(copy.getNumTransactions() == 3001 && copy[2047].getAmount() == 2047 && copy.isVoided(1023), "copied chain matches");
+    benchCheck(copy.getNumBlocks() == 11 && copy.getBlockHash(10) == blockchain.getBlockHash(10), "copied chain keeps its blocks");
+}
+
+void benchHashing() {
+    const int NUM_LEAVES = 1 << 20;
+    const HashPath PATHS[] = {HashPath::Scalar, HashPath::Sse4, HashPath::Avx2, HashPath::ShaNi};
+    HashPath best = HashEngine::getPath();
+
+    cout << "\n[hashing] " << NUM_LEAVES << " leaves of " << sizeof(TransactionRecord) << " bytes, dispatched path: " << HashEngine::pathName(best) << "\n";
+
+    std::vector<TransactionRecord> records(NUM_LEAVES);
+    for (int i = 0; i < NUM_LEAVES; i++) {
+        records[i] = Transaction(WalletId{i % 1000, 0}, WalletId{(i + 7) % 1000, 1}, benchAsset(), i).toRecord();
+    }
+    string message(1000, 'x');
+    for (size_t i = 0; i < message.size(); i++) message[i] = static_cast<char>(i * 31);
+
+    HashEngine::setPath(HashPath::Scalar);
+    Hash256 messageHash = Sha256::digest(message.data(), message.size());
+    std::vector<Hash256> reference(NUM_LEAVES);
+    HashEngine::digestMany(records.data(), sizeof(TransactionRecord), NUM_LEAVES, reference.data());
+    std::vector<Hash256> referenceNodes(NUM_LEAVES / 2);
+    HashEngine::digestMany(reference.data(), 2 * sizeof(Hash256), NUM_LEAVES / 2, referenceNodes.data());
+    std::vector<Hash256> odd(7);
+    HashEngine::digestMany(message.data(), 100, 7, odd.data());
+
+    TaskPool& pool = *TaskPool::getInstance();
+    int maxThreads = pool.getThreads();
+    pool.setThreads(1);
+    std::vector<Hash256> hashes(NUM_LEAVES);
+    for (HashPath path : PATHS) {
+        if (!HashEngine::isSupported(path)) {
+            cout << "  " << left << setw(8) << HashEngine::pathName(path) << "not supported on this CPU\n";
+            continue;
+        }
+        HashEngine::setPath(path);
+        Hash256 abc = Sha256::digest("abc", 3);
+        benchCheck(abc.toHex() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "SHA-256 test vector");
+        benchCheck(Sha256::digest(message.data(), message.size()) == messageHash, "multi-block message matches the scalar path");
+        std::vector<Hash256> oddCheck(7);
+        HashEngine::digestMany(message.data(), 100, 7, oddCheck.data());
+        benchCheck(std::equal(odd.begin(), odd.end(), oddCheck.begin()), "partial batch of 100-byte messages matches the scalar path");
+
+        double leafMs = benchElapsed([&]() { HashEngine::digestMany(records.data(), sizeof(TransactionRecord), NUM_LEAVES, hashes.data()); });
+        benchCheck(std::equal(reference.begin(), reference.end(), hashes.begin()), "leaf hashes match the scalar path");
+
+        double nodeMs = benchElapsed([&]() { HashEngine::digestMany(reference.data(), 2 * sizeof(Hash256), NUM_LEAVES / 2, hashes.data()); });
+        benchCheck(std::equal(referenceNodes.begin(), referenceNodes.end(), hashes.begin()), "node hashes match the scalar path");
+
+        cout << "  " << left << setw(8) << HashEngine::pathName(path) << right << fixed << setprecision(0)
+             << setw(12) << NUM_LEAVES / (leafMs / 1000) << " leaves/s " << setw(12) << NUM_LEAVES / 2 / (nodeMs / 1000) << " nodes/s\n";
+    }
+    HashEngine::setPath(best);
+
+    std::vector<Hash256> level;
+    Hash256 root = merkleRoot(records.data(), NUM_LEAVES - 3, level);
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        pool.setThreads(threads);
+        Hash256 parallelRoot;
+        benchTime("merkle root, " + to_string(threads) + " thread(s)", NUM_LEAVES - 3, "leaves/s", [&]() { parallelRoot = merkleRoot(records.data(), NUM_LEAVES - 3, level); });
+        benchCheck(parallelRoot == root, "parallel Merkle root matches");
+        if (threads == maxThreads) break;
+    }
+    cout.unsetf(ios::floatfield);
+    pool.setThreads(4);
+    benchCheck(merkleRoot(records.data(), NUM_LEAVES - 3, level) == root, "Merkle root split across 4 threads matches");
+    pool.setThreads(maxThreads);
+
+    std::vector<Hash256> scalarLevel;
+    HashEngine::setPath(HashPath::Scalar);
+    Hash256 scalarRoot = merkleRoot(records.data(), NUM_LEAVES - 3, scalarLevel);
+    HashEngine::setPath(best);
+    benchCheck(scalarRoot == root, "dispatched Merkle root matches the scalar path");
+}
+
+// A mixed population: every third asset is a utility coin, every third a stable coin.
+CryptoCurrency* benchMarketAsset(int i) {
+    Amount price = Amount::fromScaled((i * 7919LL) % 100003, 2);
+    long long marketCap = 1000000LL + (i * 104729LL) % 1000000007LL;
+    if (i % 3 == 1) return new UtilityCoin("BenchUtility", "BNU", price, marketCap, "Gas");
+    if (i % 3 == 2) return new StableCoin("BenchStable", "BNS", price, marketCap, "USD");
+    return new CryptoCurrency("BenchCoin", "BNC", price, marketCap);
+}
+
+void benchMarketTable() {
+    const int NUM_ASSETS = 1000000;
+    const int TOP = 10;
+
+    cout << "\n[market table] " << NUM_ASSETS << " assets\n";
+
+    DigitalAsset** assets = new DigitalAsset*[NUM_ASSETS];
+    MarketTable table;
+    table.reserve(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        CryptoCurrency* asset = benchMarketAsset(i);
+        assets[i] = asset;
+        table.set(i, *asset);
+    }
+
+    double virtualTotal = 0, tableTotal = 0;
+    benchTime("market value, virtual calls", NUM_ASSETS, "assets/s", [&]() {
+        for (int i = 0; i < NUM_ASSETS; i++) virtualTotal += assets[i]->calculateMarketValue().toDouble();
+    });
+    benchTime("market value, column scan", NUM_ASSETS, "assets/s", [&]() { tableTotal = table.totalMarketValue(); });
+    benchCheck(std::abs(virtualTotal - tableTotal) <= 1e-9 * virtualTotal, "column total matches the virtual-call total");
+
+    std::vector<std::pair<Amount, int>> ranked;
+    benchTime("top 10, virtual calls + partial sort", NUM_ASSETS, "assets/s", [&]() {
+        ranked.resize(NUM_ASSETS);
+        for (int i = 0; i < NUM_ASSETS; i++) ranked[i] = {assets[i]->calculateMarketValue(), i};
+        std::partial_sort(ranked.begin(), ranked.begin() + TOP, ranked.end(), [](const std::pair<Amount, int>& a, const std::pair<Amount, int>& b) {
+            return a.first > b.first || (a.first == b.first && a.second < b.second);
+        });
+    });
+    int top[TOP];
+    int numTop = 0;
+    benchTime("top 10, column scan", NUM_ASSETS, "assets/s", [&]() { numTop = table.topByValue(TOP, top); });
+    bool sameTop = numTop == TOP;
+    for (int i = 0; sameTop && i < TOP; i++) sameTop = top[i] == ranked[i].second;
+    benchCheck(sameTop, "column top-N matches the sorted virtual-call ranking");
+
+    MarketSummary summary = {};
+    benchTime("per-type summary, column scan", NUM_ASSETS, "assets/s", [&]() { summary = table.summarize(); });
+    benchCheck(summary.count[MARKET_CRYPTO] + summary.count[MARKET_UTILITY] + summary.count[MARKET_STABLE] == NUM_ASSETS
+        && std::abs(summary.value[MARKET_CRYPTO] + summary.value[MARKET_UTILITY] + summary.value[MARKET_STABLE] - tableTotal) <= 1e-9 * tableTotal,
+        "per-type summary adds up to the totals");
+
+    for (int i = 0; i < NUM_ASSETS; i++) delete assets[i];
+    delete[] assets;
+
+    AssetRegistry* registry = AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    registry->get(coin)->setPrice(Amount::fromScaled(25, 1));
+    registry->get(coin)->setMarketCap(4242);
+    const MarketTable& market = registry->getMarketTable();
+    benchCheck(market.getPrice(coin) == 2.5 && market.getMarketCap(coin) == 4242 && market.getMarketValue(coin) == 250.0, "registry keeps the market table in sync");
+    CryptoCurrency copy = *registry->get(coin);
+    copy.setPrice(9);
+    benchCheck(market.getPrice(coin) == 2.5, "copies of a registered asset do not touch its row");
+    registry->get(coin)->setPrice(1);
+}
+
+void benchAssetStore() {
+    const int NUM_ASSETS = 1000000;
+    const int ROUNDS = 5;
+
+    cout << "\n[asset store] " << NUM_ASSETS << " assets, " << ROUNDS << " passes; " << sizeof(UtilityCoin) << "-byte UtilityCoin object vs "
+         << sizeof(AssetValue) << "-byte variant slot\n";
+
+    CryptoCurrency** assets = new CryptoCurrency*[NUM_ASSETS];
+    AssetStore store;
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        assets[i] = benchMarketAsset(i);
+        store.add(*assets[i]);
+    }
+
+    Amount virtualTotal, visitTotal;
+    size_t virtualBytes = 0, visitBytes = 0;
+    benchTime("market value, virtual calls", static_cast<double>(NUM_ASSETS) * ROUNDS, "assets/s", [&]() {
+        for (int round = 0; round < ROUNDS; round++) {
+            AmountSum total;
+            for (int i = 0; i < NUM_ASSETS; i++) total.add(assets[i]->calculateMarketValue());
+            virtualTotal = total.total();
+        }
+    });
+    benchTime("market value, std::visit", static_cast<double>(NUM_ASSETS) * ROUNDS, "assets/s", [&]() {
+        for (int round = 0; round < ROUNDS; round++) visitTotal = store.totalMarketValue();
+    });
+    benchCheck(virtualTotal == visitTotal, "visit total matches the virtual-call total exactly");
+
+    ostringstream virtualText, visitText;
+    benchTime("displayInfo, virtual calls", NUM_ASSETS, "assets/s", [&]() {
+        for (int i = 0; i < NUM_ASSETS; i++) assets[i]->displayInfo(virtualText);
+        virtualBytes = virtualText.str().size();
+    });
+    benchTime("displayInfo, std::visit", NUM_ASSETS, "assets/s", [&]() {
+        for (int i = 0; i < NUM_ASSETS; i++) AssetStore::displayInfo(store[i], visitText);
+        visitBytes = visitText.str().size();
+    });
+    benchCheck(virtualBytes == visitBytes && virtualText.str() == visitText.str(), "visit prints the same text as the classes");
+
+    int counts[3] = {};
+    store.forEach([&](const auto& asset) {
+        using T = std::decay_t<decltype(asset)>;
+        counts[std::is_same<T, UtilityValue>::value ? 1 : std::is_same<T, StableValue>::value ? 2 : 0]++;
+    });
+    benchCheck(counts[0] == (NUM_ASSETS + 2) / 3 && counts[1] == (NUM_ASSETS + 1) / 3 && counts[2] == NUM_ASSETS / 3, "store keeps each asset's type");
+
+    for (int i = 0; i < NUM_ASSETS; i++) delete assets[i];
+    delete[] assets;
+}
+
+void benchRepricing() {
+    const int NUM_ASSETS = 100000;
+    const int NUM_WALLETS = 200000;
+    const int HOLDINGS = 4;
+    const int ROUNDS = 10;
+
+    cout << "\n[repricing] " << NUM_ASSETS << " assets, " << NUM_WALLETS << " wallets x " << HOLDINGS << " holdings, "
+         << ROUNDS << " tick rounds, avx2 " << (MarketTable::isSimdAvailable() ? "available" : "not available") << "\n";
+
+    AssetRegistry* registry = AssetRegistry::getInstance();
+    std::vector<AssetId> ids(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Tick" + to_string(i);
+        ids[i] = registry->findByName(name);
+        if (ids[i] < 0) ids[i] = registry->add(new CryptoCurrency(name.c_str(), name.c_str(), 1, 1000));
+    }
+    Wallet** wallets = new Wallet*[NUM_WALLETS];
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        wallets[i] = new Wallet("BenchOwner", 10);
+        for (int k = 0; k < HOLDINGS; k++) wallets[i]->credit(ids[(i * 7919LL + k * 104729LL) % NUM_ASSETS], Amount::fromScaled(5, 1) + k + i % 13);
+    }
+    PositionBook book;
+    book.build(wallets, NUM_WALLETS);
+    std::vector<Amount> prices(NUM_ASSETS);
+    std::vector<double> values(NUM_WALLETS);
+
+    auto tick = [&](int round) {
+        for (int i = 0; i < NUM_ASSETS; i++) prices[i] = Amount::fromScaled((i * 31LL + round * 17LL) % 50000, 2);
+    };
+
+    benchTime("setPrice one at a time", NUM_ASSETS * ROUNDS, "ticks/s", [&]() {
+        for (int round = 0; round < ROUNDS; round++) {
+            tick(round);
+            for (int i = 0; i < NUM_ASSETS; i++) registry->get(ids[i])->setPrice(prices[i]);
+        }
+    });
+    benchTime("Wallet::valuation per wallet", NUM_WALLETS * ROUNDS, "wallets/s", [&]() {
+        for (int round = 0; round < ROUNDS; round++) {
+            for (int i = 0; i < NUM_WALLETS; i++) values[i] = wallets[i]->valuation(*registry).toDouble();
+        }
+    });
+    std::vector<double> expected = values;
+
+    for (bool simd : {false, true}) {
+        if (simd && !MarketTable::isSimdAvailable()) continue;
+        MarketTable::setSimd(simd);
+        string label = simd ? "avx2" : "scalar";
+        benchTime(label + " batch reprice", NUM_ASSETS * ROUNDS, "ticks/s", [&]() {
+            for (int round = 0; round < ROUNDS; round++) {
+                tick(round);
+                registry->reprice(ids.data(), prices.data(), NUM_ASSETS);
+            }
+        });
+        std::fill(values.begin(), values.end(), -1.0);
+        benchTime(label + " mark-to-market", NUM_WALLETS * ROUNDS, "wallets/s", [&]() {
+            for (int round = 0; round < ROUNDS; round++) book.markToMarket(registry->getMarketTable(), values.data());
+        });
+        bool matches = true;
+        for (int i = 0; i < NUM_WALLETS; i++) matches &= std::abs(values[i] - expected[i]) <= 1e-12 * expected[i];
+        benchCheck(matches, "mark-to-market matches Wallet::valuation");
+        benchCheck(registry->get(ids[12345])->getPrice() == prices[12345], "batch reprice updates the asset objects");
+
+        std::vector<AssetId> badIds(ids.begin(), ids.begin() + 100);
+        std::vector<Amount> badPrices(prices.begin(), prices.begin() + 100);
+        Amount before = registry->get(badIds[0])->getPrice();
+        badPrices[0] = before + 1;
+        badPrices[57] = -1;
+        bool rejected = false;
+        try { registry->reprice(badIds.data(), badPrices.data(), 100); } catch (const invalid_argument&) { rejected = true; }
+        benchCheck(rejected && registry->get(badIds[0])->getPrice() == before, "a negative tick rejects the whole batch");
+        badPrices[57] = 1;
+        badIds[9] = registry->getNumSlots();
+        rejected = false;
+        try { registry->reprice(badIds.data(), badPrices.data(), 100); } catch (const out_of_range&) { rejected = true; }
+        benchCheck(rejected && registry->get(badIds[0])->getPrice() == before, "an unknown asset id rejects the whole batch");
+    }
+    MarketTable::setSimd(true);
+
+    for (int i = 0; i < NUM_WALLETS; i++) delete wallets[i];
+    delete[] wallets;
+}
+
+void benchWalletValues() {
+    const int NUM_WALLETS = 1000000;
+    const int NUM_ASSETS = 10000;
+    const int HOLDINGS = 4;
+    const int ROUNDS = 100;
+    const int TICKS_PER_ROUND = 10;
+    const int TRADES_PER_ROUND = 100;
+
+    cout << "\n[wallet values] " << NUM_WALLETS << " registered wallets x " << HOLDINGS << " holdings of " << NUM_ASSETS << " assets, "
+         << ROUNDS << " rounds of " << TICKS_PER_ROUND << " price ticks and " << TRADES_PER_ROUND << " credits\n";
+
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    std::vector<AssetId> assets(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Valued" + to_string(i);
+        assets[i] = registry.findByName(name);
+        if (assets[i] < 0) assets[i] = registry.add(new CryptoCurrency(name.c_str(), name.c_str(), 1, 1000));
+    }
+    std::vector<WalletId> ids(NUM_WALLETS);
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        Wallet* wallet = new Wallet(("Valuer" + to_string(i)).c_str(), HOLDINGS);
+        for (int k = 0; k < HOLDINGS; k++) wallet->credit(assets[(i * 7919LL + k * 104729LL) % NUM_ASSETS], Amount::fromScaled(5, 1) + k + i % 13);
+        ids[i] = directory.add(wallet);
+    }
+
+    auto rescan = [&]() {
+        AmountSum total;
+        for (int i = 0; i < NUM_WALLETS; i++) total.add(directory.get(ids[i])->valuation(registry));
+        return total.total();
+    };
+
+    Amount total;
+    benchTime("first total, every wallet stale", NUM_WALLETS, "wallets/s", [&]() { total = directory.totalValue(); });
+    Amount expected;
+    benchTime("full rescan with valuation()", NUM_WALLETS, "wallets/s", [&]() { expected = rescan(); });
+    benchCheck(total == expected, "cached total matches a full rescan");
+
+    long long revalued = 0;
+    uint64_t state = 5;
+    benchTime("tick, trade, read total", ROUNDS, "reads/s", [&]() {
+        for (int round = 0; round < ROUNDS; round++) {
+            for (int t = 0; t < TICKS_PER_ROUND; t++) {
+                benchRandom(state);
+                CryptoCurrency* asset = registry.get(assets[(state >> 33) % NUM_ASSETS]);
+                asset->setPrice(Amount::fromScaled(static_cast<long long>(state % 100000) + 1, 2));
+            }
+            for (int t = 0; t < TRADES_PER_ROUND; t++) {
+                benchRandom(state);
+                directory.get(ids[(state >> 33) % NUM_WALLETS])->credit(assets[(state >> 13) % NUM_ASSETS], 1);
+            }
+            revalued += directory.revalue();
+            total = directory.totalValue();
+        }
+    });
+    cout << "    " << revalued / ROUNDS << " wallets revalued per round\n";
+    benchCheck(total == rescan(), "incremental total matches a full rescan");
+    benchCheck(revalued < static_cast<long long>(ROUNDS) * (TICKS_PER_ROUND * 2 * NUM_WALLETS * HOLDINGS / NUM_ASSETS + TRADES_PER_ROUND),
+        "only holders of repriced assets and traded wallets are revalued");
+    benchCheck(directory.revalue() == 0, "reading twice revalues nothing");
+
+    Wallet* sample = directory.get(ids[4242]);
+    Amount before = sample->value();
+    sample->debit(sample->getHoldings()[0].asset, sample->getHoldings()[0].quantity);
+    benchCheck(sample->value() == sample->valuation(registry) && sample->value() < before, "a debit refreshes the wallet's value");
+
+    benchRemoveWallets(ids);
+    benchCheck(directory.totalValue() == Amount(), "removed wallets leave the total");
+}
+
+void benchTaskPool() {
+    const int NUM_ASSETS = 16;
+    const int NUM_WALLETS = 100000;
+    const int NUM_TRANSFERS = 1000000;
+    const long long NUM_TERMS = 50000000;
+    const int START_BALANCE = 1000000;
+    TaskPool& pool = *TaskPool::getInstance();
+    // At least four threads so stealing and nesting get exercised even on a single core.
+    int maxThreads = std::max(4, pool.getThreads());
+    int defaultThreads = pool.getThreads();
+
+    cout << "\n[task pool] " << defaultThreads << " default thread(s); " << NUM_WALLETS << " wallets x " << NUM_ASSETS << " holdings, "
+         << NUM_TRANSFERS << "-line transfer file\n";
+
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<AssetId> assets(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Pool" + to_string(i);
+        assets[i] = registry.findByName(name);
+        if (assets[i] < 0) assets[i] = registry.add(new CryptoCurrency(name.c_str(), name.c_str(), Amount::fromScaled(100 + i, 2), 1000));
+    }
+    std::vector<WalletId> ids = benchWallets("Pool", NUM_WALLETS, START_BALANCE, NUM_ASSETS + 1);
+    std::vector<Wallet*> wallets(NUM_WALLETS);
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        wallets[i] = directory.get(ids[i]);
+        for (int k = 0; k < NUM_ASSETS; k++) wallets[i]->credit(assets[k], Amount::fromScaled(i % 1000 + k, 1));
+    }
+
+    // Every loader must report the same bad lines in the same order, so a few are spread across the file's chunks.
+    const char* BAD_LINES[] = {"Nobody Pool1 BenchCoin 5", "Pool1 Pool2 BenchCoin five", "Pool3 Pool4", "Pool5 Pool6 NoSuchCoin 1", "Pool7 Pool8 BenchCoin 99999999"};
+    const int BAD_EVERY = 100000;
+    string path = (std::filesystem::temp_directory_path() / "coinqueror-bench-pool-transfers.txt").string();
+    {
+        ofstream out(path);
+        uint64_t state = 7;
+        for (int i = 0; i < NUM_TRANSFERS; i++) {
+            if (i % BAD_EVERY == BAD_EVERY / 2) out << BAD_LINES[i / BAD_EVERY % 5] << "\n";
+            benchRandom(state);
+            out << "Pool" << (state >> 33) % NUM_WALLETS << " Pool" << (state >> 13) % NUM_WALLETS << " BenchCoin " << state % 100 << "\n";
+        }
+    }
+
+    std::vector<Amount> expected(NUM_WALLETS), values(NUM_WALLETS);
+    for (int i = 0; i < NUM_WALLETS; i++) expected[i] = wallets[i]->valuation(registry);
+    long long expectedSum = NUM_TERMS * (NUM_TERMS - 1) / 2;
+    // What the one-thread load leaves behind; every other thread count must leave the same.
+    Blockchain serial;
+    std::vector<Amount> serialBalances(NUM_WALLETS);
+    string serialWarnings;
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        pool.setThreads(threads);
+        string suffix = ", " + to_string(threads) + " thread(s)";
+        long long sum = 0;
+        benchTime("reduce" + suffix, NUM_TERMS, "terms/s", [&]() {
+            sum = parallelReduce(0, NUM_TERMS, 1 << 16, 0LL, [](int64_t first, int64_t last) {
+                long long partial = 0;
+                for (int64_t i = first; i < last; i++) partial += i;
+                return partial;
+            }, std::plus<long long>());
+        });
+        benchCheck(sum == expectedSum, "parallel reduce matches the closed form");
+
+        benchResetBalances(ids, START_BALANCE);
+        std::fill(values.begin(), values.end(), Amount());
+        benchTime("valuation" + suffix, NUM_WALLETS, "wallets/s", [&]() {
+            parallelFor(0, NUM_WALLETS, 256, [&](int64_t first, int64_t last) {
+                for (int64_t i = first; i < last; i++) values[i] = wallets[i]->valuation(registry);
+            });
+        });
+        benchCheck(values == expected, "parallel valuation matches Wallet::valuation");
+
+        Blockchain chain;
+        ostringstream report;
+        benchTime("load" + suffix, NUM_TRANSFERS, "tx/s", [&]() {
+            // The loader reports bad lines and its own settlement rate; keep them out of the table.
+            streambuf* console = cout.rdbuf(report.rdbuf());
+            streambuf* errors = cerr.rdbuf(report.rdbuf());
+            loadTransactionsFromFile(path, chain, directory, registry);
+            cerr.rdbuf(errors);
+            cout.rdbuf(console);
+        });
+        benchCheck(chain.getNumTransactions() == NUM_TRANSFERS, "every good line settles");
+        // The closing line carries the settlement rate, which differs from run to run.
+        string warnings = report.str();
+        warnings.erase(std::min(warnings.size(), warnings.rfind("Settled ")));
+        std::vector<Amount> balances(NUM_WALLETS);
+        for (int i = 0; i < NUM_WALLETS; i++) balances[i] = wallets[i]->balance(coin);
+        if (threads == 1) {
+            benchCheck(std::count(warnings.begin(), warnings.end(), '\n') == NUM_TRANSFERS / BAD_EVERY, "each bad line is reported once");
+            serial = std::move(chain);
+            serialBalances = balances;
+            serialWarnings = warnings;
+        } else {
+            // Block hashes cover the sealing time, so blocks are compared by their transactions and Merkle roots.
+            bool same = chain.getNumTransactions() == serial.getNumTransactions() && chain.getNumBlocks() == serial.getNumBlocks();
+            for (int i = 0; same && i < chain.getNumTransactions(); i++) {
+                TransactionRecord a = chain[i].toRecord(), b = serial[i].toRecord();
+                same = memcmp(&a, &b, sizeof(a)) == 0;
+            }
+            for (int i = 0; same && i < chain.getNumBlocks(); i++) {
+                same = chain.getBlock(i).numTransactions == serial.getBlock(i).numTransactions && chain.getBlock(i).merkleRoot == serial.getBlock(i).merkleRoot;
+            }
+            benchCheck(same && balances == serialBalances, "a parallel load leaves the serial loader's chain and balances");
+            benchCheck(warnings == serialWarnings, "a parallel load reports the serial loader's warnings in the same order");
+        }
+        if (threads == maxThreads) break;
+    }
+
+    std::atomic<long long> cells(0);
+    parallelFor(0, 1000, 7, [&](int64_t first, int64_t last) {
+        for (int64_t i = first; i < last; i++) {
+            parallelFor(0, 1000, 13, [&](int64_t innerFirst, int64_t innerLast) { cells += innerLast - innerFirst; });
+        }
+    });
+    benchCheck(cells == 1000000, "nested loops cover every cell once");
+    bool propagated = false;
+    try {
+        parallelFor(0, 100000, 10, [](int64_t first, int64_t last) {
+            if (first <= 77777 && 77777 < last) throw runtime_error("task failed");
+        });
+    } catch (const runtime_error&) {
+        propagated = true;
+    }
+    benchCheck(propagated, "an exception in a task reaches the caller");
+    bool rejected = false;
+    try { pool.setThreads(0); } catch (const invalid_argument&) { rejected = true; }
+    benchCheck(rejected && pool.getThreads() == maxThreads, "a thread count below one is rejected");
+
+    pool.setThreads(defaultThreads);
+    remove(path.c_str());
+    benchRemoveWallets(ids);
+}
+
+void benchSettlement() {
+    const int NUM_WALLETS = 50000;
+    const int NUM_TRANSFERS = 1000000;
+    const int START_BALANCE = 100;
+    TaskPool& pool = *TaskPool::getInstance();
+    int maxThreads = pool.getThreads();
+
+    cout << "\n[settlement] " << NUM_TRANSFERS << " transfers between " << NUM_WALLETS << " wallets\n";
+
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<WalletId> ids = benchWallets("Settle", NUM_WALLETS, START_BALANCE);
+    std::vector<Transaction> transfers;
+    uint64_t state = 42;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        benchRandom(state);
+        int from = static_cast<int>((state >> 33) % NUM_WALLETS), to = static_cast<int>((state >> 13) % NUM_WALLETS);
+        transfers.push_back(Transaction(ids[from], ids[to], coin, Amount::fromScaled(static_cast<long long>(state % 6000), 2)));
+    }
+    transfers[7] = Transaction(ids[0], WalletId{ids[1].index, ids[1].generation + 1}, coin, 1);
+
+    SettlementEngine engine(directory, registry);
+    std::vector<SettlementStatus> expected(NUM_TRANSFERS), statuses(NUM_TRANSFERS);
+    std::vector<Amount> balances(NUM_WALLETS);
+    Blockchain sequential;
+    sequential.reserve(NUM_TRANSFERS);
+    int settled = 0;
+    benchTime("one transfer at a time", NUM_TRANSFERS, "tx/s", [&]() {
+        for (int i = 0; i < NUM_TRANSFERS; i++) settled += (expected[i] = engine.settle(transfers[i], sequential)) == SettlementStatus::Settled;
+    });
+    cout << "    " << settled << " settled\n";
+    AmountSum supply;
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        balances[i] = directory.get(ids[i])->balance(coin);
+        supply.add(balances[i]);
+    }
+    benchCheck(supply.total() == Amount(START_BALANCE) * NUM_WALLETS, "settlement conserves the asset supply");
+    benchCheck(expected[7] == SettlementStatus::UnknownWallet, "a stale wallet id is rejected");
+    benchCheck(std::count(expected.begin(), expected.end(), SettlementStatus::InsufficientFunds) > 0, "overdrafts are rejected");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        pool.setThreads(threads);
+        Blockchain batched;
+        batched.reserve(NUM_TRANSFERS);
+        benchResetBalances(ids, START_BALANCE);
+        SettlementReport report = {};
+        benchTime("batch, " + to_string(threads) + " thread(s)", NUM_TRANSFERS, "tx/s", [&]() {
+            report = engine.settleBatch(transfers.data(), NUM_TRANSFERS, batched, statuses.data());
+        });
+        cout << "    " << report.settled << " settled in " << report.waves << " conflict-free waves\n";
+        bool same = statuses == expected && batched.getNumTransactions() == sequential.getNumTransactions();
+        for (int i = 0; same && i < NUM_WALLETS; i++) same = directory.get(ids[i])->balance(coin) == balances[i];
+        benchCheck(same, "batch settlement matches one-at-a-time settlement");
+        if (threads == maxThreads) break;
+    }
+
+    Wallet* frozen = directory.get(ids[1]);
+    frozen->setIsActive(false);
+    Blockchain chain;
+    benchCheck(engine.settle(Transaction(ids[0], ids[1], coin, 1), chain) == SettlementStatus::InactiveWallet && chain.getNumTransactions() == 0,
+        "transfers to an inactive wallet are rejected");
+    benchRemoveWallets(ids);
+}
+
+void benchIngest() {
+    const int NUM_WALLETS = 20000;
+    const int NUM_TRANSFERS = 400000;
+    const int START_BALANCE = 50;
+    // At least four producers so the stress run interleaves even on a single core.
+    int maxThreads = static_cast<int>(std::max(4u, std::thread::hardware_concurrency()));
+
+    cout << "\n[concurrent ingest] " << NUM_TRANSFERS << " transfers between " << NUM_WALLETS << " wallets, "
+         << ChainIngest::STRIPES << " lock stripes\n";
+
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<WalletId> ids = benchWallets("Ingest", NUM_WALLETS, START_BALANCE);
+    std::vector<Transaction> transfers;
+    uint64_t state = 7;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        benchRandom(state);
+        // One transfer in eight involves wallet 0 so that producers contend on a hot stripe.
+        int from = i % 8 == 0 ? 0 : static_cast<int>((state >> 33) % NUM_WALLETS), to = static_cast<int>((state >> 13) % NUM_WALLETS);
+        transfers.push_back(Transaction(ids[from], ids[to], coin, Amount::fromScaled(static_cast<long long>(state % 4000), 2)));
+    }
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        benchResetBalances(ids, START_BALANCE);
+        Blockchain chain;
+        ChainIngest ingest(chain, directory, registry, threads);
+        std::atomic<int> settled(0);
+        int rejected = 0, committed = 0;
+        benchTime(to_string(threads) + " producer thread(s)", NUM_TRANSFERS, "tx/s", [&]() {
+            std::vector<std::thread> producers;
+            for (int producer = 0; producer < threads; producer++) {
+                producers.emplace_back([&, producer]() {
+                    int mine = 0;
+                    for (int i = producer; i < NUM_TRANSFERS; i += threads) mine += ingest.submit(producer, transfers[i]) == SettlementStatus::Settled;
+                    settled += mine;
+                });
+            }
+            for (std::thread& thread : producers) thread.join();
+            rejected = ingest.getRejected();
+            committed = ingest.commit();
+        });
+        cout << "    " << committed << " settled\n";
+
+        std::vector<Amount> balances(NUM_WALLETS);
+        AmountSum supply;
+        bool nonNegative = true;
+        for (int i = 0; i < NUM_WALLETS; i++) {
+            balances[i] = directory.get(ids[i])->balance(coin);
+            supply.add(balances[i]);
+            nonNegative &= !balances[i].isNegative();
+        }
+        benchCheck(committed == settled && committed + rejected == NUM_TRANSFERS && chain.getNumTransactions() == committed, "every submitted transfer is committed or rejected");
+        benchCheck(nonNegative && supply.total() == Amount(START_BALANCE) * NUM_WALLETS, "concurrent settlement conserves supply without overdrafts");
+
+        // The committed chain is a serial history: replaying it from the start balances settles every transfer and
+        // ends in the same balances.
+        benchResetBalances(ids, START_BALANCE);
+        SettlementEngine engine(directory, registry);
+        bool replays = true;
+        chain.forEach([&](const Transaction& transaction) { replays &= engine.apply(transaction) == SettlementStatus::Settled; });
+        for (int i = 0; replays && i < NUM_WALLETS; i++) replays = directory.get(ids[i])->balance(coin) == balances[i];
+        benchCheck(replays, "replaying the committed chain reproduces the balances");
+        if (threads == maxThreads) break;
+    }
+    benchRemoveWallets(ids);
+}
+
+// Reference multiset difference: each transfer of b cancels the first unmatched equal transfer of a.
+std::vector<Transaction> benchNaiveDifference(const std::vector<Transaction>& a, const std::vector<Transaction>& b) {
+    std::vector<bool> used(a.size(), false);
+    for (const Transaction& transaction : b) {
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!used[i] && a[i] == transaction) {
+                used[i] = true;
+                break;
+            }
+        }
+    }
+    std::vector<Transaction> rest;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!used[i]) rest.push_back(a[i]);
+    }
+    return rest;
+}
+
+void benchChainIndexes() {
+    const int NUM_TRANSFERS = 1000000;
+    const int NUM_WALLETS = 10000;
+    const int NUM_ASSETS = 8;
+    const int NUM_QUERIES = 1000;
+
+    cout << "\n[chain indexes] " << NUM_TRANSFERS << " transfers between " << NUM_WALLETS << " wallets in " << NUM_ASSETS << " assets, "
+         << NUM_QUERIES << " wallet queries\n";
+
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    std::vector<AssetId> assets(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Indexed" + to_string(i);
+        assets[i] = registry.findByName(name);
+        if (assets[i] < 0) assets[i] = registry.add(new CryptoCurrency(name.c_str(), name.c_str(), 1, 1000));
+    }
+    int64_t before = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    Blockchain chain;
+    chain.reserve(NUM_TRANSFERS);
+    uint64_t state = 5;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        benchRandom(state);
+        chain.addTransaction(Transaction(WalletId{static_cast<int>((state >> 33) % NUM_WALLETS), 0}, WalletId{static_cast<int>((state >> 13) % NUM_WALLETS), 0},
+                                         assets[i % NUM_ASSETS], static_cast<long long>(state % 100)));
+    }
+    chain.sealBlock();
+    int64_t after = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    for (int i = 0; i < NUM_TRANSFERS; i += 1000) chain.voidTransaction(i);
+    cout << "  " << left << setw(34) << "posting lists" << right << setw(14) << fixed << setprecision(2)
+         << chain.getIndexBytes() / (3.0 * NUM_TRANSFERS) << " bytes/posting\n";
+    cout.unsetf(ios::floatfield);
+
+    auto walletOf = [](int query) { return WalletId{static_cast<int>((query * 7919LL) % NUM_WALLETS), 0}; };
+
+    std::vector<std::vector<int>> scanned(NUM_QUERIES), indexed(NUM_QUERIES);
+    benchTime("wallet query, full scan", NUM_QUERIES / 10, "queries/s", [&]() {
+        for (int query = 0; query < NUM_QUERIES / 10; query++) {
+            WalletId wallet = walletOf(query);
+            for (int i = 0; i < chain.getNumTransactions(); i++) {
+                const Transaction& transaction = chain[i];
+                if (!chain.isVoided(i) && !transaction.isVoid() && (transaction.getFromId() == wallet || transaction.getToId() == wallet)) scanned[query].push_back(i);
+            }
+        }
+    });
+    benchTime("wallet query, posting list", NUM_QUERIES, "queries/s", [&]() {
+        for (int query = 0; query < NUM_QUERIES; query++) indexed[query] = chain.findByWallet(walletOf(query));
+    });
+    bool same = true;
+    for (int query = 0; query < NUM_QUERIES / 10; query++) same &= scanned[query] == indexed[query];
+    benchCheck(same, "wallet index matches a full scan");
+
+    std::vector<int> byAsset;
+    benchTime("asset query, posting list", NUM_ASSETS, "queries/s", [&]() {
+        for (int i = 0; i < NUM_ASSETS; i++) byAsset = chain.findByAsset(assets[i]);
+    });
+    benchCheck(byAsset.size() == NUM_TRANSFERS / NUM_ASSETS && byAsset[0] == NUM_ASSETS - 1, "asset index lists every live transfer of the asset");
+    benchCheck(chain.findByAsset(assets[0]).size() == NUM_TRANSFERS / NUM_ASSETS - NUM_TRANSFERS / 1000, "voided transfers leave the asset index");
+    benchCheck(static_cast<int>(chain.findByTime(before, after + 1).size()) == NUM_TRANSFERS - NUM_TRANSFERS / 1000,
+        "time index covers every sealed live transfer");
+    benchCheck(chain.findByTime(before - 2 * Blockchain::TIME_BUCKET_SECONDS, before).empty(), "time index excludes earlier blocks");
+    Blockchain copy = chain;
+    benchCheck(copy.findByWallet(walletOf(3)) == indexed[3], "copies keep their indexes");
+}
+
+void benchLedgerQueries() {
+    const int NUM_TRANSFERS = 2000000;
+    const int NUM_WALLETS = 50000;
+    const int NUM_ASSETS = 4;
+    const int SMALL_TABLE = 4096;
+
+    cout << "\n[ledger queries] " << NUM_TRANSFERS << " transfers between " << NUM_WALLETS << " wallets in " << NUM_ASSETS << " assets, "
+         << RowBatch::CAPACITY << "-row batches\n";
+
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    std::vector<AssetId> assets(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Queried" + to_string(i);
+        assets[i] = registry.findByName(name);
+        if (assets[i] < 0) assets[i] = registry.add(new CryptoCurrency(name.c_str(), name.c_str(), 1, 1000));
+    }
+    Blockchain chain;
+    chain.reserve(NUM_TRANSFERS);
+    uint64_t state = 11;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        benchRandom(state);
+        chain.addTransaction(Transaction(WalletId{static_cast<int>((state >> 33) % NUM_WALLETS), 0}, WalletId{static_cast<int>((state >> 13) % NUM_WALLETS), 0},
+                                         assets[(state >> 50) % NUM_ASSETS], Amount::fromScaled(static_cast<long long>(state % 10000), 2)));
+    }
+    chain.sealBlock();
+
+    auto slotOf = [&](AssetId asset) { return static_cast<size_t>(std::find(assets.begin(), assets.end(), asset) - assets.begin()); };
+    std::vector<AmountSum> volumes(NUM_ASSETS);
+    std::vector<AmountSum> flows(static_cast<size_t>(NUM_WALLETS) * NUM_ASSETS);
+    benchTime("hand-written loop", NUM_TRANSFERS, "rows/s", [&]() {
+        for (int i = 0; i < chain.getNumTransactions(); i++) {
+            const Transaction& transaction = chain[i];
+            size_t asset = slotOf(transaction.getAssetId());
+            volumes[asset].add(transaction.getAmount());
+            flows[static_cast<size_t>(transaction.getFromId().index) * NUM_ASSETS + asset].add(-transaction.getAmount());
+            flows[static_cast<size_t>(transaction.getToId().index) * NUM_ASSETS + asset].add(transaction.getAmount());
+        }
+    });
+
+    bool same = true;
+    int rows = 0;
+    benchTime("volume per asset per hour", NUM_TRANSFERS, "rows/s", [&]() {
+        QueryPlan plan = planLedgerScan(chain, LedgerScan::TRANSFERS, {QueryPredicate("time", CompareOp::GreaterEqual, 0)});
+        plan = QueryPlan(new QueryProject(std::move(plan), {ProjectColumn("asset", "asset"), ProjectColumn("hour", "time", 3600), ProjectColumn("amount", "amount")}));
+        plan = QueryPlan(new QueryGroupBy(std::move(plan), {"asset", "hour"}, {{AggregateKind::Sum, "amount", "volume"}, {AggregateKind::Count, "", "transfers"}}));
+        forEachRow(*plan, [&](const RowBatch& batch, int row) {
+            same &= batch.amounts[2][row] == volumes[slotOf(static_cast<AssetId>(batch.ints[0][row]))].total();
+            rows += static_cast<int>(batch.ints[3][row]);
+        });
+    });
+    benchCheck(same && rows == NUM_TRANSFERS, "grouped volume matches the hand-written loop");
+
+    for (int maxGroups : {1 << 20, SMALL_TABLE}) {
+        int groups = 0, spillFiles = 0;
+        AmountSum total;
+        same = true;
+        string label = maxGroups == SMALL_TABLE ? "net flow, " + to_string(SMALL_TABLE) + "-group table" : string("net flow per wallet and asset");
+        benchTime(label, 2.0 * NUM_TRANSFERS, "rows/s", [&]() {
+            QueryGroupBy* group = new QueryGroupBy(QueryPlan(new LedgerScan(chain, LedgerScan::LEGS)), {"wallet", "asset"}, {{AggregateKind::Sum, "amount", "net"}}, maxGroups);
+            QueryPlan plan(group);
+            forEachRow(*plan, [&](const RowBatch& batch, int row) {
+                Amount net = batch.amounts[2][row];
+                same &= net == flows[static_cast<size_t>(batch.ints[0][row]) * NUM_ASSETS + slotOf(static_cast<AssetId>(batch.ints[1][row]))].total();
+                total.add(net);
+                groups++;
+            });
+            spillFiles = group->getSpillFiles();
+        });
+        if (spillFiles > 0) cout << "    " << spillFiles << " spill files\n";
+        benchCheck(same && total.total() == Amount() && groups > SMALL_TABLE && (spillFiles > 0) == (maxGroups == SMALL_TABLE), maxGroups == SMALL_TABLE ? "spilled grouping matches the loop" : "net flows match the loop");
+    }
+
+    std::vector<int64_t> scanned, indexed;
+    WalletId wallet = {4242, 0};
+    benchTime("one wallet, full scan + filter", NUM_TRANSFERS, "rows/s", [&]() {
+        QueryFilter plan(QueryPlan(new LedgerScan(chain, LedgerScan::TRANSFERS)), {QueryPredicate("from", CompareOp::Equal, wallet.index)});
+        forEachRow(plan, [&](const RowBatch& batch, int row) { scanned.push_back(batch.ints[0][row]); });
+    });
+    benchTime("one wallet, index pushdown", NUM_TRANSFERS, "rows/s", [&]() {
+        QueryPlan plan = planLedgerScan(chain, LedgerScan::TRANSFERS, {QueryPredicate("from", CompareOp::Equal, wallet.index)});
+        forEachRow(*plan, [&](const RowBatch& batch, int row) { indexed.push_back(batch.ints[0][row]); });
+    });
+    benchCheck(!scanned.empty() && scanned == indexed, "index pushdown returns the scanned rows");
+
+    std::vector<Amount> amounts;
+    for (int i = 0; i < NUM_TRANSFERS; i++) amounts.push_back(chain[i].getAmount());
+    std::partial_sort(amounts.begin(), amounts.begin() + 10, amounts.end(), std::greater<Amount>());
+    std::vector<Amount> top;
+    benchTime("top 10 transfers by amount", NUM_TRANSFERS, "rows/s", [&]() {
+        QueryTopK plan(QueryPlan(new LedgerScan(chain, LedgerScan::TRANSFERS)), "amount", 10);
+        forEachRow(plan, [&](const RowBatch& batch, int row) { top.push_back(batch.amounts[4][row]); });
+    });
+    benchCheck(top == std::vector<Amount>(amounts.begin(), amounts.begin() + 10), "top-k matches a partial sort");
+
+    QueryTopK largest(QueryPlan(new QueryFilter(QueryPlan(new AssetScan(registry)), {QueryPredicate("price", CompareOp::GreaterEqual, Amount(1))})), "marketCap", 1);
+    RowBatch batch;
+    benchCheck(largest.next(batch) && batch.size == 1 && registry.get(static_cast<AssetId>(batch.ints[0][0]))->getPrice() >= 1, "asset scans filter and rank");
+}
+
+void benchReconcile() {
+    const int NUM_TRANSFERS = 1000000;
+    const int NUM_SMALL = 20000;
+    const int NUM_WALLETS = 5000;
+    TaskPool& pool = *TaskPool::getInstance();
+    int maxThreads = pool.getThreads();
+
+    cout << "\n[reconcile] two ledgers of " << NUM_TRANSFERS << " transfers, every 10th dropped and 1 in 10 new on the right\n";
+
+    AssetId coin = benchAsset();
+    auto transfer = [coin](uint64_t state) {
+        return Transaction(WalletId{static_cast<int>((state >> 33) % NUM_WALLETS), 0}, WalletId{static_cast<int>((state >> 17) % NUM_WALLETS), 0}, coin,
+                           static_cast<long long>(state % 50));
+    };
+    std::vector<Transaction> ours, theirs;
+    uint64_t state = 99;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        benchRandom(state);
+        ours.push_back(transfer(state));
+        if (i % 10 != 0) theirs.push_back(ours.back());
+        if (i % 10 == 5) theirs.push_back(Transaction(ours.back().getFromId(), ours.back().getToId(), coin, 1000 + i % 7));
+    }
+    Blockchain a, b;
+    a.reserve(NUM_TRANSFERS);
+    b.reserve(static_cast<int>(theirs.size()));
+    for (const Transaction& transaction : ours) a.addTransaction(transaction);
+    for (const Transaction& transaction : theirs) b.addTransaction(transaction);
+
+    std::vector<Transaction> smallOurs(ours.begin(), ours.begin() + NUM_SMALL), smallTheirs(theirs.begin(), theirs.begin() + NUM_SMALL);
+    std::vector<Transaction> expected;
+    benchTime("nested loop, " + to_string(NUM_SMALL) + " each", 2.0 * NUM_SMALL, "tx/s", [&]() { expected = benchNaiveDifference(smallOurs, smallTheirs); });
+    Blockchain smallA, smallB;
+    for (const Transaction& transaction : smallOurs) smallA.addTransaction(transaction);
+    for (const Transaction& transaction : smallTheirs) smallB.addTransaction(transaction);
+    Blockchain smallDifference;
+    benchTime("hash match, " + to_string(NUM_SMALL) + " each", 2.0 * NUM_SMALL, "tx/s", [&]() { smallDifference = smallA - smallB; });
+    bool same = smallDifference.getNumTransactions() == static_cast<int>(expected.size());
+    for (int i = 0; same && i < smallDifference.getNumTransactions(); i++) same = smallDifference[i] == expected[i];
+    benchCheck(same, "hash difference matches the nested loop");
+
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        pool.setThreads(threads);
+        ChainDiff changes;
+        benchTime("diff, " + to_string(threads) + " thread(s)", a.getNumTransactions() + b.getNumTransactions(), "tx/s", [&]() { changes = a.diff(b); });
+        benchCheck(changes.removed.size() == NUM_TRANSFERS / 10 && changes.added.size() == NUM_TRANSFERS / 10, "diff finds every dropped and new transfer");
+        benchCheck(changes.removed[1] == ours[10] && changes.added[0].getAmount() == 1005, "diff lists transfers in chain order");
+        if (threads == maxThreads) break;
+    }
+    Blockchain common;
+    benchTime("intersection", a.getNumTransactions() + b.getNumTransactions(), "tx/s", [&]() { common = a.intersection(b); });
+    benchCheck(common.getNumTransactions() == NUM_TRANSFERS - NUM_TRANSFERS / 10, "intersection keeps the shared transfers");
+    int added = 0;
+    benchTime("merge", a.getNumTransactions() + b.getNumTransactions(), "tx/s", [&]() { added = a.merge(b); });
+    benchCheck(added == NUM_TRANSFERS / 10 && a.diff(b).added.empty(), "merge appends only the missing transfers");
+
+    // Copies count: two equal transfers on the left and one on the right leave one behind; voided transfers are ignored.
+    Transaction one(WalletId{1, 0}, WalletId{2, 0}, coin, 5), two(WalletId{2, 0}, WalletId{3, 0}, coin, 5);
+    Blockchain x, y;
+    x.addTransaction(one);
+    x.addTransaction(one);
+    x.addTransaction(two);
+    x.voidTransaction(2);
+    y.addTransaction(one);
+    y.addTransaction(two);
+    y.addTransaction(two);
+    ChainDiff copies = x.diff(y);
+    benchCheck(copies.removed.size() == 1 && copies.removed[0] == one && copies.added.size() == 2 && copies.added[1] == two,
+        "duplicates are matched as a multiset");
+    benchCheck((x - y).getNumTransactions() == 1 && x.intersection(y).getNumTransactions() == 1, "difference and intersection count copies");
+}
+
+void benchChainLog() {
+    const int NUM_TRANSACTIONS = 1000000;
+    const int BLOCK_BYTES = sizeof(BlockHeader) + Blockchain::BLOCK_CAPACITY * sizeof(TransactionRecord);
+
+    cout << "\n[block log] " << NUM_TRANSACTIONS << " transactions in blocks of " << Blockchain::BLOCK_CAPACITY << "\n";
+
+    AssetId coin = benchAsset();
+    string base = (std::filesystem::temp_directory_path() / "coinqueror-bench.chain").string();
+    BlockLog log(base);
+    benchCheck(log.reset(), "bench chain log opens");
+    Blockchain blockchain;
+    blockchain.attachSink(&log);
+
+    benchTime("seal + append " + to_string((NUM_TRANSACTIONS + Blockchain::BLOCK_CAPACITY - 1) / Blockchain::BLOCK_CAPACITY) + " blocks", NUM_TRANSACTIONS, "tx/s", [&]() {
+        for (int i = 0; i < NUM_TRANSACTIONS; i++) {
+            blockchain.addTransaction(Transaction(WalletId{i % 1000, 0}, WalletId{(i + 1) % 1000, 0}, coin, i % 997));
+        }
+        blockchain.sealBlock();
+    });
+    benchCheck(log.getNumBlocks() == static_cast<uint64_t>(blockchain.getNumBlocks()), "every sealed block reaches the log");
+
+    TaskPool& pool = *TaskPool::getInstance();
+    int maxThreads = pool.getThreads();
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        pool.setThreads(threads);
+        log.clearCheckpoint();
+        ChainVerification result;
+        benchTime("verify, " + to_string(threads) + " thread(s)", NUM_TRANSACTIONS, "tx/s", [&]() { result = log.verify(); });
+        benchCheck(result.ok && result.verifiedBlocks == log.getNumBlocks() && result.checkedTransactions == static_cast<uint64_t>(NUM_TRANSACTIONS),
+            "full verification succeeds");
+        if (threads == maxThreads) break;
+    }
+    cout.unsetf(ios::floatfield);
+
+    for (int i = 0; i < Blockchain::BLOCK_CAPACITY; i++) {
+        blockchain.addTransaction(Transaction(WalletId{0, 0}, WalletId{1, 0}, coin, 1));
+    }
+    blockchain.sealBlock();
+    ChainVerification incremental = log.verify();
+    benchCheck(incremental.ok && incremental.checkedBlocks == 1, "verification resumes from the checkpoint");
+
+    log.close();
+    {
+        ofstream segment(base + ".000000", ios::binary | ios::app);
+        segment << "torn block";
+        ofstream index(base + ".idx", ios::binary | ios::app);
+        index << "torn";
+    }
+    BlockLog reopened(base);
+    benchCheck(reopened.open() && reopened.getNumBlocks() == static_cast<uint64_t>(blockchain.getNumBlocks()), "torn tail is discarded on open");
+    ChainVerification resumed = reopened.verify();
+    benchCheck(resumed.ok && resumed.checkedBlocks == 0 && resumed.verifiedBlocks == reopened.getNumBlocks(), "reopened log keeps its checkpoint");
+    reopened.close();
+
+    {
+        fstream segment(base + ".000000", ios::binary | ios::in | ios::out);
+        segment.seekp(5 * BLOCK_BYTES + sizeof(BlockHeader) + 10);
+        segment.put('\x7f');
+    }
+    reopened.open();
+    reopened.clearCheckpoint();
+    ChainVerification corrupted = reopened.verify();
+    benchCheck(!corrupted.ok && corrupted.failedBlock == 5 && corrupted.verifiedBlocks == 5, "corrupted block is detected");
+    reopened.removeFiles();
+}
+
+void benchSnapshot() {
+    const int NUM_WALLETS = 1000;
+    const int NUM_TRANSFERS = 100000;
+
+    cout << "\n[snapshot] " << NUM_WALLETS << " wallets, " << NUM_TRANSFERS << " transfers\n";
+
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<Wallet*> wallets(NUM_WALLETS);
+    for (int i = 0; i < NUM_WALLETS; i++) {
+        wallets[i] = directory.get(directory.add(new Wallet(("Snapshot" + to_string(i)).c_str(), 4)));
+        wallets[i]->credit(coin, i + 1);
+    }
+    Blockchain chain;
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        chain.addTransaction(Transaction(wallets[i % NUM_WALLETS]->getWalletId(), wallets[(i * 7 + 1) % NUM_WALLETS]->getWalletId(), coin, i % 997));
+    }
+    std::filesystem::path temp = std::filesystem::temp_directory_path();
+    string path = (temp / "coinqueror-bench.snap").string();
+    string generalPath = (temp / "coinqueror-bench-general.log").string(), statsPath = (temp / "coinqueror-bench-stats.log").string();
+    {
+        AuditLog<std::string> generalLog(generalPath);
+        AuditLog<int> statsLog(statsPath);
+        generalLog.addEntry("Bench", std::string("snapshot"));
+        statsLog.addEntry("Bench", 42);
+        bool saved = false;
+        benchTime("save snapshot", NUM_TRANSFERS, "tx/s", [&]() { saved = saveSnapshot(path, registry, wallets.data(), NUM_WALLETS, chain, generalLog, statsLog); });
+        benchCheck(saved, "snapshot saves");
+    }
+
+    {
+        SnapshotReader reader(path);
+        bool valid = false;
+        benchTime("validate snapshot", NUM_TRANSFERS, "tx/s", [&]() { valid = reader.validate(); });
+        benchCheck(valid, "saved snapshot validates");
+        uint64_t numRecords = 0, numBlocks = 0, numWallets = 0, numLogs = 0, mistyped = 0;
+        const TransactionRecord* records = reader.records<TransactionRecord>(SECTION_TRANSACTIONS, numRecords);
+        const BlockHeader* blocks = reader.records<BlockHeader>(SECTION_BLOCKS, numBlocks);
+        const WalletRecord* walletRecords = reader.records<WalletRecord>(SECTION_WALLETS, numWallets);
+        const LogRecord* logs = reader.records<LogRecord>(SECTION_STATS_LOG, numLogs);
+        bool same = numRecords == static_cast<uint64_t>(chain.getNumTransactions()) && numBlocks == static_cast<uint64_t>(chain.getNumBlocks());
+        for (uint64_t i = 0; same && i < numRecords; i++) {
+            TransactionRecord record = chain[static_cast<int>(i)].toRecord();
+            same = memcmp(&record, &records[i], sizeof(record)) == 0;
+        }
+        for (uint64_t i = 0; same && i < numBlocks; i++) same = Sha256::digest(&blocks[i], sizeof(BlockHeader)) == chain.getBlockHash(static_cast<int>(i));
+        benchCheck(same, "snapshot transactions and blocks read back as saved");
+        benchCheck(numWallets == NUM_WALLETS && strcmp(reader.getString(walletRecords[7].owner), "Snapshot7") == 0
+            && numLogs == 1 && logs[0].details == 42, "snapshot wallets and logs read back as saved");
+        reader.records<HoldingRecord>(SECTION_TRANSACTIONS, mistyped);
+        benchCheck(mistyped == 0, "records of the wrong size are not read");
+    }
+
+    std::string bytes;
+    {
+        ifstream in(path, ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    auto rejects = [&](const std::string& damaged) {
+        {
+            ofstream out(path, ios::binary | ios::trunc);
+            out.write(damaged.data(), damaged.size());
+        }
+        SnapshotReader reader(path);
+        return !reader.validate();
+    };
+    benchCheck(rejects(bytes.substr(0, bytes.size() - 1)) && rejects(bytes.substr(0, sizeof(SnapshotHeader) - 1)), "truncated snapshots are rejected");
+    std::string flipped = bytes;
+    flipped[bytes.size() / 2] ^= 0x40;
+    benchCheck(rejects(flipped), "a corrupt snapshot is rejected");
+    // Sections whose sizes disagree with their records, with the checksum recomputed as a crafted file would.
+    auto crafted = [&](uint32_t recordSize, uint64_t count) {
+        std::string damaged = bytes;
+        SnapshotSection* sections = reinterpret_cast<SnapshotSection*>(&damaged[sizeof(SnapshotHeader)]);
+        sections[SECTION_TRANSACTIONS - 1].recordSize = recordSize;
+        sections[SECTION_TRANSACTIONS - 1].count = count;
+        SnapshotHeader header;
+        memcpy(&header, damaged.data(), sizeof(header));
+        header.checksum = checksumBytes(damaged.data() + sizeof(SnapshotHeader), header.payloadSize);
+        memcpy(&damaged[0], &header, sizeof(header));
+        return rejects(damaged);
+    };
+    benchCheck(crafted(0, 1000ULL * NUM_TRANSFERS) && crafted(2 * sizeof(TransactionRecord), NUM_TRANSFERS / 2), "sections sized for other records are rejected");
+
+    remove(path.c_str());
+    remove(generalPath.c_str());
+    remove(statsPath.c_str());
+    for (Wallet* wallet : wallets) directory.remove(wallet->getWalletId());
+}
+
+void benchArchive() {
+    const int NUM_WALLETS = 10000;
+    const int NUM_TRANSFERS = 1000000;
+    const int START_BALANCE = 1000000;
+    const int TIMED_BLOCKS = 2048;
+    const int RECENT_BLOCKS = 100;
+    const int LOAD_ROUNDS = 5;
+
+    cout << "\n[archive] " << NUM_TRANSFERS << " transfers between " << NUM_WALLETS << " wallets, row groups of "
+         << ArchiveWriter::GROUP_BLOCKS << " blocks\n";
+
+    std::string sample;
+    uint64_t state = 3;
+    while (sample.size() < (1 << 20)) {
+        benchRandom(state);
+        if (state % 3 == 0) sample += "Archive" + to_string(state >> 50) + " ";
+        else sample.push_back(static_cast<char>(state >> 56));
+    }
+    std::vector<uint8_t> packed(Lz4::maxCompressedSize(sample.size())), unpacked(sample.size());
+    size_t packedSize = Lz4::compress(reinterpret_cast<const uint8_t*>(sample.data()), sample.size(), packed.data());
+    bool roundTrip = Lz4::decompress(packed.data(), packedSize, unpacked.data(), unpacked.size())
+        && memcmp(unpacked.data(), sample.data(), sample.size()) == 0;
+    benchCheck(roundTrip && packedSize < sample.size() && !Lz4::decompress(packed.data(), packedSize - 1, unpacked.data(), unpacked.size()),
+        "LZ4 blocks round-trip and reject truncation");
+
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    AssetRegistry& registry = *AssetRegistry::getInstance();
+    AssetId coin = benchAsset();
+    std::vector<WalletId> ids = benchWallets("Archive", NUM_WALLETS, START_BALANCE);
+    string textPath = (std::filesystem::temp_directory_path() / "coinqueror-bench-transfers.txt").string();
+    string archivePath = (std::filesystem::temp_directory_path() / "coinqueror-bench.archive").string();
+    {
+        ofstream out(textPath);
+        for (int i = 0; i < NUM_TRANSFERS; i++) {
+            benchRandom(state);
+            out << "Archive" << (state >> 33) % NUM_WALLETS << " Archive" << (state >> 13) % NUM_WALLETS << " BenchCoin " << state % 100 << "." << (state >> 7) % 100 << "\n";
+        }
+    }
+
+    auto quietly = [](auto body) {
+        ostringstream report;
+        streambuf* console = cout.rdbuf(report.rdbuf());
+        auto result = body();
+        cout.rdbuf(console);
+        return result;
+    };
+
+    Blockchain chain;
+    double textMs = benchElapsed([&]() { quietly([&]() { return loadTransactionsFromFile(textPath, chain, directory, registry); }); });
+    benchCheck(chain.getNumTransactions() == NUM_TRANSFERS, "every text transfer settles");
+    for (int i = 0; i < NUM_TRANSFERS; i += 1000) chain.voidTransaction(i);
+    bool written = false;
+    benchTime("write archive", chain.getNumTransactions(), "tx/s", [&]() { written = writeArchive(archivePath, chain, directory, registry); });
+    uintmax_t textBytes = std::filesystem::file_size(textPath), archiveBytes = std::filesystem::file_size(archivePath);
+    cout << "    " << textBytes << " bytes as text, " << archiveBytes << " archived (" << fixed << setprecision(2)
+         << static_cast<double>(archiveBytes) / chain.getNumTransactions() << " bytes/transaction)\n";
+    cout.unsetf(ios::floatfield);
+    benchCheck(written && archiveBytes * 4 < textBytes, "the archive is a fraction of the text");
+
+    // Each load is timed as the best of a few interleaved rounds, so one slow moment of the machine does not decide the ratio.
+    Blockchain restored;
+    bool loaded = true;
+    double archiveMs = 0;
+    for (int round = 0; round < LOAD_ROUNDS; round++) {
+        Blockchain archived, text;
+        double ms = benchElapsed([&]() { loaded = loadArchive(archivePath, archived, directory, registry) && loaded; });
+        archiveMs = round == 0 ? ms : std::min(archiveMs, ms);
+        if (round == LOAD_ROUNDS - 1) restored = std::move(archived);
+        else textMs = std::min(textMs, benchElapsed([&]() { quietly([&]() { return loadTransactionsFromFile(textPath, text, directory, registry); }); }));
+    }
+    benchReport("load from text", NUM_TRANSFERS, "tx/s", textMs);
+    benchReport("load from archive", chain.getNumTransactions(), "tx/s", archiveMs);
+    cout << "    " << fixed << setprecision(1) << textMs / archiveMs << "x faster than text\n";
+    cout.unsetf(ios::floatfield);
+    benchCheck(textMs / archiveMs >= 10, "an archive loads at least 10x faster than text");
+    benchCheck(loaded && restored.getNumTransactions() == chain.getNumTransactions() && restored.getNumBlocks() == chain.getNumBlocks()
+        && restored.getBlockHash(restored.getNumBlocks() - 1) == chain.getBlockHash(chain.getNumBlocks() - 1), "the archive restores the same chain");
+    // A load leaves the wallet and asset indexes to the first query, which posts the whole chain.
+    std::vector<int> firstQuery;
+    benchTime("first wallet query after a load", restored.getNumTransactions(), "tx/s", [&]() { firstQuery = restored.findByWallet(ids[42]); });
+    benchCheck(firstQuery == chain.findByWallet(ids[42]) && restored.findByAsset(coin) == chain.findByAsset(coin) && restored.isVoided(3000),
+        "restored chains are indexed and keep voids");
+
+    Blockchain appended = chain;
+    benchCheck(loadArchive(archivePath, appended, directory, registry) && appended.getNumTransactions() == 2 * chain.getNumTransactions()
+        && appended.isVoided(chain.getNumTransactions() + 5000) && !appended.isVoided(chain.getNumTransactions() + 5001), "appending shifts void targets");
+    std::vector<TransactionRecord> records;
+    int last = appended.getNumBlocks() - 1;
+    appended.getBlockRecords(last, records);
+    benchCheck(merkleRoot(records.data(), static_cast<int>(records.size())) == appended.getBlock(last).merkleRoot, "appended blocks get fresh Merkle roots");
+
+    ArchiveGroup damaged;
+    {
+        ArchiveReader reader(archivePath);
+        benchCheck(reader.validate() && reader.getNumGroups() > 3, "archive reads back");
+        damaged = reader.getGroup(2);
+    }
+    {
+        fstream file(archivePath, ios::binary | ios::in | ios::out);
+        file.seekp(damaged.offset + 100);
+        file.put('\x7f');
+    }
+    Blockchain partial;
+    bool partialLoad = quietly([&]() { return loadArchive(archivePath, partial, directory, registry); });
+    benchCheck(!partialLoad && partial.getNumTransactions() == static_cast<int>(damaged.firstRow), "a corrupt row group stops the load after the groups before it");
+
+    // Transfers of a wallet deleted before archiving load as no one's, not as whoever holds its slot now.
+    WalletId gone = directory.add(new Wallet("ArchiveGone", 4));
+    Blockchain orphaned;
+    orphaned.addTransaction(Transaction(gone, ids[0], coin, 1));
+    directory.remove(gone);
+    benchCheck(writeArchive(archivePath, orphaned, directory, registry), "orphaned chain archives");
+    Blockchain adopted;
+    bool adoptedLoad = quietly([&]() { return loadArchive(archivePath, adopted, directory, registry); });
+    benchCheck(adoptedLoad && adopted[0].getFromId() == INVALID_WALLET && adopted[0].getToId() == ids[0], "deleted wallets load as unknown");
+
+    // A chain whose blocks are a minute apart, so time predicates can skip row groups.
+    Blockchain timed;
+    int64_t start = 1700000000;
+    for (int height = 0; height < TIMED_BLOCKS; height++) {
+        for (int i = 0; i < Blockchain::BLOCK_CAPACITY; i++) {
+            benchRandom(state);
+            timed.addTransaction(Transaction(ids[(state >> 33) % NUM_WALLETS], ids[(state >> 13) % NUM_WALLETS], coin, Amount::fromScaled(static_cast<long long>(state % 10000), 2)));
+        }
+        BlockHeader header = {};
+        header.height = height;
+        header.timestamp = start + 60LL * height;
+        header.firstTransaction = static_cast<uint32_t>(height * Blockchain::BLOCK_CAPACITY);
+        header.numTransactions = Blockchain::BLOCK_CAPACITY;
+        header.prevHash = height > 0 ? timed.getBlockHash(height - 1) : Hash256{};
+        std::vector<TransactionRecord> blockRecords;
+        for (int i = 0; i < Blockchain::BLOCK_CAPACITY; i++) blockRecords.push_back(timed[header.firstTransaction + i].toRecord());
+        header.merkleRoot = merkleRoot(blockRecords.data(), Blockchain::BLOCK_CAPACITY);
+        timed.restoreBlock(header);
+    }
+    benchCheck(writeArchive(archivePath, timed, directory, registry), "timed chain archives");
+    ArchiveReader reader(archivePath);
+    benchCheck(reader.validate(), "timed archive reads back");
+
+    std::vector<QueryPredicate> recent = {QueryPredicate("time", CompareOp::GreaterEqual, start + 60LL * (TIMED_BLOCKS - RECENT_BLOCKS))};
+    int rows = 0;
+    benchTime("archive scan, every row group", reader.getNumRows(), "rows/s", [&]() {
+        ArchiveScan scan(reader, {});
+        forEachRow(scan, [&](const RowBatch&, int) { rows++; });
+    });
+    benchCheck(rows == timed.getNumTransactions(), "archive scan returns every transfer");
+    std::vector<int64_t> skipped, scanned;
+    ArchiveScan* scan = new ArchiveScan(reader, recent);
+    benchTime("last " + to_string(RECENT_BLOCKS) + " blocks, skipping groups", reader.getNumRows(), "rows/s", [&]() {
+        QueryFilter plan(QueryPlan(scan), recent);
+        forEachRow(plan, [&](const RowBatch& batch, int row) { skipped.push_back(batch.ints[0][row]); });
+        cout << "    read " << scan->getGroupsRead() << " of " << reader.getNumGroups() << " row groups\n";
+    });
+    QueryFilter reference(QueryPlan(new LedgerScan(timed, LedgerScan::TRANSFERS)), recent);
+    forEachRow(reference, [&](const RowBatch& batch, int row) { scanned.push_back(batch.ints[0][row]); });
+    benchCheck(skipped.size() == RECENT_BLOCKS * static_cast<size_t>(Blockchain::BLOCK_CAPACITY) && skipped == scanned, "statistics skip row groups without losing rows");
+
+    remove(textPath.c_str());
+    remove(archivePath.c_str());
+    benchRemoveWallets(ids);
+}
+
+void benchPriceBook() {
+    const int NUM_ASSETS = 100000;
+    const int BATCH = 1000;
+    const int BATCHES = 2000;
+    const int READS = 10000000;
+    const int NUM_HOLDERS = 10000;
+    const int HOLDINGS = 4;
+    // Registry readers also read the cached wallet total once every this many prices.
+    const int TOTAL_EVERY = 4096;
+    int numReaders = std::max(2, TaskPool::getInstance()->getThreads());
+
+    cout << "\n[price book] " << NUM_ASSETS << " assets, 1 updater publishing " << BATCHES << " batches of " << BATCH << " ticks, "
+         << numReaders << " readers\n";
+
+    AssetRegistry* registry = AssetRegistry::getInstance();
+    std::vector<AssetId> ids(NUM_ASSETS);
+    std::vector<const CryptoCurrency*> assets(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        string name = "Booked" + to_string(i);
+        ids[i] = registry->findByName(name);
+        if (ids[i] < 0) ids[i] = registry->add(new CryptoCurrency(name.c_str(), name.c_str(), 1, 1000));
+        assets[i] = registry->get(ids[i]);
+    }
+    // Each asset flips between a price that fits the low word and one that needs the high word, so a torn read of
+    // either is neither.
+    auto low = [](int i) { return Amount::fromScaled(i + 1, 2); };
+    auto high = [](int i) { return Amount(1000000000 + i) * Amount(1000000); };
+    std::vector<Amount> lowValues(NUM_ASSETS), highValues(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        lowValues[i] = low(i) * assets[i]->getValueMultiplier();
+        highValues[i] = high(i) * assets[i]->getValueMultiplier();
+    }
+    std::vector<Amount> initial(NUM_ASSETS);
+    for (int i = 0; i < NUM_ASSETS; i++) initial[i] = low(i);
+    registry->reprice(ids.data(), initial.data(), NUM_ASSETS);
+    WalletDirectory& directory = *WalletDirectory::getInstance();
+    std::vector<WalletId> holders = benchWallets("BookHolder", NUM_HOLDERS, Amount(), HOLDINGS);
+    for (int i = 0; i < NUM_HOLDERS; i++) {
+        for (int k = 0; k < HOLDINGS; k++) directory.get(holders[i])->credit(ids[(i * 7919LL + k * 104729LL) % NUM_ASSETS], k + 1);
+    }
+    directory.totalValue();
+
+    uint64_t state = 11;
+    std::vector<int> picks(READS);
+    for (int& pick : picks) {
+        benchRandom(state);
+        pick = static_cast<int>((state >> 33) % NUM_ASSETS);
+    }
+    AmountSum plain, quoted;
+    benchTime("asset field, one thread", READS, "reads/s", [&]() {
+        for (int pick : picks) plain.add(assets[pick]->getPrice() * assets[pick]->getValueMultiplier());
+    });
+    benchTime("calculateMarketValue, one thread", READS, "reads/s", [&]() {
+        for (int pick : picks) quoted.add(assets[pick]->calculateMarketValue());
+    });
+    benchCheck(plain.total() == quoted.total(), "the price book quotes the asset prices");
+
+    // One updater and several readers over prices behind one mutex, over a PriceBook of their own, and through the
+    // registry: reprice on one side, calculateMarketValue on the other.
+    std::vector<Amount> locked(initial);
+    std::mutex priceLock;
+    PriceBook book;
+    book.publish(ids.data(), initial.data(), NUM_ASSETS);
+    std::vector<std::vector<Amount>> ticks(2, std::vector<Amount>(NUM_ASSETS));
+    for (int i = 0; i < NUM_ASSETS; i++) {
+        ticks[0][i] = high(i);
+        ticks[1][i] = low(i);
+    }
+    for (int mode = 0; mode < 3; mode++) {
+        std::atomic<bool> done(false);
+        std::atomic<long long> reads(0), torn(0);
+        std::vector<std::thread> readers;
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < numReaders; r++) {
+            readers.emplace_back([&, r]() {
+                long long count = 0, bad = 0;
+                for (size_t k = r; !done.load(std::memory_order_relaxed); k = (k + numReaders) % picks.size()) {
+                    int i = picks[k];
+                    Amount value;
+                    if (mode == 0) {
+                        std::lock_guard<std::mutex> lock(priceLock);
+                        value = locked[i] * assets[i]->getValueMultiplier();
+                    } else if (mode == 1) {
+                        value = book.read(ids[i]) * assets[i]->getValueMultiplier();
+                    } else {
+                        value = assets[i]->calculateMarketValue();
+                        if (count % TOTAL_EVERY == 0) directory.totalValue();
+                    }
+                    bad += !(value == lowValues[i]) && !(value == highValues[i]);
+                    count++;
+                }
+                reads += count;
+                torn += bad;
+            });
+        }
+        for (int b = 0; b < BATCHES; b++) {
+            int first = static_cast<int>((static_cast<long long>(b) * BATCH) % NUM_ASSETS);
+            const Amount* batch = ticks[(static_cast<long long>(b) * BATCH / NUM_ASSETS) % 2].data() + first;
+            if (mode == 0) {
+                std::lock_guard<std::mutex> lock(priceLock);
+                std::copy(batch, batch + BATCH, locked.begin() + first);
+            } else if (mode == 1) {
+                book.publish(ids.data() + first, batch, BATCH);
+            } else {
+                registry->reprice(ids.data() + first, batch, BATCH);
+            }
+        }
+        double updateMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        done = true;
+        for (std::thread& reader : readers) reader.join();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        string label = mode == 0 ? "one mutex" : mode == 1 ? "price book" : "registry + wallet totals";
+        benchReport(label + ", updater", static_cast<double>(BATCHES) * BATCH, "ticks/s", updateMs);
+        benchReport(label + ", readers", static_cast<double>(reads), "reads/s", ms);
+        benchCheck(torn == 0, "concurrent readers never see a torn price");
+    }
+
+    bool settled = true;
+    for (int i = 0; i < NUM_ASSETS; i++) settled &= registry->getPriceBook().read(ids[i]) == assets[i]->getPrice();
+    benchCheck(settled && registry->getPriceBook().getGeneration() % 2 == 0, "the book ends equal to the assets between batches");
+    bool cached = true;
+    for (int i = 0; i < NUM_HOLDERS; i++) cached &= directory.valueOf(holders[i]) == directory.get(holders[i])->valuation(*registry);
+    benchCheck(cached, "cached wallet values revalued by concurrent readers miss no tick");
+    CryptoCurrency copy(*registry->get(ids[0]));
+    copy.setPrice(7);
+    benchCheck(copy.calculateMarketValue() == Amount(7) * copy.getValueMultiplier(), "copies of a registered asset quote their own price");
+    benchRemoveWallets(holders);
+    for (int i = 0; i < NUM_ASSETS; i++) registry->remove(ids[i]);
+    benchCheck(registry->getPriceBook().read(ids[0]) == 0, "removed assets quote zero");
+}
+
+void benchAmounts() {
+    const int NUM_TRANSFERS = 1000000;
+
+    cout << "\n[amounts] " << NUM_TRANSFERS << " transfers of 0.1, credited then debited\n";
+
+    float floatBalance = 0;
+    double doubleBalance = 0;
+    Amount balance;
+    const Amount tenth = Amount::fromScaled(1, 1);
+    // How far each balance strays from the exact sum halfway through, plus what is left once everything is debited.
+    double drift = 0;
+    auto reportDrift = [&]() {
+        cout << "    drift " << scientific << setprecision(3) << drift << "\n";
+        cout.unsetf(ios::floatfield);
+    };
+    benchTime("float", 2.0 * NUM_TRANSFERS, "ops/s", [&]() {
+        for (int i = 0; i < NUM_TRANSFERS; i++) floatBalance += 0.1f;
+        drift = std::abs(floatBalance - NUM_TRANSFERS / 10.0);
+        for (int i = 0; i < NUM_TRANSFERS; i++) floatBalance -= 0.1f;
+        drift += std::abs(floatBalance);
+    });
+    reportDrift();
+    benchTime("double", 2.0 * NUM_TRANSFERS, "ops/s", [&]() {
+        for (int i = 0; i < NUM_TRANSFERS; i++) doubleBalance += 0.1;
+        drift = std::abs(doubleBalance - NUM_TRANSFERS / 10.0);
+        for (int i = 0; i < NUM_TRANSFERS; i++) doubleBalance -= 0.1;
+        drift += std::abs(doubleBalance);
+    });
+    reportDrift();
+    benchTime("Amount (128-bit fixed)", 2.0 * NUM_TRANSFERS, "ops/s", [&]() {
+        AmountSum sum;
+        for (int i = 0; i < NUM_TRANSFERS; i++) sum.add(tenth);
+        balance = sum.total();
+        drift = std::abs((balance - NUM_TRANSFERS / 10).toDouble());
+        for (int i = 0; i < NUM_TRANSFERS; i++) balance -= tenth;
+        drift += std::abs(balance.toDouble());
+    });
+    reportDrift();
+    benchCheck(balance.isZero(), "fixed-point replay returns to exactly zero");
+
+    Amount parsed;
+    benchCheck(Amount::parse("12345678901234567890.123456789012345678", parsed) && parsed.toString() == "12345678901234567890.123456789012345678",
+        "18 fractional digits round-trip through text");
+    benchCheck(!Amount::parse("0.1234567890123456789", parsed) && !Amount::parse("1e5", parsed) && !Amount::parse("-", parsed), "malformed amounts are rejected");
+    benchCheck(Amount::fromScaled(15, 1) * Amount::fromScaled(3, 1) == Amount::fromScaled(45, 2) && Amount(1) / 3 * 3 == Amount::fromScaled(999999999999999999LL, 18),
+        "products and quotients are exact to 18 places");
+    benchCheck(Amount::fromScaled(125, 3).rounded(2) == Amount::fromScaled(13, 2) && (-Amount::fromScaled(125, 3)).rounded(2) == -Amount::fromScaled(13, 2),
+        "rounding is half away from zero");
+
+    Amount huge = Amount::fromWords(~0ULL, numeric_limits<int64_t>::max());
+    bool overflowed = false;
+    try { huge + Amount::fromUnits(1); } catch (const overflow_error&) { overflowed = true; }
+    benchCheck(overflowed, "addition overflow throws");
+    overflowed = false;
+    try { Amount(1000000000000LL) * Amount(1000000000000LL); } catch (const overflow_error&) { overflowed = true; }
+    benchCheck(overflowed, "multiplication overflow throws");
+    AmountSum sum;
+    sum.add(huge);
+    sum.add(huge);
+    sum.add(-huge);
+    overflowed = false;
+    try { sum.total(); } catch (const overflow_error&) { overflowed = true; }
+    benchCheck(overflowed, "an accumulator remembers an overflow that later cancels out");
+
+    AssetId coin = benchAsset();
+    bool rejected = false;
+    try { Transaction(INVALID_WALLET, INVALID_WALLET, coin, Amount::fromScaled(1, 9)); } catch (const invalid_argument&) { rejected = true; }
+    benchCheck(rejected, "transfers finer than the asset's decimals are rejected");
+    Transaction transaction(INVALID_WALLET, INVALID_WALLET, coin, Amount::fromScaled(123456789, 8));
+    benchCheck(Transaction(transaction.toRecord()).getAmount() == transaction.getAmount(), "amounts survive the on-disk record exactly");
+}
+
+int runBenchmarks() {
+    cout << "=== Coinqueror benchmarks ===\n";
+    benchAmounts();
+    benchMoveSemantics();
+    benchTransactionArena();
+    benchHashing();
+    benchMarketTable();
+    benchAssetStore();
+    benchRepricing();
+    benchPriceBook();
+    benchWalletValues();
+    benchTaskPool();
+    benchSettlement();
+    benchIngest();
+    benchChainIndexes();
+    benchLedgerQueries();
+    benchReconcile();
+    benchChainLog();
+    benchSnapshot();
+    benchArchive();
+    if (benchFailed) {
+        cout << "\nSome benchmark checks failed.\n";
+        return 1;
+    }
+    cout << "\nAll benchmark checks passed.\n";
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "--bench") return runBenchmarks();
     Meniu::getInstance()->ruleaza();
 return 0;}
\ No newline at end of file